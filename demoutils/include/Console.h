@@ -52,7 +52,6 @@ class Console : public QDockWidget
 public:
     Console(QMainWindow* parent, QMenu* menu);
 
-    void print( const QString& str );
     void execute( const QString& cmd, const QStringList& args );
 
     void installMsgHandler();
@@ -61,6 +60,7 @@ public:
     bool exposeObjectToScript(QObject* object, const QString& name);
 
 public slots:
+    void print( const QString& str );
     void getProcessStdout();
     void processCommand();
     void runScript(const QString& filename);
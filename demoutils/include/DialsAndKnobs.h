@@ -61,6 +61,10 @@ class dkValue : public QObject
     QString scriptName() const;
     dkLocation location() const { return _location; }
     bool changedLastFrame() const;
+    // Increases every time the value changes, and no two changes of any
+    // values share a stamp. Lets a computation tell whether a value it
+    // read has changed since, without keeping a copy of it.
+    int changeStamp() const { return _change_stamp; }
     bool isSticky() const { return _is_sticky; }
     void setSticky(bool sticky);
     
@@ -69,6 +73,7 @@ class dkValue : public QObject
     static int numValues() { return values().size(); }
 
   protected:
+    void markChanged();
     static void add(dkValue* value);
     static void remove(dkValue* value);
     static QList<dkValue*>& values();
@@ -81,8 +86,11 @@ class dkValue : public QObject
     QString _name;
     dkLocation _location;
     int        _last_change_frame_number;
+    int        _change_stamp;
     bool       _is_sticky;
 
+    static int _last_change_stamp;
+
   friend class DialsAndKnobs;
 };
 
@@ -370,6 +378,9 @@ class DialsAndKnobs : public QDockWidget
 
   signals:
     void dataChanged();
+    // Every change of a value with widgets, also while loading (when
+    // dataChanged() is not sent), e.g. to record a session
+    void valueChanged(dkValue* value);
 
   protected slots:
     void updateLayout();
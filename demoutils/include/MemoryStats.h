@@ -0,0 +1,56 @@
+/*****************************************************************************\
+
+MemoryStats.h
+
+Counts the allocations made with operator new and new[], by any thread,
+to report how many a frame makes and how many bytes they ask for. Only
+where MemoryStats.cc is compiled with DEMOUTILS_ALLOCATION_COUNTS do the
+counting operators replace the global ones: the benchmark and debug
+builds of qrtsc compile it into the program with that define, and
+elsewhere the counts stay at zero. malloc from C code and Qt's own
+qMalloc are not counted. A MemoryStats object counts from its
+construction or restart():
+
+    MemoryStats frame_memory;
+    draw();
+    frame_memory.recordFrame(Stats::instance());
+
+Also reads the resident set size of the process.
+
+demoutils is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _MEMORY_STATS_H_
+#define _MEMORY_STATS_H_
+
+#include <QtGlobal>
+
+class Stats;
+
+class MemoryStats
+{
+  public:
+    MemoryStats() { restart(); }
+
+    void restart();
+    // Since the construction or restart()
+    unsigned allocations() const;
+    quint64 allocatedBytes() const;
+
+    // Sets the "Peak RSS (MB)" counter, and the "Allocations" and
+    // "Allocated (KB)" ones if countsAllocations()
+    void recordFrame( Stats& stats ) const;
+
+    static bool countsAllocations();
+    // Resident set size in kB, at its peak and now. -1 where unknown.
+    static long peakRSS();
+    static long currentRSS();
+
+  protected:
+    unsigned    _allocations;
+    quint64     _bytes;
+};
+
+#endif // _MEMORY_STATS_H_
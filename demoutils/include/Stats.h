@@ -7,6 +7,32 @@ Copyright (c) 2009 Forrester Cole
 Keeps track of performance timers and counters. Inherits QAbstractItemModel
 so the statistics can be viewed in a Qt TreeView.
 
+Timers and counters are named by handles, interned on first use, so
+recording never compares strings. They may be recorded from any thread:
+each thread appends to a buffer of its own, without locks, and the
+buffers are merged into the records by the GUI thread once per frame
+(in reset() and updateView()), or emptied by discardEvents() in a frame
+not recorded. Timers nest per thread. For inner loops,
+look the handle up once:
+
+    static int h = Stats::instance().handle("Extract Isolines");
+    Stats::instance().startTimer(h);
+
+Each timer and counter keeps its values for the last historyLength()
+frames, summarized as min, median, 95th percentile and max.
+
+Timers measure CPU time. The GPU time of the same sections can be
+measured elsewhere (e.g. by GQTimerQueries, a few frames late) and given
+to setGpuTime(); it is shown in a column of its own.
+
+While tracing (startTrace() to stopTrace()), every timer run is also
+kept with its thread and start time, and every counter with its value
+at each reset(). writeTrace() writes them in the Chrome trace event
+format (for chrome://tracing or Perfetto) or as CSV. The trace buffer
+is allocated by startTrace(); the recording threads never see it.
+
+Constants are for the GUI thread only.
+
 demoutils is distributed under the terms of the GNU General Public License.
 See the COPYING file for details.
 
@@ -16,7 +42,11 @@ See the COPYING file for details.
 #define _STATS_H_
 
 #include <QString>
+#include <QStringList>
 #include <QList>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
 #include <timestamp.h>
 #include <vector>
 #include <QAbstractItemModel>
@@ -29,46 +59,110 @@ class Stats : public QAbstractItemModel
 {
     Q_OBJECT
 
+  public:
+    // Min, median, 95th percentile and max over the history of a record.
+    struct Summary
+    {
+        Summary() : min(0), median(0), p95(0), max(0), frames(0) {}
+        float   min;
+        float   median;
+        float   p95;
+        float   max;
+        int     frames;
+    };
+
+    // Where one thread records, defined in Stats.cc.
+    class ThreadBuffer;
+
   public:
     // Removes everything.
     void clear();
-    // Resets all timers and counters to zero, but leaves them in the lists.
-    void reset(); 
+    // Merges what the threads recorded, adds the frame to the history,
+    // and resets all timers and counters to zero, but leaves them in
+    // the lists.
+    void reset();
 
-    // Emits an update signal for attached views.
+    // Merges what the threads recorded, and emits an update signal for
+    // attached views.
     void updateView();
-
-    void startTimer( const QString& name );
-    void stopTimer( const QString& name );
-
-    void setCounter( const QString& name, float value );
-    void addToCounter( const QString& name, float value );
-
+    // Just merges what the threads recorded into the records.
+    void merge();
+    // Drops what the threads recorded since the last merge, for a frame
+    // whose statistics are not wanted, so that the buffers neither fill
+    // nor hold stale events for the next frame that is merged.
+    void discardEvents();
+
+    // The same name always gives the same handle. Any thread.
+    int handle( const QString& name );
+
+    // Any thread.
+    void startTimer( int handle );
+    void stopTimer( int handle );
+    void setCounter( int handle, float value );
+    void addToCounter( int handle, float value );
+
+    void startTimer( const QString& name ) { startTimer(handle(name)); }
+    void stopTimer( const QString& name ) { stopTimer(handle(name)); }
+    void setCounter( const QString& name, float value )
+        { setCounter(handle(name), value); }
+    void addToCounter( const QString& name, float value )
+        { addToCounter(handle(name), value); }
+
+    // Reopens the group if there is one of that name, so a constant can
+    // be updated by setting it again.
     void beginConstantGroup( const QString& name );
     void setConstant( const QString& name, float value );
     void setConstant( const QString& name, const QString& value );
     void endConstantGroup();
 
+    // Seconds the GPU spent in the section of the timer with this handle,
+    // wherever the timer is nested. Kept until set again or clear().
+    void setGpuTime( int handle, float seconds );
+
+    // Frames kept per timer and counter. Changing it clears the history.
+    void setHistoryLength( int frames );
+    int historyLength() const { return _history_length; }
+
+    // As of the last merge.
     int numTimers() const { return _records[TIMER].size(); }
-    const QString& timerName( int which ) const 
+    const QString& timerName( int which ) const
         { return _records[TIMER][which].name; }
-    float timerValue( int which ) const 
+    float timerValue( int which ) const
         { return _records[TIMER][which].value; }
-    
+    Summary timerSummary( int which ) const
+        { return summarize(_records[TIMER][which]); }
+    // -1 if the GPU time of the timer is unknown
+    float timerGpuValue( int which ) const
+        { return _gpu_times.value(_records[TIMER][which].handle, -1); }
+
     int numCounters() const { return _records[COUNTER].size(); }
-    const QString& counterName( int which ) const 
+    const QString& counterName( int which ) const
         { return _records[COUNTER][which].name; }
-    float counterValue( int which ) const 
+    float counterValue( int which ) const
         { return _records[COUNTER][which].value; }
+    Summary counterSummary( int which ) const
+        { return summarize(_records[COUNTER][which]); }
 
     QString timerStatistics( const QString& name );
 
+    bool isTracing() const { return _tracing; }
+
+  public slots:
+    // Starts a new trace of at most max_events events. Later events are
+    // dropped.
+    void startTrace( int max_events = 1 << 20 );
+    void stopTrace();
+    // Chrome trace event JSON if the name ends in .json, otherwise CSV.
+    bool writeTrace( const QString& filename );
+
+  public:
+
     // implementation of QAbstractItemModel
     QVariant data( const QModelIndex& index, int role ) const;
     Qt::ItemFlags flags( const QModelIndex& index ) const;
-    QVariant headerData( int section, Qt::Orientation orientation, 
+    QVariant headerData( int section, Qt::Orientation orientation,
             int role = Qt::DisplayRole) const;
-    QModelIndex index( int row, int column, 
+    QModelIndex index( int row, int column,
             const QModelIndex& parent = QModelIndex() ) const;
     QModelIndex parent(const QModelIndex &index) const;
     int rowCount( const QModelIndex& parent = QModelIndex() ) const;
@@ -81,33 +175,50 @@ class Stats : public QAbstractItemModel
     class Record
     {
       public:
-        Record() : name(), category(NUM_CATEGORIES), stamp(), 
+        Record() : name(), handle(-1), category(NUM_CATEGORIES),
                    value(0), str_value(), touches_since_last_reset(0),
+                   num_open(0), history(), history_next(0),
                    parent(0), children() {}
       public:
         QString     name;
+        int         handle;
         Category    category;
-        timestamp   stamp;
         float       value;
         QString     str_value;
         int         touches_since_last_reset;
+        int         num_open;       // Timers started and not yet stopped
+
+        QVector<float>  history;    // Ring buffer of the last frames
+        int             history_next;
 
         Record*         parent;
         QList<Record*>  children;
     };
-    
 
   protected:
     // Singleton class.
     Stats() { init(); }
     bool init();
 
+    ThreadBuffer* localBuffer();
+    void replay( ThreadBuffer* buffer );
+    Record* timerRecord( int handle, Record* parent );
+    Record* counterRecord( int handle );
+    QString handleName( int handle );
+
     void clearCategory( Category which );
     void setChildValuesToZero( Record* record );
+    void addToHistory( Record& record );
+    Summary summarize( const Record& record ) const;
 
-    int findTimer( const QString& name, const Record* parent );
+    void traceTimer( int handle, int thread, const timestamp& start,
+                     const timestamp& stop );
+    void traceCounters();
+    bool writeChromeTrace( const QString& filename );
+    bool writeTraceCSV( const QString& filename );
+
+    int findTimer( const QString& name );
     int findTimer( const Record* pointer );
-    int findCounter( const QString& name );
 
     void removeTimer( int which );
     void removeCounter( int which );
@@ -116,11 +227,34 @@ class Stats : public QAbstractItemModel
     QList<Record>       _records[NUM_CATEGORIES];
     Record              _headers[NUM_CATEGORIES];
 
-    QList<Record*>      _timer_stack;
     QList<Record*>      _constant_stack;
 
     Record              _dummy_root;
 
+    QHash<int,Record*>  _counters_by_handle;
+    QHash<int,float>    _gpu_times;
+    int                 _history_length;
+
+    QMutex              _handles_mutex;
+    QHash<QString,int>  _handles;
+    QStringList         _handle_names;
+
+    QMutex                  _buffers_mutex;
+    QList<ThreadBuffer*>    _buffers;
+    QStringList             _thread_names;  // By ThreadBuffer::thread_id
+
+    struct TraceEvent
+    {
+        int         handle;
+        int         thread;     // -1 for a counter
+        double      start;      // Seconds since _trace_start
+        double      value;      // Duration of a timer, in seconds
+    };
+    bool                    _tracing;
+    std::vector<TraceEvent> _trace;
+    timestamp               _trace_start;
+    int                     _trace_dropped;
+
     bool                _layout_changed;
     bool                _data_changed;
 
@@ -147,10 +281,14 @@ class StatsWidget : public QDockWidget
 class ScopeTimer
 {
 public:
-    ScopeTimer( const QString& name ) { _name = name; Stats::instance().startTimer(name); }
-    ~ScopeTimer() { Stats::instance().stopTimer(_name); }
+    ScopeTimer( const QString& name )
+        { _handle = Stats::instance().handle(name);
+          Stats::instance().startTimer(_handle); }
+    ScopeTimer( int handle )
+        { _handle = handle; Stats::instance().startTimer(_handle); }
+    ~ScopeTimer() { Stats::instance().stopTimer(_handle); }
 protected:
-    QString _name;
+    int _handle;
 };
 
 #ifndef DEMOUTILS_NO_TIMERS
@@ -164,7 +302,7 @@ protected:
 #define __STOP_TIMER(X) ;
 #define __SET_COUNTER(X,Y) ;
 #define __ADD_TO_COUNTER(X,Y) ;
-#define __TIME_CODE_BLOCK(X) ; 
+#define __TIME_CODE_BLOCK(X) ;
 #endif
 
 #endif // _STATS_H_
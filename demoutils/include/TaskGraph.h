@@ -0,0 +1,135 @@
+/*****************************************************************************\
+
+TaskGraph.h
+
+A small dependency graph of tasks, run on a thread pool. Each task starts
+as soon as all the tasks it depends on have finished, so independent
+stages overlap. The start and finish time of every task is kept so that
+the run can be reported in Stats.
+
+demoutils is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _TASK_GRAPH_H_
+#define _TASK_GRAPH_H_
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include "timestamp.h"
+
+class Stats;
+
+class TaskGraph : public QObject
+{
+    Q_OBJECT
+
+  public:
+    // Base class for the work done by one node of the graph.
+    class Task
+    {
+      public:
+        Task( const QString& name ) : _name(name) {}
+        virtual ~Task() {}
+        virtual void run() = 0;
+        const QString& name() const { return _name; }
+      protected:
+        QString _name;
+    };
+
+    // Calls a member function taking no arguments, e.g.
+    // new TaskGraph::MethodTask<TriMesh>("Normals", mesh, &TriMesh::need_normals)
+    template <class T> class MethodTask : public Task
+    {
+      public:
+        MethodTask( const QString& name, T* object, void (T::*method)() )
+            : Task(name), _object(object), _method(method) {}
+        void run() { (_object->*_method)(); }
+      protected:
+        T*  _object;
+        void (T::*_method)();
+    };
+
+    // Calls a free function taking no arguments.
+    class FunctionTask : public Task
+    {
+      public:
+        FunctionTask( const QString& name, void (*function)() )
+            : Task(name), _function(function) {}
+        void run() { _function(); }
+      protected:
+        void (*_function)();
+    };
+
+  public:
+    TaskGraph( QObject* parent = 0 );
+    ~TaskGraph();
+
+    // Adds a task (the graph takes ownership) that will run after all
+    // the tasks in depends_on. Returns the new task's index.
+    int addTask( Task* task, const QList<int>& depends_on = QList<int>() );
+    int addTask( Task* task, int depends_on );
+    int addTask( Task* task, int depends_on_a, int depends_on_b );
+
+    // Runs the whole graph and blocks until it is finished or canceled.
+    // Returns false if it was canceled.
+    bool run();
+
+    // May be called from any thread. Tasks that have already started
+    // finish, but no new ones are started.
+    void cancel();
+    bool isCanceled() const { return _canceled; }
+
+    void setMaxThreadCount( int count ) { _pool.setMaxThreadCount(count); }
+
+    int numTasks() const { return _nodes.size(); }
+    const QString& taskName( int which ) const { return _nodes[which].task->name(); }
+    // Times in seconds, relative to the start of run().
+    float taskStart( int which ) const { return _nodes[which].start; }
+    float taskFinish( int which ) const { return _nodes[which].finish; }
+    bool taskFinished( int which ) const { return _nodes[which].done; }
+    float totalTime() const { return _total_time; }
+
+    // Adds a constant group with the time of each task, in ms.
+    void recordStats( Stats& stats, const QString& group_name ) const;
+
+  signals:
+    // Emitted from the worker thread as each task finishes.
+    void taskFinished( const QString& name, int num_finished, int num_tasks );
+
+  protected:
+    struct Node
+    {
+        Task*       task;
+        QList<int>  dependents;
+        int         num_depends;
+        int         waiting_on;
+        float       start;
+        float       finish;
+        bool        done;
+    };
+    class Runner;
+    friend class Runner;
+
+    void execute( int which );
+    void startReady( int which );
+
+  protected:
+    QVector<Node>   _nodes;
+    QThreadPool     _pool;
+    QMutex          _mutex;
+    QWaitCondition  _all_done;
+    int             _num_running;
+    int             _num_finished;
+    volatile bool   _canceled;
+    timestamp       _start_stamp;
+    float           _total_time;
+};
+
+#endif // _TASK_GRAPH_H_
@@ -23,6 +23,7 @@ See the COPYING file for details.
 #include <QFile>
 #include <QMenu>
 #include <QKeyEvent>
+#include <QThread>
 #include <assert.h>
 
 #ifdef WIN32
@@ -152,7 +153,13 @@ void Console::msgHandler( QtMsgType type, const char* msg )
         case QtFatalMsg: break;
     }
 
-    _current_msg_console->print( out );
+    // Messages from worker threads (e.g. a scene loading in the
+    // background) are queued to the GUI thread.
+    if (QThread::currentThread() == _current_msg_console->thread())
+        _current_msg_console->print( out );
+    else
+        QMetaObject::invokeMethod( _current_msg_console, "print",
+            Qt::QueuedConnection, Q_ARG(QString, out) );
     fprintf( stderr, "%s", qPrintable(out) );
 
 #ifdef WIN32
@@ -46,6 +46,7 @@ dkValue::dkValue(const QString& name, dkLocation location)
     _name = name;
     _location = location;
     _last_change_frame_number = 0;
+    _change_stamp = 0;
     _is_sticky = false;
     add(this);
 }
@@ -68,6 +69,14 @@ QHash<QString, dkValue*>& dkValue::values_hash()
     return *table;
 }
 
+int dkValue::_last_change_stamp = 0;
+
+void dkValue::markChanged()
+{
+    _last_change_frame_number = DialsAndKnobs::frameCounter();
+    _change_stamp = ++_last_change_stamp;
+}
+
 bool dkValue::changedLastFrame() const
 {
     if (_last_change_frame_number == DialsAndKnobs::frameCounter() - 1)
@@ -178,7 +187,7 @@ void dkFloat::setValue(double f)
     if (_value != f)
     {
         _value = f;
-        _last_change_frame_number = DialsAndKnobs::frameCounter();
+        markChanged();
         
         emit valueChanged(_value);
     }
@@ -235,7 +244,7 @@ void dkInt::setValue(int i)
     if (_value != i)
     {
         _value = i;
-        _last_change_frame_number = DialsAndKnobs::frameCounter();
+        markChanged();
         emit valueChanged(_value);
     }
 }
@@ -277,7 +286,7 @@ void dkBool::setValue(bool b)
     if (_value != b)
     {
         _value = b;
-        _last_change_frame_number = DialsAndKnobs::frameCounter();
+        markChanged();
         emit valueChanged(_value);
     }
 }
@@ -317,7 +326,7 @@ void dkFilename::setValue(const QString& value)
     if (_value != value)
     {
         _value = value;
-        _last_change_frame_number = DialsAndKnobs::frameCounter();
+        markChanged();
         emit valueChanged(_value);
     }
 }
@@ -365,7 +374,7 @@ void dkStringList::setIndex(int i)
     if (_index != i)
     {
         _index = i;
-        _last_change_frame_number = DialsAndKnobs::frameCounter();
+        markChanged();
         emit indexChanged(_index);
     }
 }
@@ -416,7 +425,7 @@ QString dkImageBrowser::filename() const
 
 void dkImageBrowser::itemClicked(const QModelIndex& index)
 {
-    _last_change_frame_number = DialsAndKnobs::frameCounter();
+    markChanged();
     emit selectionChanged(index);
 }
          
@@ -464,7 +473,7 @@ void dkText::setValue(const QString& value)
     if (_value != value)
     {
         _value = value;
-        _last_change_frame_number = DialsAndKnobs::frameCounter();
+        markChanged();
         emit valueChanged(_value);
     }
 }
@@ -1068,6 +1077,9 @@ QGridLayout* DialsAndKnobs::findOrCreateLayout(const QString& group)
 
 void DialsAndKnobs::dkValueChanged()
 {
+    dkValue* value = qobject_cast<dkValue*>(sender());
+    if (value)
+        emit valueChanged(value);
     if (!_in_load)
         emit dataChanged();
 }
@@ -0,0 +1,185 @@
+/*****************************************************************************\
+
+MemoryStats.cc
+
+demoutils is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "MemoryStats.h"
+#include "Stats.h"
+
+#include <QAtomicInt>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef DEMOUTILS_ALLOCATION_COUNTS
+
+// Only ever added to, so the differences stay right as they wrap. The
+// bytes need 64 bits, which QAtomicInt doesn't have, so they are added
+// with the compiler's own atomics.
+static QAtomicInt allocation_count;
+#ifdef WIN32
+static volatile LONGLONG allocated_bytes = 0;
+#else
+static volatile quint64 allocated_bytes = 0;
+#endif
+
+static quint64 addAllocatedBytes( quint64 size )
+{
+#ifdef WIN32
+    return (quint64)InterlockedExchangeAdd64(&allocated_bytes,
+                                             (LONGLONG)size);
+#else
+    return __sync_fetch_and_add(&allocated_bytes, size);
+#endif
+}
+
+static void* countedAllocation( size_t size )
+{
+    allocation_count.fetchAndAddRelaxed(1);
+    addAllocatedBytes(size);
+    return malloc(size ? size : 1);
+}
+
+void* operator new( size_t size )
+{
+    void* p = countedAllocation(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[]( size_t size )
+{
+    void* p = countedAllocation(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new( size_t size, const std::nothrow_t& ) throw()
+{
+    return countedAllocation(size);
+}
+
+void* operator new[]( size_t size, const std::nothrow_t& ) throw()
+{
+    return countedAllocation(size);
+}
+
+void operator delete( void* p ) throw()
+{
+    free(p);
+}
+
+void operator delete[]( void* p ) throw()
+{
+    free(p);
+}
+
+void operator delete( void* p, const std::nothrow_t& ) throw()
+{
+    free(p);
+}
+
+void operator delete[]( void* p, const std::nothrow_t& ) throw()
+{
+    free(p);
+}
+
+static unsigned allocationCount()
+{
+    return (unsigned)allocation_count.fetchAndAddRelaxed(0);
+}
+
+static quint64 allocatedBytes()
+{
+    return addAllocatedBytes(0);
+}
+
+#else
+
+static unsigned allocationCount() { return 0; }
+static quint64 allocatedBytes() { return 0; }
+
+#endif // DEMOUTILS_ALLOCATION_COUNTS
+
+void MemoryStats::restart()
+{
+    _allocations = allocationCount();
+    _bytes = allocatedBytes();
+}
+
+unsigned MemoryStats::allocations() const
+{
+    return allocationCount() - _allocations;
+}
+
+quint64 MemoryStats::allocatedBytes() const
+{
+    return ::allocatedBytes() - _bytes;
+}
+
+void MemoryStats::recordFrame( Stats& stats ) const
+{
+    if (countsAllocations()) {
+        stats.setCounter("Allocations", allocations());
+        stats.setCounter("Allocated (KB)", allocatedBytes() / 1024.0f);
+    }
+    long peak = peakRSS();
+    if (peak >= 0)
+        stats.setCounter("Peak RSS (MB)", peak / 1024.0f);
+}
+
+bool MemoryStats::countsAllocations()
+{
+#ifdef DEMOUTILS_ALLOCATION_COUNTS
+    return true;
+#else
+    return false;
+#endif
+}
+
+long MemoryStats::peakRSS()
+{
+#ifdef WIN32
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef DARWIN
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+long MemoryStats::currentRSS()
+{
+#ifdef LINUX
+    // The second field of statm is the resident size, in pages
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return -1;
+    long size, resident;
+    int read = fscanf(statm, "%ld %ld", &size, &resident);
+    fclose(statm);
+    if (read != 2)
+        return -1;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return -1;
+#endif
+}
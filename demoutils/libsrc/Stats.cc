@@ -12,10 +12,162 @@ See the COPYING file for details.
 #include "Stats.h"
 #include "timestamp.h"
 #include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <QAtomicInt>
+#include <QThreadStorage>
+#include <QMutexLocker>
+#include <QThread>
+#include <QCoreApplication>
+#include <QFile>
+#include <QTextStream>
 #include <QTreeView>
 #include <QMainWindow>
 #include <QMenu>
 
+// The events recorded by one thread, in a ring buffer. The thread
+// appends at the head and the merge reads from the tail; each index is
+// written by one side only, so neither needs a lock. When the buffer is
+// full, events are dropped and counted, but a timer recorded as started
+// is always recorded as stopped: starts keep room for the stops of all
+// the timers open.
+class Stats::ThreadBuffer
+{
+  public:
+    enum Type { START, STOP, SET, ADD };
+    enum { SIZE = 1 << 14 };
+
+    struct Event
+    {
+        int         handle;
+        int         type;
+        float       value;
+        timestamp   stamp;
+    };
+
+    // A timer being replayed by the merge
+    struct OpenTimer
+    {
+        Record*     record;
+        timestamp   start;
+    };
+
+    ThreadBuffer() : events(SIZE), thread_id(0), read(0), write(0), room(SIZE),
+                     num_recorded_open(0) {}
+
+    // Owner thread
+    void start( int handle )
+    {
+        Event* e = reserve(num_recorded_open + 2);
+        open.append(handle);
+        open_recorded.append(e != 0);
+        if (!e)
+            return;
+        e->handle = handle;
+        e->type = START;
+        num_recorded_open++;
+        e->stamp = now();
+        publish();
+    }
+
+    void stop( int handle )
+    {
+        timestamp stamp = now();
+        Q_UNUSED(handle);
+        assert( open.size() > 0 && open.last() == handle );
+        if (open.isEmpty())
+            return;
+        bool recorded = open_recorded.last();
+        open.removeLast();
+        open_recorded.removeLast();
+        if (!recorded)
+            return;
+
+        num_recorded_open--;
+        Event* e = reserve(1);
+        e->handle = handle;
+        e->type = STOP;
+        e->stamp = stamp;
+        publish();
+    }
+
+    void count( int handle, Type type, float value )
+    {
+        Event* e = reserve(num_recorded_open + 1);
+        if (!e)
+            return;
+        e->handle = handle;
+        e->type = type;
+        e->value = value;
+        publish();
+    }
+
+    // Merging thread
+    unsigned published() { return (unsigned)head.fetchAndAddAcquire(0); }
+    const Event& event( unsigned which ) const
+        { return events[which & (SIZE-1)]; }
+    void consumed( unsigned upto )
+    {
+        read = upto;
+        tail.fetchAndStoreRelease((int)upto);
+    }
+
+  protected:
+    Event* reserve( int needed )
+    {
+        if (room < needed)
+        {
+            unsigned done = (unsigned)tail.fetchAndAddAcquire(0);
+            room = SIZE - (int)(write - done);
+            if (room < needed)
+            {
+                dropped.fetchAndAddRelaxed(1);
+                return 0;
+            }
+        }
+        return &events[write & (SIZE-1)];
+    }
+
+    void publish()
+    {
+        write++;
+        room--;
+        head.fetchAndStoreRelease((int)write);
+    }
+
+  public:
+    std::vector<Event>  events;
+    QAtomicInt          head;       // Written by the owner
+    QAtomicInt          tail;       // Written by the merge
+    QAtomicInt          dropped;
+    QAtomicInt          finished;   // Set when the owner exits
+
+    // Merging thread only
+    int                 thread_id;
+    unsigned            read;
+    QVector<OpenTimer>  replay_stack;
+
+  protected:
+    // Owner thread only
+    unsigned            write;
+    int                 room;
+    QVector<int>        open;
+    QVector<bool>       open_recorded;
+    int                 num_recorded_open;
+};
+
+// Deleted by QThreadStorage when its thread exits. The buffer may still
+// hold events, so it is only marked, and the next merge deletes it.
+class ThreadBufferRef
+{
+  public:
+    ThreadBufferRef( Stats::ThreadBuffer* b ) : buffer(b) {}
+    ~ThreadBufferRef() { buffer->finished.fetchAndStoreRelease(1); }
+    Stats::ThreadBuffer* buffer;
+};
+
+static QThreadStorage<ThreadBufferRef*> local_buffers;
+
 Stats Stats::_global_instance;
 
 bool Stats::init()
@@ -37,6 +189,10 @@ bool Stats::init()
     _headers[CONSTANT].name = "Constants";
     _headers[CONSTANT].category = CONSTANT;
 
+    _history_length = 100;
+    _tracing = false;
+    _trace_dropped = 0;
+
     clear();
 
     return true;
@@ -44,13 +200,25 @@ bool Stats::init()
 
 void Stats::clear()
 {
+    {
+        // Drop what the threads recorded so far. Timers open now are
+        // not reported when they stop.
+        QMutexLocker locker(&_buffers_mutex);
+        for (int i = 0; i < _buffers.size(); i++)
+        {
+            _buffers[i]->consumed(_buffers[i]->published());
+            _buffers[i]->replay_stack.clear();
+        }
+    }
+
     for (int i = 0; i < NUM_CATEGORIES; i++)
     {
         _records[i].clear();
         _headers[i].children.clear();
     }
+    _counters_by_handle.clear();
+    _gpu_times.clear();
 
-    _timer_stack.clear();
     _constant_stack.clear();
 
     _layout_changed = false;
@@ -60,21 +228,26 @@ void Stats::clear()
 
 void Stats::reset()
 {
-    //assert( _timer_stack.size() == 0 );
-    _timer_stack.clear();
+    merge();
+    if (_tracing)
+        traceCounters();
 
-    // remove any timers or counters that were not used since the last reset.
+    // remove any timers or counters that were not used since the last
+    // reset, unless a thread is still running them.
 
     // iterate over timers in reverse so that children are removed before parents
     for (int i = _records[TIMER].size()-1; i >= 0; i--)
     {
         Record& timer = _records[TIMER][i];
-        if (timer.touches_since_last_reset == 0)
+        // A timer started in an earlier frame has only its value
+        if (timer.touches_since_last_reset == 0 && timer.value == 0)
         {
-            removeTimer(i);
+            if (timer.num_open == 0 && timer.children.isEmpty())
+                removeTimer(i);
         }
         else
         {
+            addToHistory(timer);
             timer.value = 0;
             timer.touches_since_last_reset = 0;
         }
@@ -89,6 +262,7 @@ void Stats::reset()
         }
         else
         {
+            addToHistory(counter);
             counter.value = 0;
             counter.touches_since_last_reset = 0;
         }
@@ -99,6 +273,8 @@ void Stats::reset()
 
 void Stats::updateView()
 {
+    merge();
+
     if (_layout_changed)
     {
         QAbstractItemModel::reset();
@@ -108,16 +284,17 @@ void Stats::updateView()
     else if (_data_changed)
     {
         // I don't really understand how the dataChanged signal works.
-        // This updates everything, but it seems like it should just 
+        // This updates everything, but it seems like it should just
         // update the counters.
         QModelIndex a = createIndex(0,0,&_headers[COUNTER]);
-        QModelIndex b = createIndex(numCounters()-1,1,&_headers[COUNTER]);
+        QModelIndex b = createIndex(numCounters()-1,columnCount()-1,
+                                    &_headers[COUNTER]);
 
         emit dataChanged(a,b);
         _data_changed = false;
     }
 }
-        
+
 void Stats::setChildValuesToZero( Record* record )
 {
     for (int i = 0; i < record->children.size(); i++)
@@ -128,28 +305,224 @@ void Stats::setChildValuesToZero( Record* record )
     }
 }
 
-int Stats::findTimer( const QString& name, const Record* parent )
+int Stats::handle( const QString& name )
 {
-    int index = -1;
-    for (int i = 0; i < _records[TIMER].size(); i++)
+    QMutexLocker locker(&_handles_mutex);
+    QHash<QString,int>::const_iterator it = _handles.find(name);
+    if (it != _handles.end())
+        return it.value();
+
+    int handle = _handle_names.size();
+    _handle_names.append(name);
+    _handles.insert(name, handle);
+    return handle;
+}
+
+QString Stats::handleName( int handle )
+{
+    QMutexLocker locker(&_handles_mutex);
+    return _handle_names[handle];
+}
+
+Stats::ThreadBuffer* Stats::localBuffer()
+{
+    ThreadBufferRef* ref = local_buffers.localData();
+    if (!ref)
     {
-        Record& timer = _records[TIMER][i];
-        if (timer.name == name &&
-            (parent == 0 || timer.parent == parent))
+        ref = new ThreadBufferRef(new ThreadBuffer);
+        local_buffers.setLocalData(ref);
+
+        QThread* thread = QThread::currentThread();
+        QString name = thread->objectName();
+        if (QCoreApplication::instance() &&
+            thread == QCoreApplication::instance()->thread())
+            name = "Main";
+
+        QMutexLocker locker(&_buffers_mutex);
+        if (name.isEmpty())
+            name = QString("Thread %1").arg(_thread_names.size());
+        ref->buffer->thread_id = _thread_names.size();
+        _thread_names.append(name);
+        _buffers.append(ref->buffer);
+    }
+    return ref->buffer;
+}
+
+void Stats::startTimer( int handle )
+{
+    localBuffer()->start(handle);
+}
+
+void Stats::stopTimer( int handle )
+{
+    localBuffer()->stop(handle);
+}
+
+void Stats::setCounter( int handle, float value )
+{
+    localBuffer()->count(handle, ThreadBuffer::SET, value);
+}
+
+void Stats::addToCounter( int handle, float value )
+{
+    localBuffer()->count(handle, ThreadBuffer::ADD, value);
+}
+
+void Stats::merge()
+{
+    QMutexLocker locker(&_buffers_mutex);
+    int num_dropped = 0;
+    for (int i = 0; i < _buffers.size(); i++)
+    {
+        ThreadBuffer* buffer = _buffers[i];
+        // Read before the events, so none are recorded after it
+        bool finished = buffer->finished.fetchAndAddAcquire(0);
+
+        replay(buffer);
+        num_dropped += buffer->dropped.fetchAndStoreRelaxed(0);
+
+        if (finished)
         {
-            index = i;
-            break;
+            for (int j = 0; j < buffer->replay_stack.size(); j++)
+                buffer->replay_stack[j].record->num_open--;
+            delete buffer;
+            _buffers.removeAt(i);
+            i--;
         }
     }
-    return index;
+
+    // Since the last merge
+    if (num_dropped > 0)
+    {
+        Record* dropped = counterRecord(handle("Dropped Stats Events"));
+        dropped->value += num_dropped;
+        dropped->touches_since_last_reset++;
+        _data_changed = true;
+    }
 }
 
-int Stats::findTimer( const Record* pointer )
+void Stats::discardEvents()
+{
+    QMutexLocker locker(&_buffers_mutex);
+    for (int i = 0; i < _buffers.size(); i++)
+    {
+        ThreadBuffer* buffer = _buffers[i];
+        bool finished = buffer->finished.fetchAndAddAcquire(0);
+
+        buffer->consumed(buffer->published());
+        buffer->dropped.fetchAndStoreRelaxed(0);
+        // The stops of the timers open are dropped with the rest, or
+        // skipped by replay() when they come
+        for (int j = 0; j < buffer->replay_stack.size(); j++)
+            buffer->replay_stack[j].record->num_open--;
+        buffer->replay_stack.clear();
+
+        if (finished)
+        {
+            delete buffer;
+            _buffers.removeAt(i);
+            i--;
+        }
+    }
+}
+
+void Stats::replay( ThreadBuffer* buffer )
+{
+    unsigned head = buffer->published();
+    QVector<ThreadBuffer::OpenTimer>& stack = buffer->replay_stack;
+
+    for (unsigned i = buffer->read; i != head; i++)
+    {
+        const ThreadBuffer::Event& e = buffer->event(i);
+        if (e.type == ThreadBuffer::START)
+        {
+            Record* parent = stack.isEmpty() ? &_headers[TIMER]
+                                             : stack.last().record;
+            ThreadBuffer::OpenTimer open;
+            open.record = timerRecord(e.handle, parent);
+            open.start = e.stamp;
+            open.record->touches_since_last_reset++;
+            open.record->num_open++;
+            stack.append(open);
+        }
+        else if (e.type == ThreadBuffer::STOP)
+        {
+            // Started before a clear()
+            if (stack.isEmpty() || stack.last().record->handle != e.handle)
+                continue;
+
+            Record* timer = stack.last().record;
+            timer->value += e.stamp - stack.last().start;
+            if (_tracing)
+                traceTimer(e.handle, buffer->thread_id,
+                           stack.last().start, e.stamp);
+            timer->num_open--;
+            stack.removeLast();
+            _data_changed = true;
+        }
+        else
+        {
+            Record* counter = counterRecord(e.handle);
+            if (e.type == ThreadBuffer::SET)
+                counter->value = e.value;
+            else
+                counter->value += e.value;
+            counter->touches_since_last_reset++;
+            _data_changed = true;
+        }
+    }
+
+    buffer->consumed(head);
+}
+
+Stats::Record* Stats::timerRecord( int handle, Record* parent )
+{
+    for (int i = 0; i < parent->children.size(); i++)
+    {
+        if (parent->children[i]->handle == handle)
+            return parent->children[i];
+    }
+
+    // Appended after its parent, so removed before it by reset()
+    Record newtimer;
+    newtimer.name = handleName(handle);
+    newtimer.handle = handle;
+    newtimer.category = TIMER;
+    newtimer.parent = parent;
+    _records[TIMER].append(newtimer);
+    Record* pointer = &(_records[TIMER].last());
+    parent->children.append(pointer);
+
+    _layout_changed = true;
+    return pointer;
+}
+
+Stats::Record* Stats::counterRecord( int handle )
+{
+    Record* pointer = _counters_by_handle.value(handle, 0);
+    if (pointer)
+        return pointer;
+
+    Record newcounter;
+    newcounter.name = handleName(handle);
+    newcounter.handle = handle;
+    newcounter.category = COUNTER;
+    newcounter.parent = &_headers[COUNTER];
+    _records[COUNTER].append(newcounter);
+    pointer = &(_records[COUNTER].last());
+    _headers[COUNTER].children.append(pointer);
+    _counters_by_handle.insert(handle, pointer);
+
+    _layout_changed = true;
+    return pointer;
+}
+
+int Stats::findTimer( const QString& name )
 {
     int index = -1;
     for (int i = 0; i < _records[TIMER].size(); i++)
     {
-        if (&(_records[TIMER][i]) == pointer)
+        if (_records[TIMER][i].name == name)
         {
             index = i;
             break;
@@ -158,12 +531,12 @@ int Stats::findTimer( const Record* pointer )
     return index;
 }
 
-int Stats::findCounter( const QString& name )
+int Stats::findTimer( const Record* pointer )
 {
     int index = -1;
-    for (int i = 0; i < _records[COUNTER].size(); i++)
+    for (int i = 0; i < _records[TIMER].size(); i++)
     {
-        if (_records[COUNTER][i].name == name)
+        if (&(_records[TIMER][i]) == pointer)
         {
             index = i;
             break;
@@ -177,7 +550,7 @@ void Stats::removeTimer( int which )
     Record* timer = &(_records[TIMER][which]);
     assert( timer->children.size() == 0 );
     Record* parent = &_headers[TIMER];
-    if (timer->parent >= 0)
+    if (timer->parent)
     {
         parent = timer->parent;
     }
@@ -194,7 +567,7 @@ void Stats::removeTimer( int which )
 
     _records[TIMER].removeAt(which);
 }
-    
+
 void Stats::removeCounter( int which )
 {
     Record* parent = &_headers[COUNTER];
@@ -208,112 +581,255 @@ void Stats::removeCounter( int which )
         }
     }
 
+    _counters_by_handle.remove(_records[COUNTER][which].handle);
     _records[COUNTER].removeAt(which);
 }
 
-void Stats::startTimer( const QString& name )
+void Stats::setHistoryLength( int frames )
 {
-    int index = findTimer(name, _timer_stack.isEmpty() ? 0 : _timer_stack.last());  
-    if (index == -1)
+    _history_length = std::max(frames, 1);
+    for (int c = TIMER; c <= COUNTER; c++)
     {
-        index = _records[TIMER].size();
-        Record newtimer;
-        newtimer.name = name;
-        newtimer.category = TIMER;
-        newtimer.stamp = now();
-        newtimer.value = 0;
-        _records[TIMER].append(newtimer);
-        Record* pointer = &(_records[TIMER].last());
-
-        if (_timer_stack.size() > 0)
+        for (int i = 0; i < _records[c].size(); i++)
         {
-            assert( findTimer(_timer_stack.last()) < findTimer(pointer) );
-            pointer->parent = _timer_stack.last();
-            _timer_stack.last()->children.append(pointer);
+            _records[c][i].history.clear();
+            _records[c][i].history_next = 0;
         }
-        else
-        {
-            pointer->parent = &_headers[TIMER];
-            _headers[TIMER].children.append(pointer);
-        }
-
-        _layout_changed = true;
     }
+}
+
+void Stats::addToHistory( Record& record )
+{
+    if (record.history.size() < _history_length)
+        record.history.append(record.value);
     else
+        record.history[record.history_next] = record.value;
+    record.history_next = (record.history_next + 1) % _history_length;
+}
+
+Stats::Summary Stats::summarize( const Record& record ) const
+{
+    Summary summary;
+    int n = record.history.size();
+    if (n == 0)
+        return summary;
+
+    std::vector<float> sorted(record.history.begin(), record.history.end());
+    std::sort(sorted.begin(), sorted.end());
+    summary.min = sorted[0];
+    summary.median = sorted[(n-1) / 2];
+    summary.p95 = sorted[(int)ceilf(0.95f * n) - 1];
+    summary.max = sorted[n-1];
+    summary.frames = n;
+    return summary;
+}
+
+// Seconds from a to b. operator- on timestamps gives a float, which is
+// too coarse for a trace of more than a few seconds.
+static double seconds( const timestamp& a, const timestamp& b )
+{
+#ifdef WIN32
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return double(b.t.QuadPart - a.t.QuadPart) / double(frequency.QuadPart);
+#else
+    return double(b.tv_sec - a.tv_sec) + 1.0e-6 * double(b.tv_usec - a.tv_usec);
+#endif
+}
+
+void Stats::startTrace( int max_events )
+{
+    merge();
+    std::vector<TraceEvent>().swap(_trace);
+    _trace.reserve(std::max(max_events, 1));
+    _trace_dropped = 0;
+    _trace_start = now();
+    _tracing = true;
+}
+
+void Stats::stopTrace()
+{
+    merge();
+    _tracing = false;
+}
+
+void Stats::traceTimer( int handle, int thread, const timestamp& start,
+                        const timestamp& stop )
+{
+    double t = seconds(_trace_start, start);
+    if (t < 0)
+        return; // Started before the trace
+    if (_trace.size() == _trace.capacity())
     {
-        _records[TIMER][index].stamp = now();
+        _trace_dropped++;
+        return;
     }
+    TraceEvent event = { handle, thread, t, seconds(start, stop) };
+    _trace.push_back(event);
+}
 
-    _records[TIMER][index].touches_since_last_reset++;
-    _timer_stack.append(&(_records[TIMER][index]));
+void Stats::traceCounters()
+{
+    double t = seconds(_trace_start, now());
+    for (int i = 0; i < _records[COUNTER].size(); i++)
+    {
+        const Record& counter = _records[COUNTER][i];
+        if (counter.touches_since_last_reset == 0)
+            continue;
+        if (_trace.size() == _trace.capacity())
+        {
+            _trace_dropped++;
+            continue;
+        }
+        TraceEvent event = { counter.handle, -1, t, counter.value };
+        _trace.push_back(event);
+    }
 }
 
-void Stats::stopTimer( const QString& name )
+bool Stats::writeTrace( const QString& filename )
 {
-#ifdef QT_NO_DEBUG
-    Q_UNUSED(name);
-#endif
-    assert( _timer_stack.size() > 0 && _timer_stack.last()->name == name );
-    Record* rec = _timer_stack.last();
+    if (_tracing)
+        merge();
+    if (_trace_dropped > 0)
+        qWarning("Trace buffer full: %d events dropped", _trace_dropped);
+
+    if (filename.endsWith(".json", Qt::CaseInsensitive))
+        return writeChromeTrace(filename);
+    return writeTraceCSV(filename);
+}
 
-    rec->value += now() - rec->stamp;
-    _data_changed = true;
+static QString jsonString( const QString& str )
+{
+    QString out = str;
+    out.replace("\\", "\\\\");
+    out.replace("\"", "\\\"");
+    return "\"" + out + "\"";
+}
 
-    _timer_stack.removeLast();
+static QString csvString( const QString& str )
+{
+    QString out = str;
+    out.replace("\"", "\"\"");
+    return "\"" + out + "\"";
 }
 
-void Stats::setCounter( const QString& name, float value )
+bool Stats::writeChromeTrace( const QString& filename )
 {
-    int index = findCounter(name);  
-    if (index == -1)
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
     {
-        index = _records[COUNTER].size();
-        Record newcounter;
-        newcounter.name = name;
-        newcounter.category = COUNTER;
-        newcounter.value = value;
-        newcounter.parent = &_headers[COUNTER];
+        qWarning("Could not open %s", qPrintable(filename));
+        return false;
+    }
+    QTextStream out(&file);
 
-        _records[COUNTER].append(newcounter);
-        _headers[COUNTER].children.append(&(_records[COUNTER][index]));
+    QStringList names;
+    {
+        QMutexLocker locker(&_handles_mutex);
+        names = _handle_names;
+    }
+    QStringList threads;
+    {
+        QMutexLocker locker(&_buffers_mutex);
+        threads = _thread_names;
+    }
 
-        _layout_changed = true;
+    // Times in microseconds
+    const char* separator = "\n";
+    out << "{\"traceEvents\":[";
+    for (int i = 0; i < threads.size(); i++)
+    {
+        out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << i << ",\"args\":{\"name\":"
+            << jsonString(threads[i]) << "}}";
+        separator = ",\n";
     }
-    else
+    for (size_t i = 0; i < _trace.size(); i++)
     {
-        _records[COUNTER][index].value = value;
-        _data_changed = true;
+        const TraceEvent& e = _trace[i];
+        QString name = jsonString(names[e.handle]);
+        QString ts = QString::number(e.start * 1.0e6, 'f', 1);
+        out << separator;
+        if (e.thread >= 0)
+        {
+            out << "{\"name\":" << name << ",\"cat\":\"timer\",\"ph\":\"X\","
+                << "\"pid\":1,\"tid\":" << e.thread << ",\"ts\":" << ts
+                << ",\"dur\":" << QString::number(e.value * 1.0e6, 'f', 1)
+                << "}";
+        }
+        else
+        {
+            out << "{\"name\":" << name << ",\"ph\":\"C\",\"pid\":1,"
+                << "\"ts\":" << ts << ",\"args\":{\"value\":"
+                << QString::number(e.value) << "}}";
+        }
+        separator = ",\n";
     }
-    _records[COUNTER][index].touches_since_last_reset++;
+    out << "\n],\n\"displayTimeUnit\":\"ms\"}\n";
+
+    return out.status() == QTextStream::Ok;
 }
 
-void Stats::addToCounter( const QString& name, float value )
+bool Stats::writeTraceCSV( const QString& filename )
 {
-    int index = findCounter(name);  
-    if (index == -1)
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
     {
-        index = _records[COUNTER].size();
-        Record newcounter;
-        newcounter.name = name;
-        newcounter.category = COUNTER;
-        newcounter.value = value;
-        newcounter.parent = &_headers[COUNTER];
-
-        _records[COUNTER].append(newcounter);
-        _headers[COUNTER].children.append(&(_records[COUNTER][index]));
+        qWarning("Could not open %s", qPrintable(filename));
+        return false;
+    }
+    QTextStream out(&file);
 
-        _layout_changed = true;
+    QStringList names;
+    {
+        QMutexLocker locker(&_handles_mutex);
+        names = _handle_names;
     }
-    else
+    QStringList threads;
     {
-        _records[COUNTER][index].value += value;
-        _data_changed = true;
+        QMutexLocker locker(&_buffers_mutex);
+        threads = _thread_names;
     }
-    _records[COUNTER][index].touches_since_last_reset++;
+
+    out << "kind,name,thread,start_ms,duration_ms,value\n";
+    for (size_t i = 0; i < _trace.size(); i++)
+    {
+        const TraceEvent& e = _trace[i];
+        QString name = csvString(names[e.handle]);
+        QString start = QString::number(e.start * 1000.0, 'f', 3);
+        if (e.thread >= 0)
+        {
+            out << "timer," << name << ","
+                << csvString(threads[e.thread]) << ","
+                << start << "," << QString::number(e.value * 1000.0, 'f', 3)
+                << ",\n";
+        }
+        else
+        {
+            out << "counter," << name << ",," << start << ",,"
+                << QString::number(e.value) << "\n";
+        }
+    }
+
+    return out.status() == QTextStream::Ok;
 }
 
 void Stats::beginConstantGroup( const QString& name )
 {
+    // A group of the same name is reopened, so its constants can be set
+    // again instead of repeated
+    Record* parent = &_headers[CONSTANT];
+    if (_constant_stack.size() > 0)
+        parent = _constant_stack.last();
+    for (int i = 0; i < parent->children.size(); i++)
+    {
+        if (parent->children[i]->name == name)
+        {
+            _constant_stack.append(parent->children[i]);
+            return;
+        }
+    }
+
     Record newgroup;
     newgroup.name = name;
     newgroup.category = CONSTANT;
@@ -387,13 +903,19 @@ void Stats::endConstantGroup()
     _constant_stack.removeLast();
 }
 
+void Stats::setGpuTime( int handle, float seconds )
+{
+    _gpu_times[handle] = seconds;
+    _data_changed = true;
+}
+
 
 QString Stats::timerStatistics( const QString& name )
 {
-    int timer_index = findTimer(name, 0);
+    int timer_index = findTimer(name);
     if (timer_index < 0)
     {
-        timer_index = findTimer(name + " (wait GL)", 0);
+        timer_index = findTimer(name + " (wait GL)");
         if (timer_index < 0)
             return QString("Timer not found (%1).").arg(name);
     }
@@ -404,6 +926,15 @@ QString Stats::timerStatistics( const QString& name )
         average = timer.value / (float)timer.touches_since_last_reset;
     QString output = QString("%1: %2 total time, %3 calls, %4 average").
         arg(name).arg(timer.value).arg(timer.touches_since_last_reset).arg(average);
+
+    Summary summary = summarize(timer);
+    if (summary.frames > 0)
+    {
+        output += QString("; per frame over %1 frames: %2 min, %3 median, "
+                          "%4 95th percentile, %5 max").
+            arg(summary.frames).arg(summary.min).arg(summary.median).
+            arg(summary.p95).arg(summary.max);
+    }
     return output;
 }
 
@@ -423,13 +954,13 @@ QVariant Stats::data( const QModelIndex& index, int role ) const
     QVariant ret;
     if (index.column() == 0)
         ret = node->name;
-    else
+    else if (node->parent == &_dummy_root)
     {
-        if (node->parent == &_dummy_root)
-        {
-            ret = QString();
-        }
-        else if (node->category == TIMER)
+        ret = QString();
+    }
+    else if (index.column() == 1)
+    {
+        if (node->category == TIMER)
         {
             ret = QString::number(node->value, 'f', 3);
         }
@@ -442,6 +973,26 @@ QVariant Stats::data( const QModelIndex& index, int role ) const
             ret = node->str_value;
         }
     }
+    else if (index.column() == 2)
+    {
+        if (node->category == TIMER && _gpu_times.contains(node->handle))
+            ret = QString::number(_gpu_times.value(node->handle), 'f', 3);
+    }
+    else if (node->category == TIMER || node->category == COUNTER)
+    {
+        // Min, median, 95th percentile and max
+        Summary summary = summarize(*node);
+        if (summary.frames == 0)
+            return QString();
+
+        float values[4] = { summary.min, summary.median,
+                            summary.p95, summary.max };
+        float value = values[index.column() - 3];
+        if (node->category == TIMER)
+            ret = QString::number(value, 'f', 3);
+        else
+            ret = value;
+    }
 
     return ret;
 }
@@ -449,7 +1000,7 @@ QVariant Stats::data( const QModelIndex& index, int role ) const
 Qt::ItemFlags Stats::flags( const QModelIndex& index ) const
 {
     Q_UNUSED(index);
-    
+
     return Qt::ItemIsEnabled;
 }
 
@@ -457,10 +1008,10 @@ QVariant Stats::headerData( int section, Qt::Orientation orientation, int role )
 {
      if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
      {
-         if (section == 0)
-            return "Name";
-         else
-            return "Value";
+         const char* names[] = { "Name", "Value", "GPU", "Min", "Median",
+                                 "95%", "Max" };
+         if (section >= 0 && section < 7)
+            return names[section];
      }
 
      return QVariant();
@@ -511,10 +1062,10 @@ QModelIndex Stats::parent(const QModelIndex &index) const
 
     return createIndex(row, 0, parent_record);
 }
- 
+
 int Stats::rowCount( const QModelIndex& parent ) const
 {
-    int count = 0; 
+    int count = 0;
     const Record* parent_rec;
     if (!parent.isValid())
         parent_rec = &_dummy_root;
@@ -528,11 +1079,13 @@ int Stats::rowCount( const QModelIndex& parent ) const
 int Stats::columnCount( const QModelIndex& parent ) const
 {
     (void)parent;
-    
-    return 2;
+
+    // Name, value, GPU value, and min, median, 95th percentile and max of
+    // the history
+    return 7;
 }
 
-StatsWidget::StatsWidget(QMainWindow* parent, QMenu* window_menu) : 
+StatsWidget::StatsWidget(QMainWindow* parent, QMenu* window_menu) :
     QDockWidget(tr("Statistics"), parent)
 {
     QTreeView* tree_view = new QTreeView;
@@ -0,0 +1,178 @@
+/*****************************************************************************\
+
+TaskGraph.cc
+
+demoutils is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "TaskGraph.h"
+#include "Stats.h"
+#include <QRunnable>
+#include <QMutexLocker>
+#include <assert.h>
+
+class TaskGraph::Runner : public QRunnable
+{
+  public:
+    Runner( TaskGraph* graph, int which ) : _graph(graph), _which(which) {}
+    void run() { _graph->execute(_which); }
+  protected:
+    TaskGraph* _graph;
+    int        _which;
+};
+
+TaskGraph::TaskGraph( QObject* parent ) : QObject(parent)
+{
+    _num_running = 0;
+    _num_finished = 0;
+    _canceled = false;
+    _total_time = 0;
+}
+
+TaskGraph::~TaskGraph()
+{
+    _pool.waitForDone();
+    for (int i = 0; i < _nodes.size(); i++)
+        delete _nodes[i].task;
+}
+
+int TaskGraph::addTask( Task* task, const QList<int>& depends_on )
+{
+    int index = _nodes.size();
+
+    Node node;
+    node.task = task;
+    node.num_depends = depends_on.size();
+    node.waiting_on = node.num_depends;
+    node.start = 0;
+    node.finish = 0;
+    node.done = false;
+    _nodes.append(node);
+
+    // Dependencies must already be in the graph, so it can't have cycles.
+    for (int i = 0; i < depends_on.size(); i++)
+    {
+        assert( depends_on[i] >= 0 && depends_on[i] < index );
+        _nodes[depends_on[i]].dependents.append(index);
+    }
+
+    return index;
+}
+
+int TaskGraph::addTask( Task* task, int depends_on )
+{
+    return addTask(task, QList<int>() << depends_on);
+}
+
+int TaskGraph::addTask( Task* task, int depends_on_a, int depends_on_b )
+{
+    return addTask(task, QList<int>() << depends_on_a << depends_on_b);
+}
+
+bool TaskGraph::run()
+{
+    QMutexLocker locker(&_mutex);
+
+    _canceled = false;
+    _num_running = 0;
+    _num_finished = 0;
+    for (int i = 0; i < _nodes.size(); i++)
+    {
+        _nodes[i].waiting_on = _nodes[i].num_depends;
+        _nodes[i].done = false;
+    }
+
+    _start_stamp = now();
+    for (int i = 0; i < _nodes.size(); i++)
+    {
+        if (_nodes[i].num_depends == 0)
+            startReady(i);
+    }
+
+    while (_num_running > 0)
+        _all_done.wait(&_mutex);
+
+    _total_time = now() - _start_stamp;
+
+    return !_canceled && _num_finished == _nodes.size();
+}
+
+void TaskGraph::cancel()
+{
+    _canceled = true;
+}
+
+// Called with the mutex held.
+void TaskGraph::startReady( int which )
+{
+    _num_running++;
+    _pool.start(new Runner(this, which));
+}
+
+// Runs in a pool thread.
+void TaskGraph::execute( int which )
+{
+    float start = now() - _start_stamp;
+    // Also timed in Stats, so it shows on the trace with its thread
+    __START_TIMER(_nodes[which].task->name());
+    _nodes[which].task->run();
+    __STOP_TIMER(_nodes[which].task->name());
+    float finish = now() - _start_stamp;
+
+    int num_finished;
+    {
+        QMutexLocker locker(&_mutex);
+
+        Node& node = _nodes[which];
+        node.start = start;
+        node.finish = finish;
+        node.done = true;
+        num_finished = ++_num_finished;
+
+        if (!_canceled)
+        {
+            for (int i = 0; i < node.dependents.size(); i++)
+            {
+                int dependent = node.dependents[i];
+                if (--_nodes[dependent].waiting_on == 0)
+                    startReady(dependent);
+            }
+        }
+    }
+
+    // Emit before this task stops counting as running, so the graph
+    // can't be deleted out from under us.
+    emit taskFinished(_nodes[which].task->name(), num_finished,
+                      _nodes.size());
+
+    QMutexLocker locker(&_mutex);
+    _num_running--;
+    if (_num_running == 0)
+        _all_done.wakeAll();
+}
+
+void TaskGraph::recordStats( Stats& stats, const QString& group_name ) const
+{
+    float sum = 0;
+    stats.beginConstantGroup(group_name);
+    for (int i = 0; i < _nodes.size(); i++)
+    {
+        const Node& node = _nodes[i];
+        if (!node.done)
+        {
+            stats.setConstant(node.task->name(), QString("not run"));
+            continue;
+        }
+        float ms = (node.finish - node.start) * 1000.0f;
+        sum += ms;
+        stats.setConstant(node.task->name(),
+            QString("%1 ms (%2 - %3)").arg(ms, 0, 'f', 1)
+                                      .arg(node.start * 1000.0f, 0, 'f', 1)
+                                      .arg(node.finish * 1000.0f, 0, 'f', 1));
+    }
+    stats.setConstant("Sum of stages (ms)", sum);
+    stats.setConstant("Wall clock (ms)", _total_time * 1000.0f);
+    stats.endConstantGroup();
+}
@@ -6,7 +6,7 @@ Authors: Forrester Cole (fcole@cs.princeton.edu)
          Adam Finkelstein
 Copyright (c) 2009 Forrester Cole
 
-Simple 8bit image. Uses QImage for I/O.
+Simple 8bit image. Uses QImage for I/O, except for writing PNGs.
 
 libgq is distributed under the terms of the GNU General Public License.
 See the COPYING file for details.
@@ -47,6 +47,9 @@ public:
 	bool save(const QString& filename, bool flip = true );
     bool load(const QString& filename);
 
+protected:
+    bool savePNG(const QString& filename, bool flip);
+
 private:
     int _width;
     int _height;
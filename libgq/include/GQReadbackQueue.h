@@ -0,0 +1,91 @@
+/*****************************************************************************\
+
+GQReadbackQueue.h
+
+Saves framebuffer attachments without stalling the render loop. Each
+read goes into a pixel buffer object, and the buffer is only mapped a
+few frames later, when the GPU has long finished the copy. The mapped
+image is then encoded and written by a pool of writer threads, which own
+it from then on.
+
+All methods except writeImage() and numPendingWrites() must be called
+with the GL context current.
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef GQ_READBACK_QUEUE_H_
+#define GQ_READBACK_QUEUE_H_
+
+#include "GQFramebufferObject.h"
+
+#include <QString>
+#include <QList>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QAtomicInt>
+
+class GQReadbackQueue
+{
+public:
+    GQReadbackQueue( int frame_delay = 2, int max_pending_writes = 8 );
+    ~GQReadbackQueue();
+
+    // Starts reading color attachment "which" of the fbo. The extension
+    // of the filename picks the format, as in saveColorTextureToFile.
+    // With 3 channels, alpha is left out, e.g. for an opaque screenshot.
+    void readColorTexture( const GQFramebufferObject& fbo, int which,
+                           const QString& filename, int num_channels = 4 );
+
+    // Hands an image that is already in memory straight to the writers,
+    // which take ownership of it.
+    void writeImage( GQImage* image, const QString& filename );
+    void writeImage( GQFloatImage* image, const QString& filename );
+
+    // Advances the frame count, and hands every read that is old enough
+    // to the writers. Call once per frame.
+    void nextFrame();
+    // Hands every read to the writers, however recent.
+    void finish();
+    // finish(), then waits for the writers.
+    void flush();
+    // Deletes the pixel buffers. Pending reads are dropped.
+    void clear();
+
+    void setNumWriterThreads( int num ) { _writers.setMaxThreadCount(num); }
+
+    int numPendingReads() const { return _pending.size(); }
+    // Images mapped or handed over but not yet written. Safe from any thread.
+    int numPendingWrites() const { return _num_pending_writes; }
+
+protected:
+    struct Readback
+    {
+        unsigned int    pbo;
+        int             size;
+        int             frame;
+        bool            is_float;
+        int             num_channels;
+        int             width;
+        int             height;
+        QString         filename;
+    };
+
+    unsigned int takeBuffer( int size );
+    void releaseBuffer( const Readback& readback );
+    void startWrite( Readback& readback );
+
+protected:
+    int                 _frame_delay;
+    int                 _frame;
+    QList<Readback>     _pending;
+    QList<Readback>     _free;
+
+    QThreadPool         _writers;
+    QSemaphore          _write_slots;
+    QAtomicInt          _num_pending_writes;
+};
+
+#endif // GQ_READBACK_QUEUE_H_
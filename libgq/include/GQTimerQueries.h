@@ -0,0 +1,77 @@
+/*****************************************************************************\
+
+GQTimerQueries.h
+
+Measures how long the GPU spends on named sections of a frame, without
+stalling the render loop. Each begin()/end() pair issues a time elapsed
+query (EXT_timer_query). A query's result is read only a few frames
+later, and only once the GPU reports it as available. Sections are named
+by an int chosen by the caller (e.g. a Stats handle).
+
+Elapsed time queries cannot nest. Only one section can be open at a
+time, and a begin() inside another section is ignored along with its
+end().
+
+All methods must be called with the GL context current.
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef GQ_TIMER_QUERIES_H_
+#define GQ_TIMER_QUERIES_H_
+
+#include <QList>
+#include <QVector>
+#include <QHash>
+
+class GQTimerQueries
+{
+public:
+    GQTimerQueries( int frame_delay = 3 );
+    ~GQTimerQueries();
+
+    // False if the driver has no timer queries; everything is then a no-op.
+    static bool isSupported();
+
+    void begin( int id );
+    void end( int id );
+
+    // Advances the frame count, and reads the results of every complete
+    // frame that is old enough and whose queries are all available.
+    // Call once per frame, outside any section.
+    void nextFrame();
+    // Deletes the query objects. Pending results are dropped.
+    void clear();
+
+    // Seconds the GPU spent in each section, summed over the last frame
+    // read back. A section keeps its last time until it is read again.
+    const QHash<int,double>& results() const { return _results; }
+    // The frame the results are from, or -1 before the first readback.
+    int resultFrame() const { return _result_frame; }
+
+protected:
+    struct Query
+    {
+        unsigned int    query;
+        int             id;
+        int             frame;
+    };
+
+    unsigned int takeQuery();
+    bool readFrame();
+
+protected:
+    int                   _frame_delay;
+    int                   _frame;
+    int                   _open_id;
+    int                   _ignored_depth;
+    QList<Query>          _pending;
+    QVector<unsigned int> _free;
+
+    QHash<int,double>     _results;
+    int                   _result_frame;
+};
+
+#endif // GQ_TIMER_QUERIES_H_
@@ -0,0 +1,217 @@
+/*****************************************************************************\
+
+GQReadbackQueue.cc
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "GQInclude.h"
+#include "GQReadbackQueue.h"
+
+#include <QRunnable>
+#include <assert.h>
+#include <string.h>
+
+// Saves one image on a writer thread, then frees it.
+template <class Image> class GQImageWriter : public QRunnable
+{
+public:
+    GQImageWriter( Image* image, const QString& filename,
+                   QSemaphore* slots, QAtomicInt* count )
+        : _image(image), _filename(filename), _slots(slots), _count(count) {}
+
+    void run()
+    {
+        if (!_image->save(_filename))
+            qWarning("GQReadbackQueue: could not write %s",
+                     qPrintable(_filename));
+        delete _image;
+        _count->deref();
+        _slots->release();
+    }
+
+protected:
+    Image*      _image;
+    QString     _filename;
+    QSemaphore* _slots;
+    QAtomicInt* _count;
+};
+
+GQReadbackQueue::GQReadbackQueue( int frame_delay, int max_pending_writes )
+    : _write_slots(max_pending_writes), _num_pending_writes(0)
+{
+    _frame_delay = frame_delay;
+    _frame = 0;
+    _writers.setMaxThreadCount(2);
+}
+
+GQReadbackQueue::~GQReadbackQueue()
+{
+    // There may be no context left to map or delete the buffers with,
+    // so anything not finished by now is lost.
+    if (!_pending.isEmpty())
+        qWarning("GQReadbackQueue: %d reads were never finished",
+                 _pending.size());
+    _writers.waitForDone();
+}
+
+unsigned int GQReadbackQueue::takeBuffer( int size )
+{
+    for (int i = 0; i < _free.size(); i++)
+    {
+        if (_free[i].size == size)
+            return _free.takeAt(i).pbo;
+    }
+
+    GLuint pbo;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER_ARB, size, NULL, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    return pbo;
+}
+
+// Keeps a few buffers around for reuse; the rest (e.g. the sizes from
+// before a window resize) are deleted.
+void GQReadbackQueue::releaseBuffer( const Readback& readback )
+{
+    _free.append(readback);
+    if (_free.size() > _frame_delay + 2)
+    {
+        GLuint pbo = _free.takeFirst().pbo;
+        glDeleteBuffers(1, &pbo);
+    }
+}
+
+void GQReadbackQueue::readColorTexture( const GQFramebufferObject& fbo,
+                                        int which, const QString& filename,
+                                        int num_channels )
+{
+    assert(num_channels == 3 || num_channels == 4);
+    Readback readback;
+    readback.is_float = filename.endsWith("float") || filename.endsWith("pfm");
+    readback.num_channels = num_channels;
+    readback.width = fbo.width();
+    readback.height = fbo.height();
+    readback.size = readback.width * readback.height * num_channels *
+        (readback.is_float ? sizeof(float) : sizeof(uint8));
+    readback.frame = _frame;
+    readback.filename = filename;
+    readback.pbo = takeBuffer(readback.size);
+
+    // With a pack buffer bound, the "pointer" is an offset into it and
+    // the call returns without waiting for the GPU.
+    // Rows of 3 bytes per pixel aren't padded in the images
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, readback.pbo);
+    fbo.colorTexture(which)->bind();
+    glGetTexImage(fbo.glTarget(), 0, num_channels == 3 ? GL_RGB : GL_RGBA,
+                  readback.is_float ? GL_FLOAT : GL_UNSIGNED_BYTE, 0);
+    fbo.colorTexture(which)->unbind();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    glPopClientAttrib();
+
+    reportGLError();
+
+    _pending.append(readback);
+}
+
+void GQReadbackQueue::startWrite( Readback& readback )
+{
+    // Blocks if the writers have fallen too far behind, so a slow disk
+    // can't pile up images without bound.
+    _write_slots.acquire();
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, readback.pbo);
+    const void* data = glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY);
+    if (!data)
+    {
+        qWarning("GQReadbackQueue: could not map the buffer for %s",
+                 qPrintable(readback.filename));
+        glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+        _write_slots.release();
+        releaseBuffer(readback);
+        return;
+    }
+
+    _num_pending_writes.ref();
+    if (readback.is_float)
+    {
+        GQFloatImage* image = new GQFloatImage(readback.width,
+            readback.height, readback.num_channels);
+        memcpy(image->raster(), data, readback.size);
+        _writers.start(new GQImageWriter<GQFloatImage>(image,
+            readback.filename, &_write_slots, &_num_pending_writes));
+    }
+    else
+    {
+        GQImage* image = new GQImage(readback.width, readback.height,
+                                     readback.num_channels);
+        memcpy(image->raster(), data, readback.size);
+        _writers.start(new GQImageWriter<GQImage>(image,
+            readback.filename, &_write_slots, &_num_pending_writes));
+    }
+
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    releaseBuffer(readback);
+}
+
+void GQReadbackQueue::writeImage( GQImage* image, const QString& filename )
+{
+    _write_slots.acquire();
+    _num_pending_writes.ref();
+    _writers.start(new GQImageWriter<GQImage>(image, filename,
+        &_write_slots, &_num_pending_writes));
+}
+
+void GQReadbackQueue::writeImage( GQFloatImage* image,
+                                  const QString& filename )
+{
+    _write_slots.acquire();
+    _num_pending_writes.ref();
+    _writers.start(new GQImageWriter<GQFloatImage>(image, filename,
+        &_write_slots, &_num_pending_writes));
+}
+
+void GQReadbackQueue::nextFrame()
+{
+    _frame++;
+    while (!_pending.isEmpty() &&
+           _frame - _pending.first().frame >= _frame_delay)
+    {
+        Readback readback = _pending.takeFirst();
+        startWrite(readback);
+    }
+}
+
+void GQReadbackQueue::finish()
+{
+    while (!_pending.isEmpty())
+    {
+        Readback readback = _pending.takeFirst();
+        startWrite(readback);
+    }
+}
+
+void GQReadbackQueue::flush()
+{
+    finish();
+    _writers.waitForDone();
+}
+
+void GQReadbackQueue::clear()
+{
+    _pending.append(_free);
+    _free.clear();
+    for (int i = 0; i < _pending.size(); i++)
+    {
+        GLuint pbo = _pending[i].pbo;
+        glDeleteBuffers(1, &pbo);
+    }
+    _pending.clear();
+}
@@ -0,0 +1,165 @@
+/*****************************************************************************\
+
+GQTimerQueries.cc
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "GQInclude.h"
+#include "GQTimerQueries.h"
+
+GQTimerQueries::GQTimerQueries( int frame_delay )
+{
+    _frame_delay = frame_delay;
+    _frame = 0;
+    _open_id = -1;
+    _ignored_depth = 0;
+    _result_frame = -1;
+}
+
+GQTimerQueries::~GQTimerQueries()
+{
+    // As with GQReadbackQueue, there may be no context left to delete
+    // the queries with, so they are left to the context.
+}
+
+bool GQTimerQueries::isSupported()
+{
+    return GLEE_EXT_timer_query;
+}
+
+unsigned int GQTimerQueries::takeQuery()
+{
+    if (!_free.isEmpty())
+    {
+        unsigned int query = _free.last();
+        _free.pop_back();
+        return query;
+    }
+
+    GLuint query;
+    glGenQueries(1, &query);
+    return query;
+}
+
+void GQTimerQueries::begin( int id )
+{
+    if (!isSupported())
+        return;
+
+    if (_open_id >= 0)
+    {
+        _ignored_depth++;
+        return;
+    }
+
+    Query query;
+    query.query = takeQuery();
+    query.id = id;
+    query.frame = _frame;
+    glBeginQuery(GL_TIME_ELAPSED_EXT, query.query);
+    _pending.append(query);
+    _open_id = id;
+}
+
+void GQTimerQueries::end( int id )
+{
+    if (!isSupported())
+        return;
+
+    if (_ignored_depth > 0)
+    {
+        _ignored_depth--;
+        return;
+    }
+    if (_open_id != id)
+    {
+        qWarning("GQTimerQueries::end: section %d is not open", id);
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED_EXT);
+    _open_id = -1;
+}
+
+// Reads the oldest pending frame if it is old enough and all its results
+// are in. Returns false, and leaves it pending, otherwise.
+bool GQTimerQueries::readFrame()
+{
+    if (_pending.isEmpty())
+        return false;
+
+    int frame = _pending.first().frame;
+    if (_frame - frame < _frame_delay)
+        return false;
+
+    int count = 0;
+    while (count < _pending.size() && _pending[count].frame == frame)
+    {
+        GLuint available = 0;
+        glGetQueryObjectuiv(_pending[count].query,
+                            GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+        count++;
+    }
+
+    QHash<int,double> frame_results;
+    for (int i = 0; i < count; i++)
+    {
+        Query query = _pending.takeFirst();
+        GLuint64EXT nanoseconds = 0;
+        glGetQueryObjectui64vEXT(query.query, GL_QUERY_RESULT,
+                                 &nanoseconds);
+        frame_results[query.id] += nanoseconds * 1e-9;
+        _free.append(query.query);
+    }
+
+    QHashIterator<int,double> it(frame_results);
+    while (it.hasNext())
+    {
+        it.next();
+        _results[it.key()] = it.value();
+    }
+    _result_frame = frame;
+    return true;
+}
+
+void GQTimerQueries::nextFrame()
+{
+    if (!isSupported())
+        return;
+
+    if (_open_id >= 0)
+    {
+        qWarning("GQTimerQueries::nextFrame: section %d is still open",
+                 _open_id);
+        end(_open_id);
+    }
+    _ignored_depth = 0;
+
+    _frame++;
+    while (readFrame())
+        ;
+
+    reportGLError();
+}
+
+void GQTimerQueries::clear()
+{
+    if (_open_id >= 0)
+        end(_open_id);
+
+    for (int i = 0; i < _pending.size(); i++)
+        _free.append(_pending[i].query);
+    if (!_free.isEmpty())
+        glDeleteQueries(_free.size(), _free.constData());
+
+    _pending.clear();
+    _free.clear();
+    _results.clear();
+    _result_frame = -1;
+    _ignored_depth = 0;
+}
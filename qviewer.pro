@@ -5,4 +5,8 @@ SUBDIRS += libgq
 SUBDIRS += demoutils
 SUBDIRS += qglviewer
 SUBDIRS += trimesh2
+SUBDIRS += trimesh2/utilsrc
 SUBDIRS += qviewer
+SUBDIRS += qviewer/batch
+SUBDIRS += qviewer/bench
+SUBDIRS += qviewer/check
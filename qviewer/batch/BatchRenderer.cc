@@ -0,0 +1,514 @@
+/*****************************************************************************\
+
+BatchRenderer.cc
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "GQInclude.h"
+#include "BatchRenderer.h"
+#include "Scene.h"
+#include "SceneLoader.h"
+#include "Rtsc.h"
+#include "DialsAndKnobs.h"
+#include "Stats.h"
+#include "timestamp.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTextStream>
+#include <QDomElement>
+#include <QRegExp>
+
+#include <qglviewer.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+const int READBACK_DELAY = 2;
+const int MAX_QUEUED_IMAGES = 16;
+
+BatchRenderer::BatchRenderer() : _images(READBACK_DELAY, MAX_QUEUED_IMAGES)
+{
+    _width = 400;
+    _height = 400;
+    _software = false;
+    _print_stats = false;
+}
+
+BatchRenderer::~BatchRenderer()
+{
+}
+
+void BatchRenderer::setNumWriterThreads( int num )
+{
+    _images.setNumWriterThreads(num);
+}
+
+int BatchRenderer::numViews() const
+{
+    int images = 0;
+    for (int i = 0; i < _presets.size(); i++)
+        images += _presets[i].suffixes.size();
+    return _meshes.size() * _cameras.size() * images;
+}
+
+bool BatchRenderer::loadJobs( const QString& filename )
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning("Could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    QString base_dir = QFileInfo(filename).absolutePath();
+    _output_dir = base_dir + "/";
+
+    QTextStream in(&file);
+    int line_num = 0;
+    while (!in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        line_num++;
+        if (line.isEmpty() || line.startsWith("#"))
+            continue;
+        if (!parseLine(line, base_dir, line_num))
+        {
+            qWarning("%s:%d: could not parse \"%s\"",
+                qPrintable(filename), line_num, qPrintable(line));
+            return false;
+        }
+    }
+
+    // Without cameras, each mesh is rendered once from its default view.
+    if (_cameras.isEmpty())
+        _cameras << -1;
+
+    if (_meshes.isEmpty() || _presets.isEmpty())
+    {
+        qWarning("%s: need at least one mesh and one preset",
+            qPrintable(filename));
+        return false;
+    }
+    return true;
+}
+
+bool BatchRenderer::parseLine( const QString& line, const QString& base_dir,
+                               int line_num )
+{
+    QDir dir(base_dir);
+    QString command = line.section(QRegExp("\\s+"), 0, 0);
+    QString rest = line.mid(command.length()).trimmed();
+    QStringList args = rest.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+
+    if (command == "size" && args.size() == 2)
+    {
+        bool ok_w, ok_h;
+        _width = args[0].toInt(&ok_w);
+        _height = args[1].toInt(&ok_h);
+        return ok_w && ok_h && _width > 0 && _height > 0;
+    }
+    else if (command == "output" && !rest.isEmpty())
+    {
+        _output_dir = QDir::cleanPath(dir.absoluteFilePath(rest)) + "/";
+        return QDir().mkpath(_output_dir);
+    }
+    else if (command == "mesh" && !rest.isEmpty())
+    {
+        _meshes << QDir::cleanPath(dir.absoluteFilePath(rest));
+        return true;
+    }
+    else if (command == "meshes" && !rest.isEmpty())
+    {
+        QFileInfo pattern(dir.absoluteFilePath(rest));
+        QDir mesh_dir = pattern.absoluteDir();
+        QStringList names = mesh_dir.entryList(
+            QStringList() << pattern.fileName(), QDir::Files, QDir::Name);
+        if (names.isEmpty())
+            qWarning("line %d: no files match %s", line_num, qPrintable(rest));
+        for (int i = 0; i < names.size(); i++)
+            _meshes << mesh_dir.absoluteFilePath(names[i]);
+        return true;
+    }
+    else if (command == "cameras" && !args.isEmpty())
+    {
+        for (int i = 0; i < args.size(); i++)
+        {
+            bool ok;
+            _cameras << args[i].toInt(&ok);
+            if (!ok)
+                return false;
+        }
+        return true;
+    }
+    else if (command == "preset" || command == "capture")
+    {
+        Preset preset;
+        preset.capture = (command == "capture");
+        int num_suffixes = preset.capture ? Rtsc::NUM_CAPTURE_BUFFERS : 1;
+        if (!parsePreset(args, rest, num_suffixes, line_num, preset))
+            return false;
+        _presets << preset;
+        return true;
+    }
+    return false;
+}
+
+bool BatchRenderer::parsePreset( const QStringList& args, const QString& rest,
+                                 int num_suffixes, int line_num,
+                                 Preset& preset )
+{
+    if (args.size() < num_suffixes)
+        return false;
+
+    // The dials follow the suffixes.
+    QString dial_string = rest;
+    for (int i = 0; i < num_suffixes; i++)
+    {
+        preset.suffixes << args[i];
+        dial_string = dial_string.mid(dial_string.indexOf(args[i]) +
+                                      args[i].length());
+    }
+
+    QStringList dials = dial_string.split(";", QString::SkipEmptyParts);
+    for (int i = 0; i < dials.size(); i++)
+    {
+        int equals = dials[i].indexOf('=');
+        if (equals < 0)
+            return false;
+        QString name = dials[i].left(equals).trimmed();
+        QString value = dials[i].mid(equals + 1).trimmed();
+        if (!dkValue::find(name))
+        {
+            qWarning("line %d: unknown dial %s", line_num, qPrintable(name));
+            return false;
+        }
+        preset.dials << qMakePair(name, value);
+    }
+    return true;
+}
+
+bool BatchRenderer::applyDial( const QString& name, const QString& value )
+{
+    if (dkBool* b = dkBool::find(name))
+        b->setValue(value == "true" || value == "1");
+    else if (dkInt* i = dkInt::find(name))
+        i->setValue(value.toInt());
+    else if (dkFloat* f = dkFloat::find(name))
+        f->setValue(value.toDouble());
+    else if (dkStringList* s = dkStringList::find(name))
+        s->setValue(value);
+    else if (dkFilename* fn = dkFilename::find(name))
+        fn->setValue(value);
+    else
+        return false;
+    return true;
+}
+
+void BatchRenderer::applyPreset( const Preset& preset )
+{
+    for (int i = 0; i < preset.dials.size(); i++)
+        applyDial(preset.dials[i].first, preset.dials[i].second);
+}
+
+// Everything any preset will draw gets precomputed with the mesh, so
+// nothing has to be computed on demand in the middle of the views.
+int BatchRenderer::requiredAttributes()
+{
+    int attributes = 0;
+    for (int i = 0; i < _presets.size(); i++)
+    {
+        applyPreset(_presets[i]);
+        attributes |= Rtsc::requiredAttributes();
+    }
+    return attributes;
+}
+
+SceneLoader* BatchRenderer::startLoading( int which, int attributes )
+{
+    SceneLoader* loader = new SceneLoader(_meshes[which], attributes, which);
+    loader->start();
+    return loader;
+}
+
+// Same view as GLViewer::resetView followed by setRandomCamera(seed).
+void BatchRenderer::setupCamera( qglviewer::Camera& camera, Scene* scene,
+                                 int seed )
+{
+    vec center;
+    float radius;
+    scene->boundingSphere(center, radius);
+
+    dkBool* perspective = dkBool::find("Camera->Perspective");
+    camera.setType(perspective && !*perspective ?
+        qglviewer::Camera::ORTHOGRAPHIC : qglviewer::Camera::PERSPECTIVE);
+    camera.setScreenWidthAndHeight(_width, _height);
+    camera.setSceneRadius(radius + radius*0.05);
+    camera.setSceneCenter(qglviewer::Vec(center[0], center[1], center[2]));
+    camera.setFieldOfView(3.1415926f / 6.0f);
+    camera.setZNearCoefficient(0.01f);
+    camera.setOrientation(0,0);
+    camera.showEntireScene();
+
+    if (seed >= 0)
+    {
+        qsrand(seed + 27644437);
+        float z = 2.0*(float)qrand()/(float)RAND_MAX - 1;
+        float theta = asinf(z);
+        float phi = 2.0*3.14159*(float)qrand()/(float)RAND_MAX;
+        camera.setOrientation(theta,phi);
+        camera.showEntireScene();
+    }
+}
+
+void BatchRenderer::renderView( qglviewer::Camera& camera, Scene* scene,
+                                bool capture )
+{
+    DialsAndKnobs::incrementFrameCounter();
+
+    _fbo.bind(GQ_CLEAR_BUFFER);
+    glViewport(0, 0, _width, _height);
+    camera.loadProjectionMatrix();
+    camera.loadModelViewMatrix();
+
+    scene->setCameraTransform(inv(xform(camera.frame()->matrix())));
+    scene->setLightDir(vec(camera.frame()->inverseTransformOf(
+        qglviewer::Vec(0,0,1))));
+    if (capture)
+        scene->drawSceneCapture();
+    else
+        scene->drawScene();
+
+    _fbo.unbind();
+}
+
+// PNGs are written without alpha: the clear color's is 0, which would
+// leave the background transparent. Float images keep all four channels.
+static int numChannels( const QString& filename )
+{
+    return filename.endsWith("png") ? 3 : 4;
+}
+
+void BatchRenderer::writeView( const QString& filename, int attachment )
+{
+    _images.readColorTexture(_fbo, attachment, filename,
+                             numChannels(filename));
+}
+
+// The view of renderView, or one attachment of its capture, on the CPU.
+void BatchRenderer::renderSoftware( qglviewer::Camera& camera, Scene* scene,
+                                    int capture_buffer )
+{
+    DialsAndKnobs::incrementFrameCounter();
+
+    double modelview[16], projection[16];
+    camera.getModelViewMatrix(modelview);
+    camera.getProjectionMatrix(projection);
+    _raster.setMatrices(xform(modelview), xform(projection));
+
+    scene->setCameraTransform(inv(xform(camera.frame()->matrix())));
+    scene->setLightDir(vec(camera.frame()->inverseTransformOf(
+        qglviewer::Vec(0,0,1))));
+    scene->drawSceneSoftware(_raster, capture_buffer);
+}
+
+void BatchRenderer::writeSoftware( const QString& filename )
+{
+    if (filename.endsWith("float") || filename.endsWith("pfm"))
+    {
+        GQFloatImage* image = new GQFloatImage();
+        _raster.readColor(*image);
+        _images.writeImage(image, filename);
+    }
+    else
+    {
+        GQImage* image = new GQImage();
+        _raster.readColor(*image, numChannels(filename));
+        _images.writeImage(image, filename);
+    }
+}
+
+// Timers of the same name (e.g. a line type drawn in two passes) are
+// added up.
+void BatchRenderer::recordViewStats()
+{
+    Stats& stats = Stats::instance();
+    stats.merge();
+
+    QHash<QString, float> view;
+    QStringList names;
+    for (int i = 0; i < stats.numTimers(); i++)
+    {
+        QString name = stats.timerName(i) + " (ms)";
+        if (!view.contains(name))
+            names << name;
+        view[name] += stats.timerValue(i) * 1000.0f;
+    }
+    for (int i = 0; i < stats.numCounters(); i++)
+    {
+        names << stats.counterName(i);
+        view[stats.counterName(i)] = stats.counterValue(i);
+    }
+
+    for (int i = 0; i < names.size(); i++)
+    {
+        if (!_stat_values.contains(names[i]))
+            _stat_names << names[i];
+        _stat_values[names[i]].append(view[names[i]]);
+    }
+}
+
+void BatchRenderer::printStats()
+{
+    for (int i = 0; i < _stat_names.size(); i++)
+    {
+        QVector<float> values = _stat_values[_stat_names[i]];
+        std::sort(values.begin(), values.end());
+        printf("    %-40s %12.2f median %12.2f max\n",
+            qPrintable(_stat_names[i]), values[(values.size() - 1) / 2],
+            values.last());
+    }
+    _stat_names.clear();
+    _stat_values.clear();
+}
+
+QString BatchRenderer::outputName( const QString& mesh, int camera,
+                                   const QString& suffix ) const
+{
+    QString name = _output_dir + QFileInfo(mesh).completeBaseName();
+    if (camera >= 0)
+        name += QString("_%1").arg(camera);
+    return name + "_" + suffix;
+}
+
+bool BatchRenderer::run()
+{
+    int num_attachments = 1;
+    for (int p = 0; p < _presets.size(); p++)
+        if (_presets[p].capture)
+            num_attachments = Rtsc::NUM_CAPTURE_BUFFERS;
+    if (_software)
+        _raster.resize(_width, _height);
+    else if (!_fbo.init(_width, _height, num_attachments, GQ_ATTACH_DEPTH))
+        return false;
+
+    qglviewer::Camera camera;
+    Scene* current = NULL;
+    int num_views = 0;
+    int num_failed = 0;
+    float load_wait = 0;
+
+    int attributes = requiredAttributes();
+
+    if (!_trace_file.isEmpty())
+        Stats::instance().startTrace();
+
+    timestamp start = now();
+    SceneLoader* next = startLoading(0, attributes);
+    for (int m = 0; m < _meshes.size(); m++)
+    {
+        timestamp wait_start = now();
+        SceneLoader* loader = next;
+        loader->wait();
+        load_wait += now() - wait_start;
+
+        // Read and precompute the next mesh while this one renders.
+        next = (m + 1 < _meshes.size()) ? startLoading(m + 1, attributes) : NULL;
+
+        if (!loader->succeeded())
+        {
+            qWarning("Could not load %s", qPrintable(_meshes[m]));
+            delete loader;
+            num_failed++;
+            continue;
+        }
+
+        Scene* scene = loader->takeScene();
+        scene->setupMesh(loader->takePrecomputeGraph());
+        delete loader;
+        if (current)
+        {
+            current->clear();
+            delete current;
+        }
+        current = scene;
+
+        // Dials saved with a .qrt scene apply first, then each preset.
+        QDomElement dials = current->dialsAndKnobsState().firstChildElement();
+        for (; !dials.isNull(); dials = dials.nextSiblingElement())
+        {
+            dkValue* value = dkValue::find(dials.attribute("name"));
+            if (value)
+                value->load(dials);
+        }
+
+        timestamp mesh_start = now();
+        Stats::instance().reset();
+        for (int c = 0; c < _cameras.size(); c++)
+        {
+            setupCamera(camera, current, _cameras[c]);
+            for (int p = 0; p < _presets.size(); p++)
+            {
+                const Preset& preset = _presets[p];
+                applyPreset(preset);
+                if (!_software)
+                    renderView(camera, current, preset.capture);
+                for (int i = 0; i < preset.suffixes.size(); i++)
+                {
+                    QString name = outputName(_meshes[m], _cameras[c],
+                        preset.suffixes[i]);
+                    if (_software)
+                    {
+                        renderSoftware(camera, current,
+                                       preset.capture ? i : -1);
+                        writeSoftware(name);
+                    }
+                    else
+                    {
+                        writeView(name, i);
+                    }
+                    num_views++;
+                }
+                if (!_software)
+                    _images.nextFrame();
+                if (_print_stats)
+                    recordViewStats();
+                Stats::instance().reset();
+            }
+        }
+        float mesh_time = now() - mesh_start;
+        int mesh_views = numViews() / _meshes.size();
+        printf("%s: %d views, %.2f views/sec\n",
+            qPrintable(QFileInfo(_meshes[m]).fileName()), mesh_views,
+            mesh_views / mesh_time);
+        if (_print_stats)
+            printStats();
+    }
+
+    _images.flush();
+    if (!_software)
+        _images.clear();
+    float total = now() - start;
+
+    printf("%d views of %d meshes in %.2f sec: %.2f views/sec "
+           "(%.2f sec waiting for meshes)\n", num_views,
+           _meshes.size() - num_failed, total, num_views / total, load_wait);
+
+    if (!_trace_file.isEmpty())
+    {
+        Stats::instance().stopTrace();
+        if (Stats::instance().writeTrace(_trace_file))
+            printf("Wrote trace to %s\n", qPrintable(_trace_file));
+    }
+
+    if (current)
+    {
+        current->clear();
+        delete current;
+    }
+    return num_failed == 0;
+}
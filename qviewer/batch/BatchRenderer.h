@@ -0,0 +1,125 @@
+/*****************************************************************************\
+
+BatchRenderer.h
+
+Renders a job list (meshes x cameras x dial presets) into an offscreen
+framebuffer object, without a window. The next mesh is read and
+precomputed on worker threads while the current one renders, and images
+are encoded and written on I/O threads.
+
+A job list is a text file with one command per line:
+
+    # comment
+    size 400 400
+    output /path/to/output/
+    mesh model.obj                  (or a .qrt scene)
+    meshes /path/to/models/*.obj
+    cameras 1 2 3                   (seeds, as in GLViewer::setRandomCamera)
+    preset l.png  Lines->Enable Lines=true; Style->Mesh Color=White
+    capture l.png n.pfm d.pfm  Lines->Enable Lines=true
+
+Each view is written to <output><mesh name>_<camera>_<preset suffix>, and
+the suffix's extension picks the format (png, pfm, ...). Relative paths
+are relative to the job list. A capture preset renders once into three
+color attachments (see Rtsc::redrawCapture) and writes the shaded image,
+the normals and the depth under its three suffixes.
+
+With setSoftware(true), views are drawn by SoftRaster instead, and no GL
+context or shaders are needed. A capture preset then takes three passes.
+
+With setPrintStats(true), the timers and counters of Stats are printed
+after each mesh, as the median and max over its views. With a trace
+file, the whole run is traced (see Stats::startTrace) and written there.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef BATCH_RENDERER_H_
+#define BATCH_RENDERER_H_
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QPair>
+#include <QHash>
+#include <QVector>
+
+#include "GQFramebufferObject.h"
+#include "GQReadbackQueue.h"
+#include "SoftRaster.h"
+
+class Scene;
+class SceneLoader;
+
+namespace qglviewer { class Camera; }
+
+class BatchRenderer
+{
+  public:
+    BatchRenderer();
+    ~BatchRenderer();
+
+    bool loadJobs( const QString& filename );
+    void setSize( int width, int height ) { _width = width; _height = height; }
+    void setNumWriterThreads( int num );
+    void setSoftware( bool software ) { _software = software; }
+    void setPrintStats( bool print ) { _print_stats = print; }
+    void setTraceFile( const QString& filename ) { _trace_file = filename; }
+
+    int numViews() const;
+
+    // Needs a current GL context with the shaders initialized, unless
+    // rendering in software.
+    bool run();
+
+  protected:
+    struct Preset
+    {
+        QStringList                     suffixes;
+        bool                            capture;
+        QList< QPair<QString,QString> > dials;
+    };
+
+    bool parseLine( const QString& line, const QString& base_dir, int line_num );
+    bool parsePreset( const QStringList& args, const QString& rest,
+                      int num_suffixes, int line_num, Preset& preset );
+    static bool applyDial( const QString& name, const QString& value );
+    void applyPreset( const Preset& preset );
+    int requiredAttributes();
+
+    SceneLoader* startLoading( int which, int attributes );
+    void setupCamera( qglviewer::Camera& camera, Scene* scene, int seed );
+    void renderView( qglviewer::Camera& camera, Scene* scene, bool capture );
+    void writeView( const QString& filename, int attachment );
+    void renderSoftware( qglviewer::Camera& camera, Scene* scene,
+                         int capture_buffer );
+    void writeSoftware( const QString& filename );
+    void recordViewStats();
+    void printStats();
+
+    QString outputName( const QString& mesh, int camera,
+                        const QString& suffix ) const;
+
+  protected:
+    QStringList     _meshes;
+    QList<int>      _cameras;
+    QList<Preset>   _presets;
+    QString         _output_dir;
+    int             _width;
+    int             _height;
+    bool            _software;
+    bool            _print_stats;
+    QString         _trace_file;
+
+    // Timer (in ms) and counter values of each view of the current mesh
+    QStringList                     _stat_names;
+    QHash< QString, QVector<float> > _stat_values;
+
+    GQFramebufferObject _fbo;
+    GQReadbackQueue     _images;
+    SoftRaster          _raster;
+};
+
+#endif // BATCH_RENDERER_H_
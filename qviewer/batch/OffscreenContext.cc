@@ -0,0 +1,208 @@
+/*****************************************************************************\
+
+OffscreenContext.cc
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "OffscreenContext.h"
+
+#ifdef LINUX
+
+// Keep Xlib out, its macros collide with Qt.
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <string.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+typedef EGLDisplay (*GetPlatformDisplayFunc)(EGLenum platform,
+    void* native_display, const EGLint* attrib_list);
+
+static bool hasExtension( const char* extensions, const char* name )
+{
+    if (!extensions)
+        return false;
+    int len = strlen(name);
+    const char* p = extensions;
+    while ((p = strstr(p, name)) != NULL)
+    {
+        if ((p == extensions || p[-1] == ' ') &&
+            (p[len] == ' ' || p[len] == '\0'))
+            return true;
+        p += len;
+    }
+    return false;
+}
+
+OffscreenContext::OffscreenContext()
+{
+    _display = EGL_NO_DISPLAY;
+    _context = EGL_NO_CONTEXT;
+    _surface = EGL_NO_SURFACE;
+}
+
+OffscreenContext::~OffscreenContext()
+{
+    destroy();
+}
+
+bool OffscreenContext::create()
+{
+    // Prefer the surfaceless platform, which needs no display server at
+    // all; otherwise take whatever the default display is.
+    EGLDisplay display = EGL_NO_DISPLAY;
+    const char* client_extensions =
+        eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(client_extensions, "EGL_MESA_platform_surfaceless"))
+    {
+        GetPlatformDisplayFunc get_platform_display =
+            (GetPlatformDisplayFunc)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display)
+            display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                           EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    {
+        _error = "Could not initialize an EGL display";
+        return false;
+    }
+    _display = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        _error = "EGL display does not support desktop OpenGL";
+        destroy();
+        return false;
+    }
+
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_NONE };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) ||
+        num_configs < 1)
+    {
+        _error = "No EGL config supports OpenGL with pbuffers";
+        destroy();
+        return false;
+    }
+
+    // The drawing code is fixed function, so leave the profile at the
+    // default (compatibility).
+    EGLContext context = eglCreateContext(display, config,
+                                          EGL_NO_CONTEXT, NULL);
+    if (context == EGL_NO_CONTEXT)
+    {
+        _error = "Could not create an EGL OpenGL context";
+        destroy();
+        return false;
+    }
+    _context = context;
+
+    // Everything is drawn into FBOs, so a surface is only made if the
+    // driver insists on one.
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (!hasExtension(extensions, "EGL_KHR_surfaceless_context"))
+    {
+        const EGLint pbuffer_attribs[] = {
+            EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+        if (surface == EGL_NO_SURFACE)
+        {
+            _error = "Could not create an EGL pbuffer";
+            destroy();
+            return false;
+        }
+        _surface = surface;
+    }
+
+    if (!eglMakeCurrent(display, surface, surface, context))
+    {
+        _error = "Could not make the EGL context current";
+        destroy();
+        return false;
+    }
+
+    _description = QString("EGL %1.%2 (%3), %4")
+        .arg(major).arg(minor)
+        .arg(eglQueryString(display, EGL_VENDOR))
+        .arg(surface == EGL_NO_SURFACE ? "surfaceless" : "pbuffer");
+    return true;
+}
+
+void OffscreenContext::destroy()
+{
+    if (_display == EGL_NO_DISPLAY)
+        return;
+
+    eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (_surface != EGL_NO_SURFACE)
+        eglDestroySurface(_display, _surface);
+    if (_context != EGL_NO_CONTEXT)
+        eglDestroyContext(_display, _context);
+    eglTerminate(_display);
+
+    _display = EGL_NO_DISPLAY;
+    _context = EGL_NO_CONTEXT;
+    _surface = EGL_NO_SURFACE;
+}
+
+#else // !LINUX
+
+#include <QGLPixelBuffer>
+
+OffscreenContext::OffscreenContext()
+{
+    _pbuffer = NULL;
+}
+
+OffscreenContext::~OffscreenContext()
+{
+    destroy();
+}
+
+bool OffscreenContext::create()
+{
+    if (!QGLPixelBuffer::hasOpenGLPbuffers())
+    {
+        _error = "No pbuffer support";
+        return false;
+    }
+
+    _pbuffer = new QGLPixelBuffer(QSize(16, 16));
+    if (!_pbuffer->isValid() || !_pbuffer->makeCurrent())
+    {
+        _error = "Could not make a pbuffer context current";
+        destroy();
+        return false;
+    }
+
+    _description = "QGLPixelBuffer";
+    return true;
+}
+
+void OffscreenContext::destroy()
+{
+    if (_pbuffer)
+        _pbuffer->doneCurrent();
+    delete _pbuffer;
+    _pbuffer = NULL;
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*****************************************************************************\
+
+OffscreenContext.h
+
+An OpenGL context with no window, for rendering into framebuffer objects.
+Under Linux this is an EGL context, made current without a surface when
+the driver allows it (e.g. Mesa's surfaceless platform, which also runs
+on the llvmpipe software rasterizer), so no X server is needed. Elsewhere
+it falls back to a small QGLPixelBuffer.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef OFFSCREEN_CONTEXT_H_
+#define OFFSCREEN_CONTEXT_H_
+
+#include <QString>
+
+class QGLPixelBuffer;
+
+class OffscreenContext
+{
+  public:
+    OffscreenContext();
+    ~OffscreenContext();
+
+    // Creates the context and makes it current. Returns false, with
+    // the reason in errorString(), if no context could be made.
+    bool create();
+    void destroy();
+
+    const QString& description() const { return _description; }
+    const QString& errorString() const { return _error; }
+
+  protected:
+    QString         _description;
+    QString         _error;
+
+#ifdef LINUX
+    void*           _display;
+    void*           _context;
+    void*           _surface;
+#else
+    QGLPixelBuffer* _pbuffer;
+#endif
+};
+
+#endif // OFFSCREEN_CONTEXT_H_
@@ -0,0 +1,72 @@
+CONFIG += debug_and_release
+
+CONFIG(release, debug|release) {
+	DBGNAME = release
+}
+else {
+	DBGNAME = debug
+}
+DESTDIR = $${DBGNAME}
+
+win32 {
+    TEMPLATE = vcapp
+    UNAME = Win32
+}
+else {
+    TEMPLATE = app
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+    macx {
+        DEFINES += DARWIN
+        UNAME = Darwin
+        CONFIG -= app_bundle
+        LIBS += -framework CoreFoundation
+    }
+    else {
+        DEFINES += LINUX
+        UNAME = Linux
+        LIBS += -lEGL
+    }
+}
+
+TRIMESH = trimesh
+
+QT += opengl xml script
+TARGET = qrtsc_batch
+
+PRE_TARGETDEPS += ../../libgq/$${DBGNAME}/libgq.a
+DEPENDPATH += ../../libgq/include
+INCLUDEPATH += ../../libgq/include
+LIBS += -L../../libgq/$${DBGNAME} -lgq
+
+PRE_TARGETDEPS += ../../demoutils/$${DBGNAME}/libdemoutils.a
+DEPENDPATH += ../../demoutils/include
+INCLUDEPATH += ../../demoutils/include
+LIBS += -L../../demoutils/$${DBGNAME} -ldemoutils
+
+PRE_TARGETDEPS += ../../trimesh2/$${DBGNAME}/libtrimesh.a
+DEPENDPATH += ../../trimesh2/include
+INCLUDEPATH += ../../trimesh2/include
+LIBS += -L../../trimesh2/$${DBGNAME} -l$${TRIMESH}
+
+PRE_TARGETDEPS += ../../qglviewer/$${DBGNAME}/libqglviewer.a
+DEPENDPATH += ../../qglviewer
+INCLUDEPATH += ../../qglviewer 
+LIBS += -L../../qglviewer/$${DBGNAME} -lqglviewer
+DEFINES += QGLVIEWER_STATIC
+
+# The renderer itself is shared with qrtsc.
+DEPENDPATH += ../src
+INCLUDEPATH += ../src
+
+# Input
+HEADERS += *.h
+HEADERS += ../src/Rtsc.h ../src/Scene.h ../src/SceneLoader.h ../src/GLViewer.h
+HEADERS += ../src/LineSet.h ../src/SoftRaster.h ../src/LineSimplifier.h
+HEADERS += ../src/ReferenceLines.h
+HEADERS += ../src/SessionRecorder.h ../src/SessionPlayer.h
+SOURCES += *.cc
+SOURCES += ../src/Rtsc.cc ../src/Scene.cc ../src/SceneLoader.cc ../src/GLViewer.cc
+SOURCES += ../src/apparentridge.cc ../src/SoftRaster.cc ../src/LineSimplifier.cc
+SOURCES += ../src/ReferenceLines.cc
+SOURCES += ../src/SessionRecorder.cc ../src/SessionPlayer.cc
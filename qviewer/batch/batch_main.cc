@@ -0,0 +1,155 @@
+/*****************************************************************************\
+
+batch_main.cc
+
+qrtsc_batch: renders a job list without opening a window. See
+BatchRenderer.h for the job list format.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "GQInclude.h"
+#include "GQShaderManager.h"
+
+#include <QApplication>
+#include <QString>
+#include <QStringList>
+#include <QDir>
+#include <QFileInfo>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "OffscreenContext.h"
+#include "BatchRenderer.h"
+
+static void printUsage( const char* myname )
+{
+    fprintf(stderr, "\n Usage    : %s [options] jobfile\n", myname);
+    fprintf(stderr, " Options  :\n");
+    fprintf(stderr, "   -size WxH       Override the image size in the job file\n");
+    fprintf(stderr, "   -shaders dir    Directory containing programs.xml\n");
+    fprintf(stderr, "   -writers n      Number of image writer threads (default 2)\n");
+    fprintf(stderr, "   -software       Render on the CPU, without OpenGL\n");
+    fprintf(stderr, "   -stats          Print the timers and counters of each mesh\n");
+    fprintf(stderr, "   -trace file     Write a trace of the timers and counters\n");
+    fprintf(stderr, "                   (.json for chrome://tracing, otherwise CSV)\n");
+    exit(1);
+}
+
+static bool findShadersDirectory( const QString& app_path, QDir& shaders_dir )
+{
+    QStringList candidates;
+    candidates << QDir::cleanPath(app_path)
+    << QDir::cleanPath(app_path + "/../")
+    << QDir::cleanPath(app_path + "/../../")
+    << QDir::cleanPath(QDir::currentPath() + "/../")
+    << QDir::currentPath();
+
+    for (int i = 0; i < candidates.size(); i++)
+    {
+        if (QFileInfo(candidates[i] + "/shaders/programs.xml").exists()) {
+            shaders_dir = QDir(candidates[i] + "/shaders");
+            return true;
+        }
+    }
+
+    fprintf(stderr, "Could not find shaders/programs.xml. Tried:\n");
+    for (int i = 0; i < candidates.size(); i++)
+        fprintf(stderr, "  %s/shaders/programs.xml\n", qPrintable(candidates[i]));
+    return false;
+}
+
+int main( int argc, char** argv )
+{
+#ifdef LINUX
+    // No connection to a display server; the context comes from EGL.
+    QApplication app(argc, argv, false);
+#else
+    QApplication app(argc, argv);
+#endif
+
+    QString job_file;
+    QString shaders_path;
+    int width = 0, height = 0;
+    int num_writers = 0;
+    bool software = false;
+    bool print_stats = false;
+    QString trace_file;
+
+    QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-size" && i+1 < args.size()) {
+            QStringList dims = args[++i].split("x");
+            if (dims.size() != 2)
+                printUsage(argv[0]);
+            width = dims[0].toInt();
+            height = dims[1].toInt();
+        } else if (args[i] == "-shaders" && i+1 < args.size()) {
+            shaders_path = args[++i];
+        } else if (args[i] == "-writers" && i+1 < args.size()) {
+            num_writers = args[++i].toInt();
+        } else if (args[i] == "-software") {
+            software = true;
+        } else if (args[i] == "-stats") {
+            print_stats = true;
+        } else if (args[i] == "-trace" && i+1 < args.size()) {
+            trace_file = args[++i];
+        } else if (!args[i].startsWith("-") && job_file.isEmpty()) {
+            job_file = args[i];
+        } else {
+            printUsage(argv[0]);
+        }
+    }
+    if (job_file.isEmpty())
+        printUsage(argv[0]);
+
+    BatchRenderer renderer;
+    if (!renderer.loadJobs(job_file))
+        return 1;
+    if (width > 0 && height > 0)
+        renderer.setSize(width, height);
+    if (num_writers > 0)
+        renderer.setNumWriterThreads(num_writers);
+    renderer.setPrintStats(print_stats);
+    renderer.setTraceFile(trace_file);
+
+    if (software)
+    {
+        renderer.setSoftware(true);
+        printf("Software renderer, %d views\n", renderer.numViews());
+        return renderer.run() ? 0 : 1;
+    }
+
+    QDir shaders_dir(shaders_path);
+    if (shaders_path.isEmpty() &&
+        !findShadersDirectory(app.applicationDirPath(), shaders_dir))
+        return 1;
+    GQShaderManager::setShaderDirectory(shaders_dir);
+
+    OffscreenContext context;
+    if (!context.create())
+    {
+        fprintf(stderr, "%s\n", qPrintable(context.errorString()));
+        return 1;
+    }
+    printf("%s: %s\n", qPrintable(context.description()),
+        (const char*)glGetString(GL_RENDERER));
+
+    GQShaderManager::initialize();
+    if (GQShaderManager::status() != GQ_SHADERS_OK)
+    {
+        fprintf(stderr, "Could not load shaders from %s\n",
+            qPrintable(shaders_dir.absolutePath()));
+        return 1;
+    }
+
+    printf("%d views\n", renderer.numViews());
+    bool ok = renderer.run();
+
+    GQShaderManager::deinitialize();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,463 @@
+/*****************************************************************************\
+
+FrameBenchmark.cc
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "FrameBenchmark.h"
+#include "Rtsc.h"
+#include "SessionPlayer.h"
+#include "DialsAndKnobs.h"
+#include "TaskGraph.h"
+#include "Stats.h"
+#include "MemoryStats.h"
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "timestamp.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+
+#include <qglviewer.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Short names for the line type dials, for setLineTypes()
+static const struct { const char* name; const char* dial; } line_types[] = {
+    { "sil",  "Lines->Silhouette" },
+    { "c",    "Lines->Occluding Contours" },
+    { "sc",   "Lines->Suggestive Contours" },
+    { "sh",   "Lines->Suggestive Highlights" },
+    { "phr",  "Lines->Principal Hlt. (R)" },
+    { "phv",  "Lines->Principal Hlt. (V)" },
+    { "r",    "Lines->Ridges" },
+    { "v",    "Lines->Valleys" },
+    { "ar",   "Lines->Apparent Ridges" },
+    { "k",    "Lines->K" },
+    { "h",    "Lines->H" },
+    { "dwkr", "Lines->DwKr" },
+    { "bdy",  "Lines->Boundary" },
+    { "iso",  "Lines->Isophotes" },
+    { "topo", "Lines->Topo Lines" },
+};
+static const int num_line_types = sizeof(line_types) / sizeof(line_types[0]);
+
+FrameBenchmark::FrameBenchmark()
+{
+    _mesh = NULL;
+    _frames = 100;
+    _warmup = 5;
+    _seed = 0;
+    _width = 800;
+    _height = 800;
+    _threads = 0;
+    _hermite = false;
+    _hidden = false;
+    _session = NULL;
+    _precompute_seconds = 0;
+    _extract_seconds = 0;
+    _total_segments = 0;
+}
+
+FrameBenchmark::~FrameBenchmark()
+{
+    delete _session;
+    if (_mesh)
+    {
+        Rtsc::releaseMesh(_mesh);
+        delete _mesh;
+    }
+}
+
+bool FrameBenchmark::loadMesh( const QString& filename )
+{
+    _mesh = TriMesh::read(qPrintable(filename));
+    _mesh_name = QFileInfo(filename).fileName();
+    return _mesh != NULL;
+}
+
+bool FrameBenchmark::makeMesh( const QString& shape, int faces,
+                               unsigned seed )
+{
+    if (shape == "icosphere")
+        _mesh = make_icosphere(faces);
+    else if (shape == "torus")
+        _mesh = make_torus(faces);
+    else if (shape == "superquadric")
+        _mesh = make_superquadric(faces, 0.3f, 0.3f);
+    else if (shape == "noisysphere")
+        _mesh = make_noisy_sphere(faces, seed);
+    else if (shape == "rangegrid")
+        _mesh = make_range_grid(faces, seed);
+    else
+        return false;
+
+    _mesh_name = QString("%1_%2_%3").arg(shape).arg(faces).arg(seed);
+    return true;
+}
+
+bool FrameBenchmark::loadSession( const QString& filename )
+{
+    delete _session;
+    _session = new SessionPlayer;
+    if (!_session->load(filename))
+    {
+        delete _session;
+        _session = NULL;
+        return false;
+    }
+    _session_name = QFileInfo(filename).fileName();
+    _frames = _session->numFrames();
+    _width = _session->width();
+    _height = _session->height();
+    return true;
+}
+
+QString FrameBenchmark::sessionScene() const
+{
+    return _session ? _session->sceneName() : QString();
+}
+
+QStringList FrameBenchmark::lineTypeNames()
+{
+    QStringList names;
+    for (int i = 0; i < num_line_types; i++)
+        names << line_types[i].name;
+    return names;
+}
+
+bool FrameBenchmark::setLineTypes( const QString& types )
+{
+    if (types != "all")
+    {
+        QStringList valid = lineTypeNames();
+        QStringList names = types.split(",", QString::SkipEmptyParts);
+        for (int i = 0; i < names.size(); i++)
+        {
+            if (!valid.contains(names[i]))
+            {
+                qWarning("Unknown line type %s", qPrintable(names[i]));
+                return false;
+            }
+        }
+    }
+    _line_types = types;
+    return true;
+}
+
+// Every frame is extracted in full, on this thread
+static void extractInForeground()
+{
+    dkBool* background = dkBool::find("Lines->Extract in Background");
+    if (background)
+        background->setValue(false);
+    dkFloat* target_fps = dkFloat::find("Style->Target FPS");
+    if (target_fps)
+        target_fps->setValue(0.0);
+}
+
+void FrameBenchmark::applyDials()
+{
+    if (!_line_types.isEmpty())
+    {
+        QStringList names = _line_types.split(",", QString::SkipEmptyParts);
+        for (int i = 0; i < num_line_types; i++)
+        {
+            dkBool* dial = dkBool::find(line_types[i].dial);
+            if (dial)
+                dial->setValue(_line_types == "all" ||
+                               names.contains(line_types[i].name));
+        }
+    }
+
+    if (!_session)
+    {
+        dkBool* hermite = dkBool::find("Style->Use Hermite");
+        if (hermite)
+            hermite->setValue(_hermite);
+        dkBool* hidden = dkBool::find("Tests->Draw Hidden Lines");
+        if (hidden)
+            hidden->setValue(_hidden);
+    }
+
+    extractInForeground();
+}
+
+// The view of GLViewer::resetView followed by setRandomCamera(_seed), as
+// in BatchRenderer::setupCamera, turned about the vertical axis by the
+// frame's share of a full circle.
+void FrameBenchmark::setupCamera( qglviewer::Camera& camera, int frame )
+{
+    _mesh->need_bsphere();
+    const point& center = _mesh->bsphere.center;
+    float radius = _mesh->bsphere.r;
+
+    dkBool* perspective = dkBool::find("Camera->Perspective");
+    camera.setType(perspective && !*perspective ?
+        qglviewer::Camera::ORTHOGRAPHIC : qglviewer::Camera::PERSPECTIVE);
+    camera.setScreenWidthAndHeight(_width, _height);
+    camera.setSceneRadius(radius + radius*0.05);
+    camera.setSceneCenter(qglviewer::Vec(center[0], center[1], center[2]));
+    camera.setFieldOfView(3.1415926f / 6.0f);
+    camera.setZNearCoefficient(0.01f);
+
+    qsrand(_seed + 27644437);
+    float z = 2.0*(float)qrand()/(float)RAND_MAX - 1;
+    float theta = asinf(z);
+    float phi = 2.0*3.14159*(float)qrand()/(float)RAND_MAX;
+    theta += 2.0f * 3.14159f * frame / std::max(_frames, 1);
+    camera.setOrientation(theta, phi);
+    camera.showEntireScene();
+}
+
+// The session's camera, light and dials at the frame. The warmup frames
+// are the first frames of the session, which then starts over.
+void FrameBenchmark::setupSessionFrame( qglviewer::Camera& camera,
+                                        qglviewer::Frame& light, int frame )
+{
+    if (frame == -_warmup || frame == 0 || _session->atEnd())
+    {
+        _session->start(&camera, &light);
+        applyDials();
+    }
+    _session->nextFrame(&camera, &light);
+    extractInForeground();
+
+    dkBool* perspective = dkBool::find("Camera->Perspective");
+    camera.setType(perspective && !*perspective ?
+        qglviewer::Camera::ORTHOGRAPHIC : qglviewer::Camera::PERSPECTIVE);
+    camera.setScreenWidthAndHeight(_session->frameWidth(),
+                                   _session->frameHeight());
+}
+
+// Adds the timers and counters of the frame, summed by name, as
+// BatchRenderer::recordViewStats does.
+void FrameBenchmark::recordFrame( float frame_ms )
+{
+    Stats& stats = Stats::instance();
+    stats.merge();
+
+    QHash<QString, float> timers;
+    timers["Frame"] = frame_ms;
+    for (int i = 0; i < stats.numTimers(); i++)
+        timers[stats.timerName(i)] += stats.timerValue(i) * 1000.0f;
+
+    QHashIterator<QString, float> it(timers);
+    while (it.hasNext())
+    {
+        it.next();
+        if (!_timer_values.contains(it.key()))
+            _timer_names << it.key();
+        _timer_values[it.key()].append(it.value());
+    }
+
+    for (int i = 0; i < stats.numCounters(); i++)
+    {
+        const QString& name = stats.counterName(i);
+        if (!_counter_values.contains(name))
+            _counter_names << name;
+        _counter_values[name].append(stats.counterValue(i));
+        if (name == "Line Segments")
+            _total_segments += stats.counterValue(i);
+    }
+}
+
+bool FrameBenchmark::run()
+{
+    if (!_mesh)
+        return false;
+
+    applyDials();
+#ifdef _OPENMP
+    if (_threads > 0)
+        omp_set_num_threads(_threads);
+#endif
+
+    // Rtsc::initialize, with the precompute graph at hand to read its times
+    TaskGraph* precompute = Rtsc::makePrecomputeGraph(_mesh,
+        Rtsc::requiredAttributes());
+    if (_threads > 0)
+        precompute->setMaxThreadCount(_threads);
+    precompute->run();
+    for (int i = 0; i < precompute->numTasks(); i++)
+    {
+        if (!precompute->taskFinished(i))
+            continue;
+        const QString& name = precompute->taskName(i);
+        _precompute_names << name;
+        _precompute_ms[name] = (precompute->taskFinish(i) -
+                                precompute->taskStart(i)) * 1000.0f;
+    }
+    _precompute_seconds = precompute->totalTime();
+    Rtsc::setMesh(_mesh, precompute);
+
+    // The light turns with the camera, as GLViewer's light frame does
+    qglviewer::Camera camera;
+    qglviewer::Frame light;
+    light.setReferenceFrame(camera.frame());
+    Stats::instance().clear();
+    for (int frame = -_warmup; frame < _frames; frame++)
+    {
+        DialsAndKnobs::incrementFrameCounter();
+        if (_session)
+            setupSessionFrame(camera, light, frame);
+        else
+            setupCamera(camera, frame);
+        Rtsc::setCameraTransform(inv(xform(camera.frame()->matrix())));
+        Rtsc::setLightDir(vec(light.inverseTransformOf(
+            qglviewer::Vec(0,0,1))));
+
+        MemoryStats frame_memory;
+        timestamp start = now();
+        Rtsc::extractLinesOnly();
+        float seconds = now() - start;
+
+        if (frame >= 0)
+        {
+            _extract_seconds += seconds;
+            frame_memory.recordFrame(Stats::instance());
+            recordFrame(seconds * 1000.0f);
+        }
+        Stats::instance().reset();
+    }
+    return true;
+}
+
+static QString jsonString( const QString& str )
+{
+    QString out = str;
+    out.replace("\\", "\\\\");
+    out.replace("\"", "\\\"");
+    return "\"" + out + "\"";
+}
+
+QString FrameBenchmark::reportJSON() const
+{
+    QString json;
+    QTextStream out(&json);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+
+    out << "{\n";
+    out << "  \"mesh\": " << jsonString(_mesh_name) << ",\n";
+    out << "  \"vertices\": " << (int)_mesh->vertices.size() << ",\n";
+    out << "  \"faces\": " << (int)_mesh->faces.size() << ",\n";
+    if (_session)
+        out << "  \"session\": " << jsonString(_session_name) << ",\n";
+    out << "  \"frames\": " << _frames << ",\n";
+    out << "  \"warmup\": " << _warmup << ",\n";
+    out << "  \"seed\": " << _seed << ",\n";
+    out << "  \"threads\": " << _threads << ",\n";
+    out << "  \"line_types\": " <<
+        jsonString(_line_types.isEmpty() ? "default" : _line_types) << ",\n";
+    out << "  \"hermite\": " << (_hermite ? "true" : "false") << ",\n";
+    out << "  \"hidden_lines\": " << (_hidden ? "true" : "false") << ",\n";
+
+    out << "  \"precompute_ms\": {";
+    QString separator = "\n";
+    for (int i = 0; i < _precompute_names.size(); i++)
+    {
+        out << separator << "    " << jsonString(_precompute_names[i])
+            << ": " << _precompute_ms[_precompute_names[i]];
+        separator = ",\n";
+    }
+    out << "\n  },\n";
+    out << "  \"precompute_wall_ms\": " << _precompute_seconds * 1000.0f
+        << ",\n";
+
+    // Mean, median and 95th percentile, as in Stats::summarize
+    out << "  \"timers_ms\": {";
+    separator = "\n";
+    for (int i = 0; i < _timer_names.size(); i++)
+    {
+        QVector<float> values = _timer_values[_timer_names[i]];
+        std::sort(values.begin(), values.end());
+        int n = values.size();
+        double sum = 0;
+        for (int j = 0; j < n; j++)
+            sum += values[j];
+        out << separator << "    " << jsonString(_timer_names[i])
+            << ": { \"mean\": " << sum / n
+            << ", \"p50\": " << values[(n-1) / 2]
+            << ", \"p95\": " << values[(int)ceilf(0.95f * n) - 1]
+            << ", \"frames\": " << n << " }";
+        separator = ",\n";
+    }
+    out << "\n  },\n";
+
+    out << "  \"counters_mean\": {";
+    separator = "\n";
+    for (int i = 0; i < _counter_names.size(); i++)
+    {
+        const QVector<float>& values = _counter_values[_counter_names[i]];
+        double sum = 0;
+        for (int j = 0; j < values.size(); j++)
+            sum += values[j];
+        out << separator << "    " << jsonString(_counter_names[i])
+            << ": " << sum / values.size();
+        separator = ",\n";
+    }
+    out << "\n  },\n";
+    out << "  \"counts_allocations\": " <<
+        (MemoryStats::countsAllocations() ? "true" : "false") << ",\n";
+
+    // Bytes of each attribute and buffer, and how many of those are
+    // spare capacity or heap overhead
+    std::vector<Rtsc::MemoryUse> memory;
+    Rtsc::memoryUse(memory);
+    out << "  \"memory\": {";
+    separator = "\n";
+    for (size_t i = 0; i < memory.size(); i++)
+    {
+        QString name = QString("%1/%2").arg(memory[i].group)
+                                       .arg(memory[i].name);
+        out << separator << "    " << jsonString(name)
+            << ": { \"bytes\": " << (qulonglong)memory[i].bytes
+            << ", \"overhead\": " << (qulonglong)memory[i].overhead << " }";
+        separator = ",\n";
+    }
+    out << "\n  },\n";
+
+    double seconds = std::max(_extract_seconds, 1e-6f);
+    out << "  \"segments_per_sec\": " << _total_segments / seconds << ",\n";
+    out << "  \"vertices_per_sec\": " <<
+        double(_mesh->vertices.size()) * _frames / seconds << ",\n";
+    out << "  \"current_rss_kb\": " << (qlonglong)MemoryStats::currentRSS()
+        << ",\n";
+    out << "  \"peak_rss_kb\": " << (qlonglong)MemoryStats::peakRSS() << "\n";
+    out << "}\n";
+    out.flush();
+    return json;
+}
+
+bool FrameBenchmark::writeReport( const QString& filename ) const
+{
+    if (!_mesh)
+        return false;
+
+    QString json = reportJSON();
+    if (filename.isEmpty())
+    {
+        printf("%s", qPrintable(json));
+        return true;
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qWarning("Could not open %s", qPrintable(filename));
+        return false;
+    }
+    file.write(json.toUtf8());
+    return true;
+}
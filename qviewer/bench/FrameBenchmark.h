@@ -0,0 +1,115 @@
+/*****************************************************************************\
+
+FrameBenchmark.h
+
+Measures the line extraction of qrtsc, without a display or OpenGL. A
+mesh (read from a file, or made by one of the trimesh2 generators) is
+precomputed with Rtsc's precompute graph. Then compute_perview and the
+line extraction run once per frame (Rtsc::extractLinesOnly) along a
+camera orbit. The orbit starts at the view that
+GLViewer::setRandomCamera(seed) gives and turns once around the vertical
+axis over the frames, so each frame has a new view and the run is
+repeatable. With a session recorded in qrtsc (see SessionRecorder), the
+frames are instead those of the session: its cameras, light and dial
+changes, played back with SessionPlayer.
+
+The report is JSON. For each Stats timer, it gives the mean, median and
+95th percentile in ms over the frames. For each counter, it gives the
+mean; these include the allocations each frame makes (see MemoryStats).
+It also gives the precompute times, segments and vertices per second of
+extraction, the memory of each mesh attribute and engine buffer at the
+end of the run (see Rtsc::memoryUse), and the resident set size.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef FRAME_BENCHMARK_H_
+#define FRAME_BENCHMARK_H_
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+
+class TriMesh;
+class SessionPlayer;
+
+namespace qglviewer { class Camera; class Frame; }
+
+class FrameBenchmark
+{
+  public:
+    FrameBenchmark();
+    ~FrameBenchmark();
+
+    bool loadMesh( const QString& filename );
+    // A mesh of about this many faces from the generators in
+    // TriMesh_algo.h, named as mesh_make names them: icosphere, torus,
+    // superquadric, noisysphere or rangegrid. False for another name.
+    bool makeMesh( const QString& shape, int faces, unsigned seed );
+    // Replaces the orbit, the frame count and the screen size. The dials
+    // start as recorded; setLineTypes() still overrides the line types,
+    // but setHermite() and setHiddenLines() are ignored.
+    bool loadSession( const QString& filename );
+    // The scene the session was recorded with
+    QString sessionScene() const;
+
+    void setFrames( int frames ) { _frames = frames; }
+    // Frames extracted before the measured ones, not reported
+    void setWarmup( int frames ) { _warmup = frames; }
+    void setSeed( int seed ) { _seed = seed; }
+    void setSize( int width, int height ) { _width = width; _height = height; }
+    // OpenMP threads and precompute threads. 0 leaves the defaults.
+    void setThreads( int threads ) { _threads = threads; }
+    // Comma separated short names (see lineTypeNames()), or "all". Types
+    // not listed are turned off. Returns false for an unknown name.
+    bool setLineTypes( const QString& types );
+    void setHermite( bool hermite ) { _hermite = hermite; }
+    void setHiddenLines( bool hidden ) { _hidden = hidden; }
+
+    static QStringList lineTypeNames();
+
+    bool run();
+    // To stdout if the filename is empty
+    bool writeReport( const QString& filename ) const;
+
+  protected:
+    void applyDials();
+    void setupCamera( qglviewer::Camera& camera, int frame );
+    void setupSessionFrame( qglviewer::Camera& camera,
+                            qglviewer::Frame& light, int frame );
+    void recordFrame( float frame_ms );
+
+    QString reportJSON() const;
+
+  protected:
+    TriMesh*        _mesh;
+    QString         _mesh_name;
+    int             _frames;
+    int             _warmup;
+    int             _seed;
+    int             _width;
+    int             _height;
+    int             _threads;
+    QString         _line_types;
+    bool            _hermite;
+    bool            _hidden;
+    SessionPlayer*  _session;
+    QString         _session_name;
+
+    // Timer (in ms) and counter values of each measured frame, by name
+    QStringList                     _timer_names;
+    QHash< QString, QVector<float> > _timer_values;
+    QStringList                     _counter_names;
+    QHash< QString, QVector<float> > _counter_values;
+    QStringList                     _precompute_names;
+    QHash< QString, float >         _precompute_ms;
+
+    float           _precompute_seconds;
+    float           _extract_seconds;
+    double          _total_segments;
+};
+
+#endif // FRAME_BENCHMARK_H_
@@ -0,0 +1,76 @@
+CONFIG += debug_and_release
+
+CONFIG(release, debug|release) {
+	DBGNAME = release
+}
+else {
+	DBGNAME = debug
+}
+DESTDIR = $${DBGNAME}
+
+win32 {
+    TEMPLATE = vcapp
+    UNAME = Win32
+}
+else {
+    TEMPLATE = app
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+    macx {
+        DEFINES += DARWIN
+        UNAME = Darwin
+        CONFIG -= app_bundle
+        LIBS += -framework CoreFoundation
+    }
+    else {
+        DEFINES += LINUX
+        UNAME = Linux
+    }
+}
+
+TRIMESH = trimesh
+
+QT += opengl xml script
+TARGET = qrtsc_bench
+
+PRE_TARGETDEPS += ../../libgq/$${DBGNAME}/libgq.a
+DEPENDPATH += ../../libgq/include
+INCLUDEPATH += ../../libgq/include
+LIBS += -L../../libgq/$${DBGNAME} -lgq
+
+PRE_TARGETDEPS += ../../demoutils/$${DBGNAME}/libdemoutils.a
+DEPENDPATH += ../../demoutils/include
+INCLUDEPATH += ../../demoutils/include
+LIBS += -L../../demoutils/$${DBGNAME} -ldemoutils
+
+PRE_TARGETDEPS += ../../trimesh2/$${DBGNAME}/libtrimesh.a
+DEPENDPATH += ../../trimesh2/include
+INCLUDEPATH += ../../trimesh2/include
+LIBS += -L../../trimesh2/$${DBGNAME} -l$${TRIMESH}
+
+PRE_TARGETDEPS += ../../qglviewer/$${DBGNAME}/libqglviewer.a
+DEPENDPATH += ../../qglviewer
+INCLUDEPATH += ../../qglviewer 
+LIBS += -L../../qglviewer/$${DBGNAME} -lqglviewer
+DEFINES += QGLVIEWER_STATIC
+
+# The line extraction is shared with qrtsc. Nothing here is drawn, but
+# Rtsc.cc still links against OpenGL.
+DEPENDPATH += ../src
+INCLUDEPATH += ../src
+
+# Input
+HEADERS += *.h
+HEADERS += ../src/Rtsc.h ../src/LineSet.h ../src/SoftRaster.h ../src/LineSimplifier.h
+HEADERS += ../src/ReferenceLines.h
+HEADERS += ../src/SessionPlayer.h
+SOURCES += *.cc
+SOURCES += ../src/Rtsc.cc ../src/apparentridge.cc ../src/SoftRaster.cc ../src/LineSimplifier.cc
+SOURCES += ../src/ReferenceLines.cc
+SOURCES += ../src/SessionPlayer.cc
+
+# Count the allocations of each frame. MemoryStats.cc is compiled here, with
+# the define, so its operator new is the one linked; the copy in demoutils
+# is never pulled in.
+DEFINES += DEMOUTILS_ALLOCATION_COUNTS
+SOURCES += ../../demoutils/libsrc/MemoryStats.cc
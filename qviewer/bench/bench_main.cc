@@ -0,0 +1,128 @@
+/*****************************************************************************\
+
+bench_main.cc
+
+qrtsc_bench: times the line extraction along a camera orbit, without a
+display, and reports per-stage times as JSON. See FrameBenchmark.h.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include <QApplication>
+#include <QString>
+#include <QStringList>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FrameBenchmark.h"
+
+static void printUsage( const char* myname )
+{
+    fprintf(stderr, "\n Usage    : %s [options] mesh\n", myname);
+    fprintf(stderr, "            %s [options] -make shape faces\n", myname);
+    fprintf(stderr, "            %s [options] -session file [mesh]\n", myname);
+    fprintf(stderr, " Options  :\n");
+    fprintf(stderr, "   -make shape n   Generated mesh of about n faces instead of a file, as\n");
+    fprintf(stderr, "                   made by trimesh2's mesh_make (icosphere, torus,\n");
+    fprintf(stderr, "                   superquadric, noisysphere, rangegrid)\n");
+    fprintf(stderr, "   -meshseed n     Seed of the generated mesh (default 1)\n");
+    fprintf(stderr, "   -session file   Frames of a session recorded in qrtsc instead of the\n");
+    fprintf(stderr, "                   orbit, with its dials. The mesh defaults to the\n");
+    fprintf(stderr, "                   session's, when that isn't a scene file.\n");
+    fprintf(stderr, "   -frames n       Frames along the orbit (default 100)\n");
+    fprintf(stderr, "   -warmup n       Unmeasured frames first (default 5)\n");
+    fprintf(stderr, "   -seed n         Camera seed, as in setRandomCamera (default 0)\n");
+    fprintf(stderr, "   -size WxH       Screen size of the camera (default 800x800)\n");
+    fprintf(stderr, "   -threads n      OpenMP and precompute threads\n");
+    fprintf(stderr, "   -lines a,b,...  Line types to extract, or \"all\". Others are off.\n");
+    fprintf(stderr, "                   (%s)\n",
+            qPrintable(FrameBenchmark::lineTypeNames().join(",")));
+    fprintf(stderr, "   -hermite        Hermite interpolation of the lines on\n");
+    fprintf(stderr, "   -hidden         Extract hidden lines too\n");
+    fprintf(stderr, "   -o file         Write the JSON report there (default stdout)\n");
+    exit(1);
+}
+
+int main( int argc, char** argv )
+{
+    // No display and no OpenGL: only the extraction is measured.
+    QApplication app(argc, argv, false);
+
+    QString mesh_file;
+    QString report_file;
+    QString shape;
+    QString session_file;
+    int shape_faces = 0;
+    unsigned mesh_seed = 1;
+    FrameBenchmark bench;
+
+    QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-make" && i+2 < args.size()) {
+            shape = args[++i];
+            shape_faces = args[++i].toInt();
+        } else if (args[i] == "-meshseed" && i+1 < args.size()) {
+            mesh_seed = args[++i].toUInt();
+        } else if (args[i] == "-session" && i+1 < args.size()) {
+            session_file = args[++i];
+        } else if (args[i] == "-frames" && i+1 < args.size()) {
+            bench.setFrames(args[++i].toInt());
+        } else if (args[i] == "-warmup" && i+1 < args.size()) {
+            bench.setWarmup(args[++i].toInt());
+        } else if (args[i] == "-seed" && i+1 < args.size()) {
+            bench.setSeed(args[++i].toInt());
+        } else if (args[i] == "-size" && i+1 < args.size()) {
+            QStringList dims = args[++i].split("x");
+            if (dims.size() != 2)
+                printUsage(argv[0]);
+            bench.setSize(dims[0].toInt(), dims[1].toInt());
+        } else if (args[i] == "-threads" && i+1 < args.size()) {
+            bench.setThreads(args[++i].toInt());
+        } else if (args[i] == "-lines" && i+1 < args.size()) {
+            if (!bench.setLineTypes(args[++i]))
+                printUsage(argv[0]);
+        } else if (args[i] == "-hermite") {
+            bench.setHermite(true);
+        } else if (args[i] == "-hidden") {
+            bench.setHiddenLines(true);
+        } else if (args[i] == "-o" && i+1 < args.size()) {
+            report_file = args[++i];
+        } else if (!args[i].startsWith("-") && mesh_file.isEmpty()) {
+            mesh_file = args[i];
+        } else {
+            printUsage(argv[0]);
+        }
+    }
+    if (!session_file.isEmpty())
+    {
+        if (!bench.loadSession(session_file))
+        {
+            fprintf(stderr, "Could not load %s\n", qPrintable(session_file));
+            return 1;
+        }
+        QString scene = bench.sessionScene();
+        if (mesh_file.isEmpty() && shape.isEmpty() && !scene.endsWith(".qrt"))
+            mesh_file = scene;
+    }
+    if (mesh_file.isEmpty() == shape.isEmpty())
+        printUsage(argv[0]);
+
+    if (!shape.isEmpty())
+    {
+        if (!bench.makeMesh(shape, shape_faces, mesh_seed))
+            printUsage(argv[0]);
+    }
+    else if (!bench.loadMesh(mesh_file))
+    {
+        fprintf(stderr, "Could not load %s\n", qPrintable(mesh_file));
+        return 1;
+    }
+
+    if (!bench.run())
+        return 1;
+    return bench.writeReport(report_file) ? 0 : 1;
+}
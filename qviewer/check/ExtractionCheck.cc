@@ -0,0 +1,359 @@
+/*****************************************************************************\
+
+ExtractionCheck.cc
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "ExtractionCheck.h"
+#include "LineCompare.h"
+#include "LineSet.h"
+#include "Rtsc.h"
+#include "DialsAndKnobs.h"
+#include "TaskGraph.h"
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "timestamp.h"
+
+#include <qglviewer.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// The line types of Rtsc::extractForCheck, in its order, with the
+// short names of FrameBenchmark and the dial that turns each one on
+static const struct { const char* name; const char* dial; } check_types[] = {
+    { "c",   "Lines->Occluding Contours" },
+    { "sc",  "Lines->Suggestive Contours" },
+    { "sh",  "Lines->Suggestive Highlights" },
+    { "r",   "Lines->Ridges" },
+    { "v",   "Lines->Valleys" },
+    { "phr", "Lines->Principal Hlt. (R)" },
+    { "phv", "Lines->Principal Hlt. (V)" },
+    { "ar",  "Lines->Apparent Ridges" },
+};
+static const int num_check_types = Rtsc::NUM_CHECK_TYPES;
+
+// Lines that aren't checked, turned off to save time
+static const char* unchecked_dials[] = {
+    "Lines->Silhouette", "Lines->K", "Lines->H", "Lines->DwKr",
+    "Lines->Boundary", "Lines->Isophotes", "Lines->Topo Lines",
+};
+static const int num_unchecked_dials =
+    sizeof(unchecked_dials) / sizeof(unchecked_dials[0]);
+
+// Dials the extraction reads, each set to a random value per case
+static const char* random_bools[] = {
+    "Style->Use Hermite", "Style->Draw Faded", "Tests->Trim SH",
+    "Tests->Trim PH", "Tests->Trim RV", "Tests->Trim AR",
+};
+static const int num_random_bools =
+    sizeof(random_bools) / sizeof(random_bools[0]);
+static const struct { const char* dial; float max; } random_floats[] = {
+    { "Tests->SC Thresh", 0.1f },
+    { "Tests->SH Thresh", 0.1f },
+    { "Tests->PH Thresh", 0.2f },
+    { "Tests->RV Thresh", 0.3f },
+    { "Tests->AR Thresh", 0.3f },
+};
+static const int num_random_floats =
+    sizeof(random_floats) / sizeof(random_floats[0]);
+
+static const char* shapes[] = {
+    "icosphere", "torus", "superquadric", "noisysphere", "rangegrid" };
+static const int num_shapes = sizeof(shapes) / sizeof(shapes[0]);
+
+// In [0,1], from the generator qsrand seeded for the case
+static float randomFloat()
+{
+    return (float)qrand() / (float)RAND_MAX;
+}
+
+static void setBool( const char* name, bool value )
+{
+    dkBool* dial = dkBool::find(name);
+    if (dial)
+        dial->setValue(value);
+}
+
+static void setFloat( const char* name, float value )
+{
+    dkFloat* dial = dkFloat::find(name);
+    if (dial)
+        dial->setValue(value);
+}
+
+ExtractionCheck::ExtractionCheck()
+{
+    _mesh = NULL;
+    _cases = 50;
+    _only_case = -1;
+    _views = 4;
+    _seed = 1;
+    _max_faces = 20000;
+    _threads = 0;
+    _position_tolerance = 1e-3f;
+    _alpha_tolerance = 1e-3f;
+    _check_type.fill(true, num_check_types);
+    _views_checked.fill(0, num_check_types);
+    _segments.fill(0, num_check_types);
+    _disagreements.fill(0, num_check_types);
+    _seconds.fill(0, num_check_types);
+    _reference_seconds.fill(0, num_check_types);
+    _attribute_failures = 0;
+}
+
+ExtractionCheck::~ExtractionCheck()
+{
+    if (_mesh)
+    {
+        Rtsc::releaseMesh(_mesh);
+        delete _mesh;
+    }
+}
+
+QStringList ExtractionCheck::typeNames()
+{
+    QStringList names;
+    for (int i = 0; i < num_check_types; i++)
+        names << check_types[i].name;
+    return names;
+}
+
+bool ExtractionCheck::setTypes( const QString& types )
+{
+    if (types == "all")
+    {
+        _check_type.fill(true);
+        return true;
+    }
+
+    QStringList valid = typeNames();
+    QStringList names = types.split(",", QString::SkipEmptyParts);
+    _check_type.fill(false);
+    for (int i = 0; i < names.size(); i++)
+    {
+        int type = valid.indexOf(names[i]);
+        if (type < 0)
+        {
+            qWarning("Unknown line type %s", qPrintable(names[i]));
+            return false;
+        }
+        _check_type[type] = true;
+    }
+    return true;
+}
+
+// A new mesh and dial settings, from the seed and the case number
+void ExtractionCheck::setupCase( int which )
+{
+    qsrand(_seed * 7919 + which);
+    int shape = qrand() % num_shapes;
+    int faces = 1000 + qrand() % std::max(_max_faces - 999, 1);
+    unsigned mesh_seed = qrand();
+    float e1 = 0.2f + 1.8f * randomFloat();
+    float e2 = 0.2f + 1.8f * randomFloat();
+
+    TriMesh* mesh = NULL;
+    switch (shape)
+    {
+        case 0: mesh = make_icosphere(faces); break;
+        case 1: mesh = make_torus(faces, 0.1f + 0.4f * randomFloat()); break;
+        case 2: mesh = make_superquadric(faces, e1, e2); break;
+        case 3: mesh = make_noisy_sphere(faces, mesh_seed); break;
+        default: mesh = make_range_grid(faces, mesh_seed); break;
+    }
+    _case_name = QString("%1 %2 faces, seed %3").arg(shapes[shape])
+        .arg(faces).arg(mesh_seed);
+
+    // The checked lines on, so the per-view arrays they need are computed
+    for (int i = 0; i < num_check_types; i++)
+        setBool(check_types[i].dial, _check_type[i]);
+    for (int i = 0; i < num_unchecked_dials; i++)
+        setBool(unchecked_dials[i], false);
+    for (int i = 0; i < num_random_bools; i++)
+        setBool(random_bools[i], qrand() % 2);
+    for (int i = 0; i < num_random_floats; i++)
+        setFloat(random_floats[i].dial, random_floats[i].max * randomFloat());
+    setBool("Tests->Draw Hidden Lines", false);
+    setBool("Lines->Extract in Background", false);
+    setFloat("Style->Target FPS", 0.0f);
+
+    TaskGraph* precompute = Rtsc::makePrecomputeGraph(mesh,
+        Rtsc::requiredAttributes());
+    if (_threads > 0)
+        precompute->setMaxThreadCount(_threads);
+    precompute->run();
+    Rtsc::setMesh(mesh, precompute);
+
+    delete _mesh;
+    _mesh = mesh;
+}
+
+// A random view of the whole mesh, as GLViewer::setRandomCamera gives,
+// with a perspective or an orthographic camera
+void ExtractionCheck::setupCamera( qglviewer::Camera& camera )
+{
+    _mesh->need_bsphere();
+    const point& center = _mesh->bsphere.center;
+    float radius = _mesh->bsphere.r;
+
+    camera.setType(randomFloat() < 0.5f ?
+        qglviewer::Camera::ORTHOGRAPHIC : qglviewer::Camera::PERSPECTIVE);
+    camera.setScreenWidthAndHeight(800, 800);
+    camera.setSceneRadius(radius + radius*0.05);
+    camera.setSceneCenter(qglviewer::Vec(center[0], center[1], center[2]));
+    camera.setFieldOfView(3.1415926f / 6.0f);
+    camera.setZNearCoefficient(0.01f);
+
+    float z = 2.0f * randomFloat() - 1.0f;
+    float theta = asinf(z);
+    float phi = 2.0f * 3.14159f * randomFloat();
+    camera.setOrientation(theta, phi);
+    camera.showEntireScene();
+}
+
+void ExtractionCheck::checkView( int which, int view )
+{
+    Rtsc::extractLinesOnly();
+
+    LineCompare compare(_mesh);
+    compare.setTolerance(_position_tolerance, _alpha_tolerance);
+    for (int type = 0; type < num_check_types; type++)
+    {
+        if (!_check_type[type])
+            continue;
+
+        LineSet lines, reference;
+        timestamp start = now();
+        bool ok = Rtsc::extractForCheck(type, false, lines);
+        float seconds = now() - start;
+        start = now();
+        ok = ok && Rtsc::extractForCheck(type, true, reference);
+        float reference_seconds = now() - start;
+        if (!ok)
+            continue;
+
+        _views_checked[type]++;
+        _segments[type] += reference.numSegments();
+        _seconds[type] += seconds;
+        _reference_seconds[type] += reference_seconds;
+
+        compare.compare(reference, lines);
+        if (compare.agree())
+            continue;
+
+        _disagreements[type]++;
+        printf("case %d view %d %s (%s): %d matched, %d moved, "
+               "%d missing, %d extra; max distance %g, max alpha %g\n",
+               which, view, check_types[type].name, qPrintable(_case_name),
+               compare.numMatched(), compare.numMoved(),
+               compare.numMissing(), compare.numExtra(),
+               compare.maxDistance(), compare.maxAlphaError());
+        for (int i = 0; i < compare.examples().size(); i++)
+            printf("    %s\n", qPrintable(compare.examples()[i]));
+        fflush(stdout);
+    }
+}
+
+// The curvature derivatives, freed with only the curvatures needed, then
+// computed again for the ridges
+void ExtractionCheck::checkFreedAttributes( int which )
+{
+    _mesh->need_dcurv();
+    std::vector< Vec<4,float> > dcurv = _mesh->dcurv;
+
+    for (int i = 0; i < num_check_types; i++)
+        setBool(check_types[i].dial, false);
+    setBool("Lines->Principal Hlt. (R)", true);
+    Rtsc::freeUnneededAttributes();
+    bool freed = _mesh->dcurv.empty() && !_mesh->curv1.empty();
+
+    setBool("Lines->Ridges", true);
+    Rtsc::extractLinesOnly();
+
+    int differing = 0;
+    if (_mesh->dcurv.size() != dcurv.size())
+        differing = (int) dcurv.size();
+    else
+        for (size_t i = 0; i < dcurv.size(); i++)
+            for (int j = 0; j < 4; j++)
+                if (fabs(_mesh->dcurv[i][j] - dcurv[i][j]) >
+                    1e-4f * (1.0f + fabs(dcurv[i][j])))
+                {
+                    differing++;
+                    break;
+                }
+    if (!freed || differing)
+    {
+        _attribute_failures++;
+        printf("case %d (%s): dcurv %s, %d of %d vertices differ "
+               "after computing it again\n", which, qPrintable(_case_name),
+               freed ? "freed" : "not freed", differing, (int) dcurv.size());
+        fflush(stdout);
+    }
+
+    for (int i = 0; i < num_check_types; i++)
+        setBool(check_types[i].dial, _check_type[i]);
+}
+
+bool ExtractionCheck::run()
+{
+#ifdef _OPENMP
+    if (_threads > 0)
+        omp_set_num_threads(_threads);
+#endif
+    TriMesh::set_verbose(0);
+
+    int first = 0, last = _cases;
+    if (_only_case >= 0)
+    {
+        first = _only_case;
+        last = _only_case + 1;
+    }
+
+    qglviewer::Camera camera;
+    for (int which = first; which < last; which++)
+    {
+        setupCase(which);
+        for (int view = 0; view < _views; view++)
+        {
+            DialsAndKnobs::incrementFrameCounter();
+            setupCamera(camera);
+            Rtsc::setCameraTransform(inv(xform(camera.frame()->matrix())));
+            Rtsc::setLightDir(vec(camera.frame()->inverseTransformOf(
+                qglviewer::Vec(0,0,1))));
+            checkView(which, view);
+        }
+        checkFreedAttributes(which);
+    }
+
+    for (int type = 0; type < num_check_types; type++)
+        if (_disagreements[type])
+            return false;
+    return _attribute_failures == 0;
+}
+
+void ExtractionCheck::printSummary() const
+{
+    printf("\n%-5s %7s %10s %13s %10s %14s %8s\n", "type", "views",
+           "segments", "disagreeing", "ms", "reference ms", "speedup");
+    for (int type = 0; type < num_check_types; type++)
+    {
+        if (!_check_type[type])
+            continue;
+        double ms = 1000.0 * _seconds[type];
+        double reference_ms = 1000.0 * _reference_seconds[type];
+        printf("%-5s %7d %10d %13d %10.2f %14.2f %8.2f\n",
+               check_types[type].name, _views_checked[type],
+               _segments[type], _disagreements[type], ms, reference_ms,
+               ms > 0.0 ? reference_ms / ms : 0.0);
+    }
+    printf("\nfreed attributes: %d cases failed\n", _attribute_failures);
+}
@@ -0,0 +1,94 @@
+/*****************************************************************************\
+
+ExtractionCheck.h
+
+Checks the line extraction of qrtsc against the reference copy of it in
+ReferenceLines, on random cases, without a display or OpenGL. Each case
+is a mesh from one of the trimesh2 generators, of random shape, size and
+seed, and random settings of the dials the extraction reads (Hermite
+interpolation, fading, the trims and their thresholds). Each case is
+viewed from a few random cameras. For each view, every checked line type
+is extracted both ways (Rtsc::extractForCheck) and the segments compared
+with LineCompare. Both extractions are timed, so a faster extraction can
+be measured against the reference in the same run.
+
+After its views, each case also frees the attributes that lines needing
+only the curvatures don't use (Rtsc::freeUnneededAttributes), turns on
+ridges, and checks that the curvature derivatives computed again match
+the ones freed.
+
+A case is set up from the run's seed and its number alone, so a failing
+case can be rerun by itself with setOnlyCase().
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef EXTRACTION_CHECK_H_
+#define EXTRACTION_CHECK_H_
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class TriMesh;
+
+namespace qglviewer { class Camera; }
+
+class ExtractionCheck
+{
+  public:
+    ExtractionCheck();
+    ~ExtractionCheck();
+
+    void setCases( int cases ) { _cases = cases; }
+    void setOnlyCase( int which ) { _only_case = which; }
+    void setViews( int views ) { _views = views; }
+    void setSeed( unsigned seed ) { _seed = seed; }
+    // Meshes have from 1000 up to this many faces
+    void setMaxFaces( int faces ) { _max_faces = faces; }
+    void setThreads( int threads ) { _threads = threads; }
+    // See LineCompare::setTolerance
+    void setTolerance( float position, float alpha )
+        { _position_tolerance = position; _alpha_tolerance = alpha; }
+    // Comma separated short names (see typeNames()), or "all". Returns
+    // false for an unknown name.
+    bool setTypes( const QString& types );
+
+    static QStringList typeNames();
+
+    // Prints each disagreement as it is found. False if there were any.
+    bool run();
+    // Segments, disagreements and time of each line type, both ways
+    void printSummary() const;
+
+  protected:
+    void setupCase( int which );
+    void setupCamera( qglviewer::Camera& camera );
+    void checkView( int which, int view );
+    void checkFreedAttributes( int which );
+
+  protected:
+    TriMesh*        _mesh;
+    QString         _case_name;
+    int             _cases;
+    int             _only_case;
+    int             _views;
+    unsigned        _seed;
+    int             _max_faces;
+    int             _threads;
+    float           _position_tolerance;
+    float           _alpha_tolerance;
+    QVector<bool>   _check_type;
+
+    // Totals by line type
+    QVector<int>    _views_checked;
+    QVector<int>    _segments;
+    QVector<int>    _disagreements;
+    QVector<double> _seconds;
+    QVector<double> _reference_seconds;
+    int             _attribute_failures;
+};
+
+#endif // EXTRACTION_CHECK_H_
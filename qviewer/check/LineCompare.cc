@@ -0,0 +1,251 @@
+/*****************************************************************************\
+
+LineCompare.cc
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "LineCompare.h"
+#include "LineSet.h"
+#include "TriMesh.h"
+
+#include <algorithm>
+#include <math.h>
+
+// Endpoints whose barycentric coordinate is within this of zero are on
+// the edge opposite that vertex
+static const float edge_epsilon = 1e-4f;
+// Inside the face rather than on an edge
+static const int INSIDE = 3;
+static const int max_examples = 5;
+
+bool LineCompare::Segment::operator<( const Segment& other ) const
+{
+    for (int i = 0; i < 3; i++)
+        if (v[i] != other.v[i])
+            return v[i] < other.v[i];
+    return index < other.index;
+}
+
+bool LineCompare::Segment::sameFace( const Segment& other ) const
+{
+    return v[0] == other.v[0] && v[1] == other.v[1] && v[2] == other.v[2];
+}
+
+QString LineCompare::Segment::name() const
+{
+    return QString("segment %1 on face %2 %3 %4")
+        .arg(index).arg(v[0]).arg(v[1]).arg(v[2]);
+}
+
+LineCompare::LineCompare( TriMesh* mesh )
+{
+    _mesh = mesh;
+    _feature_size = mesh->feature_size();
+    _position_tolerance = 1e-3f;
+    _alpha_tolerance = 1e-3f;
+    _matched = _moved = _missing = _extra = 0;
+    _max_distance = _max_alpha_error = 0;
+}
+
+void LineCompare::setTolerance( float position, float alpha )
+{
+    _position_tolerance = position;
+    _alpha_tolerance = alpha;
+}
+
+// The index in v of the vertex opposite the edge p lies on, or INSIDE
+int LineCompare::edgeOf( const int v[3], const point& p ) const
+{
+    const point& a = _mesh->vertices[v[0]];
+    const point& b = _mesh->vertices[v[1]];
+    const point& c = _mesh->vertices[v[2]];
+    vec n = (b - a) CROSS (c - a);
+    float n2 = len2(n);
+    if (n2 == 0.0f)
+        return INSIDE;
+
+    float w[3] = { (((c - b) CROSS (p - b)) DOT n) / n2,
+                   (((a - c) CROSS (p - c)) DOT n) / n2,
+                   (((b - a) CROSS (p - a)) DOT n) / n2 };
+    int nearest = 0;
+    for (int i = 1; i < 3; i++)
+        if (fabs(w[i]) < fabs(w[nearest]))
+            nearest = i;
+    return fabs(w[nearest]) < edge_epsilon ? nearest : INSIDE;
+}
+
+void LineCompare::collect( const LineSet& lines,
+                           QVector<Segment>& segments ) const
+{
+    segments.resize(lines.numSegments());
+    for (int i = 0; i < segments.size(); i++)
+    {
+        Segment& s = segments[i];
+        for (int j = 0; j < 3; j++)
+            s.v[j] = lines.faces[i][j];
+        std::sort(s.v, s.v + 3);
+        s.edge[0] = edgeOf(s.v, lines.vertices[2*i]);
+        s.edge[1] = edgeOf(s.v, lines.vertices[2*i+1]);
+        s.index = i;
+    }
+    std::sort(segments.begin(), segments.end());
+}
+
+void LineCompare::addExample( const QString& example )
+{
+    if (_examples.size() < max_examples)
+        _examples << example;
+}
+
+// Largest endpoint distance and alpha difference of segment i of a and
+// segment j of b, with b's endpoints swapped if flip
+static void difference( const LineSet& a, int i, const LineSet& b, int j,
+                        bool flip, float& distance, float& alpha )
+{
+    distance = alpha = 0;
+    for (int k = 0; k < 2; k++)
+    {
+        int ka = 2*i + k, kb = 2*j + (flip ? 1 - k : k);
+        distance = std::max(distance, dist(a.vertices[ka], b.vertices[kb]));
+        alpha = std::max(alpha,
+                         (float) fabs(a.colors[ka][3] - b.colors[kb][3]));
+    }
+}
+
+// The closest unused segment of tst[j0..j1) to r, if there is one. With
+// same_edges, only those with their endpoints on the same edges as r's.
+bool LineCompare::closest( const LineSet& reference, const Segment& r,
+                           const LineSet& test, const QVector<Segment>& tst,
+                           int j0, int j1, const QVector<bool>& used,
+                           bool same_edges, int& best, float& best_distance,
+                           float& best_alpha ) const
+{
+    best = -1;
+    best_distance = best_alpha = 0;
+    for (int j = j0; j < j1; j++)
+    {
+        const Segment& t = tst[j];
+        if (used[j])
+            continue;
+        for (int flip = 0; flip < 2; flip++)
+        {
+            if (same_edges && (r.edge[0] != t.edge[flip] ||
+                               r.edge[1] != t.edge[1-flip]))
+                continue;
+            float distance, alpha;
+            difference(reference, r.index, test, t.index, flip,
+                       distance, alpha);
+            if (best < 0 || distance < best_distance)
+            {
+                best = j;
+                best_distance = distance;
+                best_alpha = alpha;
+            }
+        }
+    }
+    return best >= 0;
+}
+
+bool LineCompare::compare( const LineSet& reference, const LineSet& test )
+{
+    _matched = _moved = _missing = _extra = 0;
+    _max_distance = _max_alpha_error = 0;
+    _examples.clear();
+    if ((int) reference.faces.size() != reference.numSegments() ||
+        (int) test.faces.size() != test.numSegments())
+        return false;
+
+    QVector<Segment> ref, tst;
+    collect(reference, ref);
+    collect(test, tst);
+    QVector<bool> used(tst.size(), false);
+
+    // Walk the two lists a face at a time
+    int j0 = 0;
+    for (int i0 = 0; i0 < ref.size(); )
+    {
+        int i1 = i0 + 1;
+        while (i1 < ref.size() && ref[i1].sameFace(ref[i0]))
+            i1++;
+        while (j0 < tst.size() && tst[j0] < ref[i0] &&
+               !tst[j0].sameFace(ref[i0]))
+        {
+            _extra++;
+            addExample("extra " + tst[j0].name());
+            j0++;
+        }
+        int j1 = j0;
+        while (j1 < tst.size() && tst[j1].sameFace(ref[i0]))
+            j1++;
+
+        // Each reference segment takes the closest test segment with its
+        // endpoints on the same edges. Those left over take the closest
+        // one left on the face, as moved.
+        QVector<int> unmatched;
+        for (int i = i0; i < i1; i++)
+        {
+            int best;
+            float distance, alpha;
+            if (closest(reference, ref[i], test, tst, j0, j1, used, true,
+                        best, distance, alpha))
+            {
+                used[best] = true;
+                distance /= _feature_size;
+                _max_distance = std::max(_max_distance, distance);
+                _max_alpha_error = std::max(_max_alpha_error, alpha);
+                if (distance <= _position_tolerance &&
+                    alpha <= _alpha_tolerance)
+                {
+                    _matched++;
+                    continue;
+                }
+                _moved++;
+                addExample(QString("moved %1: distance %2, alpha %3")
+                    .arg(ref[i].name()).arg(distance).arg(alpha));
+            }
+            else
+            {
+                unmatched.append(i);
+            }
+        }
+        for (int k = 0; k < unmatched.size(); k++)
+        {
+            const Segment& r = ref[unmatched[k]];
+            int best;
+            float distance, alpha;
+            if (closest(reference, r, test, tst, j0, j1, used, false,
+                        best, distance, alpha))
+            {
+                used[best] = true;
+                _moved++;
+                addExample(QString("moved %1 off its edges: distance %2")
+                    .arg(r.name()).arg(distance / _feature_size));
+            }
+            else
+            {
+                _missing++;
+                addExample("missing " + r.name());
+            }
+        }
+
+        for (int j = j0; j < j1; j++)
+        {
+            if (used[j])
+                continue;
+            _extra++;
+            addExample("extra " + tst[j].name());
+        }
+        i0 = i1;
+        j0 = j1;
+    }
+
+    for (int j = j0; j < tst.size(); j++)
+    {
+        _extra++;
+        addExample("extra " + tst[j].name());
+    }
+    return true;
+}
@@ -0,0 +1,92 @@
+/*****************************************************************************\
+
+LineCompare.h
+
+Compares two extractions of the same lines, segment by segment, when
+both recorded the face of each segment (LineSet::recordFaces). Segments
+are matched within a face by the mesh edge (or the inside of the face)
+each endpoint lies on, in either direction, so the order of segments
+and of their endpoints doesn't matter. Matched segments must also agree
+in position and alpha to within a tolerance; those that don't, and
+those left over on a face that has segments in both sets, are counted
+as moved.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef LINE_COMPARE_H_
+#define LINE_COMPARE_H_
+
+#include <QStringList>
+#include <QVector>
+
+#include "Vec.h"
+
+class TriMesh;
+class LineSet;
+
+class LineCompare
+{
+  public:
+    LineCompare( TriMesh* mesh );
+
+    // Position tolerance as a fraction of the mesh's feature size, and
+    // alpha tolerance. The defaults are 1e-3 for both.
+    void setTolerance( float position, float alpha );
+
+    // False if either set lacks its faces
+    bool compare( const LineSet& reference, const LineSet& test );
+
+    int numMatched() const { return _matched; }
+    int numMoved() const { return _moved; }
+    int numMissing() const { return _missing; }   // Only in reference
+    int numExtra() const { return _extra; }       // Only in test
+    bool agree() const { return _moved + _missing + _extra == 0; }
+
+    // Largest differences among the segments matched, distance as a
+    // fraction of the feature size
+    float maxDistance() const { return _max_distance; }
+    float maxAlphaError() const { return _max_alpha_error; }
+
+    // The first few differences, one per line
+    const QStringList& examples() const { return _examples; }
+
+  protected:
+    struct Segment
+    {
+        int     v[3];       // Face, sorted
+        int     edge[2];    // Of each endpoint, see edgeOf()
+        int     index;
+
+        bool operator<( const Segment& other ) const;
+        bool sameFace( const Segment& other ) const;
+        QString name() const;
+    };
+
+    void collect( const LineSet& lines, QVector<Segment>& segments ) const;
+    int edgeOf( const int v[3], const point& p ) const;
+    bool closest( const LineSet& reference, const Segment& r,
+                  const LineSet& test, const QVector<Segment>& tst,
+                  int j0, int j1, const QVector<bool>& used,
+                  bool same_edges, int& best, float& best_distance,
+                  float& best_alpha ) const;
+    void addExample( const QString& example );
+
+  protected:
+    TriMesh*    _mesh;
+    float       _feature_size;
+    float       _position_tolerance;
+    float       _alpha_tolerance;
+
+    int         _matched;
+    int         _moved;
+    int         _missing;
+    int         _extra;
+    float       _max_distance;
+    float       _max_alpha_error;
+    QStringList _examples;
+};
+
+#endif // LINE_COMPARE_H_
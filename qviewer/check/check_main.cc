@@ -0,0 +1,80 @@
+/*****************************************************************************\
+
+check_main.cc
+
+qrtsc_check: checks the line extraction against the reference copy of
+it on random meshes, cameras and dials, and times both. See
+ExtractionCheck.h.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include <QApplication>
+#include <QString>
+#include <QStringList>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ExtractionCheck.h"
+
+static void printUsage( const char* myname )
+{
+    fprintf(stderr, "\n Usage    : %s [options]\n", myname);
+    fprintf(stderr, " Options  :\n");
+    fprintf(stderr, "   -cases n        Random cases (default 50)\n");
+    fprintf(stderr, "   -case n         Only case n, e.g. to rerun a failure\n");
+    fprintf(stderr, "   -views n        Random cameras per case (default 4)\n");
+    fprintf(stderr, "   -seed n         Seed of the run (default 1)\n");
+    fprintf(stderr, "   -faces n        Most faces of a mesh (default 20000)\n");
+    fprintf(stderr, "   -threads n      OpenMP and precompute threads\n");
+    fprintf(stderr, "   -lines a,b,...  Line types to check, or \"all\" (default)\n");
+    fprintf(stderr, "                   (%s)\n",
+            qPrintable(ExtractionCheck::typeNames().join(",")));
+    fprintf(stderr, "   -tol d a        Tolerance in position, as a fraction of\n");
+    fprintf(stderr, "                   the feature size, and in alpha\n");
+    fprintf(stderr, "                   (default 0.001 0.001)\n");
+    fprintf(stderr, " Exits with 1 if any extraction disagrees with the reference.\n");
+    exit(2);
+}
+
+int main( int argc, char** argv )
+{
+    // No display and no OpenGL: only the extraction is checked.
+    QApplication app(argc, argv, false);
+
+    ExtractionCheck check;
+
+    QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-cases" && i+1 < args.size()) {
+            check.setCases(args[++i].toInt());
+        } else if (args[i] == "-case" && i+1 < args.size()) {
+            check.setOnlyCase(args[++i].toInt());
+        } else if (args[i] == "-views" && i+1 < args.size()) {
+            check.setViews(args[++i].toInt());
+        } else if (args[i] == "-seed" && i+1 < args.size()) {
+            check.setSeed(args[++i].toUInt());
+        } else if (args[i] == "-faces" && i+1 < args.size()) {
+            check.setMaxFaces(args[++i].toInt());
+        } else if (args[i] == "-threads" && i+1 < args.size()) {
+            check.setThreads(args[++i].toInt());
+        } else if (args[i] == "-lines" && i+1 < args.size()) {
+            if (!check.setTypes(args[++i]))
+                printUsage(argv[0]);
+        } else if (args[i] == "-tol" && i+2 < args.size()) {
+            float position = args[++i].toFloat();
+            float alpha = args[++i].toFloat();
+            check.setTolerance(position, alpha);
+        } else {
+            printUsage(argv[0]);
+        }
+    }
+
+    bool agree = check.run();
+    check.printSummary();
+    return agree ? 0 : 1;
+}
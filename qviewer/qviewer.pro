@@ -68,3 +68,9 @@ DEFINES += QGLVIEWER_STATIC
 HEADERS += src/*.h
 SOURCES += src/*.cc
 
+# Debug builds count the allocations of each frame, as bench.pro does
+CONFIG(debug, debug|release) {
+    DEFINES += DEMOUTILS_ALLOCATION_COUNTS
+    SOURCES += ../demoutils/libsrc/MemoryStats.cc
+}
+
@@ -0,0 +1,19 @@
+/*****************************************************************************\
+
+capture.frag
+
+Renders the shaded polygons, the normals and the depth in one pass, into
+three color attachments. The attachments match Rtsc::CAPTURE_SHADED,
+CAPTURE_NORMALS and CAPTURE_DEPTH.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+void main()
+{
+    gl_FragData[0] = shade();
+    gl_FragData[1] = normalsColor();
+    gl_FragData[2] = depthColor();
+}
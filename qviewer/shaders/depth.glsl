@@ -0,0 +1,29 @@
+/*****************************************************************************\
+
+depth.glsl
+
+Camera depth, scaled so the bounding sphere spans [0,1] (near is 1).
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+uniform vec3 bsphere_center;
+uniform float bsphere_radius;
+
+vec4 depthColor()
+{
+    vec4 cam_bsphere_center = gl_ModelViewMatrix * vec4(bsphere_center, 1);
+    float cam_far_z = cam_bsphere_center.z - bsphere_radius;
+    float cam_near_z = cam_bsphere_center.z + bsphere_radius;
+
+    float scaled_z = (vert_pos_camera.z - cam_near_z) /
+                     (cam_far_z - cam_near_z);
+
+    vec4 out_col = vec4(1.0 - scaled_z);
+
+    out_col.a = 1.0;
+
+    return out_col;
+}
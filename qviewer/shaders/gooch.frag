@@ -4,18 +4,14 @@ gooch.frag
 Author: Forrester Cole (fcole@cs.princeton.edu)
 Copyright (c) 2009 Forrester Cole
 
-Renders the polygons of the scene.
+Shades the polygons of the scene. See polygon_render.frag and capture.frag.
 
 qviewer is distributed under the terms of the GNU General Public License.
 See the COPYING file for details.
 
 \*****************************************************************************/
 
-// interpolated values
-varying vec3			  vert_light_world;
-varying vec3			  vert_normal_world;
-
-void main()
+vec4 shade()
 {
 	float diffuse = max(dot(vert_normal_world, vert_light_world),0.0);
     float r = 0.75 + 0.25 * diffuse;
@@ -27,5 +23,5 @@ void main()
 	vec4 out_col = light * surfaceColor();
     out_col.a = 1.0;
 				      
-    gl_FragColor = out_col;
+    return out_col;
 }
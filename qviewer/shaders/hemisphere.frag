@@ -4,18 +4,14 @@ hemisphere.frag
 Author: Forrester Cole (fcole@cs.princeton.edu)
 Copyright (c) 2009 Forrester Cole
 
-Renders the polygons of the scene.
+Shades the polygons of the scene. See polygon_render.frag and capture.frag.
 
 qviewer is distributed under the terms of the GNU General Public License.
 See the COPYING file for details.
 
 \*****************************************************************************/
 
-// interpolated values
-varying vec3			  vert_light_world;
-varying vec3			  vert_normal_world;
-
-void main()
+vec4 shade()
 {
 	float diffuse = dot(vert_normal_world, vert_light_world);
     float z = diffuse * 0.5 + 0.5;
@@ -23,5 +19,5 @@ void main()
 	vec4 out_col = z * surfaceColor();
     out_col.a = 1.0;
 				      
-    gl_FragColor = out_col;
+    return out_col;
 }
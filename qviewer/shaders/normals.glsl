@@ -0,0 +1,15 @@
+/*****************************************************************************\
+
+normals.glsl
+
+Camera space normals, scaled into [0,1].
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+vec4 normalsColor()
+{
+    return vec4(vert_normal_camera*0.5 + 0.5,1.0);
+}
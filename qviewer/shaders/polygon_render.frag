@@ -0,0 +1,16 @@
+/*****************************************************************************\
+
+polygon_render.frag
+
+Renders the polygons of the scene, using the shade() function of one of
+the lighting files (diffuse.frag, toon.frag, ...).
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+void main()
+{
+    gl_FragColor = shade();
+}
@@ -6,8 +6,6 @@ uniform float scale_y;
 
 uniform float use_texture;
 
-varying vec3 vert_pos_world;
-
 vec4 surfaceColor()
 {
     vec3 coordinate = vert_pos_world * texture_scale;
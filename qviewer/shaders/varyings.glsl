@@ -0,0 +1,19 @@
+/*****************************************************************************\
+
+varyings.glsl
+
+Interpolated values from polygon_render.vert. Declared once here so that
+several shading functions can be linked into one fragment shader.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+varying vec3 vert_pos_world;
+varying vec3 vert_pos_camera;
+varying vec4 vert_pos_clip;
+varying vec3 vert_light_world;
+varying vec3 vert_normal_camera;
+varying vec3 vert_normal_world;
+varying vec3 camera_pos_world;
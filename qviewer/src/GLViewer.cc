@@ -18,9 +18,13 @@ See the COPYING file for details.
 #include <QDir>
 #include <QDebug>
 #include <QMouseEvent>
+#include <QTimer>
 #include "Scene.h"
 #include "DialsAndKnobs.h"
 #include "Stats.h"
+#include "MemoryStats.h"
+#include "SessionPlayer.h"
+#include <algorithm>
 
 static dkBool off_camera_view("Camera->Off Camera View", false, DK_MENU);
 static dkBool camera_perspective("Camera->Perspective", true, DK_MENU);
@@ -32,6 +36,10 @@ GLViewer::GLViewer(QWidget* parent) : QGLViewer( parent )
     _display_timers = false;
     _scene = NULL;
     _save_hdr_screen = false;
+    _player = NULL;
+    _replay_realtime = false;
+    _drawing_replay_frame = false;
+    _replay_size_warned = false;
 
     camera()->frame()->setWheelSensitivity(-1.0);
 
@@ -50,6 +58,20 @@ GLViewer::GLViewer(QWidget* parent) : QGLViewer( parent )
     
     connect(&off_camera_view, SIGNAL(valueChanged(bool)), this, SLOT(updateGL()));
     connect(&camera_perspective, SIGNAL(valueChanged(bool)), this, SLOT(updateGL()));
+
+    _replay_timer.setSingleShot(true);
+    connect(&_replay_timer, SIGNAL(timeout()), this, SLOT(replayNextFrame()));
+
+    Scene::setRepaintTarget(this);
+}
+
+GLViewer::~GLViewer()
+{
+    Scene::setRepaintTarget(NULL);
+    delete _player;
+    makeCurrent();
+    _screenshots.flush();
+    _screenshots.clear();
 }
 
 void GLViewer::resetView()
@@ -142,11 +164,23 @@ void GLViewer::draw()
     in_draw_function = true;
 
     Stats& perf = Stats::instance();
-    if (_display_timers)
+    bool record_stats = _display_timers || perf.isTracing();
+    if (record_stats)
     {
         perf.reset();
     }
+    else
+    {
+        perf.discardEvents();
+    }
+    MemoryStats frame_memory;
     DialsAndKnobs::incrementFrameCounter();
+    _recorder.recordFrame(_main_camera_frame, camera()->fieldOfView(),
+                          manipulatedFrame(), width(), height());
+
+    // Screenshots from a few frames ago are done on the GPU by now.
+    _screenshots.nextFrame();
+    perf.setCounter("Encoder Queue", _screenshots.numPendingWrites());
     
     if (_save_hdr_screen) {
         _hdr_fbo.initFullScreen(1,GQ_ATTACH_DEPTH);
@@ -171,8 +205,9 @@ void GLViewer::draw()
     _scene->setLightDir(vec(manipulatedFrame()->inverseTransformOf(qglviewer::Vec(0,0,1))));
     _scene->drawScene();
     
-    if (_display_timers)
+    if (record_stats)
     {
+        frame_memory.recordFrame(perf);
         perf.updateView();
     }
 
@@ -187,11 +222,25 @@ void GLViewer::postDraw()
     }
     if (_save_hdr_screen && _hdr_fbo.isBound()) {
         _hdr_fbo.unbind();
-        _hdr_fbo.saveColorTextureToFile(0, _hdr_screen_filename);
+        // The background is cleared with alpha 0; leave alpha out of the
+        // PNG so it comes out opaque, as QGLViewer's snapshots do
+        int num_channels = _hdr_screen_filename.endsWith("png") ? 3 : 4;
+        _screenshots.readColorTexture(_hdr_fbo, 0, _hdr_screen_filename,
+                                      num_channels);
         _save_hdr_screen = false;
+        // If no more frames are drawn, finish the read anyway.
+        QTimer::singleShot(250, this, SLOT(finishScreenshots()));
     }
 }
 
+void GLViewer::finishScreenshots()
+{
+    if (_screenshots.numPendingReads() == 0)
+        return;
+    makeCurrent();
+    _screenshots.finish();
+}
+
 void GLViewer::drawThumbnailViewport()
 {
     glPushAttrib(GL_VIEWPORT_BIT | GL_SCISSOR_BIT);
@@ -233,12 +282,19 @@ void GLViewer::drawThumbnailViewport()
     glPopAttrib();
 }
 
+// Screenshots are drawn into an FBO, read back through a pixel buffer and
+// encoded on a writer thread. Scripts and the batch read the file next,
+// so this still waits until it is written. Other formats (jpg, eps, ...)
+// go through QGLViewer's snapshot code.
 void GLViewer::saveScreenshot(QString filename) 
 {
-    if (filename.endsWith("pfm")) {
+    if (filename.endsWith("pfm") || filename.endsWith("float") ||
+        filename.endsWith("png")) {
         _hdr_screen_filename = filename;
         _save_hdr_screen = true;
         updateGL(); 
+        makeCurrent();
+        _screenshots.flush();
     } else {
         saveSnapshot(filename, true);
     }
@@ -324,4 +380,119 @@ void GLViewer::keyPressEvent(QKeyEvent* event)
     }
 }
 
+void GLViewer::updateGL()
+{
+    if (_player && !_drawing_replay_frame)
+        return;
+    QGLViewer::updateGL();
+}
+
+void GLViewer::linesReady()
+{
+    QGLViewer::updateGL();
+}
+
+void GLViewer::startRecording(const QString& filename, const QString& scene_name)
+{
+    _recorder.start(filename, scene_name, _main_camera_frame,
+                    camera()->fieldOfView(), manipulatedFrame(),
+                    width(), height());
+}
+
+bool GLViewer::stopRecording()
+{
+    int frames = _recorder.numFrames();
+    if (!_recorder.stop())
+        return false;
+    qDebug("Recorded %d frames", frames);
+    return true;
+}
+
+void GLViewer::replaySession(SessionPlayer* player, bool realtime,
+                             const QString& stats_file)
+{
+    if (_player)
+        finishReplay();
 
+    _player = player;
+    _replay_realtime = realtime;
+    _replay_stats_file = stats_file;
+    _replay_frame_ms.clear();
+    _replay_size_warned = false;
+
+    camera()->setFrame(_main_camera_frame);
+    _player->start(camera(), manipulatedFrame());
+    if (!stats_file.isEmpty())
+        Stats::instance().startTrace();
+
+    _replay_start = now();
+    _replay_timer.start(0);
+}
+
+// One frame per call, from the timer, so the window stays responsive
+void GLViewer::replayNextFrame()
+{
+    if (!_player)
+        return;
+    if (_player->atEnd()) {
+        finishReplay();
+        return;
+    }
+
+    if (_replay_realtime) {
+        float wait = _player->frameTime(_player->frame() + 1) -
+                     (now() - _replay_start);
+        if (wait > 0.001f) {
+            _replay_timer.start(int(wait * 1000.0f));
+            return;
+        }
+    }
+
+    _player->nextFrame(camera(), manipulatedFrame());
+    if (!_replay_size_warned &&
+        (_player->frameWidth() != width() || _player->frameHeight() != height())) {
+        _replay_size_warned = true;
+        qWarning("Frame %d was recorded at %dx%d, replayed at %dx%d",
+                 _player->frame(), _player->frameWidth(),
+                 _player->frameHeight(), width(), height());
+    }
+
+    timestamp start = now();
+    _drawing_replay_frame = true;
+    updateGL();
+    _drawing_replay_frame = false;
+    _replay_frame_ms.append((now() - start) * 1000.0f);
+
+    _replay_timer.start(0);
+}
+
+void GLViewer::finishReplay()
+{
+    _replay_timer.stop();
+    float seconds = now() - _replay_start;
+    float recorded_seconds = _player->duration();
+    delete _player;
+    _player = NULL;
+
+    if (!_replay_stats_file.isEmpty()) {
+        Stats& perf = Stats::instance();
+        perf.stopTrace();
+        perf.writeTrace(_replay_stats_file);
+    }
+
+    // Mean, median and 95th percentile, as in Stats::summarize
+    QVector<float> ms = _replay_frame_ms;
+    int n = ms.size();
+    if (n > 0) {
+        std::sort(ms.begin(), ms.end());
+        double sum = 0;
+        for (int i = 0; i < n; i++)
+            sum += ms[i];
+        qDebug("Replayed %d frames in %.2f s (recorded in %.2f s): "
+               "frame ms mean %.2f, p50 %.2f, p95 %.2f, max %.2f",
+               n, seconds, recorded_seconds, sum / n, ms[(n-1) / 2],
+               ms[(int)ceilf(0.95f * n) - 1], ms[n-1]);
+    }
+
+    emit replayFinished();
+}
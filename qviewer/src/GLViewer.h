@@ -17,10 +17,15 @@ See the COPYING file for details.
 
 #include "GQInclude.h"
 #include "GQFramebufferObject.h"
+#include "GQReadbackQueue.h"
+#include "SessionRecorder.h"
 
 #include <qglviewer.h>
+#include <QTimer>
+#include <QVector>
 
 class Scene;
+class SessionPlayer;
 
 class GLViewer : public QGLViewer
 {
@@ -28,22 +33,49 @@ class GLViewer : public QGLViewer
 
 public:
     GLViewer( QWidget* parent = 0 );
+    ~GLViewer();
 
     void setScene( Scene* npr_scene );
     void finishInit();
     void resetView();
 
     void setDisplayTimers(bool display) { _display_timers = display; }
+
+    // Records the frames drawn, and the dial changes sent to
+    // sessionRecorder()->recordDial, until stopRecording().
+    void startRecording(const QString& filename, const QString& scene_name);
+    bool stopRecording();
+    SessionRecorder* sessionRecorder() { return &_recorder; }
+
+    // Draws the frames of the session, as fast as possible or at their
+    // recorded times, then prints a summary of the frame times. While
+    // tracing, Stats records every frame; with a stats_file, the trace
+    // is started here and written there at the end. Takes the player.
+    void replaySession(SessionPlayer* player, bool realtime,
+                       const QString& stats_file);
+    bool isReplaying() const { return _player != NULL; }
     
 public slots:
+    // Ignored during a replay, except for the replayed frames
+    virtual void updateGL();
+    // Draws the lines a background extraction has just finished, also
+    // during a replay, so its frames don't keep showing stale ones
+    void linesReady();
     void setRandomCamera(int seed);
     void saveScreenshot(QString filename);
     void on_actionCamera_Perspective_toggled(bool checked);
+    void finishScreenshots();
     virtual void mousePressEvent(QMouseEvent* event);
     virtual void mouseMoveEvent(QMouseEvent* event);
     virtual void mouseReleaseEvent(QMouseEvent* event);
     virtual void keyPressEvent(QKeyEvent* event);
 
+signals:
+    void replayFinished();
+
+protected slots:
+    void replayNextFrame();
+
 protected:
     virtual void draw();
     virtual void postDraw();
@@ -51,6 +83,7 @@ protected:
 
     QPoint convertThumbnailCoords(const QPoint& p);
     void drawThumbnailViewport();
+    void finishReplay();
     
 private:
     bool   _inited;
@@ -59,11 +92,22 @@ private:
     bool   _save_hdr_screen;
     QString _hdr_screen_filename;
     GQFramebufferObject _hdr_fbo;
+    GQReadbackQueue _screenshots;
     QRect  _thumbnail_rect;
 
     Scene* _scene;
     qglviewer::ManipulatedCameraFrame* _main_camera_frame;
     qglviewer::ManipulatedCameraFrame* _off_camera_frame;
+
+    SessionRecorder _recorder;
+    SessionPlayer* _player;
+    bool   _replay_realtime;
+    bool   _drawing_replay_frame;
+    bool   _replay_size_warned;
+    QString _replay_stats_file;
+    QTimer _replay_timer;
+    timestamp _replay_start;
+    QVector<float> _replay_frame_ms;
 };
 
 #endif /*GLVIEWER_H_*/
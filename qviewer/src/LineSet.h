@@ -0,0 +1,157 @@
+/*****************************************************************************\
+
+LineSet.h
+
+The extracted lines of one frame: segments with per-vertex colors, in
+batches that share a width and depth test. The line extraction in Rtsc
+writes these instead of calling OpenGL, so the same lines can be drawn
+with GL vertex arrays or by SoftRaster. Each segment also carries a few
+flags (e.g. whether it lies on a backfacing face), so that one extraction
+can be replayed into several passes with append(). With recordFaces() on,
+each segment also keeps the face it was extracted on, so that two
+extractions can be compared segment by segment (see qviewer/check).
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef LINE_SET_H_
+#define LINE_SET_H_
+
+#include "Vec.h"
+#include <vector>
+#include <algorithm>
+
+class LineSet
+{
+  public:
+    struct Batch
+    {
+        int     first;      // Index of the first vertex
+        int     count;      // Number of vertices, two per segment
+        float   width;      // In pixels
+        bool    depth_test;
+        bool    round_caps; // Fill the gaps between wide segments
+    };
+
+    enum Flags { BACKFACING = 1 };
+
+  public:
+    LineSet() : _record_faces(false) { clear(); }
+
+    void clear()
+    {
+        vertices.clear();
+        colors.clear();
+        batches.clear();
+        flags.clear();
+        faces.clear();
+        _flags = 0;
+        _face = Vec<3,int>(-1, -1, -1);
+        _color = vec4(0, 0, 0, 1);
+        _width = 1.0f;
+        _depth_test = true;
+        _round_caps = false;
+    }
+
+    // State for the following segments, as with glColor/glLineWidth.
+    void setColor( float r, float g, float b, float a = 1.0f )
+        { _color = vec4(r, g, b, a); }
+    void setColor( const vec& c ) { setColor(c[0], c[1], c[2]); }
+    void setWidth( float width ) { _width = width; }
+    void setDepthTest( bool enable ) { _depth_test = enable; }
+    void setRoundCaps( bool enable ) { _round_caps = enable; }
+    void setFlags( int flags ) { _flags = flags; }
+    // The vertices of the face the following segments lie on. Kept in
+    // faces only if recordFaces() is on; clear() leaves that setting.
+    void setFace( int v0, int v1, int v2 ) { _face = Vec<3,int>(v0, v1, v2); }
+    void recordFaces( bool enable ) { _record_faces = enable; }
+
+    // Every two vertices make a segment, as with GL_LINES.
+    void addVertex( const point& p )
+    {
+        if (vertices.size() % 2 == 0 && !stateMatches())
+        {
+            Batch batch = { (int)vertices.size(), 0, _width,
+                            _depth_test, _round_caps };
+            batches.push_back(batch);
+        }
+        if (vertices.size() % 2 == 0)
+        {
+            flags.push_back(_flags);
+            if (_record_faces)
+                faces.push_back(_face);
+        }
+        vertices.push_back(p);
+        colors.push_back(_color);
+        batches.back().count++;
+    }
+
+    // Appends the segments of src with the current state, in color rgb
+    // but keeping their alpha. Segments with any of skip_flags are left
+    // out.
+    void append( const LineSet& src, const vec& rgb, int skip_flags = 0 )
+    {
+        for (int i = 0; i < src.numSegments(); i++)
+        {
+            if (src.flags[i] & skip_flags)
+                continue;
+            if (!src.faces.empty())
+                _face = src.faces[i];
+            for (int j = 2*i; j < 2*i + 2; j++)
+            {
+                setColor(rgb[0], rgb[1], rgb[2], src.colors[j][3]);
+                addVertex(src.vertices[j]);
+            }
+        }
+    }
+
+    // Without copying, e.g. to publish lines extracted on another thread
+    void swap( LineSet& other )
+    {
+        vertices.swap(other.vertices);
+        colors.swap(other.colors);
+        batches.swap(other.batches);
+        flags.swap(other.flags);
+        faces.swap(other.faces);
+        std::swap(_color, other._color);
+        std::swap(_width, other._width);
+        std::swap(_depth_test, other._depth_test);
+        std::swap(_round_caps, other._round_caps);
+        std::swap(_flags, other._flags);
+        std::swap(_face, other._face);
+        std::swap(_record_faces, other._record_faces);
+    }
+
+    int numSegments() const { return vertices.size() / 2; }
+    bool isEmpty() const { return vertices.empty(); }
+
+  public:
+    std::vector<point>  vertices;
+    std::vector<vec4>   colors;
+    std::vector<Batch>  batches;
+    std::vector<unsigned char> flags;   // Per segment
+    std::vector< Vec<3,int> > faces;    // Per segment, if recorded
+
+  protected:
+    bool stateMatches() const
+    {
+        if (batches.empty())
+            return false;
+        const Batch& last = batches.back();
+        return last.width == _width && last.depth_test == _depth_test &&
+               last.round_caps == _round_caps;
+    }
+
+  protected:
+    vec4    _color;
+    float   _width;
+    bool    _depth_test;
+    bool    _round_caps;
+    int     _flags;
+    Vec<3,int> _face;
+    bool    _record_faces;
+};
+
+#endif // LINE_SET_H_
@@ -0,0 +1,204 @@
+/*****************************************************************************\
+
+LineSimplifier.cc
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "LineSimplifier.h"
+#include "LineSet.h"
+
+#include <algorithm>
+
+using namespace std;
+
+LineSimplifier::LineSimplifier()
+{
+    _width = 0;
+    _height = 0;
+    _min_length = 0.5f;
+    _merge_length = 2.0f;
+    _tolerance = 0.5f;
+    _max_per_cell = 0;
+    _cell_size = 8;
+}
+
+void LineSimplifier::setView( const xform& modelview,
+                              const xform& projection, int width, int height )
+{
+    _mvp = projection * modelview;
+    _width = width;
+    _height = height;
+}
+
+vec4 LineSimplifier::clipCoords( const point& p ) const
+{
+    const xform& m = _mvp;
+    return vec4(m[0]*p[0] + m[4]*p[1] + m[8]*p[2] + m[12],
+                m[1]*p[0] + m[5]*p[1] + m[9]*p[2] + m[13],
+                m[2]*p[0] + m[6]*p[1] + m[10]*p[2] + m[14],
+                m[3]*p[0] + m[7]*p[1] + m[11]*p[2] + m[15]);
+}
+
+// Pixels from the corner of the viewport. Needs w > 0.
+vec2 LineSimplifier::toScreen( const vec4& clip ) const
+{
+    float inv_w = 1.0f / clip[3];
+    return vec2((clip[0] * inv_w + 1.0f) * 0.5f * _width,
+                (clip[1] * inv_w + 1.0f) * 0.5f * _height);
+}
+
+// True if both ends are beyond the same plane of the frustum
+bool LineSimplifier::outside( const vec4& c0, const vec4& c1 )
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (c0[i] > c0[3] && c1[i] > c1[3])
+            return true;
+        if (c0[i] < -c0[3] && c1[i] < -c1[3])
+            return true;
+    }
+    return false;
+}
+
+// A short segment joins the run if it starts where the run ends, has the
+// same flags, and the run stays straight and no longer than a cell.
+bool LineSimplifier::canMerge( const Run& run, const vec2& s0,
+                               const vec2& s1, int flags ) const
+{
+    if (flags != run.flags)
+        return false;
+    float tol2 = _tolerance * _tolerance;
+    if (dist2(s0, run.s[1]) > tol2)
+        return false;
+    if (dist2(s0, s1) > _merge_length * _merge_length)
+        return false;
+
+    vec2 d = s1 - run.s[0];
+    float len2_d = len2(d);
+    if (len2_d > float(_cell_size * _cell_size))
+        return false;
+    if (len2_d == 0.0f)
+        return true;
+
+    // Distance of the joint from the merged segment
+    vec2 e = run.s[1] - run.s[0];
+    float cross = d[0] * e[1] - d[1] * e[0];
+    return cross * cross <= tol2 * len2_d;
+}
+
+bool LineSimplifier::keep( const Run& run, vector<int>& occupancy ) const
+{
+    if (dist2(run.s[0], run.s[1]) < _min_length * _min_length)
+        return false;
+    if (_max_per_cell <= 0)
+        return true;
+
+    int grid_width = (_width + _cell_size - 1) / _cell_size;
+    int grid_height = (_height + _cell_size - 1) / _cell_size;
+    vec2 mid = 0.5f * (run.s[0] + run.s[1]);
+    int x = min(max(int(mid[0]) / _cell_size, 0), grid_width - 1);
+    int y = min(max(int(mid[1]) / _cell_size, 0), grid_height - 1);
+    int& count = occupancy[y * grid_width + x];
+    if (count >= _max_per_cell)
+        return false;
+    count++;
+    return true;
+}
+
+void LineSimplifier::addRun( LineSet& lines, const Run& run )
+{
+    lines.setFlags(run.flags);
+    for (int i = 0; i < 2; i++)
+    {
+        lines.setColor(run.c[i][0], run.c[i][1], run.c[i][2], run.c[i][3]);
+        lines.addVertex(run.p[i]);
+    }
+}
+
+int LineSimplifier::simplify( LineSet& lines ) const
+{
+    if (_width <= 0 || _height <= 0)
+        return 0;
+
+    vector<int> occupancy;
+    if (_max_per_cell > 0)
+    {
+        int grid_width = (_width + _cell_size - 1) / _cell_size;
+        int grid_height = (_height + _cell_size - 1) / _cell_size;
+        occupancy.resize(grid_width * grid_height, 0);
+    }
+
+    LineSet out;
+    for (size_t i = 0; i < lines.batches.size(); i++)
+    {
+        const LineSet::Batch& batch = lines.batches[i];
+        out.setWidth(batch.width);
+        out.setDepthTest(batch.depth_test);
+        out.setRoundCaps(batch.round_caps);
+
+        Run run;
+        bool have_run = false;
+        int end = batch.first + batch.count;
+        for (int j = batch.first; j < end; j += 2)
+        {
+            int flags = lines.flags[j/2];
+            int a = j, b = j + 1;
+            vec4 c0 = clipCoords(lines.vertices[a]);
+            vec4 c1 = clipCoords(lines.vertices[b]);
+            if (outside(c0, c1))
+                continue;
+
+            Run seg;
+            seg.flags = flags;
+            if (c0[3] <= 0.0f || c1[3] <= 0.0f)
+            {
+                // Crosses the eye plane, so it can't be measured on
+                // screen. Left for the clipper.
+                if (have_run && keep(run, occupancy))
+                    addRun(out, run);
+                have_run = false;
+                seg.p[0] = lines.vertices[a];
+                seg.p[1] = lines.vertices[b];
+                seg.c[0] = lines.colors[a];
+                seg.c[1] = lines.colors[b];
+                addRun(out, seg);
+                continue;
+            }
+
+            vec2 s0 = toScreen(c0), s1 = toScreen(c1);
+            // Neighboring faces may give their shared point either end
+            if (have_run && dist2(s1, run.s[1]) < dist2(s0, run.s[1]))
+            {
+                swap(a, b);
+                swap(s0, s1);
+            }
+            if (have_run && canMerge(run, s0, s1, flags))
+            {
+                run.p[1] = lines.vertices[b];
+                run.c[1] = lines.colors[b];
+                run.s[1] = s1;
+                continue;
+            }
+
+            if (have_run && keep(run, occupancy))
+                addRun(out, run);
+            run = seg;
+            run.p[0] = lines.vertices[a];
+            run.p[1] = lines.vertices[b];
+            run.c[0] = lines.colors[a];
+            run.c[1] = lines.colors[b];
+            run.s[0] = s0;
+            run.s[1] = s1;
+            have_run = true;
+        }
+        if (have_run && keep(run, occupancy))
+            addRun(out, run);
+    }
+
+    int removed = lines.numSegments() - out.numSegments();
+    lines.swap(out);
+    return removed;
+}
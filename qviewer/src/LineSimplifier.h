@@ -0,0 +1,87 @@
+/*****************************************************************************\
+
+LineSimplifier.h
+
+Reduces extracted lines to what can be seen at the current resolution.
+The extraction makes one segment per face crossing, so a dense mesh seen
+from afar gives millions of sub-pixel segments. simplify() projects them
+with the view and then:
+
+  - drops segments outside the view frustum,
+  - merges runs of joined, nearly collinear segments into one,
+  - drops runs shorter than the minimum length,
+  - thins overdense regions: at most a few segments per cell of a coarse
+    grid over the screen, first come first kept.
+
+Afterwards the segment count depends on the screen resolution, not on
+the mesh size.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef LINE_SIMPLIFIER_H_
+#define LINE_SIMPLIFIER_H_
+
+#include "Vec.h"
+#include "XForm.h"
+#include <vector>
+
+class LineSet;
+
+class LineSimplifier
+{
+  public:
+    LineSimplifier();
+
+    // Column major, as read from OpenGL. Width and height in pixels.
+    void setView( const xform& modelview, const xform& projection,
+                  int width, int height );
+
+    // Runs shorter than this (in pixels) are dropped. Default 0.5.
+    void setMinLength( float pixels ) { _min_length = pixels; }
+    // Segments shorter than this are merged into their neighbors while
+    // the run stays straight to within the tolerance. Default 2 and 0.5.
+    void setMergeLength( float pixels ) { _merge_length = pixels; }
+    void setTolerance( float pixels ) { _tolerance = pixels; }
+    // At most max_per_cell segments are kept in each cell_size square
+    // of pixels; 0 keeps them all. Merged runs are no longer than a
+    // cell. Default 0 and 8.
+    void setMaxPerCell( int max_per_cell ) { _max_per_cell = max_per_cell; }
+    void setCellSize( int pixels ) { _cell_size = pixels; }
+
+    // Replaces lines with the simplified segments. Batches, colors and
+    // segment flags are kept. Returns the number of segments removed.
+    int simplify( LineSet& lines ) const;
+
+  protected:
+    // A run of merged segments, in world space and on screen
+    struct Run
+    {
+        point   p[2];
+        vec4    c[2];
+        vec2    s[2];
+        int     flags;
+    };
+
+    vec4 clipCoords( const point& p ) const;
+    vec2 toScreen( const vec4& clip ) const;
+    static bool outside( const vec4& c0, const vec4& c1 );
+    bool canMerge( const Run& run, const vec2& s0, const vec2& s1,
+                   int flags ) const;
+    bool keep( const Run& run, std::vector<int>& occupancy ) const;
+    static void addRun( LineSet& lines, const Run& run );
+
+  protected:
+    xform   _mvp;
+    int     _width;
+    int     _height;
+    float   _min_length;
+    float   _merge_length;
+    float   _tolerance;
+    int     _max_per_cell;
+    int     _cell_size;
+};
+
+#endif // LINE_SIMPLIFIER_H_
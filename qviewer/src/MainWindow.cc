@@ -17,10 +17,13 @@ See the COPYING file for details.
 #include "GLViewer.h"
 #include "MainWindow.h"
 #include "Scene.h"
+#include "SceneLoader.h"
+#include "SessionPlayer.h"
 #include "Rtsc.h"
 #include "GQShaderManager.h"
 
 #include "Stats.h"
+#include "MemoryStats.h"
 #include "DialsAndKnobs.h"
 #include "Console.h"
 
@@ -37,11 +40,16 @@ MainWindow::MainWindow( )
     _console = NULL;
     _scene = NULL;
     _dials_and_knobs = NULL;
+    _scene_loader = NULL;
+    _scene_load_generation = 0;
     _gl_viewer = new GLViewer;
 }
 
 MainWindow::~MainWindow()
 {
+    // Loaders are children of the window, and wait for their thread
+    // when they are deleted.
+    cancelSceneLoad();
     delete _scene;
 }
 
@@ -91,6 +99,7 @@ void MainWindow::init( const QDir& working_dir, const QString& scene_name )
     _last_export_dir = working_dir.absolutePath();
     _last_camera_dir = working_dir.absolutePath();
     _last_screenshot_dir = working_dir.absolutePath();
+    _last_session_dir = working_dir.absolutePath();
 
     resize(1000,800);
 
@@ -131,21 +140,33 @@ void MainWindow::closeEvent( QCloseEvent* event )
     event->accept();
 }
 
-bool MainWindow::openScene( const QString& filename )
+QString MainWindow::absoluteSceneName( const QString& filename, bool* exists )
 {
-    // Try to do all the file loading before we change 
-    // the mainwindow state at all.
-
     QString absfilename = 
         QDir::fromNativeSeparators(_working_dir.absoluteFilePath(filename));
     QFileInfo fileinfo(absfilename);
     
-    if (!fileinfo.exists())
+    *exists = fileinfo.exists();
+    if (!*exists)
     {
         QMessageBox::critical(this, "File Not Found", 
             QString("\"%1\" does not exist.").arg(absfilename));
-        return false;
     }
+    return absfilename;
+}
+
+bool MainWindow::openScene( const QString& filename )
+{
+    // Try to do all the file loading before we change 
+    // the mainwindow state at all.
+
+    bool exists;
+    QString absfilename = absoluteSceneName(filename, &exists);
+    if (!exists)
+        return false;
+
+    // A background load finishing later would replace this scene.
+    cancelSceneLoad();
 
     Scene* new_scene = new Scene();
     
@@ -157,6 +178,88 @@ bool MainWindow::openScene( const QString& filename )
         return false;
     }
 
+    setScene(new_scene, filename);
+    
+    return true;
+}
+
+bool MainWindow::openSceneInBackground( const QString& filename )
+{
+    bool exists;
+    QString absfilename = absoluteSceneName(filename, &exists);
+    if (!exists)
+        return false;
+
+    // Only the newest request counts; an older one still reading its
+    // mesh finishes on its own and is thrown away.
+    cancelSceneLoad();
+
+    _scene_loader = new SceneLoader(absfilename, Rtsc::requiredAttributes(),
+                                    _scene_load_generation, this);
+    _scene_loader->setObjectName(QDir::fromNativeSeparators(filename));
+    connect(_scene_loader, 
+        SIGNAL(progress(const QString&, const QString&, int, int)),
+        this, SLOT(sceneLoadProgress(const QString&, const QString&, int, int)));
+    connect(_scene_loader, SIGNAL(finished()), 
+        this, SLOT(sceneLoaderFinished()));
+
+    _console->print(QString("Loading %1...\n").arg(absfilename));
+    setWindowTitle(QString("qrtsc - loading %1")
+                   .arg(QFileInfo(absfilename).fileName()));
+
+    _scene_loader->start();
+    return true;
+}
+
+void MainWindow::cancelSceneLoad()
+{
+    _scene_load_generation++;
+    if (_scene_loader)
+    {
+        _scene_loader->cancel();
+        _scene_loader = NULL;
+    }
+}
+
+void MainWindow::sceneLoadProgress( const QString& filename, 
+    const QString& stage, int num_finished, int num_stages )
+{
+    _console->print(QString("%1: %2 (%3/%4)\n")
+                    .arg(QFileInfo(filename).fileName()).arg(stage)
+                    .arg(num_finished).arg(num_stages));
+}
+
+void MainWindow::sceneLoaderFinished()
+{
+    SceneLoader* loader = qobject_cast<SceneLoader*>(sender());
+    assert(loader);
+    loader->deleteLater();
+
+    if (loader->generation() != _scene_load_generation ||
+        loader->isCanceled())
+    {
+        _console->print(QString("Canceled loading %1\n")
+                        .arg(loader->filename()));
+        return;
+    }
+    _scene_loader = NULL;
+
+    if (!loader->succeeded())
+    {
+        makeWindowTitle();
+        QMessageBox::critical(this, "Open Failed", 
+            QString("Failed to load \"%1\". Check console.")
+            .arg(loader->filename()));
+        return;
+    }
+
+    Scene* new_scene = loader->takeScene();
+    new_scene->setupMesh(loader->takePrecomputeGraph());
+    setScene(new_scene, loader->objectName());
+}
+
+void MainWindow::setScene( Scene* new_scene, const QString& filename )
+{
     // Success: file has been loaded, now change state
 
     if (_scene)
@@ -175,8 +278,6 @@ bool MainWindow::openScene( const QString& filename )
     _scene_name = QDir::fromNativeSeparators(filename);
     addCurrentSceneToRecentList();
     makeWindowTitle();
-    
-    return true;
 }
 
 bool MainWindow::saveScene( const QString& filename )
@@ -196,11 +297,7 @@ void MainWindow::on_actionOpen_Recent_Scene_triggered(int which)
     if (_recent_scenes.size() > which && 
         !_recent_scenes[which].isEmpty())
     {
-        QFileInfo fileinfo(_recent_scenes[which]);
-        QString fullpath = fileinfo.absoluteFilePath();
-
-        openScene( _recent_scenes[which] );
-        _gl_viewer->updateGL();
+        openSceneInBackground( _recent_scenes[which] );
     }
 }
 
@@ -294,6 +391,29 @@ void MainWindow::setupFileMenu()
 
     fileMenu->addSeparator();
 
+    QAction* recordSessionAction = new QAction(tr("Record Se&ssion..."), 0);
+    connect(recordSessionAction, SIGNAL(triggered()), 
+        this, SLOT(on_actionRecord_Session_triggered()));
+    fileMenu->addAction(recordSessionAction);
+
+    QAction* stopRecordingAction = new QAction(tr("S&top Recording"), 0);
+    connect(stopRecordingAction, SIGNAL(triggered()), 
+        this, SLOT(on_actionStop_Recording_triggered()));
+    fileMenu->addAction(stopRecordingAction);
+
+    QAction* replaySessionAction = new QAction(tr("Re&play Session..."), 0);
+    connect(replaySessionAction, SIGNAL(triggered()), 
+        this, SLOT(on_actionReplay_Session_triggered()));
+    fileMenu->addAction(replaySessionAction);
+
+    QAction* replayRealTimeAction = 
+        new QAction(tr("Replay Session in Real &Time..."), 0);
+    connect(replayRealTimeAction, SIGNAL(triggered()), 
+        this, SLOT(on_actionReplay_Session_Real_Time_triggered()));
+    fileMenu->addAction(replayRealTimeAction);
+
+    fileMenu->addSeparator();
+
     QAction* reloadShadersAction = new QAction(tr("&Reload Shaders"), 0);
     reloadShadersAction->setShortcut(QKeySequence(tr("Ctrl+L")));
     connect(reloadShadersAction, SIGNAL(triggered()), 
@@ -327,6 +447,12 @@ void MainWindow::setupMeshMenu()
     connect(smoothCurvDAction, SIGNAL(triggered()), 
             this, SLOT(on_actionSmooth_Curvature_Deriv_triggered()));
     meshMenu->addAction(smoothCurvDAction);
+
+    meshMenu->addSeparator();
+    QAction* freeAction = new QAction(tr("&Free Unneeded Attributes"), 0);
+    connect(freeAction, SIGNAL(triggered()), 
+            this, SLOT(on_actionFree_Unneeded_Attributes_triggered()));
+    meshMenu->addAction(freeAction);
 }
 
 void MainWindow::setupDockWidgets(QMenu* menu)
@@ -336,11 +462,15 @@ void MainWindow::setupDockWidgets(QMenu* menu)
     _dials_and_knobs = new DialsAndKnobs(this, menu, other_docks);
     connect(_dials_and_knobs, SIGNAL(dataChanged()),
         _gl_viewer, SLOT(updateGL()));
+    connect(_dials_and_knobs, SIGNAL(valueChanged(dkValue*)),
+        _gl_viewer->sessionRecorder(), SLOT(recordDial(dkValue*)));
 
     _console = new Console(this, menu);
     _console->installMsgHandler();
     _console->exposeObjectToScript(this, "mainwindow");
     _console->exposeObjectToScript(_gl_viewer, "viewer");
+    // e.g. stats.startTrace(), then stats.writeTrace("run.json")
+    _console->exposeObjectToScript(&Stats::instance(), "stats");
     
     _stats_widget = new StatsWidget(this, menu);
 }
@@ -367,7 +497,7 @@ void MainWindow::on_actionOpen_Scene_triggered()
 
     if (!filename.isNull())
     {
-        openScene( filename );
+        openSceneInBackground( filename );
     }
 }
 
@@ -494,6 +624,94 @@ bool MainWindow::openCamera(const QString& filename)
 }
 
 
+void MainWindow::on_actionRecord_Session_triggered()
+{
+    QString filename = 
+        myFileDialog(QFileDialog::AcceptSave, "Record Session", 
+        "Sessions (*.session)", _last_session_dir );
+
+    if (!filename.isNull())
+    {
+        startRecording( filename );
+    }
+}
+
+void MainWindow::on_actionStop_Recording_triggered()
+{
+    stopRecording();
+}
+
+void MainWindow::on_actionReplay_Session_triggered()
+{
+    QString filename = 
+        myFileDialog(QFileDialog::AcceptOpen, "Replay Session", 
+        "Sessions (*.session)", _last_session_dir );
+
+    if (!filename.isNull())
+    {
+        replaySession( filename, false );
+    }
+}
+
+void MainWindow::on_actionReplay_Session_Real_Time_triggered()
+{
+    QString filename = 
+        myFileDialog(QFileDialog::AcceptOpen, "Replay Session in Real Time", 
+        "Sessions (*.session)", _last_session_dir );
+
+    if (!filename.isNull())
+    {
+        replaySession( filename, true );
+    }
+}
+
+void MainWindow::startRecording(const QString& filename)
+{
+    QString scene_name;
+    if (!_scene_name.isEmpty())
+        scene_name = QDir::fromNativeSeparators(
+            _working_dir.absoluteFilePath(_scene_name));
+
+    _gl_viewer->startRecording(filename, scene_name);
+    _console->print(QString("Recording %1\n").arg(filename));
+}
+
+bool MainWindow::stopRecording()
+{
+    return _gl_viewer->stopRecording();
+}
+
+bool MainWindow::replaySession(const QString& filename, bool realtime,
+                               const QString& stats_file)
+{
+    SessionPlayer* player = new SessionPlayer;
+    if (!player->load(filename))
+    {
+        QMessageBox::critical(this, "Replay Failed", 
+            QString("Failed to load \"%1\". Check console.").arg(filename));
+        delete player;
+        return false;
+    }
+
+    QString scene_name;
+    if (!_scene_name.isEmpty())
+        scene_name = QDir::fromNativeSeparators(
+            _working_dir.absoluteFilePath(_scene_name));
+    if (!player->sceneName().isEmpty() && player->sceneName() != scene_name)
+    {
+        if (!openScene(player->sceneName()))
+        {
+            delete player;
+            return false;
+        }
+    }
+    if (player->width() > 0 && player->height() > 0)
+        fitViewerSize(player->width(), player->height());
+
+    _gl_viewer->replaySession(player, realtime, stats_file);
+    return true;
+}
+
 void MainWindow::setFoV(float degrees)
 {
     _gl_viewer->camera()->setFieldOfView( degrees * ( 3.1415926f / 180.0f ) );
@@ -545,6 +763,21 @@ void MainWindow::on_actionSmooth_Curvature_Deriv_triggered()
     }
 }
 
+void MainWindow::on_actionFree_Unneeded_Attributes_triggered()
+{
+    if (_scene) {
+        size_t freed = Rtsc::freeUnneededAttributes();
+        Rtsc::recordMemory(Stats::instance());
+        QString rss;
+        long kb = MemoryStats::currentRSS();
+        if (kb >= 0)
+            rss = QString(", %1 MB resident").arg(kb / 1024.0, 0, 'f', 1);
+        _console->print(QString("Freed %1 MB%2\n")
+            .arg(freed / (1024.0 * 1024.0), 0, 'f', 1).arg(rss));
+        _gl_viewer->updateGL();
+    }
+}
+
 
 void MainWindow::setupViewerResizeActions(QMenu* menu)
 {
@@ -24,6 +24,7 @@ class Scene;
 class DialsAndKnobs;
 class Console;
 class StatsWidget;
+class SceneLoader;
 
 class MainWindow : public QMainWindow
 {
@@ -45,17 +46,45 @@ class MainWindow : public QMainWindow
     void on_actionSmooth_Mesh_triggered();
     void on_actionSmooth_Curvatures_triggered();
     void on_actionSmooth_Curvature_Deriv_triggered();
+    void on_actionFree_Unneeded_Attributes_triggered();
+    void on_actionRecord_Session_triggered();
+    void on_actionStop_Recording_triggered();
+    void on_actionReplay_Session_triggered();
+    void on_actionReplay_Session_Real_Time_triggered();
     void fitViewerSize(const QString& size);
+    // openScene() blocks until the scene is loaded (scripts rely on it);
+    // openSceneInBackground() returns at once and swaps the scene in
+    // when it is ready, canceling any load still in progress.
     bool openScene(const QString& filename);
+    bool openSceneInBackground(const QString& filename);
     bool saveScene(const QString& filename);
     bool saveScreenshot(const QString& filename);
 
     bool saveCamera(const QString& filename);
     bool openCamera(const QString& filename);
 
+    // A session records the camera, light and dial changes of every
+    // frame drawn (see SessionRecorder). replaySession() opens the
+    // session's scene and viewer size if they differ, then draws its
+    // frames, as fast as possible unless realtime. Stats of every frame
+    // go to stats_file, as Stats::writeTrace writes them.
+    void startRecording(const QString& filename);
+    bool stopRecording();
+    bool replaySession(const QString& filename, bool realtime = false,
+                       const QString& stats_file = QString());
+
+  protected slots:
+    void sceneLoadProgress(const QString& filename, const QString& stage,
+                           int num_finished, int num_stages);
+    void sceneLoaderFinished();
+
   protected:
     void closeEvent(QCloseEvent* event );
 
+    QString absoluteSceneName(const QString& filename, bool* exists);
+    void cancelSceneLoad();
+    void setScene(Scene* new_scene, const QString& filename);
+
     void fitViewerSize( int x, int y );
     void setFoV(float degrees);
 
@@ -90,10 +119,14 @@ class MainWindow : public QMainWindow
 
     QDir        _working_dir;
 
+    SceneLoader* _scene_loader;
+    int         _scene_load_generation;
+
     QString     _last_scene_dir;
     QString     _last_export_dir;
     QString     _last_camera_dir;
     QString     _last_screenshot_dir;
+    QString     _last_session_dir;
 };
 
 #endif
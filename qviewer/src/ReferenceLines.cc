@@ -0,0 +1,936 @@
+/*
+ReferenceLines.cc
+
+Copies of the line extraction in Rtsc.cc and apparentridge.cc, for
+checking changes to it against.  See ReferenceLines.h.
+*/
+
+
+#ifdef WIN32
+#define _USE_MATH_DEFINES
+#include <cmath>
+#endif
+
+#include <stdio.h>
+#include "TriMesh.h"
+#include "LineSet.h"
+#include "ReferenceLines.h"
+
+using namespace std;
+
+namespace ReferenceLines {
+
+// Set from the View by each of the functions in ReferenceLines.h, under
+// the names the copied code uses
+static const TriMesh *themesh;
+static point viewpos;
+static bool draw_faded;
+static vec currcolor;
+static LineSet *currlines;
+
+static void set_view(const View &view)
+{
+	themesh = view.mesh;
+	viewpos = view.viewpos;
+	draw_faded = view.faded;
+	currcolor = view.color;
+	currlines = view.lines;
+}
+
+
+// Compute gradient of (kr * sin^2 theta) at vertex i
+static inline vec gradkr(int i)
+{
+	vec viewdir = viewpos - themesh->vertices[i];
+	float rlen_viewdir = 1.0f / len(viewdir);
+	viewdir *= rlen_viewdir;
+
+	float ndotv = viewdir DOT themesh->normals[i];
+	float sintheta = sqrt(1.0f - sqr(ndotv));
+	float csctheta = 1.0f / sintheta;
+	float u = (viewdir DOT themesh->pdir1[i]) * csctheta;
+	float v = (viewdir DOT themesh->pdir2[i]) * csctheta;
+	float kr = themesh->curv1[i] * u*u + themesh->curv2[i] * v*v;
+	float tr = u*v * (themesh->curv2[i] - themesh->curv1[i]);
+	float kt = themesh->curv1[i] * (1.0f - u*u) +
+		   themesh->curv2[i] * (1.0f - v*v);
+	vec w     = u * themesh->pdir1[i] + v * themesh->pdir2[i];
+	vec wperp = u * themesh->pdir2[i] - v * themesh->pdir1[i];
+	const Vec<4> &C = themesh->dcurv[i];
+
+	vec g = themesh->pdir1[i] * (u*u*C[0] + 2.0f*u*v*C[1] + v*v*C[2]) +
+		themesh->pdir2[i] * (u*u*C[1] + 2.0f*u*v*C[2] + v*v*C[3]) -
+		2.0f * csctheta * tr * (rlen_viewdir * wperp +
+					ndotv * (tr * w + kt * wperp));
+	g *= (1.0f - sqr(ndotv));
+	g -= 2.0f * kr * sintheta * ndotv * (kr * w + tr * wperp);
+	return g;
+}
+
+
+// Find a zero crossing between val0 and val1 by linear interpolation
+// Returns 0 if zero crossing is at val0, 1 if at val1, etc.
+static inline float find_zero_linear(float val0, float val1)
+{
+	return val0 / (val0 - val1);
+}
+
+
+// Find a zero crossing using Hermite interpolation
+float find_zero_hermite(int v0, int v1, float val0, float val1,
+			const vec &grad0, const vec &grad1)
+{
+	if (unlikely(val0 == val1))
+		return 0.5f;
+
+	// Find derivatives along edge (of interpolation parameter in [0,1]
+	// which means that e01 doesn't get normalized)
+	vec e01 = themesh->vertices[v1] - themesh->vertices[v0];
+	float d0 = e01 DOT grad0, d1 = e01 DOT grad1;
+
+	// This next line would reduce val to linear interpolation
+	//d0 = d1 = (val1 - val0);
+
+	// Use hermite interpolation:
+	//   val(s) = h1(s)*val0 + h2(s)*val1 + h3(s)*d0 + h4(s)*d1
+	// where
+	//  h1(s) = 2*s^3 - 3*s^2 + 1
+	//  h2(s) = 3*s^2 - 2*s^3
+	//  h3(s) = s^3 - 2*s^2 + s
+	//  h4(s) = s^3 - s^2
+	//
+	//  val(s)  = [2(val0-val1) +d0+d1]*s^3 +
+	//            [3(val1-val0)-2d0-d1]*s^2 + d0*s + val0
+	// where
+	//
+	//  val(0) = val0; val(1) = val1; val'(0) = d0; val'(1) = d1
+	//
+
+	// Coeffs of cubic a*s^3 + b*s^2 + c*s + d
+	float a = 2 * (val0 - val1) + d0 + d1;
+	float b = 3 * (val1 - val0) - 2 * d0 - d1;
+	float c = d0, d = val0;
+
+	// -- Find a root by bisection
+	// (as Newton can wander out of desired interval)
+
+	// Start with entire [0,1] interval
+	float sl = 0.0f, sr = 1.0f, valsl = val0, valsr = val1;
+
+	// Check if we're in a (somewhat uncommon) 3-root situation, and pick
+	// the middle root if it happens (given we aren't drawing curvy lines,
+	// seems the best approach..)
+	//
+	// Find extrema of derivative (a -> 3a; b -> 2b, c -> c),
+	// and check if they're both in [0,1] and have different signs
+	float disc = 4 * b - 12 * a * c;
+	if (disc > 0 && a != 0) {
+		disc = sqrt(disc);
+		float r1 = (-2 * b + disc) / (6 * a);
+		float r2 = (-2 * b - disc) / (6 * a);
+		if (r1 >= 0 && r1 <= 1 && r2 >= 0 && r2 <= 1) {
+			float vr1 = (((a * r1 + b) * r1 + c) * r1) + d;
+			float vr2 = (((a * r2 + b) * r2 + c) * r2) + d;
+			// When extrema have different signs inside an
+			// interval with endpoints with different signs,
+			// the middle root is in between the two extrema
+			if (vr1 < 0.0f && vr2 >= 0.0f ||
+			    vr1 > 0.0f && vr2 <= 0.0f) {
+				// 3 roots
+				if (r1 < r2) {
+					sl = r1;
+					valsl = vr1;
+					sr = r2;
+					valsr = vr2;
+				} else {
+					sl = r2;
+					valsl = vr2;
+					sr = r1;
+					valsr = vr1;
+				}
+			}
+		}
+	}
+
+	// Bisection method (constant number of interations)
+	for (int iter = 0; iter < 10; iter++) {
+		float sbi = (sl + sr) / 2.0f;
+		float valsbi = (((a * sbi + b) * sbi) + c) * sbi + d;
+
+		// Keep the half which has different signs
+		if (valsl < 0.0f && valsbi >= 0.0f ||
+		    valsl > 0.0f && valsbi <= 0.0f) {
+			sr = sbi;
+			valsr = valsbi;
+		} else {
+			sl = sbi;
+			valsl = valsbi;
+		}
+	}
+
+	return 0.5f * (sl + sr);
+}
+
+
+// Draw part of a zero-crossing curve on one triangle face, but only if
+// "test_num/test_den" is positive.  v0,v1,v2 are the indices of the 3
+// vertices, "val" are the values of the scalar field whose zero
+// crossings we are finding, and "test_*" are the values we are testing
+// to make sure they are positive.  This function assumes that val0 has
+// opposite sign from val1 and val2 - the following function is the
+// general one that figures out which one actually has the different sign.
+void draw_face_isoline2(int v0, int v1, int v2,
+			const vector<float> &val,
+			const vector<float> &test_num,
+			const vector<float> &test_den,
+			bool do_hermite, bool do_test, float fade)
+{
+	// How far along each edge?
+	float w10 = do_hermite ?
+		find_zero_hermite(v0, v1, val[v0], val[v1],
+				  gradkr(v0), gradkr(v1)) :
+		find_zero_linear(val[v0], val[v1]);
+	float w01 = 1.0f - w10;
+	float w20 = do_hermite ?
+		find_zero_hermite(v0, v2, val[v0], val[v2],
+				  gradkr(v0), gradkr(v2)) :
+		find_zero_linear(val[v0], val[v2]);
+	float w02 = 1.0f - w20;
+
+	// Points along edges
+	point p1 = w01 * themesh->vertices[v0] + w10 * themesh->vertices[v1];
+	point p2 = w02 * themesh->vertices[v0] + w20 * themesh->vertices[v2];
+
+	float test_num1 = 1.0f, test_num2 = 1.0f;
+	float test_den1 = 1.0f, test_den2 = 1.0f;
+	float z1 = 0.0f, z2 = 0.0f;
+	bool valid1 = true;
+	if (do_test) {
+		// Interpolate to find value of test at p1, p2
+		test_num1 = w01 * test_num[v0] + w10 * test_num[v1];
+		test_num2 = w02 * test_num[v0] + w20 * test_num[v2];
+		if (!test_den.empty()) {
+			test_den1 = w01 * test_den[v0] + w10 * test_den[v1];
+			test_den2 = w02 * test_den[v0] + w20 * test_den[v2];
+		}
+		// First point is valid iff num1/den1 is positive,
+		// i.e. the num and den have the same sign
+		valid1 = ((test_num1 >= 0.0f) == (test_den1 >= 0.0f));
+		// There are two possible zero crossings of the test,
+		// corresponding to zeros of the num and den
+		if ((test_num1 >= 0.0f) != (test_num2 >= 0.0f))
+			z1 = test_num1 / (test_num1 - test_num2);
+		if ((test_den1 >= 0.0f) != (test_den2 >= 0.0f))
+			z2 = test_den1 / (test_den1 - test_den2);
+		// Sort and order the zero crossings
+		if (z1 == 0.0f)
+			z1 = z2, z2 = 0.0f;
+		else if (z2 < z1)
+			swap(z1, z2);
+	}
+
+	// If the beginning of the segment was not valid, and
+	// no zero crossings, then whole segment invalid
+	if (!valid1 && !z1 && !z2)
+		return;
+
+	// Draw the valid piece(s)
+	int npts = 0;
+	if (valid1) {
+		currlines->setColor(currcolor[0], currcolor[1], currcolor[2],
+			  test_num1 / (test_den1 * fade + test_num1));
+		currlines->addVertex(p1);
+		npts++;
+	}
+	if (z1) {
+		float num = (1.0f - z1) * test_num1 + z1 * test_num2;
+		float den = (1.0f - z1) * test_den1 + z1 * test_den2;
+		currlines->setColor(currcolor[0], currcolor[1], currcolor[2],
+			  num / (den * fade + num));
+		currlines->addVertex((1.0f - z1) * p1 + z1 * p2);
+		npts++;
+	}
+	if (z2) {
+		float num = (1.0f - z2) * test_num1 + z2 * test_num2;
+		float den = (1.0f - z2) * test_den1 + z2 * test_den2;
+		currlines->setColor(currcolor[0], currcolor[1], currcolor[2],
+			  num / (den * fade + num));
+		currlines->addVertex((1.0f - z2) * p1 + z2 * p2);
+		npts++;
+	}
+	if (npts != 2) {
+		currlines->setColor(currcolor[0], currcolor[1], currcolor[2],
+			  test_num2 / (test_den2 * fade + test_num2));
+		currlines->addVertex(p2);
+	}
+}
+
+
+// See above.  This is the driver function that figures out which of
+// v0, v1, v2 has a different sign from the others.
+void draw_face_isoline(int v0, int v1, int v2,
+		       const vector<float> &val,
+		       const vector<float> &test_num,
+		       const vector<float> &test_den,
+		       const vector<float> &ndotv,
+		       bool do_bfcull, bool do_hermite,
+		       bool do_test, float fade)
+{
+	// Backface culling
+	bool backfacing = (ndotv[v0] <= 0.0f &&
+			   ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f);
+	if (likely(do_bfcull && backfacing)) {
+		return;
+	}
+
+	// Quick reject if derivs are negative
+	if (do_test) {
+		if (test_den.empty()) {
+			if (test_num[v0] <= 0.0f &&
+			    test_num[v1] <= 0.0f &&
+			    test_num[v2] <= 0.0f) {
+				return;
+			}
+		} else {
+			if (test_num[v0] <= 0.0f && test_den[v0] >= 0.0f &&
+			    test_num[v1] <= 0.0f && test_den[v1] >= 0.0f &&
+			    test_num[v2] <= 0.0f && test_den[v2] >= 0.0f) {
+				return;
+			}
+			if (test_num[v0] >= 0.0f && test_den[v0] <= 0.0f &&
+			    test_num[v1] >= 0.0f && test_den[v1] <= 0.0f &&
+			    test_num[v2] >= 0.0f && test_den[v2] <= 0.0f) {
+				return;
+			}
+		}
+	}
+
+	// Figure out which val has different sign, and draw
+	currlines->setFlags(backfacing ? LineSet::BACKFACING : 0);
+	currlines->setFace(v0, v1, v2);
+	if (val[v0] < 0.0f && val[v1] >= 0.0f && val[v2] >= 0.0f ||
+	    val[v0] > 0.0f && val[v1] <= 0.0f && val[v2] <= 0.0f)
+		draw_face_isoline2(v0, v1, v2,
+				   val, test_num, test_den,
+				   do_hermite, do_test, fade);
+	else if (val[v1] < 0.0f && val[v2] >= 0.0f && val[v0] >= 0.0f ||
+		 val[v1] > 0.0f && val[v2] <= 0.0f && val[v0] <= 0.0f)
+		draw_face_isoline2(v1, v2, v0,
+				   val, test_num, test_den,
+				   do_hermite, do_test, fade);
+	else if (val[v2] < 0.0f && val[v0] >= 0.0f && val[v1] >= 0.0f ||
+		 val[v2] > 0.0f && val[v0] <= 0.0f && val[v1] <= 0.0f)
+		draw_face_isoline2(v2, v0, v1,
+				   val, test_num, test_den,
+				   do_hermite, do_test, fade);
+}
+
+
+// Takes a scalar field and renders the zero crossings, but only where
+// test_num/test_den is greater than 0.
+void extract_isolines(const vector<float> &val,
+		      const vector<float> &test_num,
+		      const vector<float> &test_den,
+		      const vector<float> &ndotv,
+		      bool do_bfcull, bool do_hermite,
+		      bool do_test, float fade)
+{
+	const int *t = &themesh->tstrips[0];
+	const int *stripend = t;
+	const int *end = t + themesh->tstrips.size();
+
+	// Walk through triangle strips
+	while (1) {
+		if (unlikely(t >= stripend)) {
+			if (unlikely(t >= end))
+				return;
+			// New strip: each strip is stored as
+			// length followed by indices
+			stripend = t + 1 + *t;
+			// Skip over length plus first two indices of
+			// first face
+			t += 3;
+		}
+		// Draw a line if, among the values in this triangle,
+		// at least one is positive and one is negative
+		const float &v0 = val[*t], &v1 = val[*(t-1)], &v2 = val[*(t-2)];
+		if (unlikely((v0 > 0.0f || v1 > 0.0f || v2 > 0.0f) &&
+			     (v0 < 0.0f || v1 < 0.0f || v2 < 0.0f)))
+			draw_face_isoline(*(t-2), *(t-1), *t,
+					  val, test_num, test_den, ndotv,
+					  do_bfcull, do_hermite, do_test, fade);
+		t++;
+	}
+}
+
+
+// Draw part of a ridge/valley curve on one triangle face.  v0,v1,v2
+// are the indices of the 3 vertices; this function assumes that the
+// curve connects points on the edges v0-v1 and v1-v2
+// (or connects point on v0-v1 to center if to_center is true)
+void draw_segment_ridge(int v0, int v1, int v2,
+			float emax0, float emax1, float emax2,
+			float kmax0, float kmax1, float kmax2,
+			float thresh, bool to_center)
+{
+	// Interpolate to find ridge/valley line segment endpoints
+	// in this triangle and the curvatures there
+	float w10 = fabs(emax0) / (fabs(emax0) + fabs(emax1));
+	float w01 = 1.0f - w10;
+	point p01 = w01 * themesh->vertices[v0] + w10 * themesh->vertices[v1];
+	float k01 = fabs(w01 * kmax0 + w10 * kmax1);
+
+	point p12;
+	float k12;
+	if (to_center) {
+		// Connect first point to center of triangle
+		p12 = (themesh->vertices[v0] +
+		       themesh->vertices[v1] +
+		       themesh->vertices[v2]) / 3.0f;
+		k12 = fabs(kmax0 + kmax1 + kmax2) / 3.0f;
+	} else {
+		// Connect first point to second one (on next edge)
+		float w21 = fabs(emax1) / (fabs(emax1) + fabs(emax2));
+		float w12 = 1.0f - w21;
+		p12 = w12 * themesh->vertices[v1] + w21 * themesh->vertices[v2];
+		k12 = fabs(w12 * kmax1 + w21 * kmax2);
+	}
+
+	// Don't draw below threshold
+	k01 -= thresh;
+	if (k01 < 0.0f)
+		k01 = 0.0f;
+	k12 -= thresh;
+	if (k12 < 0.0f)
+		k12 = 0.0f;
+
+	// Skip lines that you can't see...
+	if (k01 == 0.0f && k12 == 0.0f)
+		return;
+
+	// Fade lines
+	if (draw_faded) {
+		k01 /= (k01 + thresh);
+		k12 /= (k12 + thresh);
+	} else {
+		k01 = k12 = 1.0f;
+	}
+
+	// Draw the line segment
+	currlines->setColor(currcolor[0], currcolor[1], currcolor[2], k01);
+	currlines->addVertex(p01);
+	currlines->setColor(currcolor[0], currcolor[1], currcolor[2], k12);
+	currlines->addVertex(p12);
+}
+
+
+// Draw ridges or valleys (depending on do_ridge) in a triangle v0,v1,v2
+// - uses ndotv for backface culling (enabled with do_bfcull)
+// - do_test checks for curvature maxima/minina for ridges/valleys
+//   (when off, it draws positive minima and negative maxima)
+// Note: this computes ridges/valleys every time, instead of once at the
+//   start (given they aren't view dependent, this is wasteful)
+// Algorithm based on formulas of Ohtake et al., 2004.
+void draw_face_ridges(int v0, int v1, int v2,
+		      bool do_ridge,
+		      const vector<float> &ndotv,
+		      bool do_bfcull, bool do_test, float thresh)
+{
+	// Backface culling
+	bool backfacing = (ndotv[v0] <= 0.0f &&
+			   ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f);
+	if (likely(do_bfcull && backfacing)) {
+		return;
+	}
+
+	// Check if ridge possible at vertices just based on curvatures
+	if (do_ridge) {
+		if ((themesh->curv1[v0] <= 0.0f) ||
+		    (themesh->curv1[v1] <= 0.0f) ||
+		    (themesh->curv1[v2] <= 0.0f)) {
+			return;
+		}
+	} else {
+		if ((themesh->curv1[v0] >= 0.0f) ||
+		    (themesh->curv1[v1] >= 0.0f) ||
+		    (themesh->curv1[v2] >= 0.0f)) {
+			return;
+		}
+	}
+
+	// Sign of curvature on ridge/valley
+	float rv_sign = do_ridge ? 1.0f : -1.0f;
+
+	// The "tmax" are the principal directions of maximal curvature,
+	// flipped to point in the direction in which the curvature
+	// is increasing (decreasing for valleys).  Note that this
+	// is a bit different from the notation in Ohtake et al.,
+	// but the tests below are equivalent.
+	const float &emax0 = themesh->dcurv[v0][0];
+	const float &emax1 = themesh->dcurv[v1][0];
+	const float &emax2 = themesh->dcurv[v2][0];
+	vec tmax0 = rv_sign * themesh->dcurv[v0][0] * themesh->pdir1[v0];
+	vec tmax1 = rv_sign * themesh->dcurv[v1][0] * themesh->pdir1[v1];
+	vec tmax2 = rv_sign * themesh->dcurv[v2][0] * themesh->pdir1[v2];
+
+	// We have a "zero crossing" if the tmaxes along an edge
+	// point in opposite directions
+	bool z01 = ((tmax0 DOT tmax1) <= 0.0f);
+	bool z12 = ((tmax1 DOT tmax2) <= 0.0f);
+	bool z20 = ((tmax2 DOT tmax0) <= 0.0f);
+
+	if (z01 + z12 + z20 < 2)
+		return;
+
+	if (do_test) {
+		const point &p0 = themesh->vertices[v0],
+			    &p1 = themesh->vertices[v1],
+			    &p2 = themesh->vertices[v2];
+
+		// Check whether we have the correct flavor of extremum:
+		// Is the curvature increasing along the edge?
+		z01 = z01 && ((tmax0 DOT (p1 - p0)) >= 0.0f ||
+			      (tmax1 DOT (p1 - p0)) <= 0.0f);
+		z12 = z12 && ((tmax1 DOT (p2 - p1)) >= 0.0f ||
+			      (tmax2 DOT (p2 - p1)) <= 0.0f);
+		z20 = z20 && ((tmax2 DOT (p0 - p2)) >= 0.0f ||
+			      (tmax0 DOT (p0 - p2)) <= 0.0f);
+
+		if (z01 + z12 + z20 < 2) {
+			return;
+		}
+	}
+
+	// Draw line segment
+	currlines->setFlags(backfacing ? LineSet::BACKFACING : 0);
+	currlines->setFace(v0, v1, v2);
+	const float &kmax0 = themesh->curv1[v0];
+	const float &kmax1 = themesh->curv1[v1];
+	const float &kmax2 = themesh->curv1[v2];
+	if (!z01) {
+		draw_segment_ridge(v1, v2, v0,
+				   emax1, emax2, emax0,
+				   kmax1, kmax2, kmax0,
+				   thresh, false);
+	} else if (!z12) {
+		draw_segment_ridge(v2, v0, v1,
+				   emax2, emax0, emax1,
+				   kmax2, kmax0, kmax1,
+				   thresh, false);
+	} else if (!z20) {
+		draw_segment_ridge(v0, v1, v2,
+				   emax0, emax1, emax2,
+				   kmax0, kmax1, kmax2,
+				   thresh, false);
+	} else {
+		// All three edges have crossings -- connect all to center
+		draw_segment_ridge(v1, v2, v0,
+				   emax1, emax2, emax0,
+				   kmax1, kmax2, kmax0,
+				   thresh, true);
+		draw_segment_ridge(v2, v0, v1,
+				   emax2, emax0, emax1,
+				   kmax2, kmax0, kmax1,
+				   thresh, true);
+		draw_segment_ridge(v0, v1, v2,
+				   emax0, emax1, emax2,
+				   kmax0, kmax1, kmax2,
+				   thresh, true);
+	}
+}
+
+
+// Draw the ridges (valleys) of the mesh
+void extract_mesh_ridges(bool do_ridge, const vector<float> &ndotv,
+			 bool do_bfcull, bool do_test, float thresh)
+{
+	const int *t = &themesh->tstrips[0];
+	const int *stripend = t;
+	const int *end = t + themesh->tstrips.size();
+
+	// Walk through triangle strips
+	while (1) {
+		if (unlikely(t >= stripend)) {
+			if (unlikely(t >= end))
+				return;
+			// New strip: each strip is stored as
+			// length followed by indices
+			stripend = t + 1 + *t;
+			// Skip over length plus first two indices of
+			// first face
+			t += 3;
+		}
+
+		draw_face_ridges(*(t-2), *(t-1), *t,
+				 do_ridge, ndotv, do_bfcull, do_test, thresh);
+		t++;
+	}
+}
+
+
+// Draw principal highlights on a face
+void draw_face_ph(int v0, int v1, int v2, bool do_ridge,
+		  const vector<float> &ndotv, bool do_bfcull,
+		  bool do_test, float thresh)
+{
+	// Backface culling
+	bool backfacing = (ndotv[v0] <= 0.0f &&
+			   ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f);
+	if (likely(do_bfcull && backfacing)) {
+		return;
+	}
+
+	// Orient principal directions based on the largest principal curvature
+	float k0 = themesh->curv1[v0];
+	float k1 = themesh->curv1[v1];
+	float k2 = themesh->curv1[v2];
+	if (do_test && (do_ridge ? min(min(k0,k1),k2) < 0.0f
+				 : max(max(k0,k1),k2) > 0.0f)) {
+		return;
+	}
+
+	vec d0 = themesh->pdir1[v0];
+	vec d1 = themesh->pdir1[v1];
+	vec d2 = themesh->pdir1[v2];
+	float kmax = fabs(k0);
+        // dref is the e1 vector with the largest |k1|
+	vec dref = d0;
+	if (fabs(k1) > kmax)
+		kmax = fabs(k1), dref = d1;
+	if (fabs(k2) > kmax)
+		kmax = fabs(k2), dref = d2;
+        
+        // Flip all the e1 to agree with dref
+	if ((d0 DOT dref) < 0.0f) d0 = -d0;
+	if ((d1 DOT dref) < 0.0f) d1 = -d1;
+	if ((d2 DOT dref) < 0.0f) d2 = -d2;
+
+        // If directions have flipped (more than 45 degrees), then give up
+        if ((d0 DOT dref) < M_SQRT1_2 ||
+            (d1 DOT dref) < M_SQRT1_2 ||
+            (d2 DOT dref) < M_SQRT1_2)
+          return;
+
+	// Compute view directions, dot products @ each vertex
+	vec viewdir0 = viewpos - themesh->vertices[v0];
+	vec viewdir1 = viewpos - themesh->vertices[v1];
+	vec viewdir2 = viewpos - themesh->vertices[v2];
+
+        // Normalize these for cos(theta) later...
+        normalize(viewdir0);
+        normalize(viewdir1);
+        normalize(viewdir2);
+
+        // e1 DOT w sin(theta) 
+        // -- which is zero when looking down e2
+	float dot0 = viewdir0 DOT d0;
+	float dot1 = viewdir1 DOT d1;
+	float dot2 = viewdir2 DOT d2;
+
+	// We have a "zero crossing" if the dot products along an edge
+	// have opposite signs
+	int z01 = (dot0*dot1 <= 0.0f);
+	int z12 = (dot1*dot2 <= 0.0f);
+	int z20 = (dot2*dot0 <= 0.0f);
+
+	if (z01 + z12 + z20 < 2)
+		return;
+
+	// Draw line segment
+	currlines->setFlags(backfacing ? LineSet::BACKFACING : 0);
+	currlines->setFace(v0, v1, v2);
+	float test0 = (sqr(themesh->curv1[v0]) - sqr(themesh->curv2[v0])) *
+                      viewdir0 DOT themesh->normals[v0];
+	float test1 = (sqr(themesh->curv1[v1]) - sqr(themesh->curv2[v1])) *
+                      viewdir0 DOT themesh->normals[v1];
+	float test2 = (sqr(themesh->curv1[v2]) - sqr(themesh->curv2[v2])) *
+                      viewdir0 DOT themesh->normals[v2];
+
+	if (!z01) {
+		draw_segment_ridge(v1, v2, v0,
+				   dot1, dot2, dot0,
+				   test1, test2, test0,
+				   thresh, false);
+	} else if (!z12) {
+		draw_segment_ridge(v2, v0, v1,
+				   dot2, dot0, dot1,
+				   test2, test0, test1,
+				   thresh, false);
+	} else if (!z20) {
+		draw_segment_ridge(v0, v1, v2,
+				   dot0, dot1, dot2,
+				   test0, test1, test2,
+				   thresh, false);
+	}
+}
+
+
+// Draw principal highlights
+void extract_mesh_ph(bool do_ridge, const vector<float> &ndotv,
+		     bool do_bfcull, bool do_test, float thresh)
+{
+	const int *t = &themesh->tstrips[0];
+	const int *stripend = t;
+	const int *end = t + themesh->tstrips.size();
+
+	// Walk through triangle strips
+	while (1) {
+		if (unlikely(t >= stripend)) {
+			if (unlikely(t >= end))
+				return;
+			// New strip: each strip is stored as
+			// length followed by indices
+			stripend = t + 1 + *t;
+			// Skip over length plus first two indices of
+			// first face
+			t += 3;
+		}
+
+		draw_face_ph(*(t-2), *(t-1), *t, do_ridge,
+			     ndotv, do_bfcull, do_test, thresh);
+		t++;
+	}
+}
+
+
+// Draw part of an apparent ridge/valley curve on one triangle face.
+// v0,v1,v2 are the indices of the 3 vertices; this function assumes that the
+// curve connects points on the edges v0-v1 and v1-v2
+// (or connects point on v0-v1 to center if to_center is true)
+void draw_segment_app_ridge(int v0, int v1, int v2,
+			    float emax0, float emax1, float emax2,
+			    float kmax0, float kmax1, float kmax2,
+			    const vec &tmax0, const vec &tmax1, const vec &tmax2,
+			    float thresh, bool to_center, bool do_test)
+{
+	// Interpolate to find ridge/valley line segment endpoints
+	// in this triangle and the curvatures there
+	float w10 = fabs(emax0) / (fabs(emax0) + fabs(emax1));
+	float w01 = 1.0f - w10;
+	point p01 = w01 * themesh->vertices[v0] + w10 * themesh->vertices[v1];
+	float k01 = fabs(w01 * kmax0 + w10 * kmax1);
+
+	point p12;
+	float k12;
+	if (to_center) {
+		// Connect first point to center of triangle
+		p12 = (themesh->vertices[v0] +
+		       themesh->vertices[v1] +
+		       themesh->vertices[v2]) / 3.0f;
+		k12 = fabs(kmax0 + kmax1 + kmax2) / 3.0f;
+	} else {
+		// Connect first point to second one (on next edge)
+		float w21 = fabs(emax1) / (fabs(emax1) + fabs(emax2));
+		float w12 = 1.0f - w21;
+		p12 = w12 * themesh->vertices[v1] + w21 * themesh->vertices[v2];
+		k12 = fabs(w12 * kmax1 + w21 * kmax2);
+	}
+
+	// Don't draw below threshold
+	k01 -= thresh;
+	if (k01 < 0.0f)
+		k01 = 0.0f;
+	k12 -= thresh;
+	if (k12 < 0.0f)
+		k12 = 0.0f;
+
+	// Skip lines that you can't see...
+	if (k01 == 0.0f && k12 == 0.0f)
+		return;
+
+	// Perform test: do the tmax-es point *towards* the segment? (Fig 6)
+	if (do_test) {
+		// Find the vector perpendicular to the segment (p01 <-> p12)
+		vec perp = trinorm(themesh->vertices[v0],
+				   themesh->vertices[v1],
+				   themesh->vertices[v2]) CROSS (p01 - p12);
+		// We want tmax1 to point opposite to perp, and
+		// tmax0 and tmax2 to point along it.  Otherwise, exit out.
+		if ((tmax0 DOT perp) <= 0.0f ||
+		    (tmax1 DOT perp) >= 0.0f ||
+		    (tmax2 DOT perp) <= 0.0f)
+			return;
+	}
+
+	// Fade lines
+	if (draw_faded) {
+		k01 /= (k01 + thresh);
+		k12 /= (k12 + thresh);
+	} else {
+		k01 = k12 = 1.0f;
+	}
+
+	// Draw the line segment
+	currlines->setColor(currcolor[0], currcolor[1], currcolor[2], k01);
+	currlines->addVertex(p01);
+	currlines->setColor(currcolor[0], currcolor[1], currcolor[2], k12);
+	currlines->addVertex(p12);
+}
+
+
+// Draw apparent ridges in a triangle
+void draw_face_app_ridges(int v0, int v1, int v2,
+			  const vector<float> &ndotv, const vector<float> &q1,
+			  const vector<vec2> &t1, const vector<float> &Dt1q1,
+			  bool do_bfcull, bool do_test, float thresh)
+{
+#if 0
+	// Backface culling is turned off: getting contours from the
+	// apparent ridge definition requires us to process faces that
+	// may be (just barely) backfacing...
+	if (likely(do_bfcull &&
+		   ndotv[v0] <= 0.0f && ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f))
+		return;
+#endif
+
+	// Trivial reject if this face isn't getting past the threshold anyway
+	const float &kmax0 = q1[v0];
+	const float &kmax1 = q1[v1];
+	const float &kmax2 = q1[v2];
+	if (kmax0 <= thresh && kmax1 <= thresh && kmax2 <= thresh)
+		return;
+
+	// The "tmax" are the principal directions of view-dependent curvature,
+	// flipped to point in the direction in which the curvature
+	// is increasing.
+	const float &emax0 = Dt1q1[v0];
+	const float &emax1 = Dt1q1[v1];
+	const float &emax2 = Dt1q1[v2];
+	vec world_t1_0 = t1[v0][0] * themesh->pdir1[v0] +
+			 t1[v0][1] * themesh->pdir2[v0];
+	vec world_t1_1 = t1[v1][0] * themesh->pdir1[v1] +
+			 t1[v1][1] * themesh->pdir2[v1];
+	vec world_t1_2 = t1[v2][0] * themesh->pdir1[v2] +
+			 t1[v2][1] * themesh->pdir2[v2];
+	vec tmax0 = Dt1q1[v0] * world_t1_0;
+	vec tmax1 = Dt1q1[v1] * world_t1_1;
+	vec tmax2 = Dt1q1[v2] * world_t1_2;
+
+	// We have a "zero crossing" if the tmaxes along an edge
+	// point in opposite directions
+	bool z01 = ((tmax0 DOT tmax1) <= 0.0f);
+	bool z12 = ((tmax1 DOT tmax2) <= 0.0f);
+	bool z20 = ((tmax2 DOT tmax0) <= 0.0f);
+
+	if (z01 + z12 + z20 < 2)
+		return;
+
+	// Draw line segment
+	currlines->setFace(v0, v1, v2);
+	if (!z01) {
+		draw_segment_app_ridge(v1, v2, v0,
+				       emax1, emax2, emax0,
+				       kmax1, kmax2, kmax0,
+				       tmax1, tmax2, tmax0,
+				       thresh, false, do_test);
+	} else if (!z12) {
+		draw_segment_app_ridge(v2, v0, v1,
+				       emax2, emax0, emax1,
+				       kmax2, kmax0, kmax1,
+				       tmax2, tmax0, tmax1,
+				       thresh, false, do_test);
+	} else if (!z20) {
+		draw_segment_app_ridge(v0, v1, v2,
+				       emax0, emax1, emax2,
+				       kmax0, kmax1, kmax2,
+				       tmax0, tmax1, tmax2,
+				       thresh, false, do_test);
+	} else {
+		// All three edges have crossings -- connect all to center
+		draw_segment_app_ridge(v1, v2, v0,
+				       emax1, emax2, emax0,
+				       kmax1, kmax2, kmax0,
+				       tmax1, tmax2, tmax0,
+				       thresh, true, do_test);
+		draw_segment_app_ridge(v2, v0, v1,
+				       emax2, emax0, emax1,
+				       kmax2, kmax0, kmax1,
+				       tmax2, tmax0, tmax1,
+				       thresh, true, do_test);
+		draw_segment_app_ridge(v0, v1, v2,
+				       emax0, emax1, emax2,
+				       kmax0, kmax1, kmax2,
+				       tmax0, tmax1, tmax2,
+				       thresh, true, do_test);
+	}
+}
+
+
+// Draw apparent ridges of the mesh
+void extract_mesh_app_ridges(const vector<float> &ndotv,
+			     const vector<float> &q1,
+			     const vector<vec2> &t1,
+			     const vector<float> &Dt1q1,
+			     bool do_bfcull, bool do_test, float thresh)
+{
+	const int *t = &themesh->tstrips[0];
+	const int *stripend = t;
+	const int *end = t + themesh->tstrips.size();
+
+	// Walk through triangle strips
+	while (1) {
+		if (unlikely(t >= stripend)) {
+			if (unlikely(t >= end))
+				return;
+			// New strip: each strip is stored as
+			// length followed by indices
+			stripend = t + 1 + *t;
+			// Skip over length plus first two indices of
+			// first face
+			t += 3;
+		}
+
+		draw_face_app_ridges(*(t-2), *(t-1), *t,
+				     ndotv, q1, t1, Dt1q1,
+				     do_bfcull, do_test, thresh);
+		t++;
+	}
+}
+
+
+
+void draw_isolines(const View &view,
+		   const vector<float> &val,
+		   const vector<float> &test_num,
+		   const vector<float> &test_den,
+		   const vector<float> &ndotv,
+		   bool do_bfcull, bool do_hermite,
+		   bool do_test, float fade)
+{
+	set_view(view);
+	extract_isolines(val, test_num, test_den, ndotv,
+			 do_bfcull, do_hermite, do_test, fade);
+}
+
+
+void draw_mesh_ridges(const View &view, bool do_ridge,
+		      const vector<float> &ndotv,
+		      bool do_bfcull, bool do_test, float thresh)
+{
+	set_view(view);
+	extract_mesh_ridges(do_ridge, ndotv, do_bfcull, do_test, thresh);
+}
+
+
+void draw_mesh_ph(const View &view, bool do_ridge,
+		  const vector<float> &ndotv,
+		  bool do_bfcull, bool do_test, float thresh)
+{
+	set_view(view);
+	extract_mesh_ph(do_ridge, ndotv, do_bfcull, do_test, thresh);
+}
+
+
+void draw_mesh_app_ridges(const View &view,
+			  const vector<float> &ndotv,
+			  const vector<float> &q1,
+			  const vector<vec2> &t1,
+			  const vector<float> &Dt1q1,
+			  bool do_bfcull, bool do_test, float thresh)
+{
+	set_view(view);
+	extract_mesh_app_ridges(ndotv, q1, t1, Dt1q1,
+				do_bfcull, do_test, thresh);
+}
+
+} // namespace ReferenceLines
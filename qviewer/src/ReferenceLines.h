@@ -0,0 +1,66 @@
+/*
+ ReferenceLines.h
+
+ The line extraction of Rtsc kept as it is, to check optimized versions
+ of it against: draw_isolines, draw_mesh_ridges, draw_mesh_ph and
+ draw_mesh_app_ridges, with the same arguments and the same segments,
+ colors and order. The copies read their mesh, view and style from a
+ View instead of Rtsc's globals, keep no statistics, and record the face
+ of each segment (see LineSet::setFace).
+
+ Leave these alone when changing the extraction in Rtsc.cc or
+ apparentridge.cc; qrtsc_check (qviewer/check) compares the two.
+ */
+
+#ifndef REFERENCE_LINES_H_
+#define REFERENCE_LINES_H_
+
+#include "Vec.h"
+#include <vector>
+
+class TriMesh;
+class LineSet;
+
+namespace ReferenceLines {
+
+// What Rtsc's globals give the extraction: themesh, lineview.viewpos,
+// "Style->Draw Faded", currcolor and currlines
+struct View
+{
+	const TriMesh	*mesh;
+	point		viewpos;
+	bool		faded;
+	vec		color;
+	LineSet		*lines;
+};
+
+// As Rtsc's draw_isolines without share_extraction
+void draw_isolines(const View &view,
+		   const std::vector<float> &val,
+		   const std::vector<float> &test_num,
+		   const std::vector<float> &test_den,
+		   const std::vector<float> &ndotv,
+		   bool do_bfcull, bool do_hermite,
+		   bool do_test, float fade);
+
+// As Rtsc's draw_mesh_ridges without share_extraction
+void draw_mesh_ridges(const View &view, bool do_ridge,
+		      const std::vector<float> &ndotv,
+		      bool do_bfcull, bool do_test, float thresh);
+
+// As Rtsc's draw_mesh_ph without share_extraction
+void draw_mesh_ph(const View &view, bool do_ridge,
+		  const std::vector<float> &ndotv,
+		  bool do_bfcull, bool do_test, float thresh);
+
+// As Rtsc::draw_mesh_app_ridges
+void draw_mesh_app_ridges(const View &view,
+			  const std::vector<float> &ndotv,
+			  const std::vector<float> &q1,
+			  const std::vector<vec2> &t1,
+			  const std::vector<float> &Dt1q1,
+			  bool do_bfcull, bool do_test, float thresh);
+
+}
+
+#endif // REFERENCE_LINES_H_
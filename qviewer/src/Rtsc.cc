@@ -24,16 +24,34 @@ Port modifications by:
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef LINUX
+#include <malloc.h>
+#endif
 #include "TriMesh.h"
 #include "TriMesh_algo.h"
 #include "XForm.h"
 #include "apparentridge.h"
 #include "timestamp.h"
 #include <algorithm>
+#include <map>
 #include "DialsAndKnobs.h"
+#include "TaskGraph.h"
+#include "Stats.h"
 #include "GQInclude.h"
 #include "GQShaderManager.h"
 #include "GQTexture.h"
+#include "GQTimerQueries.h"
+#include "Rtsc.h"
+#include "LineSet.h"
+#include "ReferenceLines.h"
+#include "LineSimplifier.h"
+#include "SoftRaster.h"
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QTimer>
 
 using namespace std;
 
@@ -42,47 +60,51 @@ namespace Rtsc {
 TriMesh* themesh;
 
 // Toggles for drawing various lines
-static dkBool draw_extsil("Lines->Silhouette", false);
-static dkBool draw_c("Lines->Occluding Contours", true);
-static dkBool draw_sc("Lines->Suggestive Contours", true);
-static dkBool draw_sh("Lines->Suggestive Highlights", false);
-static dkBool draw_phridges("Lines->Principal Hlt. (R)", false);
-static dkBool draw_phvalleys("Lines->Principal Hlt. (V)", false);
-static dkBool draw_ridges("Lines->Ridges", false);
-static dkBool draw_valleys("Lines->Valleys", false);
-static dkBool draw_apparent("Lines->Apparent Ridges", false);
-static dkBool draw_K("Lines->K", false);
-static dkBool draw_H("Lines->H", false);
-static dkBool draw_DwKr("Lines->DwKr", false);
-static dkBool draw_bdy("Lines->Boundary", true);
-static dkBool draw_isoph("Lines->Isophotes", false);
-static dkBool draw_topo("Lines->Topo Lines", false);
-static dkInt niso("Lines-># Isophotes", 20);
-static dkInt ntopo("Lines-># Topo Lines", 20);
-static dkFloat topo_offset("Lines->Topo Offset", 0.0);
-static dkBool enable_lines("Lines->Enable Lines", true);
+static dkBool ui_draw_extsil("Lines->Silhouette", false);
+static dkBool ui_draw_c("Lines->Occluding Contours", true);
+static dkBool ui_draw_sc("Lines->Suggestive Contours", true);
+static dkBool ui_draw_sh("Lines->Suggestive Highlights", false);
+static dkBool ui_draw_phridges("Lines->Principal Hlt. (R)", false);
+static dkBool ui_draw_phvalleys("Lines->Principal Hlt. (V)", false);
+static dkBool ui_draw_ridges("Lines->Ridges", false);
+static dkBool ui_draw_valleys("Lines->Valleys", false);
+static dkBool ui_draw_apparent("Lines->Apparent Ridges", false);
+static dkBool ui_draw_K("Lines->K", false);
+static dkBool ui_draw_H("Lines->H", false);
+static dkBool ui_draw_DwKr("Lines->DwKr", false);
+static dkBool ui_draw_bdy("Lines->Boundary", true);
+static dkBool ui_draw_isoph("Lines->Isophotes", false);
+static dkBool ui_draw_topo("Lines->Topo Lines", false);
+static dkInt ui_niso("Lines-># Isophotes", 20);
+static dkInt ui_ntopo("Lines-># Topo Lines", 20);
+static dkFloat ui_topo_offset("Lines->Topo Offset", 0.0);
+static dkBool ui_enable_lines("Lines->Enable Lines", true);
+static dkBool extract_in_background("Lines->Extract in Background", false);
+static dkBool ui_screen_thinning("Lines->Screen-Space Thinning", false);
+static dkInt ui_max_per_cell("Lines->Max Segments Per Cell", 8, 1, 64, 1);
 
 // Toggles for tests we perform
-static dkBool draw_hidden("Tests->Draw Hidden Lines", false);
-static dkBool test_c("Tests->Trim \"inside\" contours", false);
-static dkBool test_sc("Tests->Trim SC", true);
-static dkBool test_sh("Tests->Trim SH", true);
-static dkBool test_ph("Tests->Trim PH", true);
-static dkBool test_rv("Tests->Trim RV", true);
-static dkBool test_ar("Tests->Trim AR", true);
-static dkFloat sug_thresh("Tests->SC Thresh", 0.01, 0.0, 1, 0.01);
-static dkFloat sh_thresh("Tests->SH Thresh", 0.02, 0.0, 1, 0.01);
-static dkFloat ph_thresh("Tests->PH Thresh", 0.04, 0.0, 1, 0.01);
-static dkFloat rv_thresh("Tests->RV Thresh", 0.1, 0.0, 1, 0.01);
-static dkFloat ar_thresh("Tests->AR Thresh", 0.1, 0.0, 1, 0.01);
+static dkBool ui_draw_hidden("Tests->Draw Hidden Lines", false);
+static dkBool ui_test_c("Tests->Trim \"inside\" contours", false);
+static dkBool ui_test_sc("Tests->Trim SC", true);
+static dkBool ui_test_sh("Tests->Trim SH", true);
+static dkBool ui_test_ph("Tests->Trim PH", true);
+static dkBool ui_test_rv("Tests->Trim RV", true);
+static dkBool ui_test_ar("Tests->Trim AR", true);
+static dkFloat ui_sug_thresh("Tests->SC Thresh", 0.01, 0.0, 1, 0.01);
+static dkFloat ui_sh_thresh("Tests->SH Thresh", 0.02, 0.0, 1, 0.01);
+static dkFloat ui_ph_thresh("Tests->PH Thresh", 0.04, 0.0, 1, 0.01);
+static dkFloat ui_rv_thresh("Tests->RV Thresh", 0.1, 0.0, 1, 0.01);
+static dkFloat ui_ar_thresh("Tests->AR Thresh", 0.1, 0.0, 1, 0.01);
 static dkFloat poly_offset_factor("Tests->Polygon Offset", 5.0);
 
 // Toggles for style
-static dkBool use_texture("Style->Use Texture", false);
-static dkBool draw_faded("Style->Draw Faded", true);
-static dkBool draw_colors("Style->Draw Colors", false);
-static dkBool use_hermite("Style->Use Hermite", false);
-static dkBool single_pixel_lines("Style->Single Pixel Wide", false);
+static dkBool ui_use_texture("Style->Use Texture", false);
+static dkBool ui_draw_faded("Style->Draw Faded", true);
+static dkBool ui_draw_colors("Style->Draw Colors", false);
+static dkBool ui_use_hermite("Style->Use Hermite", false);
+static dkFloat target_fps("Style->Target FPS", 0.0, 0.0, 120.0, 5.0);
+static dkBool ui_single_pixel_lines("Style->Single Pixel Wide", false);
 static dkBool draw_edges("Style->Draw Edges", false);
     
 // Mesh colorization
@@ -90,13 +112,13 @@ vector<Color> curv_colors, gcurv_colors;
 static QStringList mesh_color_types = QStringList() << "White" << "Gray" 
     << "Black" << "Curvature" << "Gaussian C." << "Mesh" << "Depth"
     << "Normals" << "Texture";
-static dkStringList color_style("Style->Mesh Color", mesh_color_types);
+static dkStringList ui_color_style("Style->Mesh Color", mesh_color_types);
 
 // Lighting
 static QStringList lighting_types = QStringList() << "None" << "Lambertian" 
     << "Lambertian2" << "Hemisphere" << "Shiny" 
     << "Toon" << "Toon BW" << "Gooch";    
-static dkStringList lighting_style("Style->Lighting", lighting_types);
+static dkStringList ui_lighting_style("Style->Lighting", lighting_types);
 vec light_direction;
     
 // Background color
@@ -117,18 +139,150 @@ static dkBool draw_asymp("Vectors->Asymptotic", false);
 static dkBool draw_w("Vectors->W", false);
 static dkBool draw_wperp("Vectors->W Perp", false);
 
+// The line extraction reads the dials above through these copies, taken
+// by take_line_view() while no extraction is running.  An extraction in
+// the background then sees the dials the attributes and per-view arrays
+// were computed for, however they move until it finishes.
+class DialSnapshot
+{
+public:
+	DialSnapshot() : _stamp(0) { snapshots().append(this); }
+	virtual ~DialSnapshot() {}
+
+	// The dial's change stamp as of the last take()
+	int changeStamp() const { return _stamp; }
+
+	static void takeAll()
+	{
+		for (int i = 0; i < snapshots().size(); i++)
+			snapshots()[i]->take();
+	}
+
+protected:
+	virtual void take() = 0;
+
+	static QList<DialSnapshot*> &snapshots()
+	{
+		static QList<DialSnapshot*> list;
+		return list;
+	}
+
+protected:
+	int _stamp;
+};
+
+template <class Dial, class T>
+class ExtractionDial : public DialSnapshot
+{
+public:
+	ExtractionDial(const Dial &dial) : _dial(dial) { take(); }
+
+	T value() const { return _value; }
+	operator T() const { return _value; }
+	bool operator == (const T &b) const { return _value == b; }
+	bool operator != (const T &b) const { return _value != b; }
+
+protected:
+	void take()
+	{
+		_value = _dial;
+		_stamp = _dial.changeStamp();
+	}
+
+protected:
+	const Dial	&_dial;
+	T		_value;
+};
+
+typedef ExtractionDial<dkBool, bool> ExtractionBool;
+typedef ExtractionDial<dkInt, int> ExtractionInt;
+typedef ExtractionDial<dkFloat, double> ExtractionFloat;
+typedef ExtractionDial<dkStringList, QString> ExtractionStringList;
+
+static ExtractionBool draw_extsil(ui_draw_extsil), draw_c(ui_draw_c),
+	draw_sc(ui_draw_sc), draw_sh(ui_draw_sh),
+	draw_phridges(ui_draw_phridges), draw_phvalleys(ui_draw_phvalleys),
+	draw_ridges(ui_draw_ridges), draw_valleys(ui_draw_valleys),
+	draw_apparent(ui_draw_apparent), draw_K(ui_draw_K), draw_H(ui_draw_H),
+	draw_DwKr(ui_draw_DwKr), draw_bdy(ui_draw_bdy),
+	draw_isoph(ui_draw_isoph), draw_topo(ui_draw_topo),
+	enable_lines(ui_enable_lines), screen_thinning(ui_screen_thinning);
+static ExtractionInt niso(ui_niso), ntopo(ui_ntopo),
+	max_per_cell(ui_max_per_cell);
+static ExtractionFloat topo_offset(ui_topo_offset);
+static ExtractionBool draw_hidden(ui_draw_hidden), test_c(ui_test_c),
+	test_sc(ui_test_sc), test_sh(ui_test_sh), test_ph(ui_test_ph),
+	test_rv(ui_test_rv), test_ar(ui_test_ar);
+static ExtractionFloat sug_thresh(ui_sug_thresh), sh_thresh(ui_sh_thresh),
+	ph_thresh(ui_ph_thresh), rv_thresh(ui_rv_thresh),
+	ar_thresh(ui_ar_thresh);
+static ExtractionBool use_texture(ui_use_texture),
+	draw_faded(ui_draw_faded), draw_colors(ui_draw_colors),
+	use_hermite(ui_use_hermite), single_pixel_lines(ui_single_pixel_lines);
+static ExtractionStringList color_style(ui_color_style),
+	lighting_style(ui_lighting_style);
+
 // Other miscellaneous variables
 float feature_size;	// Used to make thresholds dimensionless
 float currsmooth;	// Used in smoothing
+int mesh_revision;	// Bumped whenever themesh or its attributes change
 vec currcolor;		// Current line color
+LineSet* currlines;	// Where the line extraction puts its segments
 xform xf;           // Local copy of the viewing transform
 point viewpos;
+
+// Bumped by setCameraTransform and setLightDir when the value changes
+static int camera_version = 0;
+static int light_version = 0;
+
+// The camera and light the lines are extracted for.  A copy of xf,
+// viewpos and light_direction taken when the extraction starts, so that
+// an extraction in the background (see start_extraction) doesn't see
+// the camera move under it.
+struct LineView
+{
+	xform		xf;
+	point		viewpos;
+	vec		light_direction;
+	int		camera_version;
+	int		light_version;
+	int		frame;		// DialsAndKnobs::frameCounter()
+	timestamp	time;
+	// For screen-space simplification; not known in software
+	bool		have_screen;
+	xform		projection;
+	int		viewport[4];
+	int		attributes;	// required_attributes()
+};
+static LineView lineview;	// Of the extraction running or last run
+static LineView shownview;	// Of the lines being drawn
+
+// Projection and viewport of the window, read by read_screen()
+static bool have_screen = false;
+static xform screen_projection;
+static int screen_viewport[4];
+
+// Line quality, lowered in this order by govern_quality() while the
+// camera moves and frames take longer than "Style->Target FPS" allows
+enum { FULL_QUALITY, NO_HERMITE, NO_HIDDEN_LINES, COARSE_MESH,
+       DECIMATED_LINES, NUM_QUALITY_LEVELS };
+static int quality_level = FULL_QUALITY;
     
 // Per-vertex computed values at each frame
 vector<float> ndotv, kr;
+vector<float> dwkr;
 vector<float> sctest_num, sctest_den, shtest_num;
 vector<float> q1, Dt1q1;
 vector<vec2> t1;
+vector<float> texcoords;	// For draw_c_sc_texture
+
+// Set by redrawCapture(): the mesh is drawn into all three capture
+// attachments, everything else only into CAPTURE_SHADED.
+static bool capturing = false;
+static const GLenum capture_buffers[NUM_CAPTURE_BUFFERS] = {
+    GL_COLOR_ATTACHMENT0_EXT + CAPTURE_SHADED,
+    GL_COLOR_ATTACHMENT0_EXT + CAPTURE_NORMALS,
+    GL_COLOR_ATTACHMENT0_EXT + CAPTURE_DEPTH };
 
 // Draw triangle strips.  They are stored as length followed by values.
 void draw_tstrips()
@@ -146,9 +300,9 @@ void draw_tstrips()
 void set_line_width(float amount)
 {
     if (single_pixel_lines)
-        glLineWidth(1.0);
+        currlines->setWidth(1.0);
     else
-        glLineWidth(amount);
+        currlines->setWidth(amount);
 }
 
 // Create a texture with a black line of the given width.
@@ -196,7 +350,6 @@ void draw_c_sc_texture(const vector<float> &ndotv,
 	glEnableClientState(GL_VERTEX_ARRAY);
 	glVertexPointer(3, GL_FLOAT, 0, &themesh->vertices[0][0]);
 
-	static vector<float> texcoords;
 	int nv = themesh->vertices.size();
 	texcoords.resize(2*nv);
 	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
@@ -320,6 +473,26 @@ bool load_texture( const QString& filename)
     return ret; 
 }
 
+// The shader program for the current lighting style
+static const char* lighting_program()
+{
+    if (lighting_style == "Lambertian")
+        return "diffuse";
+    else if (lighting_style == "Lambertian2")
+        return "diffuse2";
+    else if (lighting_style == "Hemisphere")
+        return "hemisphere";
+    else if (lighting_style == "Shiny")
+        return "shiny";
+    else if (lighting_style == "Toon")
+        return "toon";
+    else if (lighting_style == "Toon BW")
+        return "toonbw";
+    else if (lighting_style == "Gooch")
+        return "gooch";
+    return "nolighting";
+}
+
 // Draw the basic mesh, which we'll overlay with lines
 void draw_base_mesh()
 {
@@ -369,8 +542,20 @@ void draw_base_mesh()
     } 
 
     GQShaderRef shader;
+    // Shaded color, normals and depth at once
+    if (capturing) {
+        // Normals and depth get attachments of their own, so the shaded
+        // attachment treats those colors as white.
+        if (color_style == "Depth" || color_style == "Normals")
+            glColor3f(1,1,1);
+        shader = GQShaderManager::bindProgram(
+            QString("capture_") + lighting_program());
+        shader.setUniform3fv("light_dir_world", light_direction);
+        shader.setUniform3fv("bsphere_center", themesh->bsphere.center);
+        shader.setUniform1f("bsphere_radius", themesh->bsphere.r);
+    }
     // Shaders for debugging colors
-    if (color_style == "Depth") {
+    else if (color_style == "Depth") {
         shader = GQShaderManager::bindProgram("depth");
         shader.setUniform3fv("bsphere_center", themesh->bsphere.center);
         shader.setUniform1f("bsphere_radius", themesh->bsphere.r);
@@ -379,27 +564,11 @@ void draw_base_mesh()
     }
     // Actual lighting shaders
     else {
-        if (lighting_style == "None") {
-            shader = GQShaderManager::bindProgram("nolighting");
-        } else {
-            if (lighting_style == "Lambertian") {
-                shader = GQShaderManager::bindProgram("diffuse");
-            } else if (lighting_style == "Lambertian2") {
-                shader = GQShaderManager::bindProgram("diffuse2");
-            } else if (lighting_style == "Hemisphere") {
-                shader = GQShaderManager::bindProgram("hemisphere");
-            } else if (lighting_style == "Shiny") {
-                shader = GQShaderManager::bindProgram("shiny");
-            } else if (lighting_style == "Toon") {
-                shader = GQShaderManager::bindProgram("toon");
-            } else if (lighting_style == "Toon BW") {
-                shader = GQShaderManager::bindProgram("toonbw");
-            } else if (lighting_style == "Gooch") {
-                shader = GQShaderManager::bindProgram("gooch");
-            }
+        shader = GQShaderManager::bindProgram(lighting_program());
+        if (lighting_style != "None")
             shader.setUniform3fv("light_dir_world", light_direction);
-        }
-        
+    }
+    if (capturing || (color_style != "Depth" && color_style != "Normals")) {
         if (color_style == "Texture") {
             shader.bindNamedTexture("texture", &texture);
             shader.setUniform1f("texture_scale", texture_scale);
@@ -420,7 +589,11 @@ void draw_base_mesh()
 	glEnable(GL_CULL_FACE);
 
     // Draw geometry, no display list
+    if (capturing)
+        glDrawBuffers(NUM_CAPTURE_BUFFERS, capture_buffers);
     draw_tstrips();
+    if (capturing)
+        glDrawBuffer(capture_buffers[CAPTURE_SHADED]);
 
 	// Reset everything
     shader.unbind();    
@@ -436,7 +609,7 @@ void draw_base_mesh()
 	glDepthMask(GL_FALSE); // Do not remove me, else get dotted lines
     
 	// Draw the mesh edges on top, if requested
-	set_line_width(1);
+	glLineWidth(1);
 	if (draw_edges) {
 		glPolygonMode(GL_FRONT, GL_LINE);
 		glColor3f(0.5, 1.0, 1.0);
@@ -540,43 +713,43 @@ void draw_base_mesh()
 
 // Compute per-vertex n dot l, n dot v, radial curvature, and
 // derivative of curvature for the current view
+// (The DwKr thresholds are applied by compute_thresholds.)
 void compute_perview(vector<float> &ndotv, vector<float> &kr,
-		     vector<float> &sctest_num, vector<float> &sctest_den,
-		     vector<float> &shtest_num, vector<float> &q1,
+		     vector<float> &dwkr, vector<float> &q1,
 		     vector<vec2> &t1, vector<float> &Dt1q1,
 		     bool extra_sin2theta = false)
 {
-	if (draw_apparent)
-		themesh->need_adjacentfaces();
-
 	int nv = themesh->vertices.size();
 
-	float scthresh = sug_thresh / sqr(feature_size);
-	float shthresh = sh_thresh / sqr(feature_size);
-	bool need_DwKr = (draw_sc || draw_sh || draw_DwKr);
+	// Everything but n dot v needs the curvatures, which are only
+	// computed once some line or color asks for them
+	bool have_curv = (themesh->curv1.size() == nv);
+
+	bool need_DwKr = have_curv && (draw_sc || draw_sh || draw_DwKr);
+	bool need_apparent = have_curv && draw_apparent;
 
 	ndotv.resize(nv);
 	kr.resize(nv);
-	if (draw_apparent) {
+	if (need_apparent) {
 		q1.resize(nv);
 		t1.resize(nv);
 		Dt1q1.resize(nv);
 	}
-	if (need_DwKr) {
-		sctest_num.resize(nv);
-		sctest_den.resize(nv);
-		if (draw_sh)
-			shtest_num.resize(nv);
-	}
+	if (need_DwKr)
+		dwkr.resize(nv);
+	else
+		dwkr.clear();
 
 	// Compute quantities at each vertex
 #pragma omp parallel for
 	for (int i = 0; i < nv; i++) {
 		// Compute n DOT v
-		vec viewdir = viewpos - themesh->vertices[i];
+		vec viewdir = lineview.viewpos - themesh->vertices[i];
 		float rlv = 1.0f / len(viewdir);
 		viewdir *= rlv;
 		ndotv[i] = viewdir DOT themesh->normals[i];
+		if (!have_curv)
+			continue;
 
 		float u = viewdir DOT themesh->pdir1[i], u2 = u*u;
 		float v = viewdir DOT themesh->pdir2[i], v2 = v*v;
@@ -584,7 +757,7 @@ void compute_perview(vector<float> &ndotv, vector<float> &kr,
 		// Note:  this is actually Kr * sin^2 theta
 		kr[i] = themesh->curv1[i] * u2 + themesh->curv2[i] * v2;
 
-		if (draw_apparent) {
+		if (need_apparent) {
 			float csc2theta = 1.0f / (u2 + v2);
 			Rtsc::compute_viewdep_curv(themesh, i, ndotv[i],
 				u2*csc2theta, u*v*csc2theta, v2*csc2theta,
@@ -594,27 +767,19 @@ void compute_perview(vector<float> &ndotv, vector<float> &kr,
 			continue;
 
 		// Use DwKr * sin(theta) / cos(theta) for cutoff test
-		sctest_num[i] = u2 * (     u*themesh->dcurv[i][0] +
-				      3.0f*v*themesh->dcurv[i][1]) +
-				v2 * (3.0f*u*themesh->dcurv[i][2] +
-					   v*themesh->dcurv[i][3]);
+		dwkr[i] = u2 * (     u*themesh->dcurv[i][0] +
+			       3.0f*v*themesh->dcurv[i][1]) +
+			  v2 * (3.0f*u*themesh->dcurv[i][2] +
+				    v*themesh->dcurv[i][3]);
 		float csc2theta = 1.0f / (u2 + v2);
-		sctest_num[i] *= csc2theta;
+		dwkr[i] *= csc2theta;
 		float tr = (themesh->curv2[i] - themesh->curv1[i]) *
 			   u * v * csc2theta;
-		sctest_num[i] -= 2.0f * ndotv[i] * sqr(tr);
+		dwkr[i] -= 2.0f * ndotv[i] * sqr(tr);
 		if (extra_sin2theta)
-			sctest_num[i] *= u2 + v2;
-
-		sctest_den[i] = ndotv[i];
-
-		if (draw_sh) {
-			shtest_num[i] = -sctest_num[i];
-			shtest_num[i] -= shthresh * sctest_den[i];
-		}
-		sctest_num[i] -= scthresh * sctest_den[i];
+			dwkr[i] *= u2 + v2;
 	}
-	if (draw_apparent) {
+	if (need_apparent) {
 #pragma omp parallel for
 		for (int i = 0; i < nv; i++)
 			Rtsc::compute_Dt1q1(themesh, i, ndotv[i], q1, t1, Dt1q1[i]);
@@ -622,10 +787,35 @@ void compute_perview(vector<float> &ndotv, vector<float> &kr,
 }
 
 
+// The suggestive contour and highlight tests: DwKr less the thresholds.
+// Kept out of compute_perview so the threshold sliders don't rerun it.
+void compute_thresholds(const vector<float> &ndotv, const vector<float> &dwkr,
+			vector<float> &sctest_num, vector<float> &sctest_den,
+			vector<float> &shtest_num)
+{
+	int nv = dwkr.size();
+	float scthresh = sug_thresh / sqr(feature_size);
+	float shthresh = sh_thresh / sqr(feature_size);
+
+	sctest_num.resize(nv);
+	sctest_den.resize(nv);
+	if (draw_sh)
+		shtest_num.resize(nv);
+
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++) {
+		sctest_den[i] = ndotv[i];
+		if (draw_sh)
+			shtest_num[i] = -dwkr[i] - shthresh * sctest_den[i];
+		sctest_num[i] = dwkr[i] - scthresh * sctest_den[i];
+	}
+}
+
+
 // Compute gradient of (kr * sin^2 theta) at vertex i
 static inline vec gradkr(int i)
 {
-	vec viewdir = viewpos - themesh->vertices[i];
+	vec viewdir = lineview.viewpos - themesh->vertices[i];
 	float rlen_viewdir = 1.0f / len(viewdir);
 	viewdir *= rlen_viewdir;
 
@@ -652,10 +842,56 @@ static inline vec gradkr(int i)
 }
 
 
+// What the extraction of one type of line did, counted by the face
+// functions below and reported by LineTypeStats.  Plain ints: only one
+// thread extracts at a time.
+static struct ExtractionCounts
+{
+	int	faces;		// Visited
+	int	backfacing;	// Rejected as backfacing
+	int	test_rejects;	// Rejected by test_num/test_den
+	int	sign_rejects;	// Rejected by the sign of the curvature
+	int	zero_crossings;	// Solved along edges
+	int	bisections;	// Hermite bisection steps
+} counts;
+
+// Times the extraction of one type of line in the enclosing block, then
+// adds what it counted and the segments it emitted to the counters
+class LineTypeStats
+{
+public:
+	LineTypeStats(const char *name)
+		: _name(name), _first_segment(currlines->numSegments())
+	{
+		counts = ExtractionCounts();
+		__START_TIMER(_name);
+	}
+
+	~LineTypeStats()
+	{
+		__ADD_TO_COUNTER("Faces Visited", counts.faces);
+		__ADD_TO_COUNTER("Faces Rejected: Backfacing", counts.backfacing);
+		__ADD_TO_COUNTER("Faces Rejected: Test", counts.test_rejects);
+		__ADD_TO_COUNTER("Faces Rejected: Curvature Sign",
+				 counts.sign_rejects);
+		__ADD_TO_COUNTER("Zero Crossings", counts.zero_crossings);
+		__ADD_TO_COUNTER("Hermite Bisections", counts.bisections);
+		__ADD_TO_COUNTER(QString("Segments: ") + _name,
+				 currlines->numSegments() - _first_segment);
+		__STOP_TIMER(_name);
+	}
+
+private:
+	const char	*_name;
+	int		_first_segment;
+};
+
+
 // Find a zero crossing between val0 and val1 by linear interpolation
 // Returns 0 if zero crossing is at val0, 1 if at val1, etc.
 static inline float find_zero_linear(float val0, float val1)
 {
+	counts.zero_crossings++;
 	return val0 / (val0 - val1);
 }
 
@@ -664,6 +900,7 @@ static inline float find_zero_linear(float val0, float val1)
 float find_zero_hermite(int v0, int v1, float val0, float val1,
 			const vec &grad0, const vec &grad1)
 {
+	counts.zero_crossings++;
 	if (unlikely(val0 == val1))
 		return 0.5f;
 
@@ -751,11 +988,92 @@ float find_zero_hermite(int v0, int v1, float val0, float val1,
 			valsl = valsbi;
 		}
 	}
+	counts.bisections += 10;
 
 	return 0.5f * (sl + sr);
 }
 
 
+// Hashes the inputs of a stage or extraction (FNV-1a)
+class FrameKey
+{
+public:
+	FrameKey() : _hash(14695981039346656037ULL) {}
+
+	void add(const void *data, size_t size)
+	{
+		const unsigned char *bytes = (const unsigned char *) data;
+		for (size_t i = 0; i < size; i++) {
+			_hash ^= bytes[i];
+			_hash *= 1099511628211ULL;
+		}
+	}
+	template <class T> void add(const T &value) { add(&value, sizeof(T)); }
+	// Arrays are told apart by their storage, not their contents
+	template <class T> void add(const vector<T> &array)
+	{
+		const T *data = array.empty() ? NULL : &array[0];
+		add(data);
+	}
+
+	quint64 value() const { return _hash; }
+
+private:
+	quint64 _hash;
+};
+
+
+// With "Tests->Draw Hidden Lines" on, the hidden-line pass and the main
+// pass extract most curves twice with the same arguments, once without
+// backface culling and once with it.  While share_extraction is set,
+// draw_isolines, draw_mesh_ridges, draw_mesh_ph and draw_apparent_ridges
+// extract each curve once, without culling, marking the segments on
+// backfacing faces; each pass then appends that extraction to its own
+// lines with its own color, width and culling.
+static bool share_extraction = false;
+static map<quint64, LineSet> shared_extractions;
+static int num_shared_extractions = 0;	// Replayed, since update_stages
+
+class SharedExtraction
+{
+public:
+	// Looks up the extraction with this key.  If there is none yet,
+	// currlines records into a new one until replay().
+	SharedExtraction(const FrameKey &key)
+	{
+		map<quint64, LineSet>::iterator it =
+			shared_extractions.find(key.value());
+		_recording = (it == shared_extractions.end());
+		if (_recording) {
+			_lines = &shared_extractions[key.value()];
+			_pass = currlines;
+			currlines = _lines;
+		} else {
+			_lines = &it->second;
+			_pass = NULL;
+			num_shared_extractions++;
+		}
+	}
+
+	bool recording() const { return _recording; }
+
+	// Appends the extraction to the pass's lines in currcolor,
+	// leaving out backfacing segments if do_bfcull
+	void replay(bool do_bfcull)
+	{
+		if (_recording)
+			currlines = _pass;
+		currlines->append(*_lines, currcolor,
+				  do_bfcull ? LineSet::BACKFACING : 0);
+	}
+
+private:
+	LineSet	*_lines;
+	LineSet	*_pass;
+	bool	_recording;
+};
+
+
 // Draw part of a zero-crossing curve on one triangle face, but only if
 // "test_num/test_den" is positive.  v0,v1,v2 are the indices of the 3
 // vertices, "val" are the values of the scalar field whose zero
@@ -821,31 +1139,31 @@ void draw_face_isoline2(int v0, int v1, int v2,
 	// Draw the valid piece(s)
 	int npts = 0;
 	if (valid1) {
-		glColor4f(currcolor[0], currcolor[1], currcolor[2],
+		currlines->setColor(currcolor[0], currcolor[1], currcolor[2],
 			  test_num1 / (test_den1 * fade + test_num1));
-		glVertex3fv(p1);
+		currlines->addVertex(p1);
 		npts++;
 	}
 	if (z1) {
 		float num = (1.0f - z1) * test_num1 + z1 * test_num2;
 		float den = (1.0f - z1) * test_den1 + z1 * test_den2;
-		glColor4f(currcolor[0], currcolor[1], currcolor[2],
+		currlines->setColor(currcolor[0], currcolor[1], currcolor[2],
 			  num / (den * fade + num));
-		glVertex3fv((1.0f - z1) * p1 + z1 * p2);
+		currlines->addVertex((1.0f - z1) * p1 + z1 * p2);
 		npts++;
 	}
 	if (z2) {
 		float num = (1.0f - z2) * test_num1 + z2 * test_num2;
 		float den = (1.0f - z2) * test_den1 + z2 * test_den2;
-		glColor4f(currcolor[0], currcolor[1], currcolor[2],
+		currlines->setColor(currcolor[0], currcolor[1], currcolor[2],
 			  num / (den * fade + num));
-		glVertex3fv((1.0f - z2) * p1 + z2 * p2);
+		currlines->addVertex((1.0f - z2) * p1 + z2 * p2);
 		npts++;
 	}
 	if (npts != 2) {
-		glColor4f(currcolor[0], currcolor[1], currcolor[2],
+		currlines->setColor(currcolor[0], currcolor[1], currcolor[2],
 			  test_num2 / (test_den2 * fade + test_num2));
-		glVertex3fv(p2);
+		currlines->addVertex(p2);
 	}
 }
 
@@ -861,30 +1179,41 @@ void draw_face_isoline(int v0, int v1, int v2,
 		       bool do_test, float fade)
 {
 	// Backface culling
-	if (likely(do_bfcull && ndotv[v0] <= 0.0f &&
-		   ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f))
+	bool backfacing = (ndotv[v0] <= 0.0f &&
+			   ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f);
+	if (likely(do_bfcull && backfacing)) {
+		counts.backfacing++;
 		return;
+	}
 
 	// Quick reject if derivs are negative
 	if (do_test) {
 		if (test_den.empty()) {
 			if (test_num[v0] <= 0.0f &&
 			    test_num[v1] <= 0.0f &&
-			    test_num[v2] <= 0.0f)
+			    test_num[v2] <= 0.0f) {
+				counts.test_rejects++;
 				return;
+			}
 		} else {
 			if (test_num[v0] <= 0.0f && test_den[v0] >= 0.0f &&
 			    test_num[v1] <= 0.0f && test_den[v1] >= 0.0f &&
-			    test_num[v2] <= 0.0f && test_den[v2] >= 0.0f)
+			    test_num[v2] <= 0.0f && test_den[v2] >= 0.0f) {
+				counts.test_rejects++;
 				return;
+			}
 			if (test_num[v0] >= 0.0f && test_den[v0] <= 0.0f &&
 			    test_num[v1] >= 0.0f && test_den[v1] <= 0.0f &&
-			    test_num[v2] >= 0.0f && test_den[v2] <= 0.0f)
+			    test_num[v2] >= 0.0f && test_den[v2] <= 0.0f) {
+				counts.test_rejects++;
 				return;
+			}
 		}
 	}
 
 	// Figure out which val has different sign, and draw
+	currlines->setFlags(backfacing ? LineSet::BACKFACING : 0);
+	currlines->setFace(v0, v1, v2);
 	if (val[v0] < 0.0f && val[v1] >= 0.0f && val[v2] >= 0.0f ||
 	    val[v0] > 0.0f && val[v1] <= 0.0f && val[v2] <= 0.0f)
 		draw_face_isoline2(v0, v1, v2,
@@ -905,12 +1234,12 @@ void draw_face_isoline(int v0, int v1, int v2,
 
 // Takes a scalar field and renders the zero crossings, but only where
 // test_num/test_den is greater than 0.
-void draw_isolines(const vector<float> &val,
-		   const vector<float> &test_num,
-		   const vector<float> &test_den,
-		   const vector<float> &ndotv,
-		   bool do_bfcull, bool do_hermite,
-		   bool do_test, float fade)
+void extract_isolines(const vector<float> &val,
+		      const vector<float> &test_num,
+		      const vector<float> &test_den,
+		      const vector<float> &ndotv,
+		      bool do_bfcull, bool do_hermite,
+		      bool do_test, float fade)
 {
 	const int *t = &themesh->tstrips[0];
 	const int *stripend = t;
@@ -930,6 +1259,7 @@ void draw_isolines(const vector<float> &val,
 		}
 		// Draw a line if, among the values in this triangle,
 		// at least one is positive and one is negative
+		counts.faces++;
 		const float &v0 = val[*t], &v1 = val[*(t-1)], &v2 = val[*(t-2)];
 		if (unlikely((v0 > 0.0f || v1 > 0.0f || v2 > 0.0f) &&
 			     (v0 < 0.0f || v1 < 0.0f || v2 < 0.0f)))
@@ -941,6 +1271,36 @@ void draw_isolines(const vector<float> &val,
 }
 
 
+// extract_isolines, shared between passes if share_extraction is set
+void draw_isolines(const vector<float> &val,
+		   const vector<float> &test_num,
+		   const vector<float> &test_den,
+		   const vector<float> &ndotv,
+		   bool do_bfcull, bool do_hermite,
+		   bool do_test, float fade)
+{
+	if (!share_extraction) {
+		extract_isolines(val, test_num, test_den, ndotv,
+				 do_bfcull, do_hermite, do_test, fade);
+		return;
+	}
+
+	FrameKey key;
+	key.add('i');
+	key.add(val);
+	key.add(test_num);
+	key.add(test_den);
+	key.add(do_hermite);
+	key.add(do_test);
+	key.add(fade);
+	SharedExtraction shared(key);
+	if (shared.recording())
+		extract_isolines(val, test_num, test_den, ndotv,
+				 false, do_hermite, do_test, fade);
+	shared.replay(do_bfcull);
+}
+
+
 // Draw part of a ridge/valley curve on one triangle face.  v0,v1,v2
 // are the indices of the 3 vertices; this function assumes that the
 // curve connects points on the edges v0-v1 and v1-v2
@@ -952,6 +1312,7 @@ void draw_segment_ridge(int v0, int v1, int v2,
 {
 	// Interpolate to find ridge/valley line segment endpoints
 	// in this triangle and the curvatures there
+	counts.zero_crossings += to_center ? 1 : 2;
 	float w10 = fabs(emax0) / (fabs(emax0) + fabs(emax1));
 	float w01 = 1.0f - w10;
 	point p01 = w01 * themesh->vertices[v0] + w10 * themesh->vertices[v1];
@@ -994,10 +1355,10 @@ void draw_segment_ridge(int v0, int v1, int v2,
 	}
 
 	// Draw the line segment
-	glColor4f(currcolor[0], currcolor[1], currcolor[2], k01);
-	glVertex3fv(p01);
-	glColor4f(currcolor[0], currcolor[1], currcolor[2], k12);
-	glVertex3fv(p12);
+	currlines->setColor(currcolor[0], currcolor[1], currcolor[2], k01);
+	currlines->addVertex(p01);
+	currlines->setColor(currcolor[0], currcolor[1], currcolor[2], k12);
+	currlines->addVertex(p12);
 }
 
 
@@ -1014,21 +1375,28 @@ void draw_face_ridges(int v0, int v1, int v2,
 		      bool do_bfcull, bool do_test, float thresh)
 {
 	// Backface culling
-	if (likely(do_bfcull &&
-		   ndotv[v0] <= 0.0f && ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f))
+	bool backfacing = (ndotv[v0] <= 0.0f &&
+			   ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f);
+	if (likely(do_bfcull && backfacing)) {
+		counts.backfacing++;
 		return;
+	}
 
 	// Check if ridge possible at vertices just based on curvatures
 	if (do_ridge) {
 		if ((themesh->curv1[v0] <= 0.0f) ||
 		    (themesh->curv1[v1] <= 0.0f) ||
-		    (themesh->curv1[v2] <= 0.0f))
+		    (themesh->curv1[v2] <= 0.0f)) {
+			counts.sign_rejects++;
 			return;
+		}
 	} else {
 		if ((themesh->curv1[v0] >= 0.0f) ||
 		    (themesh->curv1[v1] >= 0.0f) ||
-		    (themesh->curv1[v2] >= 0.0f))
+		    (themesh->curv1[v2] >= 0.0f)) {
+			counts.sign_rejects++;
 			return;
+		}
 	}
 
 	// Sign of curvature on ridge/valley
@@ -1069,11 +1437,15 @@ void draw_face_ridges(int v0, int v1, int v2,
 		z20 = z20 && ((tmax2 DOT (p0 - p2)) >= 0.0f ||
 			      (tmax0 DOT (p0 - p2)) <= 0.0f);
 
-		if (z01 + z12 + z20 < 2)
+		if (z01 + z12 + z20 < 2) {
+			counts.test_rejects++;
 			return;
+		}
 	}
 
 	// Draw line segment
+	currlines->setFlags(backfacing ? LineSet::BACKFACING : 0);
+	currlines->setFace(v0, v1, v2);
 	const float &kmax0 = themesh->curv1[v0];
 	const float &kmax1 = themesh->curv1[v1];
 	const float &kmax2 = themesh->curv1[v2];
@@ -1111,8 +1483,8 @@ void draw_face_ridges(int v0, int v1, int v2,
 
 
 // Draw the ridges (valleys) of the mesh
-void draw_mesh_ridges(bool do_ridge, const vector<float> &ndotv,
-		      bool do_bfcull, bool do_test, float thresh)
+void extract_mesh_ridges(bool do_ridge, const vector<float> &ndotv,
+			 bool do_bfcull, bool do_test, float thresh)
 {
 	const int *t = &themesh->tstrips[0];
 	const int *stripend = t;
@@ -1131,6 +1503,7 @@ void draw_mesh_ridges(bool do_ridge, const vector<float> &ndotv,
 			t += 3;
 		}
 
+		counts.faces++;
 		draw_face_ridges(*(t-2), *(t-1), *t,
 				 do_ridge, ndotv, do_bfcull, do_test, thresh);
 		t++;
@@ -1138,24 +1511,50 @@ void draw_mesh_ridges(bool do_ridge, const vector<float> &ndotv,
 }
 
 
+// extract_mesh_ridges, shared between passes if share_extraction is set
+void draw_mesh_ridges(bool do_ridge, const vector<float> &ndotv,
+		      bool do_bfcull, bool do_test, float thresh)
+{
+	if (!share_extraction) {
+		extract_mesh_ridges(do_ridge, ndotv, do_bfcull, do_test,
+				    thresh);
+		return;
+	}
+
+	FrameKey key;
+	key.add('r');
+	key.add(do_ridge);
+	key.add(do_test);
+	key.add(thresh);
+	SharedExtraction shared(key);
+	if (shared.recording())
+		extract_mesh_ridges(do_ridge, ndotv, false, do_test, thresh);
+	shared.replay(do_bfcull);
+}
+
+
 // Draw principal highlights on a face
 void draw_face_ph(int v0, int v1, int v2, bool do_ridge,
 		  const vector<float> &ndotv, bool do_bfcull,
 		  bool do_test, float thresh)
 {
 	// Backface culling
-	if (likely(do_bfcull &&
-		   ndotv[v0] <= 0.0f && ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f))
+	bool backfacing = (ndotv[v0] <= 0.0f &&
+			   ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f);
+	if (likely(do_bfcull && backfacing)) {
+		counts.backfacing++;
 		return;
+	}
 
 	// Orient principal directions based on the largest principal curvature
 	float k0 = themesh->curv1[v0];
 	float k1 = themesh->curv1[v1];
 	float k2 = themesh->curv1[v2];
-	if (do_test && do_ridge && min(min(k0,k1),k2) < 0.0f)
-		return;
-	if (do_test && !do_ridge && max(max(k0,k1),k2) > 0.0f)
+	if (do_test && (do_ridge ? min(min(k0,k1),k2) < 0.0f
+				 : max(max(k0,k1),k2) > 0.0f)) {
+		counts.sign_rejects++;
 		return;
+	}
 
 	vec d0 = themesh->pdir1[v0];
 	vec d1 = themesh->pdir1[v1];
@@ -1180,9 +1579,9 @@ void draw_face_ph(int v0, int v1, int v2, bool do_ridge,
           return;
 
 	// Compute view directions, dot products @ each vertex
-	vec viewdir0 = viewpos - themesh->vertices[v0];
-	vec viewdir1 = viewpos - themesh->vertices[v1];
-	vec viewdir2 = viewpos - themesh->vertices[v2];
+	vec viewdir0 = lineview.viewpos - themesh->vertices[v0];
+	vec viewdir1 = lineview.viewpos - themesh->vertices[v1];
+	vec viewdir2 = lineview.viewpos - themesh->vertices[v2];
 
         // Normalize these for cos(theta) later...
         normalize(viewdir0);
@@ -1205,6 +1604,8 @@ void draw_face_ph(int v0, int v1, int v2, bool do_ridge,
 		return;
 
 	// Draw line segment
+	currlines->setFlags(backfacing ? LineSet::BACKFACING : 0);
+	currlines->setFace(v0, v1, v2);
 	float test0 = (sqr(themesh->curv1[v0]) - sqr(themesh->curv2[v0])) *
                       viewdir0 DOT themesh->normals[v0];
 	float test1 = (sqr(themesh->curv1[v1]) - sqr(themesh->curv2[v1])) *
@@ -1232,8 +1633,8 @@ void draw_face_ph(int v0, int v1, int v2, bool do_ridge,
 
 
 // Draw principal highlights
-void draw_mesh_ph(bool do_ridge, const vector<float> &ndotv, bool do_bfcull,
-		  bool do_test, float thresh)
+void extract_mesh_ph(bool do_ridge, const vector<float> &ndotv,
+		     bool do_bfcull, bool do_test, float thresh)
 {
 	const int *t = &themesh->tstrips[0];
 	const int *stripend = t;
@@ -1252,6 +1653,7 @@ void draw_mesh_ph(bool do_ridge, const vector<float> &ndotv, bool do_bfcull,
 			t += 3;
 		}
 
+		counts.faces++;
 		draw_face_ph(*(t-2), *(t-1), *t, do_ridge,
 			     ndotv, do_bfcull, do_test, thresh);
 		t++;
@@ -1259,78 +1661,110 @@ void draw_mesh_ph(bool do_ridge, const vector<float> &ndotv, bool do_bfcull,
 }
 
 
+// extract_mesh_ph, shared between passes if share_extraction is set
+void draw_mesh_ph(bool do_ridge, const vector<float> &ndotv, bool do_bfcull,
+		  bool do_test, float thresh)
+{
+	if (!share_extraction) {
+		extract_mesh_ph(do_ridge, ndotv, do_bfcull, do_test, thresh);
+		return;
+	}
+
+	FrameKey key;
+	key.add('p');
+	key.add(do_ridge);
+	key.add(do_test);
+	key.add(thresh);
+	SharedExtraction shared(key);
+	if (shared.recording())
+		extract_mesh_ph(do_ridge, ndotv, false, do_test, thresh);
+	shared.replay(do_bfcull);
+}
+
+
+// Apparent ridges don't cull backfaces (see draw_face_app_ridges), so
+// both passes draw the same ones
+void draw_apparent_ridges()
+{
+	LineTypeStats stats("Apparent Ridges");
+	float thresh = ar_thresh / sqr(feature_size);
+	if (!share_extraction) {
+		draw_mesh_app_ridges(ndotv, q1, t1, Dt1q1, true,
+				     test_ar, thresh);
+		return;
+	}
+
+	FrameKey key;
+	key.add('a');
+	key.add(test_ar.value());
+	key.add(thresh);
+	SharedExtraction shared(key);
+	if (shared.recording())
+		draw_mesh_app_ridges(ndotv, q1, t1, Dt1q1, true,
+				     test_ar, thresh);
+	shared.replay(false);
+}
+
+
 // Draw exterior silhouette of the mesh: this just draws
 // thick contours, which are partially hidden by the mesh.
 // Note: this needs to happen *before* draw_base_mesh...
 void draw_silhouette(const vector<float> &ndotv)
 {
-	glDepthMask(GL_FALSE);
-
+	LineTypeStats stats("Silhouette");
 	currcolor = vec(0.0, 0.0, 0.0);
 	set_line_width(6);
-	glBegin(GL_LINES);
-	draw_isolines(ndotv, vector<float>(), vector<float>(), ndotv,
-		      false, false, false, 0.0f);
-	glEnd();
-
 	// Wide lines are gappy, so fill them in
-	glEnable(GL_POINT_SMOOTH);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glPointSize(6);
-	glBegin(GL_POINTS);
+	currlines->setRoundCaps(true);
 	draw_isolines(ndotv, vector<float>(), vector<float>(), ndotv,
 		      false, false, false, 0.0f);
-	glEnd();
-
-	glDisable(GL_POINT_SMOOTH);
-	glDisable(GL_BLEND);
-	glDepthMask(GL_TRUE);
+	currlines->setRoundCaps(false);
 }
 
 
 // Draw the boundaries on the mesh
 void draw_boundaries(bool do_hidden)
 {
+	LineTypeStats stats("Boundaries");
 	themesh->need_faces();
 	themesh->need_across_edge();
+	counts.faces += themesh->faces.size();
 	if (do_hidden) {
-		glColor3f(0.6, 0.6, 0.6);
+		currlines->setColor(0.6, 0.6, 0.6);
 		set_line_width(1.5);
 	} else {
-		glColor3f(0.05, 0.05, 0.05);
+		currlines->setColor(0.05, 0.05, 0.05);
 		set_line_width(2.5);
 	}
-	glBegin(GL_LINES);
 	for (int i = 0; i < themesh->faces.size(); i++) {
 		for (int j = 0; j < 3; j++) {
 			if (themesh->across_edge[i][j] >= 0)
 				continue;
 			int v1 = themesh->faces[i][(j+1)%3];
 			int v2 = themesh->faces[i][(j+2)%3];
-			glVertex3fv(themesh->vertices[v1]);
-			glVertex3fv(themesh->vertices[v2]);
+			currlines->addVertex(themesh->vertices[v1]);
+			currlines->addVertex(themesh->vertices[v2]);
 		}
 	}
-	glEnd();
 }
 
 
 // Draw lines of n.l = const.
 void draw_isophotes(const vector<float> &ndotv)
 {
+	LineTypeStats stats("Isophotes");
 	// Compute N dot L
 	int nv = themesh->vertices.size();
 	static vector<float> ndotl;
 	ndotl.resize(nv);
 	for (int i = 0; i < nv; i++)
-		ndotl[i] = themesh->normals[i] DOT light_direction;
+		ndotl[i] = themesh->normals[i] DOT lineview.light_direction;
 
 	if (draw_colors)
 		currcolor = vec(0.4, 0.8, 0.4);
 	else
 		currcolor = vec(0.6, 0.6, 0.6);
-	glColor3fv(currcolor);
+	currlines->setColor(currcolor);
 
 	float dt = 1.0f / niso;
 	for (int it = 0; it < niso; it++) {
@@ -1341,10 +1775,8 @@ void draw_isophotes(const vector<float> &ndotv)
 			for (int i = 0; i < nv; i++)
 				ndotl[i] -= dt;
 		}
-		glBegin(GL_LINES);
 		draw_isolines(ndotl, vector<float>(), vector<float>(),
 			      ndotv, true, false, false, 0.0f);
-		glEnd();
 	}
 
         // Draw negative isophotes (useful when light is not at camera)
@@ -1352,7 +1784,7 @@ void draw_isophotes(const vector<float> &ndotv)
 		currcolor = vec(0.6, 0.9, 0.6);
 	else
 		currcolor = vec(0.7, 0.7, 0.7);
-	glColor3fv(currcolor);
+	currlines->setColor(currcolor);
 
 	for (int i = 0; i < nv; i++)
 		ndotl[i] += dt * (niso-1);
@@ -1360,10 +1792,8 @@ void draw_isophotes(const vector<float> &ndotv)
 		set_line_width(1.0);
 		for (int i = 0; i < nv; i++)
 			ndotl[i] += dt;
-		glBegin(GL_LINES);
 		draw_isolines(ndotl, vector<float>(), vector<float>(),
 			      ndotv, true, false, false, 0.0f);
-		glEnd();
 	}
 }
 
@@ -1371,7 +1801,9 @@ void draw_isophotes(const vector<float> &ndotv)
 // Draw lines of constant depth
 void draw_topolines(const vector<float> &ndotv)
 {
+	LineTypeStats stats("Topo Lines");
 	// Camera direction and scale
+	const xform &xf = lineview.xf;
 	vec camdir(xf[2], xf[6], xf[10]);
 	float depth_scale = 0.5f / themesh->bsphere.r * ntopo;
 	float depth_offset = 0.5f * ntopo - topo_offset;
@@ -1387,21 +1819,48 @@ void draw_topolines(const vector<float> &ndotv)
 
 	// Draw the topo lines
 	set_line_width(1);
-	glColor3f(0.5, 0.5, 0.5);
+	currlines->setColor(0.5, 0.5, 0.5);
 	for (int it = 0; it < ntopo; it++) {
-		glBegin(GL_LINES);
 		draw_isolines(depth, vector<float>(), vector<float>(),
 			      ndotv, true, false, false, 0.0f);
-		glEnd();
 		for (int i = 0; i < nv; i++)
 			depth[i] -= 1.0f;
 	}
 }
 
 
-// Draw K=0, H=0, and DwKr=thresh lines
-void draw_misc(const vector<float> &ndotv, const vector<float> &DwKr,
-	       bool do_hidden)
+// The line types of the two passes, one stage each (see Stage).  The
+// hidden pass, drawn first and in light colors if drawing hidden lines,
+// has no depth test and no backface culling.  Each draw_*_lines function
+// sets the width and draws in currcolor, which its *_color function gives
+// for do_hidden; a line type drawn in fixed colors has no color function.
+
+// "Style->Use Hermite", unless the quality is lowered
+static bool hermite_enabled()
+{
+	return use_hermite && quality_level < NO_HERMITE;
+}
+
+// Line colors are lighter on a lit or gray mesh
+static bool use_light_lines()
+{
+	return color_style == "Gray" || lighting_style != "None";
+}
+
+// The gray of the hidden highlights, and of the other hidden lines
+// without colors
+static vec hidden_gray()
+{
+	return use_light_lines() ? vec(0.75, 0.75, 0.75) :
+				   vec(0.55, 0.55, 0.55);
+}
+
+// K=0, H=0, DwKr=thresh.  The fields are static: FrameKey tells arrays
+// apart by their storage, so that is how the hidden and visible stages
+// share their extraction.
+static vector<float> gauss_curv, mean_curv;
+
+static void set_misc_style(bool do_hidden)
 {
 	if (do_hidden) {
 		currcolor = vec(1, 0.5, 0.5);
@@ -1410,295 +1869,1254 @@ void draw_misc(const vector<float> &ndotv, const vector<float> &DwKr,
 		currcolor = vec(1, 0, 0);
 		set_line_width(2);
 	}
+}
 
+static void draw_K_lines(bool do_hidden)
+{
+	if (!draw_K)
+		return;
+	LineTypeStats stats("K");
+	set_misc_style(do_hidden);
 	int nv = themesh->vertices.size();
-	if (draw_K) {
-		vector<float> K(nv);
-		for (int i = 0; i < nv; i++)
-			K[i] = themesh->curv1[i] * themesh->curv2[i];
-		glBegin(GL_LINES);
-		draw_isolines(K, vector<float>(), vector<float>(), ndotv,
-			      !do_hidden, false, false, 0.0f);
-		glEnd();
-	}
-	if (draw_H) {
-		vector<float> H(nv);
-		for (int i = 0; i < nv; i++)
-			H[i] = 0.5f * (themesh->curv1[i] + themesh->curv2[i]);
-		glBegin(GL_LINES);
-		draw_isolines(H, vector<float>(), vector<float>(), ndotv,
-			      !do_hidden, false, false, 0.0f);
-		glEnd();
-	}
-	if (draw_DwKr) {
-		glBegin(GL_LINES);
-		draw_isolines(DwKr, vector<float>(), vector<float>(), ndotv,
-			      !do_hidden, false, false, 0.0f);
-		glEnd();
-	}
+	gauss_curv.resize(nv);
+	for (int i = 0; i < nv; i++)
+		gauss_curv[i] = themesh->curv1[i] * themesh->curv2[i];
+	draw_isolines(gauss_curv, vector<float>(), vector<float>(), ndotv,
+		      !do_hidden, false, false, 0.0f);
 }
-    
-
 
-void draw_lines()
+static void draw_H_lines(bool do_hidden)
 {
-    
+	if (!draw_H)
+		return;
+	LineTypeStats stats("H");
+	set_misc_style(do_hidden);
 	int nv = themesh->vertices.size();
+	mean_curv.resize(nv);
+	for (int i = 0; i < nv; i++)
+		mean_curv[i] = 0.5f * (themesh->curv1[i] + themesh->curv2[i]);
+	draw_isolines(mean_curv, vector<float>(), vector<float>(), ndotv,
+		      !do_hidden, false, false, 0.0f);
+}
 
-    bool draw_light_lines = color_style == "Gray" || lighting_style != "None";
-    
-	// First rendering pass (in light gray) if drawing hidden lines
-	if (draw_hidden) {
-		glDisable(GL_DEPTH_TEST);
-        
-		// K=0, H=0, DwKr=thresh
-		draw_misc(ndotv, sctest_num, true);
-        
-		// Apparent ridges
-		if (draw_apparent) {
-			if (draw_colors) {
-				currcolor = vec(0.8, 0.8, 0.4);
-			} else {
-				if (draw_light_lines)
-					currcolor = vec(0.75, 0.75, 0.75);
-				else
-					currcolor = vec(0.55, 0.55, 0.55);
-			}
-			if (draw_colors)
-                set_line_width(2);
-			glBegin(GL_LINES);
-			Rtsc::draw_mesh_app_ridges(ndotv, q1, t1, Dt1q1, true,
-                                 test_ar, ar_thresh / sqr(feature_size));
-			glEnd();
-		}
-        
-		// Ridges and valleys
-		currcolor = vec(0.55, 0.55, 0.55);
-		if (draw_ridges) {
-			if (draw_colors)
-				currcolor = vec(0.72, 0.6, 0.72);
-			set_line_width(1);
-			glBegin(GL_LINES);
-			draw_mesh_ridges(true, ndotv, false, test_rv,
-                             rv_thresh / feature_size);
-			glEnd();
-		}
-		if (draw_valleys) {
-			if (draw_colors)
-				currcolor = vec(0.8, 0.72, 0.68);
-			set_line_width(1);
-			glBegin(GL_LINES);
-			draw_mesh_ridges(false, ndotv, false, test_rv,
-                             rv_thresh / feature_size);
-			glEnd();
-		}
-        
-		// Principal highlights
-		if (draw_phridges || draw_phvalleys) {
-			if (draw_colors) {
-				currcolor = vec(0.5,0,0);
-			} else {
-				if (draw_light_lines)
-					currcolor = vec(0.75, 0.75, 0.75);
-				else
-					currcolor = vec(0.55, 0.55, 0.55);
-			}
-			set_line_width(2);
-			glBegin(GL_LINES);
-			float thresh = ph_thresh / sqr(feature_size);
-			if (draw_phridges)
-				draw_mesh_ph(true, ndotv, false, test_ph, thresh);
-			if (draw_phvalleys)
-				draw_mesh_ph(false, ndotv, false, test_ph, thresh);
-			glEnd();
-		}
-        
-		// Suggestive highlights
-		if (draw_sh) {
-			if (draw_colors) {
-				currcolor = vec(0.5,0,0);
-			} else {
-				if (draw_light_lines)
-					currcolor = vec(0.75, 0.75, 0.75);
-				else
-					currcolor = vec(0.55,0.55,0.55);
-			}
-			float fade = draw_faded ? 0.03f / sqr(feature_size) : 0.0f;
-			set_line_width(2.5);
-			glBegin(GL_LINES);
-			draw_isolines(kr, shtest_num, sctest_den, ndotv,
-                          false, use_hermite, test_sh, fade);
-			glEnd();
-		}
-        
-		// Suggestive contours and contours
-		if (draw_sc) {
-			float fade = (draw_faded && test_sc) ?
-            0.03f / sqr(feature_size) : 0.0f;
-			if (draw_colors)
-				currcolor = vec(0.5, 0.5, 1.0);
-			set_line_width(1.5);
-			glBegin(GL_LINES);
-			draw_isolines(kr, sctest_num, sctest_den, ndotv,
-                          false, use_hermite, test_sc, fade);
-			glEnd();
-		}
-        
-		if (draw_c) {
-			if (draw_colors)
-				currcolor = vec(0.4, 0.8, 0.4);
-			set_line_width(1.5);
-			glBegin(GL_LINES);
-			draw_isolines(ndotv, kr, vector<float>(), ndotv,
-                          false, false, test_c, 0.0f);
-			glEnd();
-		}
-        
-		// Boundaries
-		if (draw_bdy)
-			draw_boundaries(true);
-        
-		glEnable(GL_DEPTH_TEST);
-	}
-    
-    
-	// The main rendering pass
-    
-	// Isophotes
-	if (draw_isoph)
-		draw_isophotes(ndotv);
-    
-	// Topo lines
-	if (draw_topo)
-		draw_topolines(ndotv);
-    
-	// K=0, H=0, DwKr=thresh
-	draw_misc(ndotv, sctest_num, false);
-    
-	// Apparent ridges
-	currcolor = vec(0.0, 0.0, 0.0);
-	if (draw_apparent) {
-		if (draw_colors)
-			currcolor = vec(0.4, 0.4, 0);
+static void draw_DwKr_lines(bool do_hidden)
+{
+	if (!draw_DwKr)
+		return;
+	LineTypeStats stats("DwKr");
+	set_misc_style(do_hidden);
+	draw_isolines(sctest_num, vector<float>(), vector<float>(), ndotv,
+		      !do_hidden, false, false, 0.0f);
+}
+
+// Apparent ridges
+static vec apparent_color(bool do_hidden)
+{
+	if (do_hidden)
+		return draw_colors ? vec(0.8, 0.8, 0.4) : hidden_gray();
+	return draw_colors ? vec(0.4, 0.4, 0) : vec(0, 0, 0);
+}
+
+static void draw_apparent_lines(bool do_hidden)
+{
+	if (!draw_apparent)
+		return;
+	if (do_hidden)
+		set_line_width(draw_colors ? 2 : 1);
+	else
 		set_line_width(2.5);
-		glBegin(GL_LINES);
-		draw_mesh_app_ridges(ndotv, q1, t1, Dt1q1, true,
-                             test_ar, ar_thresh / sqr(feature_size));
-		glEnd();
-	}
-    
-	// Ridges and valleys
-	currcolor = vec(0.0, 0.0, 0.0);
-	float rvfade = draw_faded ? rv_thresh / feature_size : 0.0f;
-	if (draw_ridges) {
-		if (draw_colors)
-			currcolor = vec(0.3, 0.0, 0.3);
-		set_line_width(2);
-		glBegin(GL_LINES);
-		draw_mesh_ridges(true, ndotv, true, test_rv,
-                         rv_thresh / feature_size);
-		glEnd();
-	}
-	if (draw_valleys) {
-		if (draw_colors)
-			currcolor = vec(0.5, 0.3, 0.2);
-		set_line_width(2);
-		glBegin(GL_LINES);
-		draw_mesh_ridges(false, ndotv, true, test_rv,
-                         rv_thresh / feature_size);
-		glEnd();
-	}
-    
-	// Principal highlights
-	if (draw_phridges || draw_phvalleys) {
-		if (draw_colors) {
-			currcolor = vec(0.5, 0, 0);
-		} else {
-			if (draw_light_lines)
-				currcolor = vec(1, 1, 1);
-			else
-				currcolor = vec(0, 0, 0);
-		}
-		set_line_width(2);
-		glBegin(GL_LINES);
-		float thresh = ph_thresh / sqr(feature_size);
-		if (draw_phridges)
-			draw_mesh_ph(true, ndotv, true, test_ph, thresh);
-		if (draw_phvalleys)
-			draw_mesh_ph(false, ndotv, true, test_ph, thresh);
-		glEnd();
-		currcolor = vec(0.0, 0.0, 0.0);
+	draw_apparent_ridges();
+}
+
+// Ridges and valleys
+static vec ridge_color(bool do_hidden)
+{
+	if (do_hidden)
+		return draw_colors ? vec(0.72, 0.6, 0.72) :
+				     vec(0.55, 0.55, 0.55);
+	return draw_colors ? vec(0.3, 0.0, 0.3) : vec(0, 0, 0);
+}
+
+static vec valley_color(bool do_hidden)
+{
+	if (do_hidden)
+		return draw_colors ? vec(0.8, 0.72, 0.68) :
+				     vec(0.55, 0.55, 0.55);
+	return draw_colors ? vec(0.5, 0.3, 0.2) : vec(0, 0, 0);
+}
+
+static void draw_ridge_lines(bool do_hidden)
+{
+	if (!draw_ridges)
+		return;
+	LineTypeStats stats("Ridges");
+	set_line_width(do_hidden ? 1 : 2);
+	draw_mesh_ridges(true, ndotv, !do_hidden, test_rv,
+			 rv_thresh / feature_size);
+}
+
+static void draw_valley_lines(bool do_hidden)
+{
+	if (!draw_valleys)
+		return;
+	LineTypeStats stats("Valleys");
+	set_line_width(do_hidden ? 1 : 2);
+	draw_mesh_ridges(false, ndotv, !do_hidden, test_rv,
+			 rv_thresh / feature_size);
+}
+
+// Principal highlights
+static vec ph_color(bool do_hidden)
+{
+	if (draw_colors)
+		return vec(0.5, 0, 0);
+	if (do_hidden)
+		return hidden_gray();
+	return use_light_lines() ? vec(1, 1, 1) : vec(0, 0, 0);
+}
+
+static void draw_ph_ridge_lines(bool do_hidden)
+{
+	if (!draw_phridges)
+		return;
+	LineTypeStats stats("Principal Highlights (R)");
+	set_line_width(2);
+	draw_mesh_ph(true, ndotv, !do_hidden, test_ph,
+		     ph_thresh / sqr(feature_size));
+}
+
+static void draw_ph_valley_lines(bool do_hidden)
+{
+	if (!draw_phvalleys)
+		return;
+	LineTypeStats stats("Principal Highlights (V)");
+	set_line_width(2);
+	draw_mesh_ph(false, ndotv, !do_hidden, test_ph,
+		     ph_thresh / sqr(feature_size));
+}
+
+// Suggestive highlights
+static vec sh_color(bool do_hidden)
+{
+	if (draw_colors)
+		return vec(0.5, 0, 0);
+	if (do_hidden)
+		return hidden_gray();
+	return use_light_lines() ? vec(1, 1, 1) : vec(0.3, 0.3, 0.3);
+}
+
+static void draw_sh_lines(bool do_hidden)
+{
+	if (!draw_sh)
+		return;
+	LineTypeStats stats("Suggestive Highlights");
+	float fade = draw_faded ? 0.03f / sqr(feature_size) : 0.0f;
+	set_line_width(2.5);
+	draw_isolines(kr, shtest_num, sctest_den, ndotv,
+		      !do_hidden, hermite_enabled(), test_sh, fade);
+}
+
+// Kr = 0 loops, visible pass only
+static vec kr_loop_color(bool)
+{
+	return draw_colors ? vec(0.5, 0.5, 1.0) : vec(0.6, 0.6, 0.6);
+}
+
+static void draw_kr_loop_lines(bool)
+{
+	if (!(draw_sc && !test_sc && !draw_hidden))
+		return;
+	LineTypeStats stats("Kr = 0 Loops");
+	set_line_width(1.5);
+	draw_isolines(kr, sctest_num, sctest_den, ndotv,
+		      true, hermite_enabled(), false, 0.0f);
+}
+
+// Suggestive contours and contours.  Without colors, the hidden ones are
+// in the gray of the hidden highlights, if any are drawn.
+static vec hidden_contour_gray()
+{
+	if (draw_phridges || draw_phvalleys || draw_sh)
+		return hidden_gray();
+	return vec(0.55, 0.55, 0.55);
+}
+
+static vec sc_color(bool do_hidden)
+{
+	if (do_hidden)
+		return draw_colors ? vec(0.5, 0.5, 1.0) : hidden_contour_gray();
+	return draw_colors ? vec(0.0, 0.0, 0.8) : vec(0, 0, 0);
+}
+
+static vec contour_color(bool do_hidden)
+{
+	if (do_hidden)
+		return draw_colors ? vec(0.4, 0.8, 0.4) : hidden_contour_gray();
+	return draw_colors ? vec(0.0, 0.6, 0.0) : vec(0, 0, 0);
+}
+
+// Textured contours are drawn by draw_everything, not the visible pass
+static void draw_sc_lines(bool do_hidden)
+{
+	if (!draw_sc || (!do_hidden && use_texture))
+		return;
+	LineTypeStats stats("Suggestive Contours");
+	float fade = (draw_faded && (test_sc || !do_hidden)) ?
+		0.03f / sqr(feature_size) : 0.0f;
+	set_line_width(do_hidden ? 1.5 : 2.5);
+	draw_isolines(kr, sctest_num, sctest_den, ndotv, !do_hidden,
+		      hermite_enabled(), test_sc || !do_hidden, fade);
+}
+
+static void draw_contour_lines(bool do_hidden)
+{
+	if (!draw_c || (!do_hidden && use_texture))
+		return;
+	LineTypeStats stats("Contours");
+	set_line_width(do_hidden ? 1.5 : 2.5);
+	draw_isolines(ndotv, kr, vector<float>(), ndotv,
+		      false, false, test_c || !do_hidden, 0.0f);
+}
+
+// Boundaries
+static void draw_boundary_lines(bool do_hidden)
+{
+	if (draw_bdy)
+		draw_boundaries(do_hidden);
+}
+
+// Attributes beyond the base mesh (faces, adjacency, strips, normals and
+// bounding sphere) that some lines, vectors or mesh colors need.
+enum {
+	NEED_CURV          = 1 << 0,
+	NEED_DCURV         = 1 << 1,
+	NEED_ADJACENTFACES = 1 << 2
+};
+
+void ensure_attributes();
+static int required_attributes();
+
+// Segments shorter than this on screen are dropped at DECIMATED_LINES
+static const float min_segment_pixels = 3.0f;
+// Removed by simplify_lines, since update_stages
+static int num_segments_thinned = 0;
+
+// With "Lines->Screen-Space Thinning" (or at DECIMATED_LINES), culls,
+// merges and thins the segments for the screen they will be drawn on
+static void simplify_lines(LineSet &lines)
+{
+	bool decimate = (quality_level >= DECIMATED_LINES);
+	if (!lineview.have_screen || !(screen_thinning || decimate))
+		return;
+
+	LineSimplifier simplifier;
+	simplifier.setView(lineview.xf, lineview.projection,
+			   lineview.viewport[2], lineview.viewport[3]);
+	if (decimate)
+		simplifier.setMinLength(min_segment_pixels);
+	if (screen_thinning)
+		simplifier.setMaxPerCell(max_per_cell);
+	num_segments_thinned += simplifier.simplify(lines);
+}
+
+// Frees v's memory, which clear() keeps.  Returns the bytes freed.
+template <class T>
+static size_t release(vector<T> &v)
+{
+	size_t bytes = TriMesh::memory_use("", v).bytes - sizeof(v);
+	vector<T>().swap(v);
+	return bytes;
+}
+
+static size_t release_line_set(LineSet &lines)
+{
+	return release(lines.vertices) + release(lines.colors) +
+	       release(lines.batches) + release(lines.flags) +
+	       release(lines.faces);
+}
+
+// Memory held by all of a LineSet's vectors, as one entry
+static TriMesh::MemoryUse line_set_memory(const char *name,
+					  const LineSet &lines)
+{
+	TriMesh::MemoryUse parts[] = {
+		TriMesh::memory_use(name, lines.vertices),
+		TriMesh::memory_use(name, lines.colors),
+		TriMesh::memory_use(name, lines.batches),
+		TriMesh::memory_use(name, lines.flags),
+		TriMesh::memory_use(name, lines.faces) };
+	// The vectors themselves are counted in sizeof(lines)
+	TriMesh::MemoryUse use = { name, sizeof(lines), 0 };
+	size_t elements = 0;
+	for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+		use.bytes += parts[i].bytes - sizeof(lines.vertices);
+		elements += parts[i].bytes - parts[i].overhead;
 	}
-    
-	// Suggestive highlights
-    if (draw_sh) {
-		if (draw_colors) {
-			currcolor = vec(0.5,0,0);
+	use.overhead = use.bytes - elements;
+	return use;
+}
+
+// The per-frame work, split into stages that each list what they read:
+// the camera, the light or the mesh, some dials, and earlier stages. A
+// stage runs again only when one of those changed since its last run,
+// as told by the dials' change stamps and the versions of the rest. Qt
+// repaints for plenty of reasons that change none of them (exposes,
+// dock moves, the stats view); a threshold slider only reruns the
+// thresholds and the lines that use them; moving the light only the
+// isophotes; a line type's dial only that line type, and a color dial
+// only recolors the lines.
+//
+// A stage records into a back buffer, and its lines are drawn from the
+// front one; publish() swaps them.  That way the stages can run on the
+// extraction thread while the GUI thread draws the last lines published.
+// READS_QUALITY: the quality level and the screen-space simplification
+enum { READS_CAMERA = 1, READS_LIGHT = 2, READS_MESH = 4,
+       READS_QUALITY = 8 };
+
+class Stage
+{
+public:
+	Stage(const char *name, int inputs, void (*run)())
+		: _name(name), _inputs(inputs), _run(run), _key(0),
+		  _color_key(0), _version(0), _has_run(false),
+		  _unpublished(false) {}
+
+	virtual ~Stage() {}
+
+	Stage &reads(const DialSnapshot &dial)
+		{ _dials.append(&dial); return *this; }
+	// A dial that changes only the colors of the lines, see recolor()
+	Stage &readsColor(const DialSnapshot &dial)
+		{ _color_dials.append(&dial); return *this; }
+	Stage &after(const Stage &stage) { _after.append(&stage); return *this; }
+
+	// Runs the stage if its inputs have changed, or only recolors its
+	// lines if only its color dials have. Line stages record into their
+	// back buffer. Returns true if the stage ran.
+	bool update()
+	{
+		quint64 key = inputKey();
+		quint64 color_key = colorKey();
+		if (_has_run && key == _key && color_key == _color_key)
+			return false;
+
+		if (_has_run && key == _key) {
+			if (!_unpublished)
+				_back = lines;
+			recolor(_back);
 		} else {
-			if (draw_light_lines)
-				currcolor = vec(1.0, 1.0, 1.0);
-			else
-				currcolor = vec(0.3,0.3,0.3);
+			_back.clear();
+			currlines = &_back;
+			__START_TIMER(_name);
+			run();
+			__STOP_TIMER(_name);
+			currlines = NULL;
+			if (_inputs & READS_QUALITY)
+				simplify_lines(_back);
 		}
-		float fade = draw_faded ? 0.03f / sqr(feature_size) : 0.0f;
-		set_line_width(2.5);
-		glBegin(GL_LINES);
-		draw_isolines(kr, shtest_num, sctest_den, ndotv,
-                      true, use_hermite, test_sh, fade);
-		glEnd();
-		currcolor = vec(0.0, 0.0, 0.0);
-    }
-    
-	// Kr = 0 loops
-	if (draw_sc && !test_sc && !draw_hidden) {
-		if (draw_colors)
-			currcolor = vec(0.5, 0.5, 1.0);
+
+		_key = key;
+		_color_key = color_key;
+		_version++;
+		_has_run = true;
+		_unpublished = true;
+		return true;
+	}
+
+	// Makes the lines of the last run the ones drawn
+	void publish()
+	{
+		if (!_unpublished)
+			return;
+		lines.swap(_back);
+		_unpublished = false;
+	}
+
+	// Forgets the lines, e.g. of a mesh that is gone
+	void clearLines()
+	{
+		lines.clear();
+		_back.clear();
+		_unpublished = false;
+	}
+
+	int version() const { return _version; }
+	const char *name() const { return _name; }
+
+	// Frees the back buffer, and the front one too if it is empty, e.g.
+	// for a line type switched off.  Both are cleared, but keep their
+	// memory, for the next run.  Returns the bytes freed.
+	size_t releaseUnused()
+	{
+		size_t bytes = release_line_set(_back);
+		if (lines.isEmpty())
+			bytes += release_line_set(lines);
+		return bytes;
+	}
+
+	// Memory held by both line buffers
+	TriMesh::MemoryUse memoryUse() const
+	{
+		TriMesh::MemoryUse use = line_set_memory(_name, lines);
+		TriMesh::MemoryUse back = line_set_memory(_name, _back);
+		use.bytes += back.bytes;
+		use.overhead += back.overhead;
+		return use;
+	}
+
+public:
+	LineSet lines;		// Published
+
+protected:
+	virtual void run() { _run(); }
+	// Gives lines the colors of the current color dials
+	virtual void recolor(LineSet &) {}
+
+	quint64 inputKey() const
+	{
+		FrameKey key;
+		if (_inputs & READS_CAMERA)
+			key.add(lineview.camera_version);
+		if (_inputs & READS_LIGHT)
+			key.add(lineview.light_version);
+		if (_inputs & READS_MESH) {
+			key.add(themesh);
+			key.add(mesh_revision);
+		}
+		if (_inputs & READS_QUALITY)
+			key.add(quality_level);
+		// The screen only matters to simplify_lines, when it has work
+		if ((_inputs & READS_QUALITY) &&
+		    (screen_thinning || quality_level >= DECIMATED_LINES)) {
+			key.add(lineview.have_screen);
+			key.add(lineview.projection);
+			key.add(lineview.viewport);
+		}
+		for (int i = 0; i < _dials.size(); i++)
+			key.add(_dials[i]->changeStamp());
+		for (int i = 0; i < _after.size(); i++)
+			key.add(_after[i]->version());
+		return key.value();
+	}
+
+	quint64 colorKey() const
+	{
+		FrameKey key;
+		for (int i = 0; i < _color_dials.size(); i++)
+			key.add(_color_dials[i]->changeStamp());
+		return key.value();
+	}
+
+protected:
+	const char		*_name;
+	int			_inputs;
+	void			(*_run)();
+	QList<const DialSnapshot*> _dials;
+	QList<const DialSnapshot*> _color_dials;
+	QList<const Stage*>	_after;
+	quint64			_key;
+	quint64			_color_key;
+	int			_version;
+	bool			_has_run;
+	LineSet			_back;
+	bool			_unpublished;
+};
+
+static void run_perview()
+{
+	compute_perview(ndotv, kr, dwkr, q1, t1, Dt1q1, use_texture);
+}
+
+static void run_thresholds()
+{
+	compute_thresholds(ndotv, dwkr, sctest_num, sctest_den, shtest_num);
+}
+
+static void run_silhouette()
+{
+	if (draw_extsil && enable_lines)
+		draw_silhouette(ndotv);
+}
+
+// One line type of the hidden or the visible pass.  Its lines are all in
+// the one color its color function gives, so its color dials only
+// recolor them, keeping the alphas of the fades.
+class LineTypeStage : public Stage
+{
+public:
+	LineTypeStage(const char *name, bool do_hidden,
+		      void (*draw)(bool), vec (*color)(bool) = NULL)
+		: Stage(name, READS_CAMERA | READS_MESH | READS_QUALITY, NULL),
+		  _do_hidden(do_hidden), _draw(draw), _color(color) {}
+
+	bool hidden() const { return _do_hidden; }
+	bool hasColor() const { return _color != NULL; }
+
+protected:
+	void run()
+	{
+		if (!enable_lines)
+			return;
+		if (_do_hidden &&
+		    !(draw_hidden && quality_level < NO_HIDDEN_LINES))
+			return;
+		if (_do_hidden)
+			currlines->setDepthTest(false);
+		if (_color)
+			currcolor = _color(_do_hidden);
+		// Both passes of a line type rerun together when its own dials
+		// change, and the second finds the extraction of the first
+		// in shared_extractions
+		share_extraction = draw_hidden;
+		_draw(_do_hidden);
+		share_extraction = false;
+	}
+
+	void recolor(LineSet &lines)
+	{
+		if (!_color)
+			return;
+		vec c = _color(_do_hidden);
+		for (size_t i = 0; i < lines.colors.size(); i++) {
+			lines.colors[i][0] = c[0];
+			lines.colors[i][1] = c[1];
+			lines.colors[i][2] = c[2];
+		}
+	}
+
+private:
+	bool	_do_hidden;
+	void	(*_draw)(bool do_hidden);
+	vec	(*_color)(bool do_hidden);
+};
+
+static void run_isophotes()
+{
+	if (draw_isoph && enable_lines)
+		draw_isophotes(ndotv);
+}
+
+static void run_topolines()
+{
+	if (draw_topo && enable_lines)
+		draw_topolines(ndotv);
+}
+
+static Stage perview_stage("Per-view", READS_CAMERA | READS_MESH,
+			   run_perview);
+static Stage thresholds_stage("Thresholds", READS_MESH, run_thresholds);
+// The silhouette goes under the mesh, the others over it in this order.
+static Stage silhouette_stage("Silhouette", READS_MESH | READS_QUALITY,
+			      run_silhouette);
+static LineTypeStage hidden_K_stage("Hidden K", true, draw_K_lines);
+static LineTypeStage hidden_H_stage("Hidden H", true, draw_H_lines);
+static LineTypeStage hidden_DwKr_stage("Hidden DwKr", true, draw_DwKr_lines);
+static LineTypeStage hidden_apparent_stage("Hidden Apparent Ridges", true,
+					   draw_apparent_lines, apparent_color);
+static LineTypeStage hidden_ridge_stage("Hidden Ridges", true,
+					draw_ridge_lines, ridge_color);
+static LineTypeStage hidden_valley_stage("Hidden Valleys", true,
+					 draw_valley_lines, valley_color);
+static LineTypeStage hidden_ph_ridge_stage("Hidden PH (R)", true,
+					   draw_ph_ridge_lines, ph_color);
+static LineTypeStage hidden_ph_valley_stage("Hidden PH (V)", true,
+					    draw_ph_valley_lines, ph_color);
+static LineTypeStage hidden_sh_stage("Hidden SH", true,
+				     draw_sh_lines, sh_color);
+static LineTypeStage hidden_sc_stage("Hidden SC", true,
+				     draw_sc_lines, sc_color);
+static LineTypeStage hidden_contour_stage("Hidden Contours", true,
+					  draw_contour_lines, contour_color);
+static LineTypeStage hidden_boundary_stage("Hidden Boundaries", true,
+					   draw_boundary_lines);
+static Stage isophotes_stage("Isophotes",
+			     READS_LIGHT | READS_MESH | READS_QUALITY,
+			     run_isophotes);
+static Stage topo_stage("Topo Lines",
+			READS_CAMERA | READS_MESH | READS_QUALITY,
+			run_topolines);
+static LineTypeStage visible_K_stage("Visible K", false, draw_K_lines);
+static LineTypeStage visible_H_stage("Visible H", false, draw_H_lines);
+static LineTypeStage visible_DwKr_stage("Visible DwKr", false,
+					draw_DwKr_lines);
+static LineTypeStage visible_apparent_stage("Visible Apparent Ridges", false,
+					    draw_apparent_lines,
+					    apparent_color);
+static LineTypeStage visible_ridge_stage("Visible Ridges", false,
+					 draw_ridge_lines, ridge_color);
+static LineTypeStage visible_valley_stage("Visible Valleys", false,
+					  draw_valley_lines, valley_color);
+static LineTypeStage visible_ph_ridge_stage("Visible PH (R)", false,
+					    draw_ph_ridge_lines, ph_color);
+static LineTypeStage visible_ph_valley_stage("Visible PH (V)", false,
+					     draw_ph_valley_lines, ph_color);
+static LineTypeStage visible_sh_stage("Visible SH", false,
+				      draw_sh_lines, sh_color);
+static LineTypeStage kr_loop_stage("Kr = 0 Loop Lines", false,
+				   draw_kr_loop_lines, kr_loop_color);
+static LineTypeStage visible_sc_stage("Visible SC", false,
+				      draw_sc_lines, sc_color);
+static LineTypeStage visible_contour_stage("Visible Contours", false,
+					   draw_contour_lines, contour_color);
+static LineTypeStage visible_boundary_stage("Visible Boundaries", false,
+					    draw_boundary_lines);
+
+static Stage *stages[] = { &perview_stage, &thresholds_stage,
+	&silhouette_stage,
+	&hidden_K_stage, &hidden_H_stage, &hidden_DwKr_stage,
+	&hidden_apparent_stage, &hidden_ridge_stage, &hidden_valley_stage,
+	&hidden_ph_ridge_stage, &hidden_ph_valley_stage, &hidden_sh_stage,
+	&hidden_sc_stage, &hidden_contour_stage, &hidden_boundary_stage,
+	&isophotes_stage, &topo_stage,
+	&visible_K_stage, &visible_H_stage, &visible_DwKr_stage,
+	&visible_apparent_stage, &visible_ridge_stage, &visible_valley_stage,
+	&visible_ph_ridge_stage, &visible_ph_valley_stage, &visible_sh_stage,
+	&kr_loop_stage, &visible_sc_stage, &visible_contour_stage,
+	&visible_boundary_stage };
+static const int num_stages = sizeof(stages) / sizeof(stages[0]);
+// All after the silhouette, which draw_everything draws under the mesh
+static Stage **const frame_line_stages = stages + 3;
+static const int num_frame_line_stages = num_stages - 3;
+
+// What every line type of the two passes reads
+static Stage &line_type(LineTypeStage &stage)
+{
+	stage.after(perview_stage)
+		.reads(enable_lines).reads(single_pixel_lines);
+	if (stage.hidden())
+		stage.reads(draw_hidden);
+	if (stage.hasColor())
+		stage.readsColor(draw_colors).readsColor(color_style)
+			.readsColor(lighting_style);
+	return stage;
+}
+
+static void setup_stages()
+{
+	static bool done = false;
+	if (done)
+		return;
+	done = true;
+
+	perview_stage.reads(draw_sc).reads(draw_sh).reads(draw_DwKr)
+		.reads(draw_apparent).reads(use_texture);
+	thresholds_stage.after(perview_stage)
+		.reads(sug_thresh).reads(sh_thresh).reads(draw_sh);
+
+	silhouette_stage.after(perview_stage)
+		.reads(draw_extsil).reads(enable_lines)
+		.reads(single_pixel_lines);
+
+	// Each line type of the two passes reads its own dials
+	line_type(hidden_K_stage).reads(draw_K);
+	line_type(visible_K_stage).reads(draw_K);
+	line_type(hidden_H_stage).reads(draw_H);
+	line_type(visible_H_stage).reads(draw_H);
+	line_type(hidden_DwKr_stage).after(thresholds_stage).reads(draw_DwKr);
+	line_type(visible_DwKr_stage).after(thresholds_stage).reads(draw_DwKr);
+	// The hidden apparent ridges are wider in colors
+	line_type(hidden_apparent_stage).reads(draw_apparent)
+		.reads(test_ar).reads(ar_thresh).reads(draw_colors);
+	line_type(visible_apparent_stage).reads(draw_apparent)
+		.reads(test_ar).reads(ar_thresh);
+	line_type(hidden_ridge_stage).reads(draw_ridges)
+		.reads(test_rv).reads(rv_thresh);
+	line_type(visible_ridge_stage).reads(draw_ridges)
+		.reads(test_rv).reads(rv_thresh);
+	line_type(hidden_valley_stage).reads(draw_valleys)
+		.reads(test_rv).reads(rv_thresh);
+	line_type(visible_valley_stage).reads(draw_valleys)
+		.reads(test_rv).reads(rv_thresh);
+	line_type(hidden_ph_ridge_stage).reads(draw_phridges)
+		.reads(test_ph).reads(ph_thresh);
+	line_type(visible_ph_ridge_stage).reads(draw_phridges)
+		.reads(test_ph).reads(ph_thresh);
+	line_type(hidden_ph_valley_stage).reads(draw_phvalleys)
+		.reads(test_ph).reads(ph_thresh);
+	line_type(visible_ph_valley_stage).reads(draw_phvalleys)
+		.reads(test_ph).reads(ph_thresh);
+	line_type(hidden_sh_stage).after(thresholds_stage).reads(draw_sh)
+		.reads(test_sh).reads(draw_faded).reads(use_hermite);
+	line_type(visible_sh_stage).after(thresholds_stage).reads(draw_sh)
+		.reads(test_sh).reads(draw_faded).reads(use_hermite);
+	line_type(kr_loop_stage).after(thresholds_stage).reads(draw_sc)
+		.reads(test_sc).reads(draw_hidden).reads(use_hermite);
+	// Without colors, the hidden contours take the highlights' gray
+	line_type(hidden_sc_stage).after(thresholds_stage).reads(draw_sc)
+		.reads(test_sc).reads(draw_faded).reads(use_hermite)
+		.readsColor(draw_phridges).readsColor(draw_phvalleys)
+		.readsColor(draw_sh);
+	line_type(visible_sc_stage).after(thresholds_stage).reads(draw_sc)
+		.reads(draw_faded).reads(use_hermite).reads(use_texture);
+	line_type(hidden_contour_stage).reads(draw_c).reads(test_c)
+		.readsColor(draw_phridges).readsColor(draw_phvalleys)
+		.readsColor(draw_sh);
+	line_type(visible_contour_stage).reads(draw_c).reads(use_texture);
+	line_type(hidden_boundary_stage).reads(draw_bdy);
+	line_type(visible_boundary_stage).reads(draw_bdy);
+
+	isophotes_stage.after(perview_stage)
+		.reads(enable_lines).reads(draw_isoph).reads(niso)
+		.reads(draw_colors).reads(single_pixel_lines);
+	topo_stage.after(perview_stage)
+		.reads(enable_lines).reads(draw_topo).reads(ntopo)
+		.reads(topo_offset).reads(single_pixel_lines);
+
+	for (int i = 2; i < num_stages; i++)
+		stages[i]->reads(screen_thinning).reads(max_per_cell);
+}
+
+static int line_cache_hits = 0, line_cache_misses = 0;
+static int num_stages_rerun = 0;	// By the last update_stages()
+
+// A coarser copy of themesh to extract from at COARSE_MESH: its vertices
+// clustered on a grid about twice the edge length.  Building it takes a
+// pass over themesh, so it is done when the mesh is set, or while the
+// camera is still, and never in the middle of an orbit; until then
+// COARSE_MESH extracts from themesh.  refresh_coarse_mesh() gives it the
+// attributes the dials need.  lod_revision is bumped whenever it changes.
+static TriMesh *lod_mesh = NULL;
+static const TriMesh *lod_source = NULL;	// Built, or tried, for
+static int lod_revision = 0;
+static const TriMesh *lod_memory_of = NULL;
+
+static void drop_coarse_mesh()
+{
+	delete lod_mesh;
+	lod_mesh = NULL;
+	lod_source = NULL;
+	lod_revision++;
+	lod_memory_of = NULL;
+}
+
+static void build_coarse_mesh()
+{
+	drop_coarse_mesh();
+	lod_source = themesh;
+	themesh->need_faces();
+	themesh->need_bbox();
+	float cell = 2.0f * themesh->feature_size();
+	if (!(cell > 0.0f))
+		return;
+
+	// Average the vertices in each cell
+	TriMesh *lod = new TriMesh;
+	int nv = themesh->vertices.size();
+	vector<int> remap(nv);
+	vector<int> count;
+	map<quint64, int> cells;
+	for (int i = 0; i < nv; i++) {
+		vec g = (themesh->vertices[i] - themesh->bbox.min) / cell;
+		quint64 key = (quint64(g[0]) << 42) | (quint64(g[1]) << 21) |
+			      quint64(g[2]);
+		map<quint64, int>::iterator it = cells.find(key);
+		if (it == cells.end()) {
+			it = cells.insert(make_pair(key,
+				(int) lod->vertices.size())).first;
+			lod->vertices.push_back(point(0,0,0));
+			count.push_back(0);
+		}
+		remap[i] = it->second;
+		lod->vertices[it->second] += themesh->vertices[i];
+		count[it->second]++;
+	}
+	for (size_t i = 0; i < lod->vertices.size(); i++)
+		lod->vertices[i] /= (float) count[i];
+
+	// Keep the faces that didn't collapse
+	for (size_t i = 0; i < themesh->faces.size(); i++) {
+		const TriMesh::Face &f = themesh->faces[i];
+		int v0 = remap[f[0]], v1 = remap[f[1]], v2 = remap[f[2]];
+		if (v0 != v1 && v1 != v2 && v2 != v0)
+			lod->faces.push_back(TriMesh::Face(v0, v1, v2));
+	}
+
+	lod->need_tstrips();
+	lod->need_normals();
+	lod->need_bsphere();
+	lod->need_across_edge();
+	lod_mesh = lod;
+}
+
+// Computes the attributes of lineview the coarse mesh lacks.  After
+// ensure_attributes(), as for themesh.
+static void refresh_coarse_mesh()
+{
+	if (!lod_mesh)
+		return;
+	int need = lineview.attributes;
+	bool missing_curv = (need & NEED_CURV) &&
+		lod_mesh->curv1.size() != lod_mesh->vertices.size();
+	bool missing_dcurv = (need & NEED_DCURV) &&
+		lod_mesh->dcurv.size() != lod_mesh->vertices.size();
+	if (!missing_curv && !missing_dcurv)
+		return;
+	if (need & NEED_CURV)
+		lod_mesh->need_curvatures();
+	if (need & NEED_DCURV)
+		lod_mesh->need_dcurv();
+	lod_revision++;
+}
+
+// Runs the stages whose inputs changed, for lineview.  Touches no GL
+// state, so it can run on the extraction thread; its timers and counters
+// go into that thread's Stats buffer.  Returns the number of stages run.
+static int update_stages()
+{
+	__TIME_CODE_BLOCK("Extract Lines");
+
+	// At COARSE_MESH, the lines come from the coarse mesh instead
+	TriMesh *mesh = themesh;
+	if (quality_level >= COARSE_MESH && lod_mesh)
+		themesh = lod_mesh;
+
+	num_shared_extractions = 0;
+	num_segments_thinned = 0;
+	int num_run = 0;
+	for (int i = 0; i < num_stages; i++)
+		if (stages[i]->update())
+			num_run++;
+	themesh = mesh;
+	// Shared only between the passes of this update
+	shared_extractions.clear();
+
+	if (num_run)
+		line_cache_misses++;
+	else
+		line_cache_hits++;
+	num_stages_rerun = num_run;
+	return num_run;
+}
+
+// Snapshot of the current camera, light and dials for the next
+// extraction
+static void take_line_view()
+{
+	DialSnapshot::takeAll();
+	lineview.xf = xf;
+	lineview.viewpos = viewpos;
+	lineview.light_direction = light_direction;
+	lineview.camera_version = camera_version;
+	lineview.light_version = light_version;
+	lineview.frame = DialsAndKnobs::frameCounter();
+	lineview.time = now();
+	lineview.have_screen = have_screen;
+	lineview.projection = screen_projection;
+	for (int i = 0; i < 4; i++)
+		lineview.viewport[i] = screen_viewport[i];
+	lineview.attributes = required_attributes();
+}
+
+// The window's projection and viewport, for simplify_lines
+static void read_screen()
+{
+	GLdouble projection[16];
+	glGetDoublev(GL_PROJECTION_MATRIX, projection);
+	screen_projection = xform(projection);
+	glGetIntegerv(GL_VIEWPORT, screen_viewport);
+	have_screen = true;
+}
+
+// The mesh and its coarse copy are only measured again when they
+// change, as their vectors of vectors take a pass over the vertices.
+// mesh_memory_of is reset when attributes are freed without a new
+// mesh_revision.
+static vector<TriMesh::MemoryUse> mesh_memory, lod_memory;
+static const TriMesh *mesh_memory_of = NULL;
+static int mesh_memory_revision = -1;
+static int lod_memory_revision = -1;
+
+static void add_memory_use(vector<MemoryUse> &use, const char *group,
+			   const TriMesh::MemoryUse &m)
+{
+	MemoryUse u = { group, m.name, m.bytes, m.overhead };
+	use.push_back(u);
+}
+
+// The memory of the mesh ("Mesh"), the per-view arrays ("Per-View"),
+// and the lines and coarse mesh ("Lines").  Only while no extraction
+// is running.
+static void memory_use(vector<MemoryUse> &use)
+{
+	use.clear();
+	if (themesh) {
+		if (mesh_memory_of != themesh ||
+		    mesh_memory_revision != mesh_revision) {
+			mesh_memory.clear();
+			themesh->memory_use(mesh_memory);
+			mesh_memory_of = themesh;
+			mesh_memory_revision = mesh_revision;
+		}
+		for (size_t i = 0; i < mesh_memory.size(); i++)
+			add_memory_use(use, "Mesh", mesh_memory[i]);
+	}
+	add_memory_use(use, "Mesh",
+		TriMesh::memory_use("curvature colors", curv_colors));
+	add_memory_use(use, "Mesh",
+		TriMesh::memory_use("gaussian curvature colors", gcurv_colors));
+
+	add_memory_use(use, "Per-View", TriMesh::memory_use("ndotv", ndotv));
+	add_memory_use(use, "Per-View", TriMesh::memory_use("kr", kr));
+	add_memory_use(use, "Per-View", TriMesh::memory_use("dwkr", dwkr));
+	add_memory_use(use, "Per-View",
+		TriMesh::memory_use("sctest_num", sctest_num));
+	add_memory_use(use, "Per-View",
+		TriMesh::memory_use("sctest_den", sctest_den));
+	add_memory_use(use, "Per-View",
+		TriMesh::memory_use("shtest_num", shtest_num));
+	add_memory_use(use, "Per-View", TriMesh::memory_use("q1", q1));
+	add_memory_use(use, "Per-View", TriMesh::memory_use("t1", t1));
+	add_memory_use(use, "Per-View", TriMesh::memory_use("Dt1q1", Dt1q1));
+	add_memory_use(use, "Per-View",
+		TriMesh::memory_use("texcoords", texcoords));
+
+	for (int i = 0; i < num_stages; i++)
+		add_memory_use(use, "Lines", stages[i]->memoryUse());
+
+	// A map node holds its key and LineSet, and the tree's links: three
+	// pointers and a color
+	TriMesh::MemoryUse shared = { "Shared Extractions", 0, 0 };
+	map<quint64, LineSet>::const_iterator it;
+	for (it = shared_extractions.begin(); it != shared_extractions.end();
+	     ++it) {
+		TriMesh::MemoryUse lines = line_set_memory("", it->second);
+		size_t node = TriMesh::heap_bytes(sizeof(*it) +
+						   4 * sizeof(void *));
+		shared.bytes += node - sizeof(LineSet) + lines.bytes;
+		shared.overhead += node - sizeof(*it) + lines.overhead;
+	}
+	add_memory_use(use, "Lines", shared);
+
+	TriMesh::MemoryUse coarse = { "Coarse Mesh", 0, 0 };
+	if (lod_mesh) {
+		if (lod_memory_of != lod_mesh ||
+		    lod_memory_revision != lod_revision) {
+			lod_memory.clear();
+			lod_mesh->memory_use(lod_memory);
+			lod_memory_of = lod_mesh;
+			lod_memory_revision = lod_revision;
+		}
+		coarse.bytes = sizeof(TriMesh);
+		for (size_t i = 0; i < lod_memory.size(); i++) {
+			coarse.bytes += lod_memory[i].bytes;
+			coarse.overhead += lod_memory[i].overhead;
+		}
+	}
+	add_memory_use(use, "Lines", coarse);
+}
+
+static QString memory_string(const MemoryUse &use)
+{
+	return QString("%1 MB (%2 MB overhead)")
+		.arg(use.bytes / (1024.0 * 1024.0), 0, 'f', 2)
+		.arg(use.overhead / (1024.0 * 1024.0), 0, 'f', 2);
+}
+
+// Sets the "Memory" constants, one group per memory_use() group
+static void record_memory(Stats &stats, const vector<MemoryUse> &use)
+{
+	stats.beginConstantGroup("Memory");
+	const char *group = NULL;
+	for (size_t i = 0; i < use.size(); i++) {
+		if (!group || strcmp(group, use[i].group)) {
+			if (group)
+				stats.endConstantGroup();
+			group = use[i].group;
+			stats.beginConstantGroup(group);
+		}
+		stats.setConstant(use[i].name, memory_string(use[i]));
+	}
+	if (group)
+		stats.endConstantGroup();
+	stats.endConstantGroup();
+}
+
+// The total of each group as a counter, e.g. "Mesh Memory (MB)", and
+// the constants again if anything changed since they were last set
+static void report_memory()
+{
+#ifndef DEMOUTILS_NO_TIMERS
+	static vector<MemoryUse> use, recorded;
+	memory_use(use);
+
+	size_t mesh = 0, perview = 0, lines = 0;
+	bool changed = (use.size() != recorded.size());
+	for (size_t i = 0; i < use.size(); i++) {
+		if (!strcmp(use[i].group, "Mesh"))
+			mesh += use[i].bytes;
+		else if (!strcmp(use[i].group, "Per-View"))
+			perview += use[i].bytes;
 		else
-			currcolor = vec(0.6, 0.6, 0.6);
-		set_line_width(1.5);
-		glBegin(GL_LINES);
-		draw_isolines(kr, sctest_num, sctest_den, ndotv,
-                      true, use_hermite, false, 0.0f);
-		glEnd();
-		currcolor = vec(0.0, 0.0, 0.0);
+			lines += use[i].bytes;
+		if (!changed && use[i].bytes != recorded[i].bytes)
+			changed = true;
 	}
-    
-	// Suggestive contours and contours
-	if (draw_sc && !use_texture) {
-		float fade = draw_faded ? 0.03f / sqr(feature_size) : 0.0f;
-		if (draw_colors)
-			currcolor = vec(0.0, 0.0, 0.8);
-		set_line_width(2.5);
-		glBegin(GL_LINES);
-		draw_isolines(kr, sctest_num, sctest_den, ndotv,
-                      true, use_hermite, true, fade);
-		glEnd();
+	__SET_COUNTER("Mesh Memory (MB)", mesh / (1024.0f * 1024.0f));
+	__SET_COUNTER("Per-View Memory (MB)", perview / (1024.0f * 1024.0f));
+	__SET_COUNTER("Line Memory (MB)", lines / (1024.0f * 1024.0f));
+
+	if (changed) {
+		record_memory(Stats::instance(), use);
+		recorded = use;
 	}
-	if (draw_c && !use_texture) {
-		if (draw_colors)
-			currcolor = vec(0.0, 0.6, 0.0);
-		set_line_width(2.5);
-		glBegin(GL_LINES);
-		draw_isolines(ndotv, kr, vector<float>(), ndotv,
-                      false, false, true, 0.0f);
-		glEnd();
+#endif
+}
+
+// Makes the lines of the last update_stages() the ones drawn, and
+// reports on it
+static void publish_lines()
+{
+	for (int i = 0; i < num_stages; i++)
+		stages[i]->publish();
+	shownview = lineview;
+
+	__SET_COUNTER("Line Cache Hits", line_cache_hits);
+	__SET_COUNTER("Line Cache Misses", line_cache_misses);
+	__SET_COUNTER("Stages Rerun", num_stages_rerun);
+	__SET_COUNTER("Shared Extractions", num_shared_extractions);
+	__SET_COUNTER("Segments Thinned", num_segments_thinned);
+
+	int num_segments = 0;
+	for (int i = 0; i < num_stages; i++)
+		num_segments += stages[i]->lines.numSegments();
+	__SET_COUNTER("Line Segments", num_segments);
+
+	report_memory();
+}
+
+// With "Lines->Extract in Background" on, the stages run on a thread of
+// their own, against a snapshot of the view (lineview), while the GUI
+// thread keeps drawing the mesh with the lines last published.  The
+// lines are in world space, so they stay on the mesh as the camera
+// moves; they are only late to appear and disappear at the contours.
+// The extraction reads the dials as take_line_view() found them: the
+// change stamps rerun whatever a dial moved meanwhile in the next one.
+static QAtomicInt extraction_running;	// 1 from start to finish
+static QObject *repaint_target = NULL;
+
+static QThreadPool &extraction_thread()
+{
+	static QThreadPool *pool = NULL;
+	if (!pool) {
+		pool = new QThreadPool;
+		pool->setMaxThreadCount(1);
 	}
-	if ((draw_sc || draw_c) && use_texture)
-		draw_c_sc_texture(ndotv, kr, sctest_num, sctest_den);
-    
-    
-    
-	// Boundaries
-	if (draw_bdy)
-		draw_boundaries(false);
+	return *pool;
 }
-    
+
+class ExtractionJob : public QRunnable
+{
+public:
+	void run()
+	{
+		int num_run = update_stages();
+		// Release, so the results are visible to extraction_idle()
+		extraction_running.fetchAndStoreRelease(0);
+		// Have the new lines drawn
+		if (num_run && repaint_target)
+			QMetaObject::invokeMethod(repaint_target, "linesReady",
+						  Qt::QueuedConnection);
+	}
+};
+
+static bool extraction_idle()
+{
+	return extraction_running.testAndSetAcquire(0, 0);
+}
+
+// Publishes the last extraction if it has finished, and starts one for
+// the current view.  Call on the GUI thread.
+static void start_extraction()
+{
+	if (!extraction_idle())
+		return;
+	publish_lines();
+	quality_level = FULL_QUALITY;
+
+	// Attributes are computed here, as they change the mesh
+	setup_stages();
+	take_line_view();
+	ensure_attributes();
+	extraction_running.fetchAndStoreRelaxed(1);
+	extraction_thread().start(new ExtractionJob);
+}
+
+// Waits for the extraction thread, so that the mesh and the per-view
+// arrays can be used on this one
+void finishExtraction()
+{
+	if (!extraction_idle())
+		extraction_thread().waitForDone();
+	publish_lines();
+}
+
+void releaseMesh(const TriMesh *mesh)
+{
+	if (mesh == themesh)
+		finishExtraction();
+}
+
+void setRepaintTarget(QObject *target)
+{
+	finishExtraction();
+	repaint_target = target;
+}
+
+// Bring the per-view arrays and lines up to date for the current view,
+// without drawing anything
+void extract_lines()
+{
+	finishExtraction();
+	setup_stages();
+	take_line_view();
+	ensure_attributes();
+	if (quality_level >= COARSE_MESH)
+		refresh_coarse_mesh();
+	update_stages();
+	publish_lines();
+}
+
+// Lowers the line quality one level per frame while the camera moves
+// and the frames take longer than "Style->Target FPS" allows, and raises
+// it again when they are fast, or back to full once the camera stops.
+// Only for synchronous extraction in a window: in the background, the
+// extraction doesn't hold up the frames anyway.
+static void govern_quality(float last_frame_time)
+{
+	// The camera counts as moving until it has been still this long
+	const float settle_time = 0.25f;
+	static int last_camera_version = -1;
+	static timestamp last_motion, repaint_requested;
+	if (camera_version != last_camera_version) {
+		last_camera_version = camera_version;
+		last_motion = now();
+	}
+	bool moving = (now() - last_motion < settle_time);
+
+	// An extraction left running in the background reads quality_level
+	// and the coarse mesh
+	if (!extraction_idle())
+		extraction_thread().waitForDone();
+	if (target_fps > 0.0 && !moving && lod_source != themesh)
+		build_coarse_mesh();
+
+	if (target_fps <= 0.0 || !moving) {
+		quality_level = FULL_QUALITY;
+	} else {
+		float budget = 1.0f / target_fps;
+		if (last_frame_time > budget &&
+		    quality_level < NUM_QUALITY_LEVELS - 1)
+			quality_level++;
+		else if (last_frame_time < 0.5f * budget &&
+			 quality_level > FULL_QUALITY)
+			quality_level--;
+	}
+	// The textured contours need per-view arrays of themesh itself
+	if (quality_level >= COARSE_MESH && ui_use_texture)
+		quality_level = NO_HIDDEN_LINES;
+	__SET_COUNTER("Quality Level", quality_level);
+	if (quality_level == FULL_QUALITY)
+		return;
+
+	// No frame tells us the camera has stopped, so ask for one
+	if (repaint_target && now() - repaint_requested > settle_time) {
+		QTimer::singleShot(int(1000 * settle_time), repaint_target,
+				   SLOT(updateGL()));
+		repaint_requested = now();
+	}
+}
+
+// How far the lines drawn are behind the camera
+static void report_line_latency()
+{
+	bool behind = (shownview.camera_version != camera_version ||
+		       shownview.light_version != light_version);
+	float ms = behind ? 1000.0f * (now() - shownview.time) : 0.0f;
+	int frames = behind ?
+		DialsAndKnobs::frameCounter() - shownview.frame : 0;
+	__SET_COUNTER("Line Latency (ms)", ms);
+	__SET_COUNTER("Line Latency (frames)", frames);
+}
+
+// GPU time of the drawing sections, read back a few frames late and
+// shown next to their CPU timers.  The sections must not overlap.
+static GQTimerQueries gpu_timers;
+
+static void start_draw_section(const char *name)
+{
+	__START_TIMER(name);
+	gpu_timers.begin(Stats::instance().handle(name));
+}
+
+static void stop_draw_section(const char *name)
+{
+	gpu_timers.end(Stats::instance().handle(name));
+	__STOP_TIMER(name);
+}
+
+static void report_gpu_times()
+{
+	gpu_timers.nextFrame();
+	QHashIterator<int,double> it(gpu_timers.results());
+	while (it.hasNext()) {
+		it.next();
+		Stats::instance().setGpuTime(it.key(), it.value());
+	}
+}
+
+// Draw extracted lines with vertex arrays, one call per batch
+void draw_line_set(const LineSet &lines)
+{
+	if (lines.isEmpty())
+		return;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, &lines.vertices[0][0]);
+	glColorPointer(4, GL_FLOAT, 0, &lines.colors[0][0]);
+
+	for (size_t i = 0; i < lines.batches.size(); i++) {
+		const LineSet::Batch &batch = lines.batches[i];
+		if (batch.depth_test)
+			glEnable(GL_DEPTH_TEST);
+		else
+			glDisable(GL_DEPTH_TEST);
+		glLineWidth(batch.width);
+		glDrawArrays(GL_LINES, batch.first, batch.count);
+		if (batch.round_caps) {
+			glPointSize(batch.width);
+			glDrawArrays(GL_POINTS, batch.first, batch.count);
+		}
+	}
+
+	glEnable(GL_DEPTH_TEST);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
 // Draw the mesh, possibly including a bunch of lines
 void draw_everything()
 {
-	compute_perview(ndotv, kr, sctest_num, sctest_den, shtest_num,
-                    q1, t1, Dt1q1, use_texture);
-    
+	static float last_frame_time = 0.0f;
+	timestamp frame_start = now();
+	read_screen();
+
+	// Only a window gets repainted when the lines are ready (batch
+	// rendering has no repaint target), and textured contours are drawn
+	// from the per-view arrays.  The dials are read as they are now, as
+	// the extraction about to start is what takes them.
+	if (extract_in_background && repaint_target &&
+	    !(ui_use_texture && ui_enable_lines)) {
+		start_extraction();
+	} else {
+		if (repaint_target && !capturing)
+			govern_quality(last_frame_time);
+		else
+			quality_level = FULL_QUALITY;
+		extract_lines();
+	}
+	report_line_latency();
+
 	// Enable antialiased lines
 	glEnable(GL_POINT_SMOOTH);
 	glEnable(GL_LINE_SMOOTH);
@@ -1706,38 +3124,51 @@ void draw_everything()
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Exterior silhouette
-	if (draw_extsil && enable_lines)
-		draw_silhouette(ndotv);
+	start_draw_section("Submit Lines");
+	glDepthMask(GL_FALSE);
+	draw_line_set(silhouette_stage.lines);
+	glDepthMask(GL_TRUE);
+	stop_draw_section("Submit Lines");
 
 	// The mesh itself, possibly colored and/or lit
+	start_draw_section("Draw Base Mesh");
 	glDisable(GL_BLEND);
 	draw_base_mesh();
 	glEnable(GL_BLEND);
+	stop_draw_section("Draw Base Mesh");
 
-	if (enable_lines) {
-        draw_lines();
-    }
+	start_draw_section("Submit Lines");
+	for (int i = 0; i < num_frame_line_stages; i++)
+		draw_line_set(frame_line_stages[i]->lines);
+	stop_draw_section("Submit Lines");
+	if (enable_lines && (draw_sc || draw_c) && use_texture)
+		draw_c_sc_texture(ndotv, kr, sctest_num, sctest_den);
 
 	glDisable(GL_LINE_SMOOTH);
 	glDisable(GL_POINT_SMOOTH);
 	glDisable(GL_BLEND);
 	glDepthMask(GL_TRUE);
-}
 
+	report_gpu_times();
+	last_frame_time = now() - frame_start;
+}
 
 void setCameraTransform(xform main)
 {
+    if (main != xf)
+        camera_version++;
     xf = main;
     viewpos = inv(xf) * point(0,0,0);
 }
     
 void setLightDir(const vec& lightdir)
 {
+    if (lightdir != light_direction)
+        light_version++;
     light_direction = lightdir;
 }
 
-// Draw the scene
-void redraw()
+static void set_clear_color()
 {
     if (background_style == "Black") {
         glClearColor(0.0,0.0,0.0,0.0);
@@ -1746,85 +3177,306 @@ void redraw()
     } else {
         glClearColor(1.0,1.0,1.0,0.0);
     }
+}
+
+// Draw the scene
+void redraw()
+{
+    set_clear_color();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     draw_everything();
 }
 
+// Draw the scene into the capture attachments of the bound framebuffer
+void redrawCapture()
+{
+    // Normals and depth are black where there is no mesh, as when they
+    // are drawn with the "Normals" and "Depth" mesh colors.
+    glDrawBuffers(NUM_CAPTURE_BUFFERS, capture_buffers);
+    glClearColor(0.0,0.0,0.0,0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glDrawBuffer(capture_buffers[CAPTURE_SHADED]);
+    set_clear_color();
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    capturing = true;
+    draw_everything();
+    capturing = false;
+
+    glDrawBuffers(NUM_CAPTURE_BUFFERS, capture_buffers);
+}
+
+// The color the mesh is drawn with, as set up in draw_base_mesh
+static void software_mesh_color(SoftRaster::MeshStyle &style)
+{
+    style.color = vec(1,1,1);
+    style.colors = NULL;
+    if (color_style == "Gray") {
+        style.color = vec(0.65, 0.65, 0.65);
+    } else if (color_style == "Black") {
+        style.color = vec(0,0,0);
+    } else if (color_style == "Curvature") {
+        if (curv_colors.empty())
+            compute_curv_colors();
+        style.colors = &curv_colors;
+    } else if (color_style == "Gaussian C.") {
+        if (gcurv_colors.empty())
+            compute_gcurv_colors();
+        style.colors = &gcurv_colors;
+    } else if (color_style == "Mesh" && themesh->colors.size()) {
+        style.colors = &themesh->colors;
+    }
+}
+
+static SoftRaster::Shading software_shading()
+{
+    if (lighting_style == "Lambertian")
+        return SoftRaster::SHADE_DIFFUSE;
+    else if (lighting_style == "Lambertian2")
+        return SoftRaster::SHADE_DIFFUSE2;
+    else if (lighting_style == "Hemisphere")
+        return SoftRaster::SHADE_HEMISPHERE;
+    else if (lighting_style == "Shiny")
+        return SoftRaster::SHADE_SHINY;
+    else if (lighting_style == "Toon")
+        return SoftRaster::SHADE_TOON;
+    else if (lighting_style == "Toon BW")
+        return SoftRaster::SHADE_TOONBW;
+    else if (lighting_style == "Gooch")
+        return SoftRaster::SHADE_GOOCH;
+    return SoftRaster::SHADE_NONE;
+}
+
+// Draw the scene on the CPU, in the same order as draw_everything
+void redrawSoftware(SoftRaster &raster, int capture_buffer)
+{
+    // No GL projection to simplify the lines for
+    have_screen = false;
+    extract_lines();
+
+    SoftRaster::MeshStyle style;
+    software_mesh_color(style);
+    style.shading = software_shading();
+    style.light_dir = light_direction;
+    style.offset_factor = poly_offset_factor;
+    style.offset_units = 30.0f;
+
+    // The normals and depth attachments hold just the mesh.
+    if (capture_buffer == CAPTURE_NORMALS ||
+        capture_buffer == CAPTURE_DEPTH) {
+        style.shading = (capture_buffer == CAPTURE_NORMALS) ?
+            SoftRaster::SHADE_NORMALS : SoftRaster::SHADE_DEPTH;
+        raster.clear(vec4(0,0,0,0));
+        raster.drawMesh(themesh, style);
+        return;
+    }
+
+    if (capture_buffer == CAPTURE_SHADED &&
+        (color_style == "Depth" || color_style == "Normals")) {
+        style.color = vec(1,1,1);
+    } else if (color_style == "Depth") {
+        style.shading = SoftRaster::SHADE_DEPTH;
+    } else if (color_style == "Normals") {
+        style.shading = SoftRaster::SHADE_NORMALS;
+    }
+
+    if (background_style == "Black")
+        raster.clear(vec4(0,0,0,0));
+    else if (background_style == "Gray")
+        raster.clear(vec4(0.5,0.5,0.5,0));
+    else
+        raster.clear(vec4(1,1,1,0));
+
+    raster.drawLines(silhouette_stage.lines);
+    raster.drawMesh(themesh, style);
+    for (int i = 0; i < num_frame_line_stages; i++)
+        raster.drawLines(frame_line_stages[i]->lines);
+}
+
+void extractLinesOnly()
+{
+    have_screen = false;
+    extract_lines();
+}
+
+bool extractForCheck(int type, bool reference, LineSet& lines)
+{
+    finishExtraction();
+    int nv = themesh->vertices.size();
+    bool have_sc = ((int) sctest_num.size() == nv);
+    bool have_sh = have_sc && ((int) shtest_num.size() == nv);
+    bool have_apparent = ((int) Dt1q1.size() == nv);
+
+    // The arguments of the visible pass
+    bool do_ridge = true;
+    float fade = draw_faded ? 0.03f / sqr(feature_size) : 0.0f;
+    float rv_t = rv_thresh / feature_size;
+    float ph_t = ph_thresh / sqr(feature_size);
+    float ar_t = ar_thresh / sqr(feature_size);
+    ReferenceLines::View view = { themesh, lineview.viewpos, draw_faded,
+                                  vec(0,0,0), &lines };
+
+    // Extract on our own, then put back the state of the passes
+    LineSet* pass = currlines;
+    bool shared = share_extraction;
+    currlines = &lines;
+    currcolor = view.color;
+    lines.recordFaces(true);
+    lines.setColor(currcolor);
+    share_extraction = false;
+
+    bool ok = true;
+    switch (type) {
+    case CHECK_CONTOURS:
+        if (reference)
+            ReferenceLines::draw_isolines(view, ndotv, kr, vector<float>(),
+                ndotv, false, false, true, 0.0f);
+        else
+            draw_isolines(ndotv, kr, vector<float>(), ndotv,
+                false, false, true, 0.0f);
+        break;
+    case CHECK_SUGGESTIVE_CONTOURS:
+        if (!(ok = have_sc))
+            break;
+        if (reference)
+            ReferenceLines::draw_isolines(view, kr, sctest_num, sctest_den,
+                ndotv, true, hermite_enabled(), true, fade);
+        else
+            draw_isolines(kr, sctest_num, sctest_den, ndotv,
+                true, hermite_enabled(), true, fade);
+        break;
+    case CHECK_SUGGESTIVE_HIGHLIGHTS:
+        if (!(ok = have_sh))
+            break;
+        if (reference)
+            ReferenceLines::draw_isolines(view, kr, shtest_num, sctest_den,
+                ndotv, true, hermite_enabled(), test_sh, fade);
+        else
+            draw_isolines(kr, shtest_num, sctest_den, ndotv,
+                true, hermite_enabled(), test_sh, fade);
+        break;
+    case CHECK_VALLEYS:
+        do_ridge = false;
+        // Fall through
+    case CHECK_RIDGES:
+        if (reference)
+            ReferenceLines::draw_mesh_ridges(view, do_ridge, ndotv,
+                true, test_rv, rv_t);
+        else
+            draw_mesh_ridges(do_ridge, ndotv, true, test_rv, rv_t);
+        break;
+    case CHECK_PH_VALLEYS:
+        do_ridge = false;
+        // Fall through
+    case CHECK_PH_RIDGES:
+        if (reference)
+            ReferenceLines::draw_mesh_ph(view, do_ridge, ndotv,
+                true, test_ph, ph_t);
+        else
+            draw_mesh_ph(do_ridge, ndotv, true, test_ph, ph_t);
+        break;
+    case CHECK_APPARENT_RIDGES:
+        if (!(ok = have_apparent))
+            break;
+        if (reference)
+            ReferenceLines::draw_mesh_app_ridges(view, ndotv, q1, t1, Dt1q1,
+                true, test_ar, ar_t);
+        else
+            draw_mesh_app_ridges(ndotv, q1, t1, Dt1q1, true, test_ar, ar_t);
+        break;
+    default:
+        ok = false;
+    }
+
+    currlines = pass;
+    share_extraction = shared;
+    return ok;
+}
+
 // Smooth the mesh
-void filter_mesh(int dummy = 0)
+void filter_mesh(int /*dummy*/)
 {
+	finishExtraction();
 	printf("\r");  fflush(stdout);
 	smooth_mesh(themesh, currsmooth);
 
+	// Curvatures get recomputed by the next frame, if it needs them
 	themesh->pointareas.clear();
 	themesh->normals.clear();
 	themesh->curv1.clear();
 	themesh->dcurv.clear();
 	themesh->need_normals();
-	themesh->need_curvatures();
-	themesh->need_dcurv();
 	curv_colors.clear();
 	gcurv_colors.clear();
 	currsmooth *= 1.1f;
+	mesh_revision++;
+	drop_coarse_mesh();
 }
 
 
 // Diffuse the normals across the mesh
-void filter_normals(int dummy = 0)
+void filter_normals(int /*dummy*/)
 {
+	finishExtraction();
 	printf("\r");  fflush(stdout);
 	diffuse_normals(themesh, currsmooth);
 	themesh->curv1.clear();
 	themesh->dcurv.clear();
-	themesh->need_curvatures();
-	themesh->need_dcurv();
 	curv_colors.clear();
 	gcurv_colors.clear();
 	currsmooth *= 1.1f;
+	mesh_revision++;
 }
 
 
 // Diffuse the curvatures across the mesh
-void filter_curv(int dummy = 0)
+void filter_curv(int /*dummy*/)
 {
+	finishExtraction();
 	printf("\r");  fflush(stdout);
 	diffuse_curv(themesh, currsmooth);
 	themesh->dcurv.clear();
-	themesh->need_dcurv();
 	curv_colors.clear();
 	gcurv_colors.clear();
 	currsmooth *= 1.1f;
+	mesh_revision++;
 }
 
 
 // Diffuse the curvature derivatives across the mesh
-void filter_dcurv(int dummy = 0)
+void filter_dcurv(int /*dummy*/)
 {
+	finishExtraction();
 	printf("\r");  fflush(stdout);
 	diffuse_dcurv(themesh, currsmooth);
 	curv_colors.clear();
 	gcurv_colors.clear();
 	currsmooth *= 1.1f;
+	mesh_revision++;
 }
 
 
 // Perform an iteration of subdivision
-void subdivide_mesh(int dummy = 0)
+void subdivide_mesh(int /*dummy*/)
 {
+	finishExtraction();
 	printf("\r");  fflush(stdout);
 	subdiv(themesh);
 
 	themesh->need_tstrips();
 	themesh->need_normals();
-	themesh->need_pointareas();
-	themesh->need_curvatures();
-	themesh->need_dcurv();
 	curv_colors.clear();
 	gcurv_colors.clear();
+	mesh_revision++;
+	drop_coarse_mesh();
 }
 
 
+// Set once compute_feature_size() has seen the curvatures of this mesh
+static bool have_feature_size = false;
+
 // Compute a "feature size" for the mesh: computed as 1% of
 // the reciprocal of the 10-th percentile curvature
 void compute_feature_size()
@@ -1854,19 +3506,271 @@ void compute_feature_size()
 	nth_element(samples.begin(), samples.begin() + which, samples.end());
 
 	feature_size = min(mult / samples[which], max_feature_size);
+	have_feature_size = true;
 }
 
-void initialize(TriMesh* mesh)
+// Timings of the last initialize() and of the last stages computed on
+// demand, reported by recordStats()
+static TaskGraph* precompute_graph = NULL;
+static TaskGraph* ondemand_graph = NULL;
+
+static void compute_smoothing_scale()
+{
+	currsmooth = 0.5f * themesh->feature_size();
+}
+
+// Attributes needed by the dials as they are now, rather than as the
+// last take_line_view() found them
+static int required_attributes()
 {
+	int need = 0;
+
+	if (ui_enable_lines) {
+		if (ui_draw_sc || ui_draw_sh || ui_draw_DwKr ||
+		    ui_draw_ridges || ui_draw_valleys)
+			need |= NEED_CURV | NEED_DCURV;
+		if (ui_draw_phridges || ui_draw_phvalleys ||
+		    ui_draw_K || ui_draw_H)
+			need |= NEED_CURV;
+		if (ui_draw_apparent)
+			need |= NEED_CURV | NEED_ADJACENTFACES;
+		// Contours are trimmed by the sign of kr, except when
+		// they come only from the texture
+		if (ui_draw_c &&
+		    (!ui_use_texture || (ui_draw_hidden && ui_test_c)))
+			need |= NEED_CURV;
+	}
+	if (draw_curv1 || draw_curv2 || draw_asymp)
+		need |= NEED_CURV;
+	if (ui_color_style == "Curvature" ||
+	    ui_color_style == "Gaussian C.")
+		need |= NEED_CURV;
+
+	return need;
+}
+
+// Attributes the mesh already has, tested the same way need_* does
+static int available_attributes()
+{
+	int have = 0;
+	if (themesh->curv1.size() == themesh->vertices.size())
+		have |= NEED_CURV;
+	if (themesh->dcurv.size() == themesh->vertices.size())
+		have |= NEED_DCURV;
+	if (!themesh->adjacentfaces.empty())
+		have |= NEED_ADJACENTFACES;
+	return have;
+}
+
+static QList<int> after(int a, int b = -1)
+{
+	QList<int> depends_on;
+	if (a >= 0)
+		depends_on << a;
+	if (b >= 0)
+		depends_on << b;
+	return depends_on;
+}
+
+// Adds the stages computing the given attributes (and the feature size,
+// if asked) to g.  faces, normals and bsphere are the stages producing
+// those, or -1 if the mesh already has them.
+static void add_attribute_tasks(TaskGraph& g, TriMesh* mesh, int attributes,
+				bool feature_size, int faces,
+				int normals, int bsphere)
+{
+	typedef TaskGraph::MethodTask<TriMesh> MeshTask;
+
+	if (attributes & NEED_ADJACENTFACES)
+		g.addTask(new MeshTask("Adjacent Faces", mesh,
+			&TriMesh::need_adjacentfaces), after(faces));
+
+	// need_dcurv reads the point areas without computing them
+	int pointareas = -1, curv = -1;
+	if (attributes & (NEED_CURV | NEED_DCURV))
+		pointareas = g.addTask(new MeshTask("Point Areas", mesh,
+			&TriMesh::need_pointareas), after(faces));
+	if (attributes & NEED_CURV)
+		curv = g.addTask(new MeshTask("Curvatures", mesh,
+			&TriMesh::need_curvatures), after(normals, pointareas));
+	if (attributes & NEED_DCURV)
+		g.addTask(new MeshTask("Curvature Derivatives", mesh,
+			&TriMesh::need_dcurv), after(curv, pointareas));
+	if (feature_size)
+		g.addTask(new TaskGraph::FunctionTask("Feature Size",
+			compute_feature_size), after(curv, bsphere));
+}
+
+// Computes whatever the dials of lineview need that the mesh doesn't
+// have yet, e.g. the first time "Lines->Ridges" is switched on.
+void ensure_attributes()
+{
+	int need = lineview.attributes;
+	int missing = need & ~available_attributes();
+	bool need_feature_size = (need & NEED_CURV) && !have_feature_size;
+	if (!missing && !need_feature_size)
+		return;
+
+	delete ondemand_graph;
+	ondemand_graph = new TaskGraph;
+	add_attribute_tasks(*ondemand_graph, themesh, missing,
+			    need_feature_size, -1, -1, -1);
+	ondemand_graph->run();
+	mesh_revision++;
+}
+
+int requiredAttributes()
+{
+	return required_attributes();
+}
+
+TaskGraph* makePrecomputeGraph(TriMesh* mesh, int attributes)
+{
+	// Each need_* would pull in its own prerequisites one after another.
+	// Spelling the dependencies out lets independent stages overlap
+	// (bsphere and point areas don't wait for the strips).  Normals
+	// still wait for the strips, so they come out exactly as before.
+	// Curvatures and their derivatives are only computed here if asked
+	// for; otherwise ensure_attributes() computes them when some line
+	// first needs them.
+	typedef TaskGraph::MethodTask<TriMesh> MeshTask;
+	TaskGraph* graph = new TaskGraph;
+	TaskGraph& g = *graph;
+
+	int faces = g.addTask(new MeshTask("Faces", mesh,
+		&TriMesh::need_faces));
+	int bsphere = g.addTask(new MeshTask("Bounding Sphere", mesh,
+		&TriMesh::need_bsphere));
+	int adjacency = g.addTask(new MeshTask("Adjacency", mesh,
+		&TriMesh::need_across_edge), faces);
+	int tstrips = g.addTask(new MeshTask("Triangle Strips", mesh,
+		&TriMesh::need_tstrips), adjacency);
+	int normals = g.addTask(new MeshTask("Normals", mesh,
+		&TriMesh::need_normals), tstrips);
+
+	// The adjacency stage builds the adjacent faces on the way
+	add_attribute_tasks(g, mesh, attributes & ~NEED_ADJACENTFACES, false,
+			    faces, normals, bsphere);
+
+	return graph;
+}
+
+void setMesh(TriMesh* mesh, TaskGraph* precompute)
+{
+	finishExtraction();
+	for (int i = 0; i < num_stages; i++)
+		stages[i]->clearLines();
 	themesh = mesh;
 
-	themesh->need_tstrips();
-	themesh->need_bsphere();
-	themesh->need_normals();
-	themesh->need_curvatures();
-	themesh->need_dcurv();
-	compute_feature_size();
-	currsmooth = 0.5f * themesh->feature_size();
+	delete precompute_graph;
+	precompute_graph = precompute;
+	delete ondemand_graph;
+	ondemand_graph = NULL;
+
+	curv_colors.clear();
+	gcurv_colors.clear();
+	mesh_revision++;
+	have_feature_size = false;
+	if (available_attributes() & NEED_CURV)
+		compute_feature_size();
+	compute_smoothing_scale();
+
+	drop_coarse_mesh();
+	if (target_fps > 0.0)
+		build_coarse_mesh();
+}
+
+void initialize(TriMesh* mesh)
+{
+	TaskGraph* precompute = makePrecomputeGraph(mesh,
+						    required_attributes());
+	precompute->run();
+	setMesh(mesh, precompute);
+}
+
+void recordStats(Stats& stats)
+{
+	if (precompute_graph)
+		precompute_graph->recordStats(stats, "Precompute");
+	if (ondemand_graph)
+		ondemand_graph->recordStats(stats, "Precompute (On Demand)");
+	recordMemory(stats);
+}
+
+void memoryUse(vector<MemoryUse>& use)
+{
+	finishExtraction();
+	memory_use(use);
+}
+
+void recordMemory(Stats& stats)
+{
+	vector<MemoryUse> use;
+	memoryUse(use);
+	record_memory(stats, use);
+}
+
+size_t freeUnneededAttributes()
+{
+	finishExtraction();
+	// What is drawn until the next extraction must not need what is freed
+	DialSnapshot::takeAll();
+	size_t freed = 0;
+
+	if (themesh) {
+		int need = required_attributes();
+		// need_curvatures and need_dcurv both weight by the point
+		// areas, but only need_curvatures computes them, so they go
+		// with the curvatures
+		if (!(need & NEED_CURV)) {
+			freed += release(themesh->curv1) +
+				 release(themesh->curv2) +
+				 release(themesh->pdir1) +
+				 release(themesh->pdir2);
+			freed += release(themesh->pointareas) +
+				 release(themesh->cornerareas);
+			freed += release(curv_colors) + release(gcurv_colors);
+		}
+		if (!(need & NEED_DCURV))
+			freed += release(themesh->dcurv);
+		if (!(need & NEED_ADJACENTFACES))
+			freed += release(themesh->adjacentfaces);
+		// Only used by the trimesh2 functions (smoothing, diffusion)
+		// that compute them again
+		freed += release(themesh->neighbors);
+		mesh_memory_of = NULL;
+	}
+
+	// The per-view arrays compute_perview and compute_thresholds only
+	// fill for these dials; turning one on reruns them
+	if (!(draw_sc || draw_sh || draw_DwKr))
+		freed += release(dwkr) + release(sctest_num) +
+			 release(sctest_den);
+	if (!draw_sh)
+		freed += release(shtest_num);
+	if (!draw_apparent)
+		freed += release(q1) + release(t1) + release(Dt1q1);
+	if (!use_texture)
+		freed += release(texcoords);
+
+	for (int i = 0; i < num_stages; i++)
+		freed += stages[i]->releaseUnused();
+
+	// The quality never drops to COARSE_MESH without a target rate
+	if (lod_mesh && target_fps <= 0.0) {
+		vector<TriMesh::MemoryUse> use;
+		lod_mesh->memory_use(use);
+		freed += sizeof(TriMesh);
+		for (size_t i = 0; i < use.size(); i++)
+			freed += use[i].bytes;
+		drop_coarse_mesh();
+	}
+
+#ifdef LINUX
+	// Hand the free pages back, so the RSS shows the difference
+	malloc_trim(0);
+#endif
+	return freed;
 }
     
 } // namespace Rtsc
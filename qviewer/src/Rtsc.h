@@ -16,19 +16,101 @@
  
  */
 
+#ifndef RTSC_H_
+#define RTSC_H_
 
 #include "XForm.h"
+#include <vector>
 
 class TriMesh;
+class Stats;
+class QObject;
+class TaskGraph;
+class SoftRaster;
+class LineSet;
 
 namespace Rtsc {
 
 // Initialize global variables that were previous done in main()
 void initialize(TriMesh* mesh);
+
+// initialize() in two steps, so that the precompute can run on a worker
+// thread while the previous mesh is still being drawn.  The attributes
+// come from requiredAttributes(), read on the GUI thread; the graph
+// touches only the new mesh.  setMesh() swaps the mesh in and takes
+// ownership of the graph, for recordStats().
+int requiredAttributes();
+TaskGraph* makePrecomputeGraph(TriMesh* mesh, int attributes);
+void setMesh(TriMesh* mesh, TaskGraph* precompute);
+
 void setCameraTransform(xform main);
 void setLightDir(const vec& lightdir);
 void redraw();
 
+// With "Lines->Extract in Background" on, redraw() draws the lines of
+// the last view extracted, and extracts the current one on a worker
+// thread. The target's linesReady() slot is invoked when new lines are
+// ready. finishExtraction() waits for the worker; the mesh must not be
+// changed before it returns. releaseMesh() does the same before a mesh
+// is deleted, if it is the one in use; it may be called on any thread.
+void setRepaintTarget(QObject* target);
+void finishExtraction();
+void releaseMesh(const TriMesh* mesh);
+
+// Color attachments written by redrawCapture()
+enum { CAPTURE_SHADED, CAPTURE_NORMALS, CAPTURE_DEPTH, NUM_CAPTURE_BUFFERS };
+
+// redraw() into the first three color attachments of the bound
+// framebuffer at once: the shaded mesh with its lines, and the mesh's
+// normals and depth as the "Normals" and "Depth" mesh colors draw them.
+// One pass instead of three, so compute_perview and the line extraction
+// run once per view.
+void redrawCapture();
+// redraw() on the CPU, into a raster already set up with the view's
+// matrices. With a capture buffer, draws what redrawCapture() puts in
+// that attachment instead. Textures, edges and vectors are not drawn.
+void redrawSoftware(SoftRaster& raster, int capture_buffer = -1);
+// Everything redraw() does short of drawing: compute_perview and the
+// line extraction for the current camera and light, into the stages'
+// lines. No OpenGL, and no screen to simplify the lines for.
+void extractLinesOnly();
+// One type of line, as the main pass extracts it for the view and dials
+// of the last extractLinesOnly(), into lines (with their faces recorded),
+// by the extraction redraw() uses or by the copy of it in ReferenceLines.
+// For checking changes to the extraction; see qviewer/check. False if
+// the per-view arrays the type needs weren't computed (its dial is off).
+enum { CHECK_CONTOURS, CHECK_SUGGESTIVE_CONTOURS,
+       CHECK_SUGGESTIVE_HIGHLIGHTS, CHECK_RIDGES, CHECK_VALLEYS,
+       CHECK_PH_RIDGES, CHECK_PH_VALLEYS, CHECK_APPARENT_RIDGES,
+       NUM_CHECK_TYPES };
+bool extractForCheck(int type, bool reference, LineSet& lines);
+// Report the timing of each precompute stage of the last initialize(),
+// and recordMemory()
+void recordStats(Stats& stats);
+
+// Memory held by each attribute of the mesh (group "Mesh"), each per-view
+// array ("Per-View"), and the lines of each stage and the coarse mesh
+// ("Lines"), in bytes, counting spare capacity and estimated heap
+// overhead as overhead; see TriMesh::memory_use. The entries of a group
+// are consecutive. Waits for the extraction.
+struct MemoryUse
+{
+    const char* group;
+    const char* name;
+    size_t bytes;
+    size_t overhead;
+};
+void memoryUse(std::vector<MemoryUse>& use);
+// Sets memoryUse() as constants, in a "Memory" group. Each extraction
+// also updates them, and sets the total of each group as the "Mesh
+// Memory (MB)", "Per-View Memory (MB)" and "Line Memory (MB)" counters.
+void recordMemory(Stats& stats);
+// Frees the mesh attributes, per-view arrays and line buffers that the
+// lines, vectors and colors turned on don't use, and the coarse mesh
+// without a target frame rate. They are computed again if a dial
+// needs them. Returns the bytes freed.
+size_t freeUnneededAttributes();
+
 // Smooth the mesh
 void filter_mesh(int dummy = 0);
 // Diffuse the normals across the mesh
@@ -42,3 +124,4 @@ void subdivide_mesh(int dummy = 0);
 
 }
 
+#endif // RTSC_H_
@@ -32,6 +32,7 @@ Scene::Scene()
 
 void Scene::clear()
 {
+    Rtsc::releaseMesh(_trimesh);
     delete _trimesh;
     _trimesh = NULL;
     _viewer_state.clear();
@@ -40,6 +41,24 @@ void Scene::clear()
 
 
 bool Scene::load( const QString& filename )
+{
+    if (!read(filename))
+        return false;
+
+    setupMesh();
+    return true;
+}
+
+bool Scene::load( const QDomElement& root, const QDir& path )
+{
+    if (!read(root, path))
+        return false;
+
+    setupMesh();
+    return true;
+}
+
+bool Scene::read( const QString& filename )
 {
     if (filename.endsWith(fileExtension()))
     {
@@ -63,7 +82,7 @@ bool Scene::load( const QString& filename )
         QDomElement root = doc.documentElement();
         QDir path = QFileInfo(filename).absoluteDir();
 
-        return load(root, path); 
+        return read(root, path); 
     }
     else
     {
@@ -76,13 +95,12 @@ bool Scene::load( const QString& filename )
         }
         _viewer_state.clear();
         _dials_and_knobs_state.clear();
-		setupMesh();
 
         return true;
     }
 }
 
-bool Scene::load( const QDomElement& root, const QDir& path )
+bool Scene::read( const QDomElement& root, const QDir& path )
 {
     int version = root.attribute("version").toInt();
     if (version != CURRENT_VERSION)
@@ -125,7 +143,6 @@ bool Scene::load( const QDomElement& root, const QDir& path )
         qWarning("Scene::load: no dials_and_knobs node found.\n");
         return false;
     }
-	setupMesh();
 
     return true;
 }
@@ -190,11 +207,34 @@ void Scene::drawScene()
 
 }
 
+void Scene::drawSceneCapture()
+{
+    if (GQShaderManager::status() != GQ_SHADERS_OK)
+        return;
+
+    Rtsc::redrawCapture();
+}
+
+void Scene::drawSceneSoftware( SoftRaster& raster, int capture_buffer )
+{
+    Rtsc::redrawSoftware(raster, capture_buffer);
+}
+
 void Scene::setupMesh()
 {
     Rtsc::initialize(_trimesh);
 }
 
+TaskGraph* Scene::makePrecomputeGraph( int attributes )
+{
+    return Rtsc::makePrecomputeGraph(_trimesh, attributes);
+}
+
+void Scene::setupMesh( TaskGraph* precompute )
+{
+    Rtsc::setMesh(_trimesh, precompute);
+}
+
 void Scene::setCameraTransform( const xform& xf )
 {
     _camera_transform = xf;
@@ -206,10 +246,17 @@ void Scene::setLightDir( const vec& lightdir )
     Rtsc::setLightDir(lightdir);
 }
 
+void Scene::setRepaintTarget( QObject* target )
+{
+    Rtsc::setRepaintTarget(target);
+}
+
 void Scene::recordStats(Stats& stats)
 {
     stats.beginConstantGroup("Mesh");
     stats.setConstant("Num Vertices", _trimesh->vertices.size());
     stats.setConstant("Num Faces", _trimesh->faces.size());
     stats.endConstantGroup();
+
+    Rtsc::recordStats(stats);
 }
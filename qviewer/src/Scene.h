@@ -25,6 +25,9 @@ class DialsAndKnobs;
 class TriMesh;
 class dkFloat;
 class dkEnum;
+class TaskGraph;
+class SoftRaster;
+class QObject;
 
 class Scene
 {
@@ -35,6 +38,14 @@ public:
 
 	bool load( const QString& filename );
     bool load( const QDomElement& root, const QDir& path );
+
+    // load() is read() followed by setupMesh(). read() and the precompute
+    // graph touch only this scene, so they can run on a worker thread
+    // (see SceneLoader); setupMesh() must run on the GUI thread.
+    bool read( const QString& filename );
+    bool read( const QDomElement& root, const QDir& path );
+    TaskGraph* makePrecomputeGraph( int attributes );
+    void setupMesh( TaskGraph* precompute );
     bool save( const QString& filename, const GLViewer* viewer,
                const DialsAndKnobs* dials_and_knobs );
     bool save( QDomDocument& doc, QDomElement& root, const QDir& path );
@@ -42,12 +53,21 @@ public:
     void recordStats(Stats& stats);
 
     void drawScene(); 
+    // Shaded image, normals and depth in one pass (Rtsc::redrawCapture).
+    // The bound framebuffer needs at least three color attachments.
+    void drawSceneCapture();
+    // drawScene() without OpenGL (Rtsc::redrawSoftware).
+    void drawSceneSoftware( SoftRaster& raster, int capture_buffer = -1 );
 
     void boundingSphere(vec& center, float& radius);
 
     void setCameraTransform( const xform& xf );
     void setLightDir(const vec& lightdir);
 
+    // Repainted when lines extracted in the background are ready
+    // (see Rtsc::setRepaintTarget).
+    static void setRepaintTarget( QObject* target );
+
     const TriMesh* trimesh() const { return _trimesh; }
     const QDomElement& viewerState() { return _viewer_state; }
     const QDomElement& dialsAndKnobsState() { return _dials_and_knobs_state; }
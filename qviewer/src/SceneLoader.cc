@@ -0,0 +1,93 @@
+/*****************************************************************************\
+
+SceneLoader.cc
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "SceneLoader.h"
+#include "Scene.h"
+#include "TaskGraph.h"
+
+#include <QMutexLocker>
+
+SceneLoader::SceneLoader( const QString& filename, int attributes,
+                          int generation, QObject* parent )
+    : QThread(parent)
+{
+    _filename = filename;
+    _attributes = attributes;
+    _generation = generation;
+    _canceled = false;
+    _succeeded = false;
+    _scene = NULL;
+    _graph = NULL;
+}
+
+SceneLoader::~SceneLoader()
+{
+    cancel();
+    wait();
+
+    delete _graph;
+    if (_scene)
+        _scene->clear();
+    delete _scene;
+}
+
+void SceneLoader::cancel()
+{
+    QMutexLocker locker(&_mutex);
+    _canceled = true;
+    if (_graph)
+        _graph->cancel();
+}
+
+Scene* SceneLoader::takeScene()
+{
+    Scene* scene = _scene;
+    _scene = NULL;
+    return scene;
+}
+
+TaskGraph* SceneLoader::takePrecomputeGraph()
+{
+    TaskGraph* graph = _graph;
+    _graph = NULL;
+    return graph;
+}
+
+void SceneLoader::run()
+{
+    Scene* scene = new Scene;
+    if (!scene->read(_filename))
+    {
+        delete scene;
+        return;
+    }
+    _scene = scene;
+
+    {
+        QMutexLocker locker(&_mutex);
+        if (_canceled)
+            return;
+        _graph = scene->makePrecomputeGraph(_attributes);
+    }
+    connect(_graph, SIGNAL(taskFinished(const QString&, int, int)),
+            this, SLOT(forwardProgress(const QString&, int, int)),
+            Qt::DirectConnection);
+
+    _succeeded = _graph->run();
+
+    // The graph goes to Rtsc on the GUI thread, so it should live there.
+    _graph->moveToThread(thread());
+}
+
+// Runs in a pool thread of the precompute graph.
+void SceneLoader::forwardProgress( const QString& stage, int num_finished,
+                                   int num_stages )
+{
+    emit progress(_filename, stage, num_finished, num_stages);
+}
@@ -0,0 +1,74 @@
+/*****************************************************************************\
+
+SceneLoader.h
+
+Reads a scene and runs its precompute on a worker thread, so the window
+keeps drawing the previous scene in the meantime. When QThread's
+finished() signal arrives, the receiver takes the loaded scene with
+takeScene() and swaps it in on the GUI thread.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef SCENE_LOADER_H_
+#define SCENE_LOADER_H_
+
+#include <QThread>
+#include <QMutex>
+#include <QString>
+
+class Scene;
+class TaskGraph;
+
+class SceneLoader : public QThread
+{
+    Q_OBJECT
+
+  public:
+    // attributes are from Rtsc::requiredAttributes(), read on the
+    // GUI thread before the loader is started.
+    SceneLoader( const QString& filename, int attributes, int generation,
+                 QObject* parent = 0 );
+    ~SceneLoader();
+
+    // May be called from any thread. TriMesh::read can't be interrupted,
+    // but no precompute stage starts after this.
+    void cancel();
+    bool isCanceled() const { return _canceled; }
+
+    const QString& filename() const { return _filename; }
+    int generation() const { return _generation; }
+
+    // Valid once the thread has finished. The caller takes ownership;
+    // whatever isn't taken is deleted with the loader.
+    bool succeeded() const { return _succeeded; }
+    Scene* takeScene();
+    TaskGraph* takePrecomputeGraph();
+
+  signals:
+    // Forwarded from the worker thread, for progress reports.
+    void progress( const QString& filename, const QString& stage,
+                   int num_finished, int num_stages );
+
+  protected:
+    void run();
+
+  protected slots:
+    void forwardProgress( const QString& stage, int num_finished,
+                          int num_stages );
+
+  protected:
+    QString         _filename;
+    int             _attributes;
+    int             _generation;
+
+    QMutex          _mutex;
+    volatile bool   _canceled;
+    bool            _succeeded;
+    Scene*          _scene;
+    TaskGraph*      _graph;
+};
+
+#endif // SCENE_LOADER_H_
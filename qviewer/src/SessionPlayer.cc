@@ -0,0 +1,171 @@
+/*****************************************************************************\
+
+SessionPlayer.cc
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "SessionPlayer.h"
+#include "SessionRecorder.h"
+#include "DialsAndKnobs.h"
+
+#include <QFile>
+#include <QStringList>
+
+#include <qglviewer.h>
+
+static qglviewer::Vec vecAttribute( const QDomElement& element,
+                                    const QString& name )
+{
+    QStringList values = element.attribute(name).split(" ",
+        QString::SkipEmptyParts);
+    if (values.size() != 3)
+        return qglviewer::Vec();
+    return qglviewer::Vec(values[0].toDouble(), values[1].toDouble(),
+                          values[2].toDouble());
+}
+
+static qglviewer::Quaternion quaternionAttribute( const QDomElement& element,
+                                                  const QString& name )
+{
+    QStringList values = element.attribute(name).split(" ",
+        QString::SkipEmptyParts);
+    if (values.size() != 4)
+        return qglviewer::Quaternion();
+    return qglviewer::Quaternion(values[0].toDouble(), values[1].toDouble(),
+                                 values[2].toDouble(), values[3].toDouble());
+}
+
+SessionPlayer::SessionPlayer()
+{
+    _width = _height = 0;
+    _frame = -1;
+}
+
+bool SessionPlayer::load( const QString& filename )
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning("Could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    _doc = QDomDocument("session");
+    QString parse_errors;
+    if (!_doc.setContent(&file, &parse_errors))
+    {
+        qWarning("Parse errors: %s", qPrintable(parse_errors));
+        return false;
+    }
+    file.close();
+
+    QDomElement root = _doc.documentElement();
+    int version = root.attribute("version").toInt();
+    if (root.tagName() != "session" ||
+        version != SessionRecorder::CURRENT_VERSION)
+    {
+        qWarning("SessionPlayer::load: not a session, or version out of "
+                 "date (%d, current is %d)", version,
+                 SessionRecorder::CURRENT_VERSION);
+        return false;
+    }
+    _scene_name = root.attribute("scene");
+    _width = root.attribute("width").toInt();
+    _height = root.attribute("height").toInt();
+
+    _start = root.firstChildElement("start");
+    _events.clear();
+    _frame_events.clear();
+    for (QDomElement e = _start.nextSiblingElement(); !e.isNull();
+         e = e.nextSiblingElement())
+    {
+        if (e.tagName() == "frame")
+            _frame_events.append(_events.size());
+        _events.append(e);
+    }
+    _frame = -1;
+    return !_start.isNull();
+}
+
+float SessionPlayer::duration() const
+{
+    return numFrames() > 0 ? frameTime(numFrames() - 1) : 0.0f;
+}
+
+float SessionPlayer::frameTime( int i ) const
+{
+    if (i < 0 || i >= numFrames())
+        return 0.0f;
+    return _events[_frame_events[i]].attribute("t").toFloat();
+}
+
+int SessionPlayer::frameWidth() const
+{
+    if (_frame < 0)
+        return _width;
+    return _events[_frame_events[_frame]].attribute("width").toInt();
+}
+
+int SessionPlayer::frameHeight() const
+{
+    if (_frame < 0)
+        return _height;
+    return _events[_frame_events[_frame]].attribute("height").toInt();
+}
+
+void SessionPlayer::apply( QDomElement& element, qglviewer::Camera* camera,
+                           qglviewer::Frame* light )
+{
+    QString tag = element.tagName();
+    if (tag == "camera")
+    {
+        camera->frame()->setPosition(vecAttribute(element, "position"));
+        camera->frame()->setOrientation(
+            quaternionAttribute(element, "orientation"));
+        camera->setFieldOfView(element.attribute("fov").toFloat());
+    }
+    else if (tag == "light")
+    {
+        light->setRotation(quaternionAttribute(element, "rotation"));
+    }
+    else if (tag == "dial" || tag == "dials")
+    {
+        for (QDomElement e = element.firstChildElement(); !e.isNull();
+             e = e.nextSiblingElement())
+        {
+            dkValue* value = dkValue::find(e.attribute("name"));
+            if (!value)
+            {
+                qWarning("SessionPlayer: don't recognize value %s",
+                         qPrintable(e.attribute("name")));
+                continue;
+            }
+            value->load(e);
+        }
+    }
+}
+
+void SessionPlayer::start( qglviewer::Camera* camera,
+                           qglviewer::Frame* light )
+{
+    for (QDomElement e = _start.firstChildElement(); !e.isNull();
+         e = e.nextSiblingElement())
+        apply(e, camera, light);
+    _frame = -1;
+}
+
+bool SessionPlayer::nextFrame( qglviewer::Camera* camera,
+                               qglviewer::Frame* light )
+{
+    if (atEnd())
+        return false;
+
+    int first = _frame < 0 ? 0 : _frame_events[_frame] + 1;
+    _frame++;
+    for (int i = first; i < _frame_events[_frame]; i++)
+        apply(_events[i], camera, light);
+    return true;
+}
@@ -0,0 +1,75 @@
+/*****************************************************************************\
+
+SessionPlayer.h
+
+Plays back a session written by SessionRecorder. start() sets the dials,
+camera and light to their state when recording began. Each nextFrame()
+then applies the camera, light and dial changes recorded up to the next
+drawn frame, so drawing after each call repeats the frames of the
+session. The player doesn't draw or wait: GLViewer::replaySession draws
+the frames as fast as it can or at their recorded times, and qrtsc_bench
+extracts the lines of each frame without a display.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef SESSION_PLAYER_H_
+#define SESSION_PLAYER_H_
+
+#include <QString>
+#include <QVector>
+#include <QDomDocument>
+#include <QDomElement>
+
+namespace qglviewer { class Camera; class Frame; }
+
+class SessionPlayer
+{
+  public:
+    SessionPlayer();
+
+    bool load( const QString& filename );
+
+    const QString& sceneName() const { return _scene_name; }
+    // Of the viewer when recording began
+    int width() const { return _width; }
+    int height() const { return _height; }
+    int numFrames() const { return _frame_events.size(); }
+    // Recorded time of the last frame, in seconds
+    float duration() const;
+
+    // The light's reference frame should be the camera frame
+    void start( qglviewer::Camera* camera, qglviewer::Frame* light );
+    // False after the last frame
+    bool nextFrame( qglviewer::Camera* camera, qglviewer::Frame* light );
+    bool atEnd() const { return _frame >= numFrames() - 1; }
+
+    // Of the frame the last nextFrame() reached
+    int frame() const { return _frame; }
+    float frameTime() const { return frameTime(_frame); }
+    int frameWidth() const;
+    int frameHeight() const;
+    // Recorded time of frame i, in seconds
+    float frameTime( int i ) const;
+
+  protected:
+    void apply( QDomElement& element, qglviewer::Camera* camera,
+                qglviewer::Frame* light );
+
+  protected:
+    QDomDocument        _doc;
+    QDomElement         _start;
+    QString             _scene_name;
+    int                 _width;
+    int                 _height;
+
+    // The elements after <start>, in order, and the index of each
+    // <frame> among them
+    QVector<QDomElement> _events;
+    QVector<int>        _frame_events;
+    int                 _frame;
+};
+
+#endif // SESSION_PLAYER_H_
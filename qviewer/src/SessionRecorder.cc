@@ -0,0 +1,164 @@
+/*****************************************************************************\
+
+SessionRecorder.cc
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "SessionRecorder.h"
+#include "DialsAndKnobs.h"
+
+#include <QFile>
+
+#include <qglviewer.h>
+
+// Enough digits to read back the same float
+static QString number( double value )
+{
+    return QString::number(value, 'g', 9);
+}
+
+static QString vecString( const qglviewer::Vec& v )
+{
+    return QString("%1 %2 %3").arg(number(v[0])).arg(number(v[1]))
+        .arg(number(v[2]));
+}
+
+static QString quaternionString( const qglviewer::Quaternion& q )
+{
+    return QString("%1 %2 %3 %4").arg(number(q[0])).arg(number(q[1]))
+        .arg(number(q[2])).arg(number(q[3]));
+}
+
+SessionRecorder::SessionRecorder()
+{
+    _recording = false;
+    _num_frames = 0;
+}
+
+void SessionRecorder::start( const QString& filename,
+                             const QString& scene_name,
+                             const qglviewer::Frame* camera_frame, float fov,
+                             const qglviewer::Frame* light,
+                             int width, int height )
+{
+    _filename = filename;
+    _doc = QDomDocument("session");
+    _root = _doc.createElement("session");
+    _root.setAttribute("version", CURRENT_VERSION);
+    _root.setAttribute("scene", scene_name);
+    _root.setAttribute("width", width);
+    _root.setAttribute("height", height);
+    _doc.appendChild(_root);
+
+    _last_camera.clear();
+    _last_light.clear();
+    QDomElement start = _doc.createElement("start");
+    start.appendChild(cameraElement(camera_frame, fov));
+    start.appendChild(lightElement(light));
+    QDomElement dials = _doc.createElement("dials");
+    QList<dkValue*> values = dkValue::allValues();
+    for (int i = 0; i < values.size(); i++)
+        values[i]->save(_doc, dials);
+    start.appendChild(dials);
+    _root.appendChild(start);
+
+    _num_frames = 0;
+    _start_time = now();
+    _recording = true;
+}
+
+bool SessionRecorder::stop()
+{
+    if (!_recording)
+        return false;
+    _recording = false;
+
+    QFile file(_filename);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning("SessionRecorder::stop - Could not save %s",
+                 qPrintable(_filename));
+        return false;
+    }
+    file.write(_doc.toByteArray());
+    file.close();
+
+    // The document can be large; don't hold it until the next session
+    _doc = QDomDocument();
+    _root = QDomElement();
+    return true;
+}
+
+// A camera element, or a null element if the camera hasn't changed since
+// the last one
+QDomElement SessionRecorder::cameraElement(
+        const qglviewer::Frame* camera_frame, float fov )
+{
+    QString position = vecString(camera_frame->position());
+    QString orientation = quaternionString(camera_frame->orientation());
+    QString key = position + " " + orientation + " " + number(fov);
+    if (key == _last_camera)
+        return QDomElement();
+    _last_camera = key;
+
+    QDomElement element = _doc.createElement("camera");
+    element.setAttribute("position", position);
+    element.setAttribute("orientation", orientation);
+    element.setAttribute("fov", number(fov));
+    return element;
+}
+
+QDomElement SessionRecorder::lightElement( const qglviewer::Frame* light )
+{
+    QString rotation = quaternionString(light->rotation());
+    if (rotation == _last_light)
+        return QDomElement();
+    _last_light = rotation;
+
+    QDomElement element = _doc.createElement("light");
+    element.setAttribute("rotation", rotation);
+    return element;
+}
+
+void SessionRecorder::recordFrame( const qglviewer::Frame* camera_frame,
+                                   float fov, const qglviewer::Frame* light,
+                                   int width, int height )
+{
+    if (!_recording)
+        return;
+
+    QString t = number(elapsed());
+    QDomElement camera = cameraElement(camera_frame, fov);
+    if (!camera.isNull())
+    {
+        camera.setAttribute("t", t);
+        _root.appendChild(camera);
+    }
+    QDomElement light_e = lightElement(light);
+    if (!light_e.isNull())
+    {
+        light_e.setAttribute("t", t);
+        _root.appendChild(light_e);
+    }
+
+    QDomElement frame = _doc.createElement("frame");
+    frame.setAttribute("t", t);
+    frame.setAttribute("width", width);
+    frame.setAttribute("height", height);
+    _root.appendChild(frame);
+    _num_frames++;
+}
+
+void SessionRecorder::recordDial( dkValue* value )
+{
+    if (!_recording)
+        return;
+
+    QDomElement dial = _doc.createElement("dial");
+    dial.setAttribute("t", number(elapsed()));
+    value->save(_doc, dial);
+    _root.appendChild(dial);
+}
@@ -0,0 +1,91 @@
+/*****************************************************************************\
+
+SessionRecorder.h
+
+Records a viewing session to a file, so it can be played back later as a
+repeatable benchmark (see SessionPlayer). The file is XML:
+
+<session version="1" scene="/models/bunny.qrt" width="800" height="600">
+  <start>
+    <camera position="x y z" orientation="q0 q1 q2 q3" fov="0.52"/>
+    <light rotation="q0 q1 q2 q3"/>
+    <dials> one element per dkValue, as dkValue::save writes them </dials>
+  </start>
+  <camera t="0.51" position=... orientation=... fov=.../>
+  <light t="0.51" rotation=.../>
+  <dial t="0.73"> <bool name="Lines->Ridges" value="1"/> </dial>
+  <frame t="0.74" width="800" height="600"/>
+  ...
+</session>
+
+Times are in seconds from the start. The viewer calls recordFrame() for
+every frame it draws, which adds a camera or light element if they moved
+since the last frame, then a frame element. Dial changes are added as
+they happen, through recordDial(). The light rotation is relative to the
+camera frame, as GLViewer's light frame is. Nothing is written until
+stop().
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef SESSION_RECORDER_H_
+#define SESSION_RECORDER_H_
+
+#include <QObject>
+#include <QString>
+#include <QDomDocument>
+#include <QDomElement>
+
+#include "timestamp.h"
+
+class dkValue;
+
+namespace qglviewer { class Frame; }
+
+class SessionRecorder : public QObject
+{
+    Q_OBJECT
+
+  public:
+    SessionRecorder();
+
+    // Snapshots the dials, camera and light as the start of the session
+    void start( const QString& filename, const QString& scene_name,
+                const qglviewer::Frame* camera_frame, float fov,
+                const qglviewer::Frame* light, int width, int height );
+    // Writes the session. False if the file couldn't be written.
+    bool stop();
+    bool isRecording() const { return _recording; }
+    int numFrames() const { return _num_frames; }
+
+    void recordFrame( const qglviewer::Frame* camera_frame, float fov,
+                      const qglviewer::Frame* light, int width, int height );
+
+    static const int CURRENT_VERSION = 1;
+
+  public slots:
+    void recordDial( dkValue* value );
+
+  protected:
+    float elapsed() const { return now() - _start_time; }
+    QDomElement cameraElement( const qglviewer::Frame* camera_frame,
+                               float fov );
+    QDomElement lightElement( const qglviewer::Frame* light );
+
+  protected:
+    bool            _recording;
+    QString         _filename;
+    QDomDocument    _doc;
+    QDomElement     _root;
+    timestamp       _start_time;
+    int             _num_frames;
+
+    // The attributes of the last camera and light elements, so only
+    // changes are recorded
+    QString         _last_camera;
+    QString         _last_light;
+};
+
+#endif // SESSION_RECORDER_H_
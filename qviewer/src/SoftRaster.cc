@@ -0,0 +1,651 @@
+/*****************************************************************************\
+
+SoftRaster.cc
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "SoftRaster.h"
+#include "LineSet.h"
+#include "TriMesh.h"
+#include "GQImage.h"
+
+#include <algorithm>
+#include <math.h>
+#include <assert.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+// Resolution of a 24 bit depth buffer, for the "units" of polygon offset
+static const float DEPTH_UNIT = 1.0f / 16777216.0f;
+
+static inline int numThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+static inline int threadNum()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static inline float clamp01( float x )
+{
+    return x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+}
+
+SoftRaster::SoftRaster()
+{
+    _width = _height = 0;
+    _tiles_x = _tiles_y = 0;
+    _bsphere_near = _bsphere_far = 0;
+}
+
+void SoftRaster::resize( int width, int height )
+{
+    _width = width;
+    _height = height;
+    _tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    _tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    _color.resize(width * height * 4);
+    _depth.resize(width * height);
+}
+
+void SoftRaster::setMatrices( const xform& modelview, const xform& projection )
+{
+    _modelview = modelview;
+    _mvp = projection * modelview;
+    _camera_pos = inv(modelview) * point(0,0,0);
+
+    xform n = norm_xf(modelview);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            _normal_matrix[3*i + j] = n[i + 4*j];
+}
+
+void SoftRaster::clear( const vec4& color )
+{
+    int num_pixels = _width * _height;
+    for (int i = 0; i < num_pixels; i++)
+        for (int c = 0; c < 4; c++)
+            _color[4*i + c] = color[c];
+    fill(_depth.begin(), _depth.end(), 1.0f);
+}
+
+vec4 SoftRaster::clipCoords( const point& p ) const
+{
+    const xform& m = _mvp;
+    return vec4(m[0]*p[0] + m[4]*p[1] + m[8]*p[2] + m[12],
+                m[1]*p[0] + m[5]*p[1] + m[9]*p[2] + m[13],
+                m[2]*p[0] + m[6]*p[1] + m[10]*p[2] + m[14],
+                m[3]*p[0] + m[7]*p[1] + m[11]*p[2] + m[15]);
+}
+
+// Viewport (0, 0, width, height) and depth range [0, 1]. The fourth
+// coordinate is 1/w, for perspective correct interpolation.
+vec4 SoftRaster::toWindow( const vec4& clip ) const
+{
+    float inv_w = 1.0f / clip[3];
+    return vec4((clip[0] * inv_w * 0.5f + 0.5f) * _width,
+                (clip[1] * inv_w * 0.5f + 0.5f) * _height,
+                clip[2] * inv_w * 0.5f + 0.5f,
+                inv_w);
+}
+
+float SoftRaster::cameraZ( const point& p ) const
+{
+    const xform& m = _modelview;
+    return m[2]*p[0] + m[6]*p[1] + m[10]*p[2] + m[14];
+}
+
+// The pixels whose centers lie in the box, or false if there are none.
+bool SoftRaster::pixelBounds( float minx, float miny, float maxx, float maxy,
+                              Bounds& b ) const
+{
+    // Also catches NaNs from degenerate input.
+    if (!(minx < _width && miny < _height && maxx > 0 && maxy > 0))
+        return false;
+    b.x0 = max(0, (int)ceilf(minx - 0.5f));
+    b.y0 = max(0, (int)ceilf(miny - 0.5f));
+    b.x1 = min(_width - 1, (int)floorf(maxx - 0.5f));
+    b.y1 = min(_height - 1, (int)floorf(maxy - 0.5f));
+    return b.x0 <= b.x1 && b.y0 <= b.y1;
+}
+
+void SoftRaster::binTiles( const Bounds& b, int index,
+                           vector< vector<int> >& bins ) const
+{
+    for (int ty = b.y0 / TILE_SIZE; ty <= b.y1 / TILE_SIZE; ty++)
+        for (int tx = b.x0 / TILE_SIZE; tx <= b.x1 / TILE_SIZE; tx++)
+            bins[ty * _tiles_x + tx].push_back(index);
+}
+
+SoftRaster::Bounds SoftRaster::tileBounds( int tile ) const
+{
+    Bounds b;
+    b.x0 = (tile % _tiles_x) * TILE_SIZE;
+    b.y0 = (tile / _tiles_x) * TILE_SIZE;
+    b.x1 = min(b.x0 + TILE_SIZE, _width) - 1;
+    b.y1 = min(b.y0 + TILE_SIZE, _height) - 1;
+    return b;
+}
+
+int SoftRaster::addVertex( const vec4& clip, const point& p, const vec& normal,
+                           const vec& color )
+{
+    _window.push_back(toWindow(clip));
+    _camera_z.push_back(cameraZ(p));
+    _normals.push_back(normal);
+    if (!_colors.empty())
+        _colors.push_back(color);
+    return _window.size() - 1;
+}
+
+// Clips a face against the near plane (z > -w, in clip coordinates) and
+// adds the pieces in front to tris.
+void SoftRaster::clipFace( const TriMesh* mesh, int face,
+                           vector<Triangle>& tris )
+{
+    const TriMesh::Face& f = mesh->faces[face];
+    vec4 clip[3];
+    float dist[3];
+    for (int i = 0; i < 3; i++)
+    {
+        clip[i] = clipCoords(mesh->vertices[f[i]]);
+        dist[i] = clip[i][2] + clip[i][3];
+    }
+
+    int poly[4];
+    int num = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3;
+        if (dist[i] >= 0)
+            poly[num++] = f[i];
+        if ((dist[i] >= 0) != (dist[j] >= 0))
+        {
+            float t = dist[i] / (dist[i] - dist[j]);
+            int a = f[i], b = f[j];
+            vec color = _colors.empty() ? vec() :
+                mix(_colors[a], _colors[b], t);
+            poly[num++] = addVertex(mix(clip[i], clip[j], t),
+                mix(mesh->vertices[a], mesh->vertices[b], t),
+                mix(_normals[a], _normals[b], t), color);
+        }
+    }
+
+    for (int i = 2; i < num; i++)
+    {
+        Triangle tri = { { poly[0], poly[i-1], poly[i] } };
+        tris.push_back(tri);
+    }
+}
+
+void SoftRaster::drawMesh( const TriMesh* mesh, const MeshStyle& style )
+{
+    int nv = mesh->vertices.size();
+    int nf = mesh->faces.size();
+    if (nv == 0 || nf == 0 || (int)mesh->normals.size() != nv ||
+        _width <= 0 || _height <= 0)
+        return;
+
+    vec center = _modelview * mesh->bsphere.center;
+    _bsphere_far = center[2] - mesh->bsphere.r;
+    _bsphere_near = center[2] + mesh->bsphere.r;
+    _light_dir = style.light_dir;
+    normalize(_light_dir);
+    _specular_half = _camera_pos + _light_dir;
+    normalize(_specular_half);
+
+    _window.resize(nv);
+    _camera_z.resize(nv);
+    _normals.resize(nv);
+    bool per_vertex_color = style.colors && (int)style.colors->size() == nv;
+    _colors.resize(per_vertex_color ? nv : 0);
+
+    vector<char> in_front(nv);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < nv; i++)
+    {
+        const point& p = mesh->vertices[i];
+        vec4 clip = clipCoords(p);
+        in_front[i] = clip[2] + clip[3] >= 0;
+        if (in_front[i])
+            _window[i] = toWindow(clip);
+        _camera_z[i] = cameraZ(p);
+        _normals[i] = mesh->normals[i];
+        normalize(_normals[i]);
+        if (per_vertex_color)
+            _colors[i] = (*style.colors)[i];
+    }
+
+    // Each thread sets up and bins a contiguous range of faces, so that
+    // reading the bins in thread order keeps the faces in mesh order.
+    // Faces crossing the near plane are clipped afterwards, in an extra
+    // bin of their own.
+    int num_threads = numThreads();
+    int num_tiles = _tiles_x * _tiles_y;
+    vector< vector<Triangle> > tris(num_threads + 1);
+    vector< vector< vector<int> > > bins(num_threads + 1,
+        vector< vector<int> >(num_tiles));
+    vector< vector<int> > clipped(num_threads);
+
+#pragma omp parallel
+    {
+        int thread = threadNum();
+        vector<Triangle>& my_tris = tris[thread];
+        vector< vector<int> >& my_bins = bins[thread];
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < nf; i++)
+        {
+            const TriMesh::Face& f = mesh->faces[i];
+            int front = in_front[f[0]] + in_front[f[1]] + in_front[f[2]];
+            if (front == 0)
+                continue;
+            if (front < 3)
+            {
+                clipped[thread].push_back(i);
+                continue;
+            }
+            Triangle tri = { { f[0], f[1], f[2] } };
+            Bounds b;
+            if (setupTriangle(tri, b))
+            {
+                my_tris.push_back(tri);
+                binTiles(b, my_tris.size() - 1, my_bins);
+            }
+        }
+    }
+
+    vector<Triangle> pieces;
+    for (int t = 0; t < num_threads; t++)
+        for (size_t i = 0; i < clipped[t].size(); i++)
+            clipFace(mesh, clipped[t][i], pieces);
+    for (size_t i = 0; i < pieces.size(); i++)
+    {
+        Bounds b;
+        if (setupTriangle(pieces[i], b))
+        {
+            tris[num_threads].push_back(pieces[i]);
+            binTiles(b, tris[num_threads].size() - 1, bins[num_threads]);
+        }
+    }
+
+#pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < num_tiles; tile++)
+    {
+        Bounds tb = tileBounds(tile);
+        for (int t = 0; t <= num_threads; t++)
+        {
+            const vector<int>& bin = bins[t][tile];
+            for (size_t i = 0; i < bin.size(); i++)
+                rasterTriangle(tris[t][bin[i]], tb, style);
+        }
+    }
+}
+
+// Back-face culls the triangle and finds its pixels. Counterclockwise
+// in window coordinates is front facing, as with glFrontFace(GL_CCW).
+bool SoftRaster::setupTriangle( const Triangle& tri, Bounds& b ) const
+{
+    const vec4& p0 = _window[tri.v[0]];
+    const vec4& p1 = _window[tri.v[1]];
+    const vec4& p2 = _window[tri.v[2]];
+    float area2 = (p1[0] - p0[0]) * (p2[1] - p0[1]) -
+                  (p2[0] - p0[0]) * (p1[1] - p0[1]);
+    if (!(area2 > 0))
+        return false;
+
+    return pixelBounds(min(p0[0], min(p1[0], p2[0])),
+                       min(p0[1], min(p1[1], p2[1])),
+                       max(p0[0], max(p1[0], p2[0])),
+                       max(p0[1], max(p1[1], p2[1])), b);
+}
+
+void SoftRaster::rasterTriangle( const Triangle& tri, const Bounds& tile,
+                                 const MeshStyle& style )
+{
+    const vec4* p[3] = { &_window[tri.v[0]], &_window[tri.v[1]],
+                         &_window[tri.v[2]] };
+
+    Bounds b;
+    float minx = min((*p[0])[0], min((*p[1])[0], (*p[2])[0]));
+    float miny = min((*p[0])[1], min((*p[1])[1], (*p[2])[1]));
+    float maxx = max((*p[0])[0], max((*p[1])[0], (*p[2])[0]));
+    float maxy = max((*p[0])[1], max((*p[1])[1], (*p[2])[1]));
+    if (!pixelBounds(minx, miny, maxx, maxy, b))
+        return;
+    b.x0 = max(b.x0, tile.x0);
+    b.y0 = max(b.y0, tile.y0);
+    b.x1 = min(b.x1, tile.x1);
+    b.y1 = min(b.y1, tile.y1);
+    if (b.x0 > b.x1 || b.y0 > b.y1)
+        return;
+
+    // Edge functions e_i = a_i x + b_i y + c_i, positive inside. Edge i
+    // is opposite vertex i, so e_i / area2 is its barycentric coordinate.
+    float ea[3], eb[3], ec[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const vec4& pa = *p[(i + 1) % 3];
+        const vec4& pb = *p[(i + 2) % 3];
+        ea[i] = pa[1] - pb[1];
+        eb[i] = pb[0] - pa[0];
+        ec[i] = -ea[i] * pa[0] - eb[i] * pa[1];
+    }
+    float area2 = ea[0] * (*p[0])[0] + eb[0] * (*p[0])[1] + ec[0];
+    if (!(area2 > 0))
+        return;
+    float inv_area2 = 1.0f / area2;
+
+    // Window z is linear in screen space. Polygon offset as in the GL
+    // spec: factor * max slope + units * resolution.
+    float z[3] = { (*p[0])[2], (*p[1])[2], (*p[2])[2] };
+    float dzdx = (ea[0]*z[0] + ea[1]*z[1] + ea[2]*z[2]) * inv_area2;
+    float dzdy = (eb[0]*z[0] + eb[1]*z[1] + eb[2]*z[2]) * inv_area2;
+    float offset = style.offset_factor * max(fabsf(dzdx), fabsf(dzdy)) +
+                   style.offset_units * DEPTH_UNIT;
+
+    float px0 = b.x0 + 0.5f;
+    for (int y = b.y0; y <= b.y1; y++)
+    {
+        float py = y + 0.5f;
+        float e_row[3];
+        for (int i = 0; i < 3; i++)
+            e_row[i] = ea[i] * px0 + eb[i] * py + ec[i];
+
+        int x = b.x0;
+#ifdef __SSE2__
+        // Four pixels at a time; the survivors are shaded one by one.
+        const __m128 steps = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 zero = _mm_setzero_ps();
+        __m128 e0 = _mm_add_ps(_mm_set1_ps(e_row[0]),
+                               _mm_mul_ps(_mm_set1_ps(ea[0]), steps));
+        __m128 e1 = _mm_add_ps(_mm_set1_ps(e_row[1]),
+                               _mm_mul_ps(_mm_set1_ps(ea[1]), steps));
+        __m128 e2 = _mm_add_ps(_mm_set1_ps(e_row[2]),
+                               _mm_mul_ps(_mm_set1_ps(ea[2]), steps));
+        const __m128 step0 = _mm_set1_ps(4.0f * ea[0]);
+        const __m128 step1 = _mm_set1_ps(4.0f * ea[1]);
+        const __m128 step2 = _mm_set1_ps(4.0f * ea[2]);
+        for (; x + 3 <= b.x1; x += 4)
+        {
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero),
+                _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            int mask = _mm_movemask_ps(inside);
+            if (mask)
+            {
+                float v0[4], v1[4], v2[4];
+                _mm_storeu_ps(v0, e0);
+                _mm_storeu_ps(v1, e1);
+                _mm_storeu_ps(v2, e2);
+                for (int k = 0; k < 4; k++)
+                    if (mask & (1 << k))
+                        shadePixel(tri, x + k, y, v0[k] * inv_area2,
+                            v1[k] * inv_area2, v2[k] * inv_area2,
+                            z, offset, style);
+            }
+            e0 = _mm_add_ps(e0, step0);
+            e1 = _mm_add_ps(e1, step1);
+            e2 = _mm_add_ps(e2, step2);
+        }
+#endif
+        for (; x <= b.x1; x++)
+        {
+            float dx = x - b.x0;
+            float e0 = e_row[0] + ea[0] * dx;
+            float e1 = e_row[1] + ea[1] * dx;
+            float e2 = e_row[2] + ea[2] * dx;
+            if (e0 >= 0 && e1 >= 0 && e2 >= 0)
+                shadePixel(tri, x, y, e0 * inv_area2, e1 * inv_area2,
+                           e2 * inv_area2, z, offset, style);
+        }
+    }
+}
+
+inline void SoftRaster::shadePixel( const Triangle& tri, int x, int y,
+                                    float l0, float l1, float l2,
+                                    const float z[3], float offset,
+                                    const MeshStyle& style )
+{
+    float depth = l0 * z[0] + l1 * z[1] + l2 * z[2];
+    // Outside the far plane, which isn't clipped against.
+    if (depth > 1.0f)
+        return;
+    depth = clamp01(depth + offset);
+
+    int pixel = y * _width + x;
+    if (!(depth < _depth[pixel]))
+        return;
+    _depth[pixel] = depth;
+
+    // Perspective correct weights for the vertex attributes.
+    float w0 = l0 * _window[tri.v[0]][3];
+    float w1 = l1 * _window[tri.v[1]][3];
+    float w2 = l2 * _window[tri.v[2]][3];
+    float inv_sum = 1.0f / (w0 + w1 + w2);
+    vec c = shade(tri, w0 * inv_sum, w1 * inv_sum, w2 * inv_sum, style);
+
+    float* out = &_color[4 * pixel];
+    out[0] = c[0];
+    out[1] = c[1];
+    out[2] = c[2];
+    out[3] = 1.0f;
+}
+
+// The fragment programs in shaders/, for an untextured surface.
+vec SoftRaster::shade( const Triangle& tri, float w0, float w1, float w2,
+                       const MeshStyle& style ) const
+{
+    int v0 = tri.v[0], v1 = tri.v[1], v2 = tri.v[2];
+    vec n = w0 * _normals[v0] + w1 * _normals[v1] + w2 * _normals[v2];
+
+    if (style.shading == SHADE_NORMALS)
+    {
+        const float* m = _normal_matrix;
+        return vec(m[0]*n[0] + m[1]*n[1] + m[2]*n[2],
+                   m[3]*n[0] + m[4]*n[1] + m[5]*n[2],
+                   m[6]*n[0] + m[7]*n[1] + m[8]*n[2]) * 0.5f + vec(0.5f, 0.5f, 0.5f);
+    }
+    else if (style.shading == SHADE_DEPTH)
+    {
+        float cz = w0 * _camera_z[v0] + w1 * _camera_z[v1] +
+                   w2 * _camera_z[v2];
+        float scaled = (cz - _bsphere_near) / (_bsphere_far - _bsphere_near);
+        return vec(1.0f - scaled, 1.0f - scaled, 1.0f - scaled);
+    }
+
+    vec surface = _colors.empty() ? style.color :
+        w0 * _colors[v0] + w1 * _colors[v1] + w2 * _colors[v2];
+
+    float ndotl = n DOT _light_dir;
+    float diffuse = max(ndotl, 0.0f);
+    switch (style.shading)
+    {
+        case SHADE_DIFFUSE:
+            return diffuse * surface;
+        case SHADE_DIFFUSE2:
+            return sqrtf(diffuse) * surface;
+        case SHADE_HEMISPHERE:
+            return (ndotl * 0.5f + 0.5f) * surface;
+        case SHADE_SHINY:
+        {
+            float specular = max(_specular_half DOT n, 0.0f);
+            float shiny = powf(specular, 50.0f);
+            return 0.1f * surface + 0.5f * diffuse * surface +
+                   vec(0.4f * shiny, 0.4f * shiny, 0.4f * shiny);
+        }
+        case SHADE_TOON:
+            return min(max(2.0f * (diffuse - 0.2f), 0.8f), 1.0f) * surface;
+        case SHADE_TOONBW:
+            return min(max(25.0f * (diffuse - 0.07f), 0.0f), 1.0f) * surface;
+        case SHADE_GOOCH:
+        {
+            float rg = 0.75f + 0.25f * diffuse;
+            return vec(rg * surface[0], rg * surface[1],
+                       (0.9f - 0.1f * diffuse) * surface[2]);
+        }
+        default:
+            return surface;
+    }
+}
+
+void SoftRaster::drawLines( const LineSet& lines )
+{
+    if (lines.isEmpty() || _width <= 0 || _height <= 0)
+        return;
+
+    vector<Segment> segments;
+    segments.reserve(lines.numSegments());
+    int num_tiles = _tiles_x * _tiles_y;
+    vector< vector<int> > bins(num_tiles);
+
+    for (size_t i = 0; i < lines.batches.size(); i++)
+    {
+        const LineSet::Batch& batch = lines.batches[i];
+        for (int v = batch.first; v + 1 < batch.first + batch.count; v += 2)
+        {
+            vec4 clip[2] = { clipCoords(lines.vertices[v]),
+                             clipCoords(lines.vertices[v+1]) };
+            float dist[2] = { clip[0][2] + clip[0][3],
+                              clip[1][2] + clip[1][3] };
+            if (dist[0] < 0 && dist[1] < 0)
+                continue;
+
+            Segment seg;
+            seg.c[0] = lines.colors[v];
+            seg.c[1] = lines.colors[v+1];
+            for (int e = 0; e < 2; e++)
+            {
+                if (dist[e] < 0)
+                {
+                    float t = dist[e] / (dist[e] - dist[1-e]);
+                    clip[e] = mix(clip[e], clip[1-e], t);
+                    seg.c[e] = mix(seg.c[e], seg.c[1-e], t);
+                }
+                seg.p[e] = toWindow(clip[e]);
+            }
+            seg.width = batch.width;
+            seg.depth_test = batch.depth_test;
+            seg.round_caps = batch.round_caps;
+
+            float r = 0.5f * seg.width + 0.5f;
+            Bounds b;
+            if (!pixelBounds(min(seg.p[0][0], seg.p[1][0]) - r,
+                             min(seg.p[0][1], seg.p[1][1]) - r,
+                             max(seg.p[0][0], seg.p[1][0]) + r,
+                             max(seg.p[0][1], seg.p[1][1]) + r, b))
+                continue;
+            segments.push_back(seg);
+            binTiles(b, segments.size() - 1, bins);
+        }
+    }
+
+#pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < num_tiles; tile++)
+    {
+        Bounds tb = tileBounds(tile);
+        for (size_t i = 0; i < bins[tile].size(); i++)
+            rasterSegment(segments[bins[tile][i]], tb);
+    }
+}
+
+// Antialiased by the distance from each pixel center to the segment, so
+// coverage falls off over one pixel at the edge of the line. With round
+// caps the line is a capsule, like GL_LINES with GL_POINTS at the ends.
+void SoftRaster::rasterSegment( const Segment& seg, const Bounds& tile )
+{
+    float r = 0.5f * seg.width + 0.5f;
+    float ax = seg.p[0][0], ay = seg.p[0][1];
+    float dx = seg.p[1][0] - ax, dy = seg.p[1][1] - ay;
+    float len2 = dx*dx + dy*dy;
+    float len = sqrtf(len2);
+    float inv_len2 = len2 > 0 ? 1.0f / len2 : 0.0f;
+
+    Bounds b;
+    if (!pixelBounds(min(ax, ax + dx) - r, min(ay, ay + dy) - r,
+                     max(ax, ax + dx) + r, max(ay, ay + dy) + r, b))
+        return;
+    b.x0 = max(b.x0, tile.x0);
+    b.y0 = max(b.y0, tile.y0);
+    b.x1 = min(b.x1, tile.x1);
+    b.y1 = min(b.y1, tile.y1);
+
+    for (int y = b.y0; y <= b.y1; y++)
+    {
+        for (int x = b.x0; x <= b.x1; x++)
+        {
+            float qx = x + 0.5f - ax, qy = y + 0.5f - ay;
+            float t = (qx*dx + qy*dy) * inv_len2;
+            float tc = clamp01(t);
+            float ex = qx - tc*dx, ey = qy - tc*dy;
+
+            float coverage;
+            if (seg.round_caps)
+            {
+                coverage = clamp01(r - sqrtf(ex*ex + ey*ey));
+            }
+            else
+            {
+                // Flat ends: distance across the line, times the
+                // coverage along it.
+                float across = fabsf(qx*dy - qy*dx) / max(len, 1e-6f);
+                float along = min(t, 1.0f - t) * len + 0.5f;
+                coverage = clamp01(r - across) * clamp01(along);
+            }
+            if (coverage <= 0)
+                continue;
+
+            int pixel = y * _width + x;
+            float depth = seg.p[0][2] + tc * (seg.p[1][2] - seg.p[0][2]);
+            if (seg.depth_test && !(depth <= _depth[pixel]))
+                continue;
+
+            // glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA), which
+            // applies to the alpha channel too.
+            vec4 c = mix(seg.c[0], seg.c[1], tc);
+            float alpha = c[3] * coverage;
+            float* out = &_color[4 * pixel];
+            out[0] += alpha * (c[0] - out[0]);
+            out[1] += alpha * (c[1] - out[1]);
+            out[2] += alpha * (c[2] - out[2]);
+            out[3] = alpha * alpha + (1.0f - alpha) * out[3];
+        }
+    }
+}
+
+void SoftRaster::readColor( GQImage& image, int num_channels ) const
+{
+    assert(num_channels == 3 || num_channels == 4);
+    image.resize(_width, _height, num_channels);
+    unsigned char* raster = image.raster();
+    int pixels = _width * _height;
+    for (int i = 0; i < pixels; i++)
+        for (int c = 0; c < num_channels; c++)
+            raster[i*num_channels + c] =
+                (unsigned char)(clamp01(_color[i*4 + c]) * 255.0f + 0.5f);
+}
+
+void SoftRaster::readColor( GQFloatImage& image ) const
+{
+    image.resize(_width, _height, 4);
+    copy(_color.begin(), _color.end(), image.raster());
+}
@@ -0,0 +1,144 @@
+/*****************************************************************************\
+
+SoftRaster.h
+
+A CPU renderer for the mesh and its extracted lines, for machines with
+no OpenGL at all. It follows what Rtsc::redraw does on the GPU: z-buffered,
+back-face culled triangles shaded like the programs in shaders/, with
+polygon offset, and antialiased wide lines blended on top with their
+fade alpha. Textures and the debugging overlays (edges, vectors) are not
+drawn.
+
+The image is split into tiles, which are rasterized in parallel with
+OpenMP. Within a tile, primitives are drawn in the order they were
+submitted, so the result doesn't depend on the number of threads.
+
+qviewer is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef SOFT_RASTER_H_
+#define SOFT_RASTER_H_
+
+#include "Vec.h"
+#include "XForm.h"
+#include "Color.h"
+#include <vector>
+
+class TriMesh;
+class LineSet;
+class GQImage;
+class GQFloatImage;
+
+class SoftRaster
+{
+  public:
+    // One for each of the lighting programs, plus the debugging colors
+    enum Shading { SHADE_NONE, SHADE_DIFFUSE, SHADE_DIFFUSE2,
+                   SHADE_HEMISPHERE, SHADE_SHINY, SHADE_TOON, SHADE_TOONBW,
+                   SHADE_GOOCH, SHADE_NORMALS, SHADE_DEPTH };
+
+    struct MeshStyle
+    {
+        Shading                     shading;
+        vec                         color;      // Used if colors is NULL
+        const std::vector<Color>*   colors;     // Per vertex
+        vec                         light_dir;  // World space
+        float                       offset_factor; // As glPolygonOffset
+        float                       offset_units;
+    };
+
+  public:
+    SoftRaster();
+
+    void resize( int width, int height );
+    int width() const { return _width; }
+    int height() const { return _height; }
+
+    // Column major, as read from OpenGL or qglviewer::Camera.
+    void setMatrices( const xform& modelview, const xform& projection );
+
+    void clear( const vec4& color );
+
+    // Depth test GL_LESS, depth writes on.
+    void drawMesh( const TriMesh* mesh, const MeshStyle& style );
+    // Blended over the image. Depth test GL_LEQUAL, per batch; never
+    // writes depth.
+    void drawLines( const LineSet& lines );
+
+    // Bottom row first, like glReadPixels.
+    const float* colorBuffer() const { return &_color[0]; }
+    // RGB, or RGBA with num_channels 4
+    void readColor( GQImage& image, int num_channels = 4 ) const;
+    void readColor( GQFloatImage& image ) const;
+
+  protected:
+    enum { TILE_SIZE = 64 };
+
+    struct Triangle
+    {
+        int     v[3];
+    };
+
+    struct Segment
+    {
+        vec4    p[2];       // Window x, y, z, and 1/w
+        vec4    c[2];
+        float   width;
+        bool    depth_test;
+        bool    round_caps;
+    };
+
+    // Inclusive pixel ranges
+    struct Bounds { int x0, y0, x1, y1; };
+
+    vec4 clipCoords( const point& p ) const;
+    vec4 toWindow( const vec4& clip ) const;
+    float cameraZ( const point& p ) const;
+    bool pixelBounds( float minx, float miny, float maxx, float maxy,
+                      Bounds& b ) const;
+    void binTiles( const Bounds& b, int index,
+                   std::vector< std::vector<int> >& bins ) const;
+    Bounds tileBounds( int tile ) const;
+
+    int addVertex( const vec4& clip, const point& p, const vec& normal,
+                   const vec& color );
+    void clipFace( const TriMesh* mesh, int face,
+                   std::vector<Triangle>& tris );
+    bool setupTriangle( const Triangle& tri, Bounds& b ) const;
+    void rasterTriangle( const Triangle& tri, const Bounds& tile,
+                         const MeshStyle& style );
+    void shadePixel( const Triangle& tri, int x, int y,
+                     float l0, float l1, float l2, const float z[3],
+                     float offset, const MeshStyle& style );
+    vec shade( const Triangle& tri, float w0, float w1, float w2,
+               const MeshStyle& style ) const;
+    void rasterSegment( const Segment& seg, const Bounds& tile );
+
+  protected:
+    int                 _width;
+    int                 _height;
+    int                 _tiles_x;
+    int                 _tiles_y;
+    std::vector<float>  _color;     // RGBA
+    std::vector<float>  _depth;
+
+    xform               _modelview;
+    xform               _mvp;
+    float               _normal_matrix[9];  // Row major
+    point               _camera_pos;
+
+    // Per-vertex values for the mesh being drawn. Vertices made by
+    // near-plane clipping are appended after the mesh's.
+    std::vector<vec4>   _window;    // x, y, z, 1/w
+    std::vector<vec>    _normals;
+    std::vector<vec>    _colors;    // Empty for a constant color
+    std::vector<float>  _camera_z;
+    float               _bsphere_near;
+    float               _bsphere_far;
+    vec                 _light_dir;
+    vec                 _specular_half;
+};
+
+#endif // SOFT_RASTER_H_
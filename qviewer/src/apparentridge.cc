@@ -13,7 +13,7 @@ Implements method of
 
 #include <stdio.h>
 #include "TriMesh.h"
-#include "GQInclude.h"
+#include "LineSet.h"
 #include "Rtsc.h"
 #include "DialsAndKnobs.h"
 
@@ -24,6 +24,7 @@ namespace Rtsc
 
 extern TriMesh *themesh;
 extern vec currcolor; // Current line color
+extern LineSet* currlines; // Where the lines go
 bool draw_faded;
 
 
@@ -210,10 +211,10 @@ void draw_segment_app_ridge(int v0, int v1, int v2,
 	}
 
 	// Draw the line segment
-	glColor4f(currcolor[0], currcolor[1], currcolor[2], k01);
-	glVertex3fv(p01);
-	glColor4f(currcolor[0], currcolor[1], currcolor[2], k12);
-	glVertex3fv(p12);
+	currlines->setColor(currcolor[0], currcolor[1], currcolor[2], k01);
+	currlines->addVertex(p01);
+	currlines->setColor(currcolor[0], currcolor[1], currcolor[2], k12);
+	currlines->addVertex(p12);
 }
 
 
@@ -265,6 +266,7 @@ void draw_face_app_ridges(int v0, int v1, int v2,
 		return;
 
 	// Draw line segment
+	currlines->setFace(v0, v1, v2);
 	if (!z01) {
 		draw_segment_app_ridge(v1, v2, v0,
 				       emax1, emax2, emax0,
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include "XForm.h"
 #include "MainWindow.h"
+#include "Stats.h"
 #include "qrtscApp.h"
 
 qrtscApp::qrtscApp(int& argc, char** argv) : QApplication(argc, argv)
@@ -43,7 +44,11 @@ qrtscApp::qrtscApp(int& argc, char** argv) : QApplication(argc, argv)
     {
         const QString& arg = arguments()[i];
         
-        if (i == 1 && !arg.startsWith("-"))
+        if (arg == "-trace" && i+1 < arguments().size())
+        {
+            _trace_file = arguments()[++i];
+        }
+        else if (!arg.startsWith("-") && scene_name.isEmpty())
         {
             scene_name = arg;
         }
@@ -51,6 +56,10 @@ qrtscApp::qrtscApp(int& argc, char** argv) : QApplication(argc, argv)
             printUsage(argv[0]);
     }
     
+    // Trace from startup, so the scene loading is in it
+    if (!_trace_file.isEmpty())
+        Stats::instance().startTrace();
+
     _main_window.init( working_dir, scene_name );	
     _main_window.show();
 }
@@ -70,7 +79,11 @@ bool qrtscApp::event(QEvent *event)
 void qrtscApp::printUsage(const char *myname)
 {
     fprintf(stderr, "\n");
-    fprintf(stderr, "\n Usage    : %s [infile]\n", myname);
+    fprintf(stderr, "\n Usage    : %s [options] [infile]\n", myname);
+    fprintf(stderr, " Options  :\n");
+    fprintf(stderr, "   -trace file     Record a trace of the timers and counters, and\n");
+    fprintf(stderr, "                   write it on exit (.json for chrome://tracing,\n");
+    fprintf(stderr, "                   otherwise CSV)\n");
     exit(1);
 }
 
@@ -112,5 +125,8 @@ int main( int argc, char** argv )
 {
     qrtscApp app(argc, argv);
 
-    return app.exec();
+    int result = app.exec();
+    if (!app.traceFile().isEmpty())
+        Stats::instance().writeTrace(app.traceFile());
+    return result;
 }
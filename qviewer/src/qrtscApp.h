@@ -28,6 +28,11 @@ class qrtscApp : public QApplication
     
     bool findShadersDirectory(QDir& shaders_dir);
 
+  public:
+    // Where to write the trace started by -trace, or empty
+    const QString& traceFile() const { return _trace_file; }
+
   protected:
     MainWindow _main_window;
+    QString _trace_file;
 };
@@ -25,16 +25,20 @@ extern void compute_overlaps(TriMesh *s1, TriMesh *s2,
 // Returns alignment error, or -1 on failure.
 // Pass in 0 for maxdist to figure it out...
 // Pass in vector<float>() for weights to figure it out...
+// If niters is non-NULL, it receives the number of point-to-plane
+// iterations done.
 extern float ICP(TriMesh *s1, TriMesh *s2,
 		 const xform &xf1, xform &xf2,
 		 const KDtree *kd1, const KDtree *kd2,
 		 vector<float> &weights1, vector<float> &weights2,
 		 float maxdist = 0.0f, int verbose = 0,
-		 bool do_scale = false, bool do_affine = false);
+		 bool do_scale = false, bool do_affine = false,
+		 int *niters = NULL);
 
 // Easier-to-use interface to ICP
 extern float ICP(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 		 int verbose = 0,
-		 bool do_scale = false, bool do_affine = false);
+		 bool do_scale = false, bool do_affine = false,
+		 int *niters = NULL);
 
 #endif
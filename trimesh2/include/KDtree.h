@@ -5,42 +5,451 @@ Szymon Rusinkiewicz
 Princeton University
 
 KDtree.h
-A K-D tree for points, with limited capabilities (find nearest point to 
-a given point, or to a ray). 
+A K-D tree for points, with limited capabilities (find nearest point to
+a given point or to a ray, k nearest points, points within a radius).
+
+The tree is stored as a flat array of nodes in depth-first order (the
+first child of a node immediately follows it, the second is found at a
+relative offset), and the points are copied into leaf order, so that
+traversals touch contiguous memory.  The searches are templated on the
+compatibility test, so a plain functor costs no virtual call per point.
 */
 
+#include <cmath>
+#include <cstddef>
 #include <vector>
 
-class KDtree {
-private:
-	class Node;
-	Node *root;
-	void build(const float *ptlist, int n);
 
+class KDtree {
 public:
-	// Compatibility function for closest-compatible-point searches
+	// Compatibility function for closest-compatible-point searches.
+	// Kept for existing callers: any class with a
+	// bool operator () (const float *p) const can be used directly
+	// with the templated queries below.
 	struct CompatFunc
 	{
 		virtual bool operator () (const float *p) const = 0;
 		virtual ~CompatFunc() {}  // To make the compiler shut up
 	};
 
+	// The compatibility test used when none is given
+	struct AlwaysCompat
+	{
+		bool operator () (const float *) const { return true; }
+	};
+
+private:
+	enum { MAX_PTS_PER_NODE = 7 };
+
+	// One node of the tree.  Interior nodes have npts == 0, and
+	// their first child is the next node in the array.
+	struct Node {
+		float center[3];
+		float r;
+		int npts;
+		int splitaxis;		// Interior nodes
+		int child2;		// Interior nodes: offset from this node
+		int first;		// Leaf nodes: index into pts / inds
+	};
+
+	const float *ptlist;		// The points as passed in
+	int npoints;
+	std::vector<Node> nodes;	// nodes[0] is the root
+	std::vector<float> pts;		// Copy of the points in leaf order
+	std::vector<int> inds;		// Index in ptlist of each point in pts
+
+	void build(const float *ptlist_, int n);
+	static void build_subtree(float *p, int *ind, int first, int n,
+				  std::vector<Node> &out);
+
+	// Wrapper that lets the old virtual CompatFunc be used with the
+	// templated searches, and treats NULL as "always compatible"
+	struct VirtualCompat {
+		const CompatFunc *f;
+		VirtualCompat(const CompatFunc *f_) : f(f_) {}
+		bool operator () (const float *p) const
+			{ return !f || (*f)(p); }
+	};
+
+	// State carried through a traversal
+	template <class Compat> struct Traversal_Info {
+		const float *p, *dir;
+		int closest;
+		float closest_d, closest_d2;
+		const Compat *iscompat;
+		// For k-nearest and radius searches
+		int k, nfound;
+		int *knn;
+		float *knn_d2;
+		std::vector<int> *found;
+	};
+
+	template <class Compat>
+	void find_closest_to_pt(int n, Traversal_Info<Compat> &k) const;
+	template <class Compat>
+	void find_closest_to_ray(int n, Traversal_Info<Compat> &k) const;
+	template <class Compat>
+	void find_k_closest_to_pt(int n, Traversal_Info<Compat> &k) const;
+	template <class Compat>
+	void find_in_radius(int n, Traversal_Info<Compat> &k) const;
+
+	static inline float sqr(float x)
+		{ return x*x; }
+	static inline float dist2(const float *x, const float *y)
+		{ return sqr(x[0]-y[0]) + sqr(x[1]-y[1]) + sqr(x[2]-y[2]); }
+	static inline float dist2ray2(const float *x, const float *p,
+				      const float *d)
+	{
+		float xp0 = x[0]-p[0], xp1 = x[1]-p[1], xp2 = x[2]-p[2];
+		return sqr(xp0) + sqr(xp1) + sqr(xp2) -
+		       sqr(xp0*d[0] + xp1*d[1] + xp2*d[2]);
+	}
+	float default_maxdist2(float maxdist2) const
+		{ return (maxdist2 > 0.0f) ? maxdist2 : sqr(nodes[0].r); }
+	const float *orig(int i) const
+		{ return ptlist + 3 * inds[i]; }
+
+public:
 	// Constructor from an array of points
-	KDtree(const float *ptlist, int n)
-		{ build(ptlist, n); }
+	KDtree(const float *ptlist_, int n)
+		{ build(ptlist_, n); }
 	// Constructor from a vector of points
 	template <class T> KDtree(const std::vector<T> &v)
 		{ build((const float *) &v[0], v.size()); }
-	~KDtree();
+	~KDtree() {}
 
 	// The queries: returns closest point to a point or a ray,
-	// provided it's within sqrt(maxdist2) and is compatible
+	// provided it's within sqrt(maxdist2) and is compatible.
+	// Returned pointers point into the array the tree was built from.
 	const float *closest_to_pt(const float *p,
 				   float maxdist2,
-				   const CompatFunc *iscompat = NULL) const;
+				   const CompatFunc *iscompat = NULL) const
+		{ return closest_to_pt(p, maxdist2, VirtualCompat(iscompat)); }
 	const float *closest_to_ray(const float *p, const float *dir,
 				    float maxdist2,
-				    const CompatFunc *iscompat = NULL) const;
+				    const CompatFunc *iscompat = NULL) const
+		{ return closest_to_ray(p, dir, maxdist2,
+					VirtualCompat(iscompat)); }
+	template <class Compat>
+	const float *closest_to_pt(const float *p, float maxdist2,
+				   const Compat &iscompat) const;
+	template <class Compat>
+	const float *closest_to_ray(const float *p, const float *dir,
+				    float maxdist2,
+				    const Compat &iscompat) const;
+
+	// The k nearest compatible points within sqrt(maxdist2), closest
+	// first.  Returns the number found (at most k).
+	template <class Compat>
+	int find_k_closest_to_pt(std::vector<const float *> &knn,
+				 const float *p, int k, float maxdist2,
+				 const Compat &iscompat) const;
+	int find_k_closest_to_pt(std::vector<const float *> &knn,
+				 const float *p, int k,
+				 float maxdist2 = 0.0f) const
+		{ return find_k_closest_to_pt(knn, p, k, maxdist2,
+					      AlwaysCompat()); }
+
+	// All compatible points within sqrt(maxdist2), in no particular order
+	template <class Compat>
+	void find_in_radius(std::vector<const float *> &found,
+			    const float *p, float maxdist2,
+			    const Compat &iscompat) const;
+	void find_in_radius(std::vector<const float *> &found,
+			    const float *p, float maxdist2) const
+		{ find_in_radius(found, p, maxdist2, AlwaysCompat()); }
+
+	// Batch queries over nq points (3*nq floats), run in parallel.
+	// Results are indices into the original point array, -1 if none.
+	// For the k-nearest version, results has k entries per query.
+	void closest_to_pts(const float *q, int nq, float maxdist2,
+			    std::vector<int> &results) const;
+	void find_k_closest_to_pts(const float *q, int nq, int k,
+				   float maxdist2,
+				   std::vector<int> &results) const;
+
+	// Size of the tree, for memory reporting
+	int num_nodes() const { return nodes.size(); }
+	size_t memory_used() const
+	{
+		return nodes.capacity() * sizeof(Node) +
+		       pts.capacity() * sizeof(float) +
+		       inds.capacity() * sizeof(int);
+	}
 };
 
+
+// Crawl the KD tree
+template <class Compat>
+void KDtree::find_closest_to_pt(int n, Traversal_Info<Compat> &k) const
+{
+	const Node &node = nodes[n];
+
+	// Leaf nodes
+	if (node.npts) {
+		const float *p = &pts[3*node.first];
+		for (int i = 0; i < node.npts; i++, p += 3) {
+			float myd2 = dist2(p, k.p);
+			if ((myd2 < k.closest_d2) &&
+			    (*k.iscompat)(orig(node.first + i))) {
+				k.closest_d2 = myd2;
+				k.closest_d = std::sqrt(k.closest_d2);
+				k.closest = node.first + i;
+			}
+		}
+		return;
+	}
+
+
+	// Check whether to abort
+	if (dist2(node.center, k.p) >= sqr(node.r + k.closest_d))
+		return;
+
+	// Recursive case
+	float myd = node.center[node.splitaxis] - k.p[node.splitaxis];
+	if (myd >= 0.0f) {
+		find_closest_to_pt(n + 1, k);
+		if (myd < k.closest_d)
+			find_closest_to_pt(n + node.child2, k);
+	} else {
+		find_closest_to_pt(n + node.child2, k);
+		if (-myd < k.closest_d)
+			find_closest_to_pt(n + 1, k);
+	}
+}
+
+
+// Crawl the KD tree to look for the closest point to
+// the line going through k.p in the direction k.dir
+template <class Compat>
+void KDtree::find_closest_to_ray(int n, Traversal_Info<Compat> &k) const
+{
+	const Node &node = nodes[n];
+
+	// Leaf nodes
+	if (node.npts) {
+		const float *p = &pts[3*node.first];
+		for (int i = 0; i < node.npts; i++, p += 3) {
+			float myd2 = dist2ray2(p, k.p, k.dir);
+			if ((myd2 < k.closest_d2) &&
+			    (*k.iscompat)(orig(node.first + i))) {
+				k.closest_d2 = myd2;
+				k.closest_d = std::sqrt(k.closest_d2);
+				k.closest = node.first + i;
+			}
+		}
+		return;
+	}
+
+
+	// Check whether to abort
+	if (dist2ray2(node.center, k.p, k.dir) >= sqr(node.r + k.closest_d))
+		return;
+
+	// Recursive case
+	if (k.p[node.splitaxis] < node.center[node.splitaxis] ) {
+		find_closest_to_ray(n + 1, k);
+		find_closest_to_ray(n + node.child2, k);
+	} else {
+		find_closest_to_ray(n + node.child2, k);
+		find_closest_to_ray(n + 1, k);
+	}
+}
+
+
+// Crawl the KD tree keeping the k closest points found so far,
+// sorted by distance.  k.closest_d is the current search radius.
+template <class Compat>
+void KDtree::find_k_closest_to_pt(int n, Traversal_Info<Compat> &k) const
+{
+	const Node &node = nodes[n];
+
+	// Leaf nodes
+	if (node.npts) {
+		const float *p = &pts[3*node.first];
+		for (int i = 0; i < node.npts; i++, p += 3) {
+			float myd2 = dist2(p, k.p);
+			if (myd2 >= k.closest_d2 ||
+			    !(*k.iscompat)(orig(node.first + i)))
+				continue;
+			// Insertion into the sorted list
+			int j = (k.nfound < k.k) ? k.nfound++ : k.k - 1;
+			while (j > 0 && k.knn_d2[j-1] > myd2) {
+				k.knn_d2[j] = k.knn_d2[j-1];
+				k.knn[j] = k.knn[j-1];
+				j--;
+			}
+			k.knn_d2[j] = myd2;
+			k.knn[j] = node.first + i;
+			if (k.nfound == k.k) {
+				k.closest_d2 = k.knn_d2[k.k-1];
+				k.closest_d = std::sqrt(k.closest_d2);
+			}
+		}
+		return;
+	}
+
+
+	// Check whether to abort
+	if (dist2(node.center, k.p) >= sqr(node.r + k.closest_d))
+		return;
+
+	// Recursive case
+	float myd = node.center[node.splitaxis] - k.p[node.splitaxis];
+	if (myd >= 0.0f) {
+		find_k_closest_to_pt(n + 1, k);
+		if (myd < k.closest_d)
+			find_k_closest_to_pt(n + node.child2, k);
+	} else {
+		find_k_closest_to_pt(n + node.child2, k);
+		if (-myd < k.closest_d)
+			find_k_closest_to_pt(n + 1, k);
+	}
+}
+
+
+// Crawl the KD tree collecting every point within the radius
+template <class Compat>
+void KDtree::find_in_radius(int n, Traversal_Info<Compat> &k) const
+{
+	const Node &node = nodes[n];
+
+	// Leaf nodes
+	if (node.npts) {
+		const float *p = &pts[3*node.first];
+		for (int i = 0; i < node.npts; i++, p += 3) {
+			if (dist2(p, k.p) < k.closest_d2 &&
+			    (*k.iscompat)(orig(node.first + i)))
+				k.found->push_back(node.first + i);
+		}
+		return;
+	}
+
+	// Check whether to abort
+	if (dist2(node.center, k.p) >= sqr(node.r + k.closest_d))
+		return;
+
+	// Recursive case
+	float myd = node.center[node.splitaxis] - k.p[node.splitaxis];
+	if (myd >= 0.0f) {
+		find_in_radius(n + 1, k);
+		if (myd < k.closest_d)
+			find_in_radius(n + node.child2, k);
+	} else {
+		find_in_radius(n + node.child2, k);
+		if (-myd < k.closest_d)
+			find_in_radius(n + 1, k);
+	}
+}
+
+
+// Return the closest point in the KD tree to p
+template <class Compat>
+const float *KDtree::closest_to_pt(const float *p, float maxdist2,
+				   const Compat &iscompat) const
+{
+	if (nodes.empty())
+		return NULL;
+
+	Traversal_Info<Compat> k;
+	k.p = p;
+	k.iscompat = &iscompat;
+	k.closest = -1;
+	k.closest_d2 = default_maxdist2(maxdist2);
+	k.closest_d = std::sqrt(k.closest_d2);
+
+	find_closest_to_pt(0, k);
+
+	return (k.closest < 0) ? NULL : orig(k.closest);
+}
+
+
+// Return the closest point in the KD tree to the line
+// going through p in the direction dir
+template <class Compat>
+const float *KDtree::closest_to_ray(const float *p, const float *dir,
+				    float maxdist2,
+				    const Compat &iscompat) const
+{
+	if (nodes.empty())
+		return NULL;
+
+	float one_over_dir_len = 1.0f / std::sqrt(sqr(dir[0]) +
+						  sqr(dir[1]) +
+						  sqr(dir[2]));
+	float normalized_dir[3] = { dir[0] * one_over_dir_len,
+				    dir[1] * one_over_dir_len,
+				    dir[2] * one_over_dir_len };
+
+	Traversal_Info<Compat> k;
+	k.dir = normalized_dir;
+	k.p = p;
+	k.iscompat = &iscompat;
+	k.closest = -1;
+	k.closest_d2 = default_maxdist2(maxdist2);
+	k.closest_d = std::sqrt(k.closest_d2);
+
+	find_closest_to_ray(0, k);
+
+	return (k.closest < 0) ? NULL : orig(k.closest);
+}
+
+
+// Find the k closest points to p
+template <class Compat>
+int KDtree::find_k_closest_to_pt(std::vector<const float *> &knn,
+				 const float *p, int k_, float maxdist2,
+				 const Compat &iscompat) const
+{
+	knn.clear();
+	if (nodes.empty() || k_ <= 0)
+		return 0;
+
+	std::vector<int> knn_ind(k_);
+	std::vector<float> knn_d2(k_);
+
+	Traversal_Info<Compat> k;
+	k.p = p;
+	k.iscompat = &iscompat;
+	k.closest_d2 = default_maxdist2(maxdist2);
+	k.closest_d = std::sqrt(k.closest_d2);
+	k.k = k_;
+	k.nfound = 0;
+	k.knn = &knn_ind[0];
+	k.knn_d2 = &knn_d2[0];
+
+	find_k_closest_to_pt(0, k);
+
+	knn.resize(k.nfound);
+	for (int i = 0; i < k.nfound; i++)
+		knn[i] = orig(knn_ind[i]);
+	return k.nfound;
+}
+
+
+// Find all points within sqrt(maxdist2) of p
+template <class Compat>
+void KDtree::find_in_radius(std::vector<const float *> &found,
+			    const float *p, float maxdist2,
+			    const Compat &iscompat) const
+{
+	found.clear();
+	if (nodes.empty())
+		return;
+
+	std::vector<int> found_ind;
+	Traversal_Info<Compat> k;
+	k.p = p;
+	k.iscompat = &iscompat;
+	k.closest_d2 = maxdist2;
+	k.closest_d = std::sqrt(k.closest_d2);
+	k.found = &found_ind;
+
+	find_in_radius(0, k);
+
+	found.resize(found_ind.size());
+	for (size_t i = 0; i < found_ind.size(); i++)
+		found[i] = orig(found_ind[i]);
+}
+
 #endif
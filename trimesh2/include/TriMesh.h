@@ -186,6 +186,29 @@ public:
 	// XXX - Add stuff here
 	float feature_size();
 
+	// Memory held by an attribute: the vector itself, its capacity, and
+	// an estimate of the heap's own overhead for the allocation.  For a
+	// vector of vectors (neighbors, adjacentfaces), also the same for
+	// each inner vector, which is often more than the elements.
+	struct MemoryUse {
+		const char *name;
+		size_t bytes;		// All of it
+		size_t overhead;	// All but the size() elements
+	};
+	// One entry per attribute, in the order declared above
+	void memory_use(vector<MemoryUse> &use) const;
+	template <class T>
+	static MemoryUse memory_use(const char *name, const vector<T> &v);
+	template <class T>
+	static MemoryUse memory_use(const char *name,
+				    const vector< vector<T> > &v);
+	// A heap allocation of n bytes, with malloc's size word and its
+	// rounding to 16 bytes, as in glibc
+	static size_t heap_bytes(size_t n)
+	{
+		return n ? (n + sizeof(size_t) + 15) & ~size_t(15) : 0;
+	}
+
 	// Useful queries
 	// XXX - Add stuff here
 	bool is_bdy(int v)
@@ -218,6 +241,32 @@ public:
 		{}
 };
 
+template <class T>
+TriMesh::MemoryUse TriMesh::memory_use(const char *name, const vector<T> &v)
+{
+	MemoryUse use;
+	use.name = name;
+	use.bytes = sizeof(v) + heap_bytes(v.capacity() * sizeof(T));
+	use.overhead = use.bytes - v.size() * sizeof(T);
+	return use;
+}
+
+template <class T>
+TriMesh::MemoryUse TriMesh::memory_use(const char *name,
+				       const vector< vector<T> > &v)
+{
+	MemoryUse use;
+	use.name = name;
+	use.bytes = sizeof(v) + heap_bytes(v.capacity() * sizeof(v[0]));
+	size_t elements = 0;
+	for (size_t i = 0; i < v.size(); i++) {
+		use.bytes += heap_bytes(v[i].capacity() * sizeof(T));
+		elements += v[i].size() * sizeof(T);
+	}
+	use.overhead = use.bytes - elements;
+	return use;
+}
+
 inline const TriMesh::BBox operator + (const TriMesh::BBox &b, const point &p)
 {
 	return TriMesh::BBox(b) += p;
@@ -146,4 +146,29 @@ extern void erode(TriMesh *mesh);
 // Add a bit of noise to the mesh 
 extern void noisify(TriMesh *mesh, float amount);
 
+// Procedural test meshes, for benchmarks and tests.  nfaces is a target:
+// each shape comes as close to it as its tessellation allows.  The same
+// arguments always give the same mesh.
+
+// Unit sphere, each face of an icosahedron cut into n*n triangles
+extern TriMesh *make_icosphere(int nfaces);
+
+// Torus around the Z axis, of radius 1 and tube radius r
+extern TriMesh *make_torus(int nfaces, float r = 0.25f);
+
+// Superquadric with exponents e1 (north-south) and e2 (east-west):
+// 1 is round, smaller is boxier, 2 is an octahedron
+extern TriMesh *make_superquadric(int nfaces, float e1, float e2);
+
+// Icosphere displaced along the radius by at most amplitude, using 3-D
+// Perlin noise on a features^3 grid.  Many suggestive contours and ridges.
+extern TriMesh *make_noisy_sphere(int nfaces, unsigned seed,
+				  float amplitude = 0.15f, int features = 16);
+
+// Range grid over [-1,1]^2 of a noisy height field, with a fraction of
+// the samples missing.  Only the grid is filled in: need_faces() then
+// goes through triangulate_grid().
+extern TriMesh *make_range_grid(int nfaces, unsigned seed,
+				float holes = 0.1f);
+
 #endif
@@ -21,6 +21,8 @@ using namespace std;
 #define MIN_PAIRS 25
 #define DESIRED_PAIRS 500
 #define DESIRED_PAIRS_EARLY 50
+#define DESIRED_PAIRS_COARSE 125
+#define COARSE_ITERS 2
 #define DESIRED_PAIRS_FINAL 2000
 #define COMPAT_THRESH 0.7f
 #define TERM_THRESH 5
@@ -54,7 +56,7 @@ struct PtPair {
 
 
 // A class for evaluating compatibility of normals during KDtree searches
-class NormCompat : public KDtree::CompatFunc {
+class NormCompat {
 private:
 	const vec n;
 	TriMesh *m;
@@ -64,7 +66,7 @@ public:
 	NormCompat(const vec &n_, TriMesh *m_, bool &p_):
 		n(n_), m(m_), pointcloud(p_)
 		{}
-	virtual bool operator () (const float *p) const
+	bool operator () (const float *p) const
 	{
 		int idx = (const point *)p - (const point *)&(m->vertices[0]);
 		if (pointcloud)
@@ -103,42 +105,67 @@ public:
 	enum { GRID_SHIFT = 4, GRID_MAX = (1 << GRID_SHIFT) - 1 };
 	float xmin, xmax, ymin, ymax, zmin, zmax, scale;
 	char g[1 << 3*GRID_SHIFT];
-	bool valid(const point &p)
+	bool valid(const point &p) const
 	{
 		return p[0] > xmin && p[1] > ymin && p[2] > zmin &&
 		       p[0] < xmax && p[1] < ymax && p[2] < zmax;
 	}
-	int ind(const point &p)
+	int ind(const point &p) const
 	{
 		int x = min(int(scale * (p[0] - xmin)), int(GRID_MAX));
 		int y = min(int(scale * (p[1] - ymin)), int(GRID_MAX));
 		int z = min(int(scale * (p[2] - zmin)), int(GRID_MAX));
 		return (x << (2*GRID_SHIFT)) + (y << GRID_SHIFT) + z;
 	}
-	bool overlaps(const point &p) { return valid(p) && g[ind(p)]; }
+	bool overlaps(const point &p) const { return valid(p) && g[ind(p)]; }
 	Grid(const vector<point> &pts);
 };
 
 
-// Compute a Grid from a list of points
+// Compute a Grid from a list of points.  Each thread finds the bbox of
+// and marks cells for its share of the points, and the results are merged.
 Grid::Grid(const vector<point> &pts)
 {
 	memset(g, 0, sizeof(g));
 	xmin = xmax = pts[0][0];
 	ymin = ymax = pts[0][1];
 	zmin = zmax = pts[0][2];
-	for (size_t i = 1; i < pts.size(); i++) {
-		if (pts[i][0] < xmin)  xmin = pts[i][0];
-		if (pts[i][0] > xmax)  xmax = pts[i][0];
-		if (pts[i][1] < ymin)  ymin = pts[i][1];
-		if (pts[i][1] > ymax)  ymax = pts[i][1];
-		if (pts[i][2] < zmin)  zmin = pts[i][2];
-		if (pts[i][2] > zmax)  zmax = pts[i][2];
+	int n = pts.size();
+#pragma omp parallel
+	{
+		float txmin = xmin, txmax = xmax;
+		float tymin = ymin, tymax = ymax;
+		float tzmin = zmin, tzmax = zmax;
+#pragma omp for nowait
+		for (int i = 1; i < n; i++) {
+			if (pts[i][0] < txmin)  txmin = pts[i][0];
+			if (pts[i][0] > txmax)  txmax = pts[i][0];
+			if (pts[i][1] < tymin)  tymin = pts[i][1];
+			if (pts[i][1] > tymax)  tymax = pts[i][1];
+			if (pts[i][2] < tzmin)  tzmin = pts[i][2];
+			if (pts[i][2] > tzmax)  tzmax = pts[i][2];
+		}
+#pragma omp critical
+		{
+			xmin = min(xmin, txmin);  xmax = max(xmax, txmax);
+			ymin = min(ymin, tymin);  ymax = max(ymax, tymax);
+			zmin = min(zmin, tzmin);  zmax = max(zmax, tzmax);
+		}
 	}
 	scale = 1.0f / max(max(xmax-xmin, ymax-ymin), zmax-zmin);
 	scale *= float(1 << GRID_SHIFT);
-	for (size_t i = 0; i < pts.size(); i++)
-		g[ind(pts[i])] = 1;
+
+#pragma omp parallel
+	{
+		char tg[1 << 3*GRID_SHIFT];
+		memset(tg, 0, sizeof(tg));
+#pragma omp for nowait
+		for (int i = 0; i < n; i++)
+			tg[ind(pts[i])] = 1;
+#pragma omp critical
+		for (int i = 0; i < (1 << 3*GRID_SHIFT); i++)
+			g[i] |= tg[i];
+	}
 }
 
 
@@ -173,7 +200,8 @@ void compute_overlaps(TriMesh *s1, TriMesh *s2,
 #endif
 
 	o1.resize(nv1);
-	for (size_t i = 0; i < nv1; i++) {
+#pragma omp parallel for
+	for (int i = 0; i < (int) nv1; i++) {
 		o1[i] = 0;
 		point p = xf12 * s1->vertices[i];
 #ifdef USE_GRID_FOR_OVERLAPS
@@ -192,7 +220,8 @@ void compute_overlaps(TriMesh *s1, TriMesh *s2,
 	}
 
 	o2.resize(nv2);
-	for (size_t i = 0; i < nv2; i++) {
+#pragma omp parallel for
+	for (int i = 0; i < (int) nv2; i++) {
 		o2[i] = 0;
 		point p = xf21 * s2->vertices[i];
 #ifdef USE_GRID_FOR_OVERLAPS
@@ -231,6 +260,9 @@ static void select_and_match(TriMesh *s1, TriMesh *s2,
 	xform xf12r = norm_xf(xf12);
 	float maxdist2 = sqr(maxdist);
 
+	// Pick the samples.  This walks the CDF using the serial random
+	// number generator, so the samples don't depend on the thread count.
+	vector<int> samples;
 	size_t i = 0;
 	float cval = 0.0f;
 	while (1) {
@@ -240,22 +272,32 @@ static void select_and_match(TriMesh *s1, TriMesh *s2,
 		while (sampcdf1[i] <= cval)
 			i++;
 		cval = sampcdf1[i];
-
-		point p = xf12 * s1->vertices[i];
-		vec n = xf12r * s1->normals[i];
-
-		// Do the matching
-		bool pointcloud2 = (s2->faces.empty() && s2->tstrips.empty());
+		samples.push_back(i);
+	}
+
+	// Do the matching, in parallel
+	bool pointcloud2 = (s2->faces.empty() && s2->tstrips.empty());
+	const float *v2 = (const float *) &(s2->vertices[0][0]);
+	int nsamples = samples.size();
+	vector<int> matches(nsamples);
+#pragma omp parallel for schedule(dynamic, 32)
+	for (int j = 0; j < nsamples; j++) {
+		point p = xf12 * s1->vertices[samples[j]];
+		vec n = xf12r * s1->normals[samples[j]];
 		NormCompat nc(n, s2, pointcloud2);
 
-		const float *match = kd2->closest_to_pt(p, maxdist2, &nc);
-		if (!match)
-			continue;
-		int imatch = (match - (const float *) &(s2->vertices[0][0])) / 3;
-		if (!pointcloud2 && s2->is_bdy(imatch))
-			continue;
+		const float *match = kd2->closest_to_pt(p, maxdist2, nc);
+		matches[j] = match ? (match - v2) / 3 : -1;
+		if (matches[j] >= 0 && !pointcloud2 && s2->is_bdy(matches[j]))
+			matches[j] = -1;
+	}
 
-		// Project both points into world coords and save 
+	// Project both points into world coords and save, in sample order
+	for (int j = 0; j < nsamples; j++) {
+		int imatch = matches[j];
+		if (imatch < 0)
+			continue;
+		int i = samples[j];
 		if (flip) {
 			pairs.push_back(PtPair(xf2  * s2->vertices[imatch],
 					       xf1  * s1->vertices[i],
@@ -269,7 +311,10 @@ static void select_and_match(TriMesh *s1, TriMesh *s2,
 }
 
 
-// Compute ICP alignment matrix, including eigenvector decomposition
+// Compute ICP alignment matrix, including eigenvector decomposition.
+// The system is symmetric, so only its upper triangle is accumulated.
+// This stays serial: ICP gathers at most DESIRED_PAIRS_FINAL pairs, too
+// few for per-thread copies of the system to pay for their reduction.
 static void compute_ICPmatrix(const vector<PtPair> &pairs,
 			      float evec[6][6], float eval[6], float b[6],
 			      point &centroid, float &scale, float &err)
@@ -287,7 +332,8 @@ static void compute_ICPmatrix(const vector<PtPair> &pairs,
 	scale /= float(n);
 	scale = 1.0f / sqrt(scale);
 
-	memset(&evec[0][0], 0, 6*6*sizeof(float));
+	float A[21];
+	memset(&A[0], 0, 21*sizeof(float));
 	memset(&b[0], 0, 6*sizeof(float));
 
 	err = 0.0f;
@@ -304,13 +350,17 @@ static void compute_ICPmatrix(const vector<PtPair> &pairs,
 
 		err += d * d;
 		float x[6] = { c[0], c[1], c[2], n[0], n[1], n[2] };
-		for (int j = 0; j < 6; j++) {
+		for (int j = 0, jk = 0; j < 6; j++) {
 			b[j] += d * x[j];
-			for (int k = 0; k < 6; k++)
-				evec[j][k] += x[j] * x[k];
+			for (int k = j; k < 6; k++, jk++)
+				A[jk] += x[j] * x[k];
 		}
 	}
 
+	for (int j = 0, jk = 0; j < 6; j++)
+		for (int k = j; k < 6; k++, jk++)
+			evec[j][k] = evec[k][j] = A[jk];
+
 	err /= float(n);
 	err = sqrt(err) / scale;
 	eigdc<float,6>(evec, eval);
@@ -444,13 +494,56 @@ void compute_scale(const vector<PtPair> &pairs, xform &alignxf,
 }
 
 
+// Recompute the sampling CDF for one mesh, given the inverse covariance
+// of the current alignment.  Returns false if there is no overlap.
+static bool update_cdf(TriMesh *s, const xform &xf,
+		       const vector<float> &weights,
+		       const point &centroid, float scale,
+		       float Cinv[6][6], vector<float> &sampcdf)
+{
+	xform xfr = norm_xf(xf);
+	int n = s->vertices.size();
+#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		sampcdf[i] = 0.0;
+		if (!weights[i])
+			continue;
+		point p = xf * s->vertices[i];
+		p -= centroid;
+		p *= scale;
+		vec n = xfr * s->normals[i];
+		vec c = p CROSS n;
+		for (int j = 0; j < 6; j++) {
+			float tmp = Cinv[j][0] * c[0] + Cinv[j][1] * c[1] +
+				    Cinv[j][2] * c[2] + Cinv[j][3] * n[0] +
+				    Cinv[j][4] * n[1] + Cinv[j][5] * n[2];
+			if (j < 3)
+				sampcdf[i] += tmp * c[j];
+			else
+				sampcdf[i] += tmp * n[j-3];
+		}
+		sampcdf[i] *= weights[i];
+	}
+	for (int i = 1; i < n; i++)
+		sampcdf[i] += sampcdf[i-1];
+	if (!sampcdf[n-1])
+		return false;
+	float cscale = 1.0f / sampcdf[n-1];
+#pragma omp parallel for
+	for (int i = 0; i < n-1; i++)
+		sampcdf[i] *= cscale;
+	sampcdf[n-1] = 1.0f;
+	return true;
+}
+
+
 // Do one iteration of ICP
 static float ICP_iter(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 		      const KDtree *kd1, const KDtree *kd2,
 		      const vector<float> &weights1, const vector<float> &weights2,
 		      float &maxdist, int verbose,
 		      vector<float> &sampcdf1, vector<float> &sampcdf2,
-		      float &incr, bool update_cdfs,
+		      float &incr, int desired_pairs, bool update_cdfs,
 		      bool do_scale, bool do_affine)
 {
 	// Compute pairs
@@ -493,7 +586,7 @@ static float ICP_iter(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 	}
 
 	// Update incr and maxdist based on what happened here
-	incr *= (float) pairs.size() / DESIRED_PAIRS;
+	incr *= (float) pairs.size() / desired_pairs;
 	maxdist = max(2.0f * sqrt(thresh), 0.7f * maxdist);
 
 	// Do the minimization
@@ -540,73 +633,12 @@ static float ICP_iter(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 			Cinv[i][j] = x[j];
 	}
 
-	xform xf1r = norm_xf(xf1);
-	size_t n1 = s1->vertices.size();
-	for (size_t i = 0; i < n1; i++) {
-		sampcdf1[i] = 0.0;
-		if (!weights1[i])
-			continue;
-		point p = xf1 * s1->vertices[i];
-		p -= centroid;
-		p *= scale;
-		vec n = xf1r * s1->normals[i];
-		vec c = p CROSS n;
-		for (int j = 0; j < 6; j++) {
-			float tmp = Cinv[j][0] * c[0] + Cinv[j][1] * c[1] +
-				    Cinv[j][2] * c[2] + Cinv[j][3] * n[0] +
-				    Cinv[j][4] * n[1] + Cinv[j][5] * n[2];
-			if (j < 3)
-				sampcdf1[i] += tmp * c[j];
-			else
-				sampcdf1[i] += tmp * n[j-3];
-		}
-		sampcdf1[i] *= weights1[i];
-	}
-	for (size_t i = 1; i < n1; i++)
-		sampcdf1[i] += sampcdf1[i-1];
-	if (!sampcdf1[n1-1]) {
+	if (!update_cdf(s1, xf1, weights1, centroid, scale, Cinv, sampcdf1) ||
+	    !update_cdf(s2, xf2, weights2, centroid, scale, Cinv, sampcdf2)) {
 		if (verbose)
 			dprintf("No overlap.\n");
 		return -1.0f;
 	}
-	float cscale = 1.0f / sampcdf1[n1-1];
-	for (size_t i = 0; i < n1-1; i++)
-		sampcdf1[i] *= cscale;
-	sampcdf1[n1-1] = 1.0f;
-
-	xform xf2r = norm_xf(xf2);
-	size_t n2 = s2->vertices.size();
-	for (size_t i = 0; i < n2; i++) {
-		sampcdf2[i] = 0.0;
-		if (!weights2[i])
-			continue;
-		point p = xf2 * s2->vertices[i];
-		p -= centroid;
-		p *= scale;
-		vec n = xf2r * s2->normals[i];
-		vec c = p CROSS n;
-		for (int j = 0; j < 6; j++) {
-			float tmp = Cinv[j][0] * c[0] + Cinv[j][1] * c[1] +
-				    Cinv[j][2] * c[2] + Cinv[j][3] * n[0] +
-				    Cinv[j][4] * n[1] + Cinv[j][5] * n[2];
-			if (j < 3)
-				sampcdf2[i] += tmp * c[j];
-			else
-				sampcdf2[i] += tmp * n[j-3];
-		}
-		sampcdf2[i] *= weights2[i];
-	}
-	for (size_t i = 1; i < n2; i++)
-		sampcdf2[i] += sampcdf2[i-1];
-	cscale = 1.0f / sampcdf2[n2-1];
-	if (!sampcdf2[n2-1]) {
-		if (verbose)
-			dprintf("No overlap.\n");
-		return -1.0f;
-	}
-	for (size_t i = 0; i < n2-1; i++)
-		sampcdf2[i] *= cscale;
-	sampcdf2[n2-1] = 1.0f;
 
 	timestamp t5 = now();
 	if (verbose > 1) {
@@ -728,7 +760,8 @@ float ICP(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 	  const KDtree *kd1, const KDtree *kd2,
 	  vector<float> &weights1, vector<float> &weights2,
 	  float maxdist /* = 0.0f */, int verbose /* = 0 */,
-	  bool do_scale /* = false */, bool do_affine /* = false */)
+	  bool do_scale /* = false */, bool do_affine /* = false */,
+	  int *niters /* = NULL */)
 {
 	// Make sure we have everything precomputed
 	s1->need_normals();  s2->need_normals();
@@ -775,9 +808,10 @@ float ICP(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 	if (weights1.size() != nv1 || weights2.size() != nv2)
 		compute_overlaps(s1, s2, xf1, xf2, kd1, kd2,
 				 weights1, weights2, maxdist, verbose);
+	int desired_pairs = DESIRED_PAIRS_COARSE;
 	float err = ICP_iter(s1, s2, xf1, xf2, kd1, kd2, weights1, weights2,
 			     maxdist, verbose, sampcdf1, sampcdf2,
-			     incr, true, false, false);
+			     incr, desired_pairs, true, false, false);
 	if (verbose > 1) {
 		timestamp tnow = now();
 		dprintf("Time for initial iterations: %.2f msec.\n\n",
@@ -787,6 +821,36 @@ float ICP(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 	if (err < 0.0f)
 		return err;
 
+	// Coarse-to-fine: a fixed few iterations at each sampling density
+	// below DESIRED_PAIRS, to get close cheaply...
+	int total_iters = 0;
+	while (desired_pairs < DESIRED_PAIRS) {
+		for (int i = 0; i < COARSE_ITERS; i++) {
+			if (verbose > 1)
+				dprintf("Using incr = %f\n", incr);
+			err = ICP_iter(s1, s2, xf1, xf2, kd1, kd2,
+				       weights1, weights2, maxdist, verbose,
+				       sampcdf1, sampcdf2, incr, desired_pairs,
+				       false, false, false);
+			total_iters++;
+			if (verbose > 1) {
+				timestamp tnow = now();
+				dprintf("Time for this iteration: %.2f msec.\n\n",
+				       (tnow-t) * 1000.0f);
+				t = tnow;
+			}
+			if (err < 0.0f)
+				return err;
+		}
+		int newpairs = min(2 * desired_pairs, int(DESIRED_PAIRS));
+		incr *= (float) desired_pairs / newpairs;
+		desired_pairs = newpairs;
+		if (verbose > 1)
+			dprintf("Increasing to %d pairs\n", desired_pairs);
+	}
+
+	// ... then iterate at DESIRED_PAIRS until converged, with the
+	// whole MAX_ITERS budget
 	bool rigid_only = true;
 	int iters = 0;
 	vector<int> err_delta_history(TERM_HIST);
@@ -800,8 +864,9 @@ float ICP(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 					 weights1, weights2, maxdist, verbose);
 		err = ICP_iter(s1, s2, xf1, xf2, kd1, kd2, weights1, weights2,
 			       maxdist, verbose, sampcdf1, sampcdf2, incr,
-			       recompute, do_scale && !rigid_only,
+			       desired_pairs, recompute, do_scale && !rigid_only,
 			       do_affine && !rigid_only);
+		total_iters++;
 		if (verbose > 1) {
 			timestamp tnow = now();
 			dprintf("Time for this iteration: %.2f msec.\n\n",
@@ -830,17 +895,19 @@ float ICP(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 	} while (++iters < MAX_ITERS);
 
 	if (verbose > 1)
-		dprintf("Did %d iterations\n\n", iters);
+		dprintf("Did %d iterations\n\n", total_iters);
 
 	// One final iteration at a higher sampling rate...
 	if (verbose > 1)
 		dprintf("Last iteration...\n");
-	incr *= (float) DESIRED_PAIRS / DESIRED_PAIRS_FINAL;
+	incr *= (float) desired_pairs / DESIRED_PAIRS_FINAL;
 	if (verbose > 1)
 		dprintf("Using incr = %f\n", incr);
 	err = ICP_iter(s1, s2, xf1, xf2, kd1, kd2, weights1, weights2,
 		       maxdist, verbose, sampcdf1, sampcdf2, incr,
-		       false, do_scale, do_affine);
+		       DESIRED_PAIRS_FINAL, false, do_scale, do_affine);
+	if (niters)
+		*niters = total_iters + 1;
 	if (verbose > 1) {
 		timestamp tnow = now();
 		dprintf("Time for this iteration: %.2f msec.\n\n",
@@ -854,14 +921,15 @@ float ICP(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 // Easier-to-use interface to ICP
 float ICP(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 	  int verbose /* = 0 */,
-	  bool do_scale /* = false */, bool do_affine /* = false */)
+	  bool do_scale /* = false */, bool do_affine /* = false */,
+	  int *niters /* = NULL */)
 {
 	KDtree *kd1 = new KDtree(s1->vertices);
 	KDtree *kd2 = new KDtree(s2->vertices);
 	vector<float> weights1, weights2;
 	float icperr = ICP(s1, s2, xf1, xf2, kd1, kd2,
 			   weights1, weights2, 0.0f, verbose,
-			   do_scale, do_affine);
+			   do_scale, do_affine, niters);
 	delete kd2;
 	delete kd1;
 	return icperr;
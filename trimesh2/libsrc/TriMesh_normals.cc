@@ -20,26 +20,6 @@ of per-vertex texture coordinates.
 #include "TriMesh.h"
 #include "KDtree.h"
 #include "lineqn.h"
-#include <set>
-using std::set;
-
-
-// Helper class for finding k-nearest-neighbors: returns true iff
-// a point is not in the given set of points
-class NotInSet : public KDtree::CompatFunc {
-private:
-	const float *plist;
-	const set<int> &s;
-public:
-	NotInSet(const float *plist_, const set<int> &s_) :
-			plist(plist_), s(s_)
-		{}
-	virtual bool operator () (const float *p) const
-	{
-		int ind = p - plist; 
-		return (s.find(ind) == s.end());
-	}
-};
 
 
 // Compute per-vertex normals
@@ -95,30 +75,30 @@ void TriMesh::need_normals()
 		const vec ref(0, 0, 1);
 		const float *v0 = &vertices[0][0];
 		KDtree *kd = new KDtree(v0, nv);
+		// k neighbors plus the point itself
+		vector<int> knn;
+		kd->find_k_closest_to_pts(v0, nv, k + 1, 0.0f, knn);
+		delete kd;
 #pragma omp parallel for
 		for (int i = 0; i < nv; i++) {
-			const float *vi = &vertices[i][0];
-			set<int> s;
-			s.insert(vi - v0);
-			for (int j = 0; j < k; j++) {
-				NotInSet ns(v0, s);
-				const float *match =
-					kd->closest_to_pt(vi, 0.0f, &ns);
-				if (!match)
-					break;
-				s.insert(match - v0);
+			const int *ki = &knn[i * (k + 1)];
+			int nfound = 0;
+			for (int j = 0; j < k + 1; j++) {
+				if (ki[j] >= 0 && ki[j] != i)
+					nfound++;
 			}
-			if (s.size() < 4) {
+			if (nfound < 3) {
 				dprintf("Warning: not enough points for vertex %d\n", i);
 				normals[i] = ref;
 				continue;
 			}
 			// Compute covariance
 			float C[3][3] = { {0,0,0}, {0,0,0}, {0,0,0} };
-			for (set<int>::iterator it = s.begin(); it != s.end(); it++) {
-				int ind = *it / 3;
-				if (ind == i)
+			for (int j = 0, used = 0; j < k + 1 && used < k; j++) {
+				int ind = ki[j];
+				if (ind < 0 || ind == i)
 					continue;
+				used++;
 				vec d = vertices[ind] - vertices[i];
 				for (int l = 0; l < 3; l++)
 					for (int m = 0; m < 3; m++)
@@ -130,7 +110,6 @@ void TriMesh::need_normals()
 			if ((normals[i] DOT ref) < 0.0f)
 				normals[i] = -normals[i];
 		}
-		delete kd;
 	}
 
 	// Make them all unit-length
@@ -44,3 +44,32 @@ float TriMesh::feature_size()
 	return sqrt(samples[samples.size()/2]);
 }
 
+
+
+// Memory held by each attribute, vector headers and heap overhead included
+void TriMesh::memory_use(vector<MemoryUse> &use) const
+{
+	use.clear();
+	use.push_back(memory_use("vertices", vertices));
+	use.push_back(memory_use("faces", faces));
+	use.push_back(memory_use("tstrips", tstrips));
+	use.push_back(memory_use("grid", grid));
+	use.push_back(memory_use("colors", colors));
+	use.push_back(memory_use("confidences", confidences));
+	use.push_back(memory_use("flags", flags));
+	use.push_back(memory_use("normals", normals));
+	use.push_back(memory_use("pdir1", pdir1));
+	use.push_back(memory_use("pdir2", pdir2));
+	use.push_back(memory_use("curv1", curv1));
+	use.push_back(memory_use("curv2", curv2));
+	use.push_back(memory_use("dcurv", dcurv));
+	use.push_back(memory_use("cornerareas", cornerareas));
+	use.push_back(memory_use("pointareas", pointareas));
+	use.push_back(memory_use("texcoords", texcoords));
+	use.push_back(memory_use("texfaces", texfaces));
+	use.push_back(memory_use("udirs", udirs));
+	use.push_back(memory_use("vdirs", vdirs));
+	use.push_back(memory_use("neighbors", neighbors));
+	use.push_back(memory_use("adjacentfaces", adjacentfaces));
+	use.push_back(memory_use("across_edge", across_edge));
+}
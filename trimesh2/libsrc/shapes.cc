@@ -0,0 +1,340 @@
+/*
+shapes.cc
+Procedural test meshes of a given size: icospheres, tori, superquadrics,
+noise-displaced spheres and range grids.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "noise3d.h"
+#define dprintf TriMesh::dprintf
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+
+// Small, fast, reproducible random numbers in [0,1)
+static inline float rnd(unsigned &state)
+{
+	state = state * 1664525u + 1013904223u;
+	return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+
+// Icosahedron, faces counterclockwise seen from outside
+static const float T = 1.6180339887f;
+static const float ico_verts[12][3] = {
+	{ -1, T, 0 }, { 1, T, 0 }, { -1, -T, 0 }, { 1, -T, 0 },
+	{ 0, -1, T }, { 0, 1, T }, { 0, -1, -T }, { 0, 1, -T },
+	{ T, 0, -1 }, { T, 0, 1 }, { -T, 0, -1 }, { -T, 0, 1 } };
+static const int ico_faces[20][3] = {
+	{ 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+	{ 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+	{ 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+	{ 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 } };
+
+
+// Indices of the vertices of a geodesic sphere of frequency n.  Vertex
+// (i,j) of icosahedron face f is at A + (B-A)*i/n + (C-A)*j/n.  The
+// corners come first, then n-1 vertices on each edge, then the ones
+// inside each face, so that faces share their edge vertices.
+struct Geodesic {
+	int n;
+	int edge_start[12][12];
+	int face_start[20];
+
+	// Vertex k of n along the edge from corner u to corner v
+	int edge_vertex(int u, int v, int k) const
+	{
+		if (k == 0)
+			return u;
+		if (k == n)
+			return v;
+		if (u < v)
+			return edge_start[u][v] + k - 1;
+		else
+			return edge_start[v][u] + n - k - 1;
+	}
+
+	int vertex(int f, int i, int j) const
+	{
+		int a = ico_faces[f][0], b = ico_faces[f][1], c = ico_faces[f][2];
+		if (j == 0)
+			return edge_vertex(a, b, i);
+		if (i == 0)
+			return edge_vertex(a, c, j);
+		if (i + j == n)
+			return edge_vertex(b, c, j);
+		// Rows j = 1 .. n-2 hold i = 1 .. n-1-j
+		return face_start[f] + (j-1) * (n-1) - (j-1) * j / 2 + (i-1);
+	}
+};
+
+
+// Unit sphere of frequency n: 20*n*n faces
+static TriMesh *geodesic_sphere(int n)
+{
+	n = std::max(n, 1);
+	TriMesh *mesh = new TriMesh;
+	Geodesic g;
+	g.n = n;
+
+	int nv = 10 * n * n + 2;
+	mesh->vertices.reserve(nv);
+	point corners[12];
+	for (int i = 0; i < 12; i++) {
+		corners[i] = point(ico_verts[i][0], ico_verts[i][1], ico_verts[i][2]);
+		mesh->vertices.push_back(corners[i]);
+	}
+
+	for (int i = 0; i < 12; i++)
+		for (int j = 0; j < 12; j++)
+			g.edge_start[i][j] = -1;
+	for (int f = 0; f < 20; f++) {
+		for (int e = 0; e < 3; e++) {
+			int u = ico_faces[f][e], v = ico_faces[f][(e+1)%3];
+			if (u > v)
+				swap(u, v);
+			if (g.edge_start[u][v] >= 0)
+				continue;
+			g.edge_start[u][v] = mesh->vertices.size();
+			for (int k = 1; k < n; k++)
+				mesh->vertices.push_back(corners[u] +
+					(corners[v] - corners[u]) * (float(k) / n));
+		}
+	}
+
+	for (int f = 0; f < 20; f++) {
+		const point &a = corners[ico_faces[f][0]];
+		const point &b = corners[ico_faces[f][1]];
+		const point &c = corners[ico_faces[f][2]];
+		g.face_start[f] = mesh->vertices.size();
+		for (int j = 1; j < n - 1; j++)
+			for (int i = 1; i < n - j; i++)
+				mesh->vertices.push_back(a +
+					(b - a) * (float(i) / n) +
+					(c - a) * (float(j) / n));
+	}
+
+	nv = mesh->vertices.size();
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++)
+		normalize(mesh->vertices[i]);
+
+	mesh->faces.resize(20 * n * n);
+#pragma omp parallel for
+	for (int f = 0; f < 20; f++) {
+		int next = f * n * n;
+		for (int j = 0; j < n; j++) {
+			for (int i = 0; i < n - j; i++) {
+				int v00 = g.vertex(f, i, j);
+				int v10 = g.vertex(f, i+1, j);
+				int v01 = g.vertex(f, i, j+1);
+				mesh->faces[next++] = TriMesh::Face(v00, v10, v01);
+				if (i + j < n - 1) {
+					int v11 = g.vertex(f, i+1, j+1);
+					mesh->faces[next++] =
+						TriMesh::Face(v10, v11, v01);
+				}
+			}
+		}
+	}
+
+	return mesh;
+}
+
+
+static int geodesic_frequency(int nfaces)
+{
+	return std::max(1, int(sqrt(nfaces / 20.0) + 0.5));
+}
+
+
+TriMesh *make_icosphere(int nfaces)
+{
+	dprintf("Making icosphere... ");
+	TriMesh *mesh = geodesic_sphere(geodesic_frequency(nfaces));
+	dprintf("Done.\n");
+	return mesh;
+}
+
+
+TriMesh *make_torus(int nfaces, float r)
+{
+	dprintf("Making torus... ");
+
+	// Square-ish faces: the tube is r times as long around
+	int nph = std::max(3, int(sqrt(0.5 * nfaces * r) + 0.5));
+	int nth = std::max(3, int(0.5 * nfaces / nph + 0.5));
+
+	TriMesh *mesh = new TriMesh;
+	mesh->vertices.resize(nth * nph);
+#pragma omp parallel for
+	for (int i = 0; i < nth; i++) {
+		float th = 2.0f * float(M_PI) * i / nth;
+		for (int j = 0; j < nph; j++) {
+			float ph = 2.0f * float(M_PI) * j / nph;
+			float rad = 1.0f + r * cos(ph);
+			mesh->vertices[i * nph + j] =
+				point(rad * cos(th), rad * sin(th), r * sin(ph));
+		}
+	}
+
+	mesh->faces.resize(2 * nth * nph);
+#pragma omp parallel for
+	for (int i = 0; i < nth; i++) {
+		int i1 = (i + 1) % nth;
+		for (int j = 0; j < nph; j++) {
+			int j1 = (j + 1) % nph;
+			int f = 2 * (i * nph + j);
+			mesh->faces[f] = TriMesh::Face(i * nph + j,
+				i1 * nph + j, i1 * nph + j1);
+			mesh->faces[f+1] = TriMesh::Face(i * nph + j,
+				i1 * nph + j1, i * nph + j1);
+		}
+	}
+
+	dprintf("Done.\n");
+	return mesh;
+}
+
+
+// Each vertex of an icosphere is moved along its direction onto the
+// surface (|x|^(2/e2) + |y|^(2/e2))^(e2/e1) + |z|^(2/e1) = 1
+TriMesh *make_superquadric(int nfaces, float e1, float e2)
+{
+	dprintf("Making superquadric... ");
+	TriMesh *mesh = geodesic_sphere(geodesic_frequency(nfaces));
+	e1 = std::max(e1, 0.01f);
+	e2 = std::max(e2, 0.01f);
+
+	int nv = mesh->vertices.size();
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++) {
+		point &p = mesh->vertices[i];
+		float xy = pow(fabs(p[0]), 2.0f / e2) + pow(fabs(p[1]), 2.0f / e2);
+		float f = pow(xy, e2 / e1) + pow(fabs(p[2]), 2.0f / e1);
+		p *= pow(f, -0.5f * e1);
+	}
+
+	dprintf("Done.\n");
+	return mesh;
+}
+
+
+// Noise3D draws its tables from a generator shared by all noise, so
+// redraw them from the seed
+static void reseed(Noise3D &noise, unsigned seed)
+{
+	unsigned state = seed;
+	int pxy = std::max(noise.xsize, noise.ysize);
+	for (int i = 0; i < pxy; i++)
+		noise.p[i] = i;
+	for (int i = 0; i < pxy; i++) {
+		int j = std::min(int(rnd(state) * pxy), pxy - 1);
+		swap(noise.p[i], noise.p[j]);
+	}
+	for (int i = pxy; i < (int) noise.p.size(); i++)
+		noise.p[i] = noise.p[i-pxy];
+	for (size_t i = 0; i < noise.r.size(); i++)
+		noise.r[i] = rnd(state);
+}
+
+
+TriMesh *make_noisy_sphere(int nfaces, unsigned seed, float amplitude,
+			   int features)
+{
+	dprintf("Making noisy sphere... ");
+	TriMesh *mesh = geodesic_sphere(geodesic_frequency(nfaces));
+	features = std::max(features, 2);
+	PerlinNoise3D noise(features, features, features);
+	reseed(noise, seed);
+
+	int nv = mesh->vertices.size();
+	vector<float> n(nv);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++) {
+		const point &p = mesh->vertices[i];
+		n[i] = noise.lookup(0.5f * p[0] + 0.5f, 0.5f * p[1] + 0.5f,
+				    0.5f * p[2] + 0.5f);
+	}
+
+	// Zero mean, and at most amplitude either way
+	double sum = 0;
+	for (int i = 0; i < nv; i++)
+		sum += n[i];
+	float mean = sum / nv;
+	float maxdev = 0;
+	for (int i = 0; i < nv; i++)
+		maxdev = std::max(maxdev, (float) fabs(n[i] - mean));
+	float scale = maxdev > 0.0f ? amplitude / maxdev : 0.0f;
+
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++)
+		mesh->vertices[i] *= 1.0f + scale * (n[i] - mean);
+
+	dprintf("Done.\n");
+	return mesh;
+}
+
+
+TriMesh *make_range_grid(int nfaces, unsigned seed, float holes)
+{
+	dprintf("Making range grid... ");
+
+	// Two faces per cell
+	int w = std::max(2, int(sqrt(0.5 * nfaces) + 0.5) + 1);
+	int h = w;
+	int ngrid = w * h;
+
+	PerlinNoise3D height(16, 16, 16);
+	reseed(height, seed);
+	PerlinNoise3D missing(8, 8, 8);
+	reseed(missing, seed + 1);
+
+	vector<float> z(ngrid), m(ngrid);
+#pragma omp parallel for
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; i++) {
+			float u = float(i) / (w - 1), v = float(j) / (h - 1);
+			z[i + j * w] = height.lookup(u, v, 0.5f);
+			m[i + j * w] = missing.lookup(u, v, 0.5f);
+		}
+	}
+
+	// The lowest values of the second noise are the holes, in blobs
+	// like real dropouts
+	float threshold = -1.0f;
+	int nholes = int(std::min(std::max(holes, 0.0f), 1.0f) * ngrid);
+	if (nholes > 0) {
+		vector<float> sorted(m);
+		std::nth_element(sorted.begin(), sorted.begin() + nholes - 1,
+				 sorted.end());
+		threshold = sorted[nholes - 1];
+	}
+
+	TriMesh *mesh = new TriMesh;
+	mesh->grid_width = w;
+	mesh->grid_height = h;
+	mesh->grid.resize(ngrid, TriMesh::GRID_INVALID);
+	mesh->vertices.reserve(ngrid - nholes);
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; i++) {
+			int k = i + j * w;
+			if (m[k] <= threshold)
+				continue;
+			mesh->grid[k] = mesh->vertices.size();
+			mesh->vertices.push_back(point(
+				2.0f * i / (w - 1) - 1.0f,
+				2.0f * j / (h - 1) - 1.0f,
+				0.5f * z[k]));
+		}
+	}
+
+	dprintf("Done.\n");
+	return mesh;
+}
@@ -0,0 +1,184 @@
+/*
+icp_bench.cc
+Measure ICP speed and accuracy by aligning a mesh to randomly perturbed,
+noisy copies of itself.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "TriMesh.h"
+#include "XForm.h"
+#include "ICP.h"
+#include "timestamp.h"
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+
+// Small, fast, reproducible random numbers in [0,1)
+static inline float rnd(unsigned &state)
+{
+	state = state * 1664525u + 1013904223u;
+	return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+
+// A sphere with bumps on it, tessellated as an n x 2n lat-long grid,
+// for when no mesh is given on the command line
+static TriMesh *make_bumpy_sphere(int n)
+{
+	TriMesh *mesh = new TriMesh;
+	for (int i = 0; i <= n; i++) {
+		float th = M_PI * i / n;
+		for (int j = 0; j < 2*n; j++) {
+			float ph = M_PI * j / n;
+			float r = 1.0f + 0.1f * sin(5.0f * th) * sin(7.0f * ph);
+			mesh->vertices.push_back(point(r * sin(th) * cos(ph),
+						       r * sin(th) * sin(ph),
+						       r * cos(th)));
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < 2*n; j++) {
+			int j1 = (j + 1) % (2*n);
+			int v00 = i * 2*n + j, v01 = i * 2*n + j1;
+			int v10 = v00 + 2*n, v11 = v01 + 2*n;
+			if (i > 0)
+				mesh->faces.push_back(TriMesh::Face(v00, v10, v01));
+			if (i < n - 1)
+				mesh->faces.push_back(TriMesh::Face(v01, v10, v11));
+		}
+	}
+	// The poles are duplicated; that's fine for ICP
+	return mesh;
+}
+
+
+void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [options] [mesh]\n", myname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-trials n	Number of perturbed copies (default 10)\n");
+	fprintf(stderr, "	-rot deg	Max rotation of the copies (default 10)\n");
+	fprintf(stderr, "	-trans f	Max translation, fraction of size (default 0.05)\n");
+	fprintf(stderr, "	-noise f	Vertex noise, fraction of size (default 0.001)\n");
+	fprintf(stderr, "	-res n		Resolution of built-in sphere (default 500)\n");
+	fprintf(stderr, "	-t threads	Number of OpenMP threads\n");
+	fprintf(stderr, "	-seed s		Random seed (default 1)\n");
+	fprintf(stderr, "	-v		Verbose ICP\n");
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	int trials = 10, res = 500, verbose = 0;
+	float maxrot = 10.0f, maxtrans = 0.05f, noise = 0.001f;
+	unsigned seed = 1;
+	const char *filename = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-trials") && i+1 < argc)
+			trials = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-rot") && i+1 < argc)
+			maxrot = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-trans") && i+1 < argc)
+			maxtrans = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-noise") && i+1 < argc)
+			noise = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-res") && i+1 < argc)
+			res = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-seed") && i+1 < argc)
+			seed = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-v"))
+			verbose = 2;
+		else if (!strcmp(argv[i], "-t") && i+1 < argc) {
+			int nthreads = atoi(argv[++i]);
+#ifdef _OPENMP
+			omp_set_num_threads(nthreads);
+#else
+			(void) nthreads;
+#endif
+		} else if (argv[i][0] == '-' || filename)
+			usage(argv[0]);
+		else
+			filename = argv[i];
+	}
+	if (trials <= 0 || res < 4)
+		usage(argv[0]);
+	if (!verbose)
+		TriMesh::set_verbose(0);
+
+	TriMesh *s1 = filename ? TriMesh::read(filename) :
+				 make_bumpy_sphere(res);
+	if (!s1)
+		usage(argv[0]);
+	s1->need_bsphere();
+	float size = s1->bsphere.r;
+	int nv = s1->vertices.size();
+
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	printf("%d vertices, %d trials, %d threads\n", nv, trials, nthreads);
+
+	unsigned state = seed;
+	double total_time = 0.0, total_err = 0.0, total_rms = 0.0;
+	int total_iters = 0, failures = 0;
+	for (int t = 0; t < trials; t++) {
+		// A noisy copy, displaced by a random rigid motion
+		TriMesh *s2 = new TriMesh;
+		s2->vertices = s1->vertices;
+		s2->faces = s1->faces;
+		for (int i = 0; i < nv; i++)
+			for (int j = 0; j < 3; j++)
+				s2->vertices[i][j] += noise * size *
+						      (2.0f * rnd(state) - 1.0f);
+		vec axis(rnd(state) - 0.5f, rnd(state) - 0.5f, rnd(state) - 0.5f);
+		float angle = maxrot * (M_PI / 180.0f) * rnd(state);
+		vec trans(rnd(state) - 0.5f, rnd(state) - 0.5f, rnd(state) - 0.5f);
+		trans *= 2.0f * maxtrans * size;
+		xform xf1, xf2 = xform::trans(trans) *
+				 xform::rot(angle, axis);
+
+		timestamp t0 = now();
+		int niters = 0;
+		float err = ICP(s1, s2, xf1, xf2, verbose, false, false,
+				&niters);
+		float elapsed = now() - t0;
+
+		// The right answer is the identity
+		double rms = 0.0;
+		for (int i = 0; i < nv; i++)
+			rms += dist2(xf2 * s1->vertices[i], s1->vertices[i]);
+		rms = sqrt(rms / nv) / size;
+
+		printf("trial %2d: %3d iters  %8.3f s  %8.1f iters/s  "
+		       "ICP error %g  RMS xform error %g\n",
+		       t, niters, elapsed, niters / elapsed, err, rms);
+		if (err < 0.0f) {
+			failures++;
+		} else {
+			total_time += elapsed;
+			total_iters += niters;
+			total_err += err;
+			total_rms += rms;
+		}
+		delete s2;
+	}
+
+	int ok = trials - failures;
+	if (ok) {
+		printf("mean: %.1f iters/s  %.3f s/alignment  "
+		       "ICP error %g  RMS xform error %g  (%d failed)\n",
+		       total_iters / total_time, total_time / ok,
+		       total_err / ok, total_rms / ok, failures);
+	} else {
+		printf("all %d alignments failed\n", trials);
+	}
+	delete s1;
+	return failures ? 1 : 0;
+}
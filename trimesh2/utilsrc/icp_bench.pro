@@ -0,0 +1,3 @@
+TARGET = icp_bench
+SOURCES += icp_bench.cc
+include(utilsrc.pri)
@@ -0,0 +1,155 @@
+/*
+kdtree_bench.cc
+Measure KDtree construction time and query throughput on random points.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "KDtree.h"
+#include "timestamp.h"
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+using std::vector;
+
+
+// Small, fast, reproducible random numbers in [0,1)
+static inline float rnd(unsigned &state)
+{
+	state = state * 1664525u + 1013904223u;
+	return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+
+// Fill a list of n points, either uniform in the unit cube or
+// clustered on the surface of a sphere (which looks more like a scan)
+static void make_points(vector<float> &p, int n, bool surface, unsigned seed)
+{
+	p.resize(3 * n);
+	unsigned state = seed;
+	for (int i = 0; i < n; i++) {
+		float x = rnd(state), y = rnd(state), z = rnd(state);
+		if (surface) {
+			x -= 0.5f; y -= 0.5f; z -= 0.5f;
+			float l = sqrt(x*x + y*y + z*z);
+			if (l == 0.0f) { x = 1.0f; l = 1.0f; }
+			x /= l; y /= l; z /= l;
+		}
+		p[3*i] = x; p[3*i+1] = y; p[3*i+2] = z;
+	}
+}
+
+
+static void report(const char *what, int nq, float t)
+{
+	printf("%-28s %9.3f s  %12.0f queries/s\n", what, t, nq / t);
+}
+
+
+void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [options]\n", myname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-n npts		Number of points in tree (default 10000000)\n");
+	fprintf(stderr, "	-q nq		Number of queries (default 1000000)\n");
+	fprintf(stderr, "	-k k		Neighbors for k-nearest queries (default 12)\n");
+	fprintf(stderr, "	-r radius	Radius for radius queries (default 0.002)\n");
+	fprintf(stderr, "	-t threads	Number of OpenMP threads\n");
+	fprintf(stderr, "	-surface	Points on a sphere instead of in a cube\n");
+	fprintf(stderr, "	-seed s		Random seed (default 1)\n");
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	int npts = 10000000, nq = 1000000, k = 12;
+	float radius = 0.002f;
+	bool surface = false;
+	unsigned seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-n") && i+1 < argc)
+			npts = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-q") && i+1 < argc)
+			nq = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-k") && i+1 < argc)
+			k = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i+1 < argc)
+			radius = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-seed") && i+1 < argc)
+			seed = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-surface"))
+			surface = true;
+		else if (!strcmp(argv[i], "-t") && i+1 < argc) {
+			int nthreads = atoi(argv[++i]);
+#ifdef _OPENMP
+			omp_set_num_threads(nthreads);
+#else
+			(void) nthreads;
+#endif
+		} else
+			usage(argv[0]);
+	}
+	if (npts <= 0 || nq <= 0 || k <= 0)
+		usage(argv[0]);
+
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	printf("%d points, %d queries, %d threads\n", npts, nq, nthreads);
+
+	vector<float> p, q;
+	make_points(p, npts, surface, seed);
+	make_points(q, nq, surface, seed + 12345);
+
+	timestamp t0 = now();
+	KDtree *kd = new KDtree(&p[0], npts);
+	float tbuild = now() - t0;
+	printf("%-28s %9.3f s  %12.0f points/s  (%d nodes, %.1f MB)\n",
+		"Build", tbuild, npts / tbuild, kd->num_nodes(),
+		kd->memory_used() / 1048576.0f);
+
+	// One query at a time, on a single thread
+	int nserial = nq / 10, found = 0;
+	t0 = now();
+	for (int i = 0; i < nserial; i++) {
+		if (kd->closest_to_pt(&q[3*i], 0.0f))
+			found++;
+	}
+	report("Nearest, single thread", nserial, now() - t0);
+
+	vector<int> results;
+	t0 = now();
+	kd->closest_to_pts(&q[0], nq, 0.0f, results);
+	report("Nearest, batch", nq, now() - t0);
+
+	t0 = now();
+	kd->find_k_closest_to_pts(&q[0], nq, k, 0.0f, results);
+	char buf[64];
+	sprintf(buf, "%d-nearest, batch", k);
+	report(buf, nq, now() - t0);
+
+	long long total_in_radius = 0;
+	t0 = now();
+#pragma omp parallel reduction(+:total_in_radius)
+	{
+		vector<const float *> inrad;
+#pragma omp for schedule(dynamic, 256)
+		for (int i = 0; i < nq; i++) {
+			kd->find_in_radius(inrad, &q[3*i], radius * radius);
+			total_in_radius += inrad.size();
+		}
+	}
+	float trad = now() - t0;
+	report("Radius, parallel", nq, trad);
+	printf("  (%.2f points per radius query)\n",
+		(double) total_in_radius / nq);
+
+	delete kd;
+	return found ? 0 : 1;
+}
@@ -0,0 +1,3 @@
+TARGET = kdtree_bench
+SOURCES += kdtree_bench.cc
+include(utilsrc.pri)
@@ -0,0 +1,361 @@
+/*
+kernel_bench.cc
+Time the mesh kernels of trimesh2 one at a time, across mesh sizes and
+thread counts.  Each run starts from a fresh copy of a noisy sphere
+(make_noisy_sphere) with the kernel's inputs already computed, so only
+the kernel itself is timed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "KDtree.h"
+#include "timestamp.h"
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+using std::string;
+using std::vector;
+
+
+// State shared between a kernel's setup and run
+static float sigma;
+static KDtree *kd;
+static vector<float> queries;
+static vector<int> results;
+static string tmpdir = ".";
+
+
+// Setup: compute the kernel's inputs, and clear its output
+static void setup_normals(TriMesh *mesh)
+{
+	mesh->normals.clear();
+}
+
+static void setup_pointareas(TriMesh *mesh)
+{
+	mesh->pointareas.clear();
+	mesh->cornerareas.clear();
+}
+
+static void setup_curvatures(TriMesh *mesh)
+{
+	mesh->need_normals();
+	mesh->need_pointareas();
+	mesh->curv1.clear(); mesh->curv2.clear();
+	mesh->pdir1.clear(); mesh->pdir2.clear();
+}
+
+static void setup_dcurv(TriMesh *mesh)
+{
+	mesh->need_curvatures();
+	mesh->dcurv.clear();
+}
+
+static void setup_tstrips(TriMesh *mesh)
+{
+	mesh->need_across_edge();
+	mesh->tstrips.clear();
+}
+
+static void setup_across_edge(TriMesh *mesh)
+{
+	mesh->need_adjacentfaces();
+	mesh->across_edge.clear();
+}
+
+static void setup_neighbors(TriMesh *mesh)
+{
+	mesh->neighbors.clear();
+}
+
+static void setup_smooth(TriMesh *mesh)
+{
+	mesh->need_normals();
+	mesh->need_pointareas();
+	mesh->need_neighbors();
+	sigma = 2.0f * mesh->feature_size();
+}
+
+static void setup_diffuse_curv(TriMesh *mesh)
+{
+	setup_smooth(mesh);
+	mesh->need_curvatures();
+}
+
+static void setup_subdiv(TriMesh *mesh)
+{
+	mesh->need_across_edge();
+	mesh->need_adjacentfaces();
+}
+
+static void setup_kdtree_query(TriMesh *mesh)
+{
+	kd = new KDtree(mesh->vertices);
+
+	// Queries a little off the surface
+	float offset = 0.5f * mesh->feature_size();
+	mesh->need_normals();
+	int nv = mesh->vertices.size();
+	queries.resize(3 * nv);
+	for (int i = 0; i < nv; i++) {
+		point q = mesh->vertices[i] + offset * mesh->normals[i];
+		queries[3*i] = q[0];
+		queries[3*i+1] = q[1];
+		queries[3*i+2] = q[2];
+	}
+}
+
+static void cleanup_kdtree(TriMesh *)
+{
+	delete kd;
+	kd = NULL;
+}
+
+
+// The kernels
+static void run_normals(TriMesh *mesh) { mesh->need_normals(); }
+static void run_pointareas(TriMesh *mesh) { mesh->need_pointareas(); }
+static void run_curvatures(TriMesh *mesh) { mesh->need_curvatures(); }
+static void run_dcurv(TriMesh *mesh) { mesh->need_dcurv(); }
+static void run_tstrips(TriMesh *mesh) { mesh->need_tstrips(); }
+static void run_across_edge(TriMesh *mesh) { mesh->need_across_edge(); }
+static void run_neighbors(TriMesh *mesh) { mesh->need_neighbors(); }
+static void run_smooth(TriMesh *mesh) { smooth_mesh(mesh, sigma); }
+static void run_diffuse_curv(TriMesh *mesh) { diffuse_curv(mesh, sigma); }
+static void run_subdiv(TriMesh *mesh) { subdiv(mesh); }
+
+static void run_kdtree_build(TriMesh *mesh)
+{
+	kd = new KDtree(mesh->vertices);
+}
+
+static void run_kdtree_query(TriMesh *mesh)
+{
+	kd->closest_to_pts(&queries[0], mesh->vertices.size(), 0.0f, results);
+}
+
+
+// The parsers read a file written by prepare_files
+static string file_name(const char *suffix)
+{
+	return tmpdir + "/kernel_bench_" + suffix;
+}
+
+static void prepare_files(TriMesh *base)
+{
+	TriMesh::set_verbose(0);
+	base->write(file_name("bin.ply").c_str());
+	base->write(("ply_ascii:" + file_name("asc.ply")).c_str());
+	base->write(file_name("mesh.obj").c_str());
+	base->write(file_name("mesh.off").c_str());
+}
+
+static void remove_files()
+{
+	remove(file_name("bin.ply").c_str());
+	remove(file_name("asc.ply").c_str());
+	remove(file_name("mesh.obj").c_str());
+	remove(file_name("mesh.off").c_str());
+}
+
+static void read_file(const char *suffix)
+{
+	TriMesh *mesh = TriMesh::read(file_name(suffix).c_str());
+	delete mesh;
+}
+
+static void run_read_ply(TriMesh *) { read_file("bin.ply"); }
+static void run_read_ply_ascii(TriMesh *) { read_file("asc.ply"); }
+static void run_read_obj(TriMesh *) { read_file("mesh.obj"); }
+static void run_read_off(TriMesh *) { read_file("mesh.off"); }
+
+
+enum { PER_VERTEX, PER_FACE };
+
+struct Kernel {
+	const char *name;
+	int per;
+	void (*setup)(TriMesh *);
+	void (*run)(TriMesh *);
+	void (*cleanup)(TriMesh *);
+};
+
+static const Kernel kernels[] = {
+	{ "need_normals",     PER_VERTEX, setup_normals,      run_normals,      NULL },
+	{ "need_pointareas",  PER_FACE,   setup_pointareas,   run_pointareas,   NULL },
+	{ "need_curvatures",  PER_VERTEX, setup_curvatures,   run_curvatures,   NULL },
+	{ "need_dcurv",       PER_VERTEX, setup_dcurv,        run_dcurv,        NULL },
+	{ "need_tstrips",     PER_FACE,   setup_tstrips,      run_tstrips,      NULL },
+	{ "need_across_edge", PER_FACE,   setup_across_edge,  run_across_edge,  NULL },
+	{ "need_neighbors",   PER_VERTEX, setup_neighbors,    run_neighbors,    NULL },
+	{ "smooth_mesh",      PER_VERTEX, setup_smooth,       run_smooth,       NULL },
+	{ "diffuse_curv",     PER_VERTEX, setup_diffuse_curv, run_diffuse_curv, NULL },
+	{ "subdiv",           PER_FACE,   setup_subdiv,       run_subdiv,       NULL },
+	{ "kdtree_build",     PER_VERTEX, NULL,               run_kdtree_build, cleanup_kdtree },
+	{ "kdtree_query",     PER_VERTEX, setup_kdtree_query, run_kdtree_query, cleanup_kdtree },
+	{ "read_ply",         PER_FACE,   NULL,               run_read_ply,     NULL },
+	{ "read_ply_ascii",   PER_FACE,   NULL,               run_read_ply_ascii, NULL },
+	{ "read_obj",         PER_FACE,   NULL,               run_read_obj,     NULL },
+	{ "read_off",         PER_FACE,   NULL,               run_read_off,     NULL },
+};
+static const int nkernels = sizeof(kernels) / sizeof(kernels[0]);
+
+
+// Median time, in seconds, of nrepeat runs after nwarmup unmeasured ones
+static float time_kernel(const Kernel &k, const TriMesh *base,
+			 int nwarmup, int nrepeat)
+{
+	vector<float> times;
+	for (int i = 0; i < nwarmup + nrepeat; i++) {
+		TriMesh *mesh = new TriMesh(*base);
+		if (k.setup)
+			k.setup(mesh);
+		timestamp t0 = now();
+		k.run(mesh);
+		float t = now() - t0;
+		if (k.cleanup)
+			k.cleanup(mesh);
+		delete mesh;
+		if (i >= nwarmup)
+			times.push_back(t);
+	}
+	std::sort(times.begin(), times.end());
+	return times[(times.size() - 1) / 2];
+}
+
+
+static vector<int> parse_list(const char *s)
+{
+	vector<int> list;
+	while (*s) {
+		list.push_back(atoi(s));
+		const char *comma = strchr(s, ',');
+		if (!comma)
+			break;
+		s = comma + 1;
+	}
+	return list;
+}
+
+
+void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [options]\n", myname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-sizes a,b,...	Face counts (default 10000,100000,1000000)\n");
+	fprintf(stderr, "	-threads a,b,...	Thread counts (default 1,2,4,... up to all)\n");
+	fprintf(stderr, "	-k name,...	Only these kernels (default all)\n");
+	fprintf(stderr, "	-repeat n	Timed runs, of which the median is reported (default 5)\n");
+	fprintf(stderr, "	-warmup n	Untimed runs first (default 1)\n");
+	fprintf(stderr, "	-seed s		Seed of the test meshes (default 1)\n");
+	fprintf(stderr, "	-tmp dir	Where the parsers' input files go (default .)\n");
+	fprintf(stderr, "Kernels:\n");
+	for (int i = 0; i < nkernels; i++)
+		fprintf(stderr, "	%s\n", kernels[i].name);
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	vector<int> sizes, threads;
+	const char *only = NULL;
+	int nrepeat = 5, nwarmup = 1;
+	unsigned seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-sizes") && i+1 < argc)
+			sizes = parse_list(argv[++i]);
+		else if (!strcmp(argv[i], "-threads") && i+1 < argc)
+			threads = parse_list(argv[++i]);
+		else if (!strcmp(argv[i], "-k") && i+1 < argc)
+			only = argv[++i];
+		else if (!strcmp(argv[i], "-repeat") && i+1 < argc)
+			nrepeat = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-warmup") && i+1 < argc)
+			nwarmup = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-seed") && i+1 < argc)
+			seed = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-tmp") && i+1 < argc)
+			tmpdir = argv[++i];
+		else
+			usage(argv[0]);
+	}
+	if (nrepeat < 1 || nwarmup < 0)
+		usage(argv[0]);
+
+	if (sizes.empty()) {
+		sizes.push_back(10000);
+		sizes.push_back(100000);
+		sizes.push_back(1000000);
+	}
+	int maxthreads = 1;
+#ifdef _OPENMP
+	maxthreads = omp_get_max_threads();
+#endif
+	if (threads.empty()) {
+		for (int t = 1; t < maxthreads; t *= 2)
+			threads.push_back(t);
+		threads.push_back(maxthreads);
+	}
+
+	vector<const Kernel *> todo;
+	for (int i = 0; i < nkernels; i++) {
+		if (!only)
+			todo.push_back(&kernels[i]);
+		else {
+			string list = string(",") + only + ",";
+			string name = string(",") + kernels[i].name + ",";
+			if (list.find(name) != string::npos)
+				todo.push_back(&kernels[i]);
+		}
+	}
+	if (todo.empty())
+		usage(argv[0]);
+
+	TriMesh::set_verbose(0);
+	// Speedup and efficiency are measured against the first thread
+	// count, not against an assumed perfect scaling from one thread
+	printf("Speedup and efficiency relative to %d thread%s\n\n",
+		threads[0], threads[0] == 1 ? "" : "s");
+	printf("%-18s %10s %10s %7s %12s %10s %8s %6s\n", "kernel", "faces",
+		"vertices", "threads", "median ms", "ns/elem", "speedup", "eff");
+
+	for (size_t s = 0; s < sizes.size(); s++) {
+		TriMesh *base = make_noisy_sphere(sizes[s], seed);
+		prepare_files(base);
+		int nv = base->vertices.size(), nf = base->faces.size();
+
+		for (size_t k = 0; k < todo.size(); k++) {
+			const Kernel &kernel = *todo[k];
+			int nelem = (kernel.per == PER_VERTEX) ? nv : nf;
+			float tfirst = 0.0f;
+			for (size_t t = 0; t < threads.size(); t++) {
+#ifdef _OPENMP
+				omp_set_num_threads(threads[t]);
+#endif
+				float tk = time_kernel(kernel, base, nwarmup, nrepeat);
+				if (t == 0)
+					tfirst = tk;
+				float speedup = tfirst / tk;
+				float eff = speedup * threads[0] / threads[t];
+				printf("%-18s %10d %10d %7d %12.3f %10.1f %8.2f %5.0f%%\n",
+					kernel.name, nf, nv, threads[t], tk * 1000.0f,
+					tk * 1.0e9f / nelem, speedup, 100.0f * eff);
+				fflush(stdout);
+			}
+		}
+
+		delete base;
+		remove_files();
+	}
+
+	return 0;
+}
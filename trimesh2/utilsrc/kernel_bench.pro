@@ -0,0 +1,3 @@
+TARGET = kernel_bench
+SOURCES += kernel_bench.cc
+include(utilsrc.pri)
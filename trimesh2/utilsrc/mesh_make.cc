@@ -0,0 +1,95 @@
+/*
+mesh_make.cc
+Create test meshes of a given size: icospheres, tori, superquadrics,
+noisy spheres and range grids.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "timestamp.h"
+
+
+void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s shape nfaces outfile [options]\n", myname);
+	fprintf(stderr, "Shapes:\n");
+	fprintf(stderr, "	icosphere	Unit sphere\n");
+	fprintf(stderr, "	torus		Torus of radius 1\n");
+	fprintf(stderr, "	superquadric	Superquadric of radius 1\n");
+	fprintf(stderr, "	noisysphere	Sphere displaced by Perlin noise\n");
+	fprintf(stderr, "	rangegrid	Noisy height field as a range grid (write .ply)\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-seed s		Random seed (default 1)\n");
+	fprintf(stderr, "	-r radius	Tube radius of the torus (default 0.25)\n");
+	fprintf(stderr, "	-e e1 e2	Superquadric exponents (default 0.3 0.3)\n");
+	fprintf(stderr, "	-amp a		Noise displacement (default 0.15)\n");
+	fprintf(stderr, "	-features n	Noise grid size; more means smaller bumps (default 16)\n");
+	fprintf(stderr, "	-holes f	Fraction of range grid samples missing (default 0.1)\n");
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 4)
+		usage(argv[0]);
+	const char *shape = argv[1];
+	int nfaces = atoi(argv[2]);
+	const char *outfile = argv[3];
+
+	unsigned seed = 1;
+	float r = 0.25f, e1 = 0.3f, e2 = 0.3f;
+	float amp = 0.15f, holes = 0.1f;
+	int features = 16;
+
+	for (int i = 4; i < argc; i++) {
+		if (!strcmp(argv[i], "-seed") && i+1 < argc)
+			seed = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i+1 < argc)
+			r = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-e") && i+2 < argc) {
+			e1 = atof(argv[++i]);
+			e2 = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-amp") && i+1 < argc)
+			amp = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-features") && i+1 < argc)
+			features = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-holes") && i+1 < argc)
+			holes = atof(argv[++i]);
+		else
+			usage(argv[0]);
+	}
+	if (nfaces <= 0)
+		usage(argv[0]);
+
+	timestamp t0 = now();
+	TriMesh *mesh = NULL;
+	if (!strcmp(shape, "icosphere"))
+		mesh = make_icosphere(nfaces);
+	else if (!strcmp(shape, "torus"))
+		mesh = make_torus(nfaces, r);
+	else if (!strcmp(shape, "superquadric"))
+		mesh = make_superquadric(nfaces, e1, e2);
+	else if (!strcmp(shape, "noisysphere"))
+		mesh = make_noisy_sphere(nfaces, seed, amp, features);
+	else if (!strcmp(shape, "rangegrid"))
+		mesh = make_range_grid(nfaces, seed, holes);
+	else
+		usage(argv[0]);
+	float t = now() - t0;
+
+	if (mesh->grid.empty())
+		printf("%lu vertices, %lu faces", (unsigned long) mesh->vertices.size(),
+			(unsigned long) mesh->faces.size());
+	else
+		printf("%lu vertices, %d x %d grid", (unsigned long) mesh->vertices.size(),
+			mesh->grid_width, mesh->grid_height);
+	printf(" in %.3f s\n", t);
+
+	bool ok = mesh->write(outfile);
+	delete mesh;
+	return ok ? 0 : 1;
+}
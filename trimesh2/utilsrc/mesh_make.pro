@@ -0,0 +1,3 @@
+TARGET = mesh_make
+SOURCES += mesh_make.cc
+include(utilsrc.pri)
@@ -0,0 +1,35 @@
+# Common settings for the trimesh2 command-line utilities.
+# Each utility has its own .pro that sets TARGET and SOURCES
+# and then includes this file.
+
+CONFIG += debug_and_release console
+CONFIG -= app_bundle qt
+
+CONFIG(release, debug|release) {
+    DBGNAME = release
+}
+else {
+    DBGNAME = debug
+}
+DESTDIR = $${DBGNAME}
+
+win32 {
+    TEMPLATE = vcapp
+    DEFINES += _CRT_SECURE_NO_WARNINGS
+}
+else {
+    TEMPLATE = app
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+    macx {
+        DEFINES += DARWIN
+    }
+    else {
+        DEFINES += LINUX
+    }
+}
+
+PRE_TARGETDEPS += ../$${DBGNAME}/libtrimesh.a
+DEPENDPATH += ../include
+INCLUDEPATH += ../include
+LIBS += -L../$${DBGNAME} -ltrimesh
@@ -0,0 +1,13 @@
+TEMPLATE = subdirs
+
+SUBDIRS += kdtree_bench
+kdtree_bench.file = kdtree_bench.pro
+
+SUBDIRS += icp_bench
+icp_bench.file = icp_bench.pro
+
+SUBDIRS += mesh_make
+mesh_make.file = mesh_make.pro
+
+SUBDIRS += kernel_bench
+kernel_bench.file = kernel_bench.pro